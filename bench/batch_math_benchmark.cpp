@@ -0,0 +1,169 @@
+// Batch math kernels at 1k/10k/100k instances, every SIMD level this CPU supports against the
+// scalar glm path. Results of each level are compared with scalar before timing.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/BatchMath.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+const int NR_REPEATS = 7;
+
+struct Instances {
+    std::vector<float> px, py, pz, rotation, sx, sy, sz;
+    std::vector<float> localMin[3], localMax[3], worldMin[3], worldMax[3];
+    std::vector<float> radius;
+    std::vector<glm::mat4> world, mvp;
+    std::vector<std::uint8_t> flags;
+
+    explicit Instances(size_t n) : px(n), py(n), pz(n), rotation(n), sx(n), sy(n), sz(n), radius(n), world(n), mvp(n),
+                                   flags(n) {
+        std::mt19937 rng((unsigned int) n);
+        std::uniform_real_distribution<float> pos(-200.0f, 200.0f), angle(-360.0f, 360.0f), size(0.2f, 2.0f);
+        for (int k = 0; k < 3; ++k) {
+            localMin[k].resize(n);
+            localMax[k].resize(n);
+            worldMin[k].resize(n);
+            worldMax[k].resize(n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            px[i] = pos(rng);
+            py[i] = pos(rng) * 0.01f;
+            pz[i] = pos(rng);
+            rotation[i] = angle(rng);
+            sx[i] = size(rng);
+            sy[i] = size(rng);
+            sz[i] = size(rng);
+            for (int k = 0; k < 3; ++k) {
+                localMin[k][i] = -size(rng);
+                localMax[k][i] = size(rng);
+            }
+            radius[i] = size(rng);
+        }
+    }
+
+    rg::TrsColumns trs() const {
+        return rg::TrsColumns{px.data(), py.data(), pz.data(), rotation.data(), sx.data(), sy.data(), sz.data()};
+    }
+    rg::BoxColumns local() const {
+        return rg::BoxColumns{localMin[0].data(), localMin[1].data(), localMin[2].data(),
+                              localMax[0].data(), localMax[1].data(), localMax[2].data()};
+    }
+    rg::BoxColumns worldBoxes() const {
+        return rg::BoxColumns{worldMin[0].data(), worldMin[1].data(), worldMin[2].data(),
+                              worldMax[0].data(), worldMax[1].data(), worldMax[2].data()};
+    }
+    rg::BoxOutputColumns worldOut() {
+        return rg::BoxOutputColumns{worldMin[0].data(), worldMin[1].data(), worldMin[2].data(),
+                                    worldMax[0].data(), worldMax[1].data(), worldMax[2].data()};
+    }
+    rg::SphereColumns spheres() const {
+        return rg::SphereColumns{px.data(), py.data(), pz.data(), radius.data()};
+    }
+};
+
+template<typename F>
+double bestOfNs(F&& f) {
+    double best = 1e30;
+    for (int r = 0; r < NR_REPEATS; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+float maxDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) {
+    float worst = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r)
+                worst = std::max(worst, std::fabs(a[i][c][r] - b[i][c][r]));
+        }
+    }
+    return worst;
+}
+
+float maxDifference(const std::vector<float>& a, const std::vector<float>& b) {
+    float worst = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i)
+        worst = std::max(worst, std::fabs(a[i] - b[i]));
+    return worst;
+}
+
+}
+
+int main() {
+    const size_t counts[] = {1000, 10000, 100000};
+    const rg::SimdLevel levels[] = {rg::SimdLevel::Scalar, rg::SimdLevel::Sse2, rg::SimdLevel::Avx2};
+    rg::SimdLevel best = rg::GetBatchKernels().Level;
+    std::printf("cpu supports up to %s\n", rg::SimdLevelName(rg::DetectSimdLevel()));
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(4.0f, 5.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+    rg::Frustum frustum(viewProjection);
+    glm::vec4 light(10.0f, 0.0f, -20.0f, 60.0f); // a point light against the world boxes
+
+    int failures = 0;
+    for (size_t n : counts) {
+        Instances reference(n);
+        const rg::BatchKernels& scalar = rg::GetBatchKernels(rg::SimdLevel::Scalar);
+        scalar.ComposeTrs(reference.trs(), reference.world.data(), 0, n);
+        scalar.TransformBoxes(reference.local(), reference.world.data(), reference.worldOut(), 0, n);
+        scalar.MultiplyMatrices(viewProjection, reference.world.data(), reference.mvp.data(), 0, n);
+        size_t referenceBoxes = scalar.CullBoxes(frustum, reference.worldBoxes(), reference.flags.data(), 1, 0, n);
+        size_t referenceSpheres = scalar.CullSpheres(frustum, reference.spheres(), reference.flags.data(), 1, 0, n);
+        size_t referenceTouching = scalar.SphereTouchesBoxes(light, reference.worldBoxes(), reference.flags.data(), 1, 0, n);
+
+        std::printf("\n%zu instances (ns per instance, best of %d)\n", n, NR_REPEATS);
+        std::printf("%-8s %10s %10s %10s %10s %10s %10s\n", "level", "compose", "aabb", "mvp", "cull box", "cull sphere",
+                    "light box");
+        double scalarNs[6] = {};
+        for (rg::SimdLevel level : levels) {
+            if (level > rg::DetectSimdLevel())
+                continue;
+            const rg::BatchKernels& k = rg::GetBatchKernels(level);
+            Instances data(n);
+            double ns[6];
+            ns[0] = bestOfNs([&] { k.ComposeTrs(data.trs(), data.world.data(), 0, n); });
+            ns[1] = bestOfNs([&] { k.TransformBoxes(data.local(), data.world.data(), data.worldOut(), 0, n); });
+            ns[2] = bestOfNs([&] { k.MultiplyMatrices(viewProjection, data.world.data(), data.mvp.data(), 0, n); });
+            size_t boxes = 0, spheres = 0, touching = 0;
+            ns[3] = bestOfNs([&] { boxes = k.CullBoxes(frustum, data.worldBoxes(), data.flags.data(), 1, 0, n); });
+            ns[4] = bestOfNs([&] { spheres = k.CullSpheres(frustum, data.spheres(), data.flags.data(), 1, 0, n); });
+            ns[5] = bestOfNs([&] { touching = k.SphereTouchesBoxes(light, data.worldBoxes(), data.flags.data(), 1, 0, n); });
+
+            float matrixError = std::max(maxDifference(data.world, reference.world), maxDifference(data.mvp, reference.mvp));
+            float boxError = 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                boxError = std::max(boxError, maxDifference(data.worldMin[c], reference.worldMin[c]));
+                boxError = std::max(boxError, maxDifference(data.worldMax[c], reference.worldMax[c]));
+            }
+            // the vector sine/cosine differ from libm in the last bits, culling may flip on exact touches
+            bool ok = matrixError < 1e-3f && boxError < 1e-3f
+                      && std::abs((long) boxes - (long) referenceBoxes) <= (long) (n / 10000 + 1)
+                      && std::abs((long) spheres - (long) referenceSpheres) <= (long) (n / 10000 + 1)
+                      && std::abs((long) touching - (long) referenceTouching) <= (long) (n / 10000 + 1);
+            failures += !ok;
+
+            if (level == rg::SimdLevel::Scalar) {
+                for (int j = 0; j < 6; ++j)
+                    scalarNs[j] = ns[j];
+            }
+            std::printf("%-8s", rg::SimdLevelName(level));
+            for (int j = 0; j < 6; ++j)
+                std::printf(" %6.2f x%-3.1f", ns[j] / n, scalarNs[j] / ns[j]);
+            std::printf("%s%s\n", level == best ? "  (default)" : "", ok ? "" : "  MISMATCH");
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// Microbenchmarks of the engine library (rg_engine) that need no window or GL context: model import,
+// vertex processing, texture decode, frustum culling and draw key sorting. See microbench.h for the
+// command line; --benchmark_out=file.json writes the results in Google Benchmark's JSON layout.
+#include "microbench.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/filesystem.h>
+#include <learnopengl/model.h>
+#include <rg/BatchMath.h>
+#include <rg/DrawList.h>
+#include <rg/RadixSort.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// by benchmark argument, so the names stay short: BM_ImportModel/0 is the Pac-Man
+const char* MODELS[] = {"resources/objects/Pac-Man/Pac-Man.obj", "resources/objects/Piano/Piano.obj"};
+const char* TEXTURES[][2] = {{"resources/objects/Pac-Man", "Tex_0113_0.png"},
+                             {"resources/objects/Piano", "1.png"},
+                             {"resources/objects/Wood Table with glasplatte", "Reflexion.jpg"}};
+
+void BM_ImportModel(bench::State& state) {
+    std::string path = FileSystem::getPath(MODELS[state.range(0)]);
+    std::int64_t vertices = 0;
+    for (auto _ : state) {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+        if (!scene) {
+            state.SkipWithError(importer.GetErrorString());
+            return;
+        }
+        vertices = 0;
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+            vertices += scene->mMeshes[i]->mNumVertices;
+        bench::DoNotOptimize(scene);
+    }
+    state.SetItemsProcessed(state.iterations() * vertices);
+    state.SetLabel(MODELS[state.range(0)]);
+}
+BENCHMARK(BM_ImportModel)->Arg(0)->Arg(1);
+
+// aiMesh to the engine's Vertex and index arrays, what Model::processMesh does per mesh
+void BM_ReadMeshGeometry(bench::State& state) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(FileSystem::getPath(MODELS[state.range(0)]), MODEL_IMPORT_FLAGS);
+    if (!scene) {
+        state.SkipWithError(importer.GetErrorString());
+        return;
+    }
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    for (auto _ : state) {
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
+            vertices.clear();
+            indices.clear();
+            ReadMeshGeometry(scene->mMeshes[i], vertices, indices);
+            bench::DoNotOptimize(vertices.data());
+        }
+    }
+    std::int64_t count = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+        count += scene->mMeshes[i]->mNumVertices;
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * count * (std::int64_t) sizeof(Vertex));
+    state.SetLabel(MODELS[state.range(0)]);
+}
+BENCHMARK(BM_ReadMeshGeometry)->Arg(0)->Arg(1);
+
+// stb_image decode, the part of texture loading that runs on loader threads
+void BM_DecodeTexture(bench::State& state) {
+    const char* const* texture = TEXTURES[state.range(0)];
+    std::string directory = FileSystem::getPath(texture[0]);
+    std::int64_t bytes = 0;
+    for (auto _ : state) {
+        TextureImage image = LoadTextureImage(texture[1], directory);
+        if (!image.data) {
+            state.SkipWithError(std::string("cannot decode ") + texture[1]);
+            return;
+        }
+        bytes = (std::int64_t) image.width * image.height * image.nrComponents;
+        stbi_image_free(image.data);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.SetLabel(texture[1]);
+}
+BENCHMARK(BM_DecodeTexture)->Arg(0)->Arg(1)->Arg(2);
+
+void fillScene(rg::Scene& scene, size_t n) {
+    std::mt19937 rng((unsigned int) n);
+    std::uniform_real_distribution<float> pos(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<float> size(0.05f, 0.3f);
+    rg::Aabb local(glm::vec3(-1.0f), glm::vec3(1.0f));
+    scene.Reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        scene.CreateRenderable((std::uint16_t) (rng() % 8), (std::uint16_t) (rng() % 4), local,
+                               glm::vec3(pos(rng), pos(rng) * 0.1f, pos(rng)), angle(rng), glm::vec3(size(rng)));
+    rg::UpdateWorldTransforms(scene.Renderables, 0, n);
+    rg::UpdateWorldBounds(scene.Renderables, 0, n);
+}
+
+rg::Frustum benchFrustum() {
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(4.0f, 5.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return rg::Frustum(projection * view);
+}
+
+// args: renderables, SimdLevel (0 scalar, 1 sse2, 2 avx2; capped to what the CPU runs)
+void BM_CullBoxes(bench::State& state) {
+    rg::Scene scene;
+    fillScene(scene, (size_t) state.range(0));
+    rg::Frustum frustum = benchFrustum();
+    const rg::BatchKernels& kernels = rg::GetBatchKernels((rg::SimdLevel) state.range(1));
+    rg::RenderableTable& t = scene.Renderables;
+    for (auto _ : state)
+        bench::DoNotOptimize(kernels.CullBoxes(frustum, rg::WorldBoxColumns(t), t.Flags.data(), rg::RenderFlagVisible,
+                                               0, t.Size()));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(rg::SimdLevelName(kernels.Level));
+}
+BENCHMARK(BM_CullBoxes)->Args({100000, 0})->Args({100000, 1})->Args({100000, 2})->Args({1000000, 2});
+
+// cull plus LOD, sort keys and the sorted draw list, on one thread
+void BM_BuildDrawList(bench::State& state) {
+    rg::Scene scene;
+    fillScene(scene, (size_t) state.range(0));
+    rg::Frustum frustum = benchFrustum();
+    glm::vec3 viewPosition(4.0f, 5.0f, 6.0f);
+    std::vector<rg::DrawItem> draws;
+    for (auto _ : state) {
+        rg::CullRenderables(scene.Renderables, frustum);
+        rg::BuildDrawList(scene, viewPosition, draws);
+        bench::DoNotOptimize(draws.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BuildDrawList)->Arg(10000)->Arg(100000);
+
+std::vector<rg::SortEntry> shuffledKeys(size_t n) {
+    std::mt19937_64 rng(n);
+    std::vector<rg::SortEntry> keys(n);
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = rg::SortEntry{rng() & 0xffffffffffull, (std::uint32_t) i};
+    return keys;
+}
+
+void BM_RadixSort(bench::State& state) {
+    std::vector<rg::SortEntry> keys = shuffledKeys((size_t) state.range(0)), work;
+    rg::RadixSorter sorter;
+    for (auto _ : state) {
+        state.PauseTiming();
+        work = keys;
+        state.ResumeTiming();
+        sorter.Sort(work);
+        bench::DoNotOptimize(work.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RadixSort)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+void BM_StdStableSort(bench::State& state) {
+    std::vector<rg::SortEntry> keys = shuffledKeys((size_t) state.range(0)), work;
+    for (auto _ : state) {
+        state.PauseTiming();
+        work = keys;
+        state.ResumeTiming();
+        std::stable_sort(work.begin(), work.end(), [](const rg::SortEntry& a, const rg::SortEntry& b) {
+            return a.Key < b.Key;
+        });
+        bench::DoNotOptimize(work.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StdStableSort)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,164 @@
+// Ray casting throughput of the BVHs: a displaced grid mesh traced with the SSE and scalar
+// kernels, then the instance BVH over a scene of many copies of it. Hits are checked against a
+// brute force scan over all triangles.
+#include <glm/glm.hpp>
+#include <rg/Bvh.h>
+#include <rg/Scene.h>
+#include <rg/SceneQueries.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+const unsigned int GRID = 256; // GRID * GRID * 2 triangles
+const size_t NR_RAYS = 200000;
+const size_t NR_CHECKED_RAYS = 200;
+const size_t NR_INSTANCES = 10000;
+const int NR_REPEATS = 3;
+
+void buildGrid(unsigned int n, std::vector<glm::vec3>& positions, std::vector<std::uint32_t>& indices) {
+    for (unsigned int z = 0; z <= n; ++z) {
+        for (unsigned int x = 0; x <= n; ++x) {
+            float u = (float) x / n * 2.0f - 1.0f;
+            float v = (float) z / n * 2.0f - 1.0f;
+            positions.push_back(glm::vec3(u, 0.1f * std::sin(u * 9.0f) * std::cos(v * 7.0f), v));
+        }
+    }
+    for (unsigned int z = 0; z < n; ++z) {
+        for (unsigned int x = 0; x < n; ++x) {
+            std::uint32_t i = z * (n + 1) + x;
+            indices.insert(indices.end(), {i, i + n + 1, i + 1, i + 1, i + n + 1, i + n + 2});
+        }
+    }
+}
+
+bool bruteForce(const std::vector<glm::vec3>& positions, const std::vector<std::uint32_t>& indices, const rg::Ray& ray,
+                float& t) {
+    bool found = false;
+    t = ray.TMax;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+        glm::vec3 e1 = b - a, e2 = c - a;
+        glm::vec3 p = glm::cross(ray.Direction, e2);
+        float det = glm::dot(e1, p);
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        glm::vec3 s = ray.Origin - a;
+        float u = glm::dot(s, p) / det;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(ray.Direction, q) / det;
+        float d = glm::dot(e2, q) / det;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && d > 0.0f && d < t) {
+            t = d;
+            found = true;
+        }
+    }
+    return found;
+}
+
+template<typename F>
+double bestOfSeconds(F&& f) {
+    double best = 1e30;
+    for (int r = 0; r < NR_REPEATS; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double s = std::chrono::duration<double>(end - start).count();
+        if (s < best)
+            best = s;
+    }
+    return best;
+}
+
+void report(const char* name, size_t rays, double seconds, size_t hits) {
+    std::printf("%-24s %8.2f Mrays/s  (%zu/%zu hit)\n", name, rays / seconds * 1e-6, hits, rays);
+}
+
+}
+
+int main() {
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    buildGrid(GRID, positions, indices);
+
+    rg::MeshBvh mesh;
+    auto buildStart = std::chrono::steady_clock::now();
+    mesh.Build(positions, indices);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+    std::printf("mesh: %zu triangles, %zu nodes, build %.1f ms\n", mesh.TriangleCount(), mesh.Tree.Nodes.size(), buildMs);
+
+    std::mt19937 rng(27);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<rg::Ray> rays(NR_RAYS);
+    for (rg::Ray& ray : rays) {
+        glm::vec3 origin(unit(rng) * 1.5f, 1.0f + unit(rng) * 0.5f, unit(rng) * 1.5f);
+        glm::vec3 target(unit(rng), 0.0f, unit(rng));
+        ray = rg::Ray(origin, glm::normalize(target - origin));
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < NR_CHECKED_RAYS; ++i) {
+        rg::TriangleHit simd, scalar;
+        float expected;
+        bool hit = bruteForce(positions, indices, rays[i], expected);
+        bool hitSimd = mesh.Intersect(rays[i], simd);
+        bool hitScalar = mesh.IntersectScalar(rays[i], scalar);
+        if (hit != hitSimd || hit != hitScalar
+            || (hit && (std::fabs(simd.T - expected) > 1e-4f || std::fabs(scalar.T - expected) > 1e-4f)))
+            ++failures;
+    }
+    std::printf("checked %zu rays against brute force: %d mismatches\n", NR_CHECKED_RAYS, failures);
+
+    size_t hits = 0;
+    double seconds = bestOfSeconds([&] {
+        hits = 0;
+        rg::TriangleHit hit;
+        for (const rg::Ray& ray : rays)
+            hits += mesh.Intersect(ray, hit);
+    });
+    report("mesh bvh (sse)", NR_RAYS, seconds, hits);
+    seconds = bestOfSeconds([&] {
+        hits = 0;
+        rg::TriangleHit hit;
+        for (const rg::Ray& ray : rays)
+            hits += mesh.IntersectScalar(ray, hit);
+    });
+    report("mesh bvh (scalar)", NR_RAYS, seconds, hits);
+
+    // scene: copies of the grid scattered over a 400x400 yard, rays cast from eye height
+    std::vector<rg::MeshBvh> meshes(1, mesh);
+    rg::Aabb local(glm::vec3(-1.0f, -0.1f, -1.0f), glm::vec3(1.0f, 0.1f, 1.0f));
+    std::uniform_real_distribution<float> yard(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    rg::Scene scene;
+    scene.Reserve(NR_INSTANCES);
+    for (size_t i = 0; i < NR_INSTANCES; ++i) {
+        glm::vec3 p(yard(rng), unit(rng) * 2.0f, yard(rng));
+        scene.CreateRenderable(0, 0, local, p, angle(rng), glm::vec3(1.0f + unit(rng) * 0.5f));
+    }
+    rg::UpdateTransforms(scene);
+    rg::SceneBvh sceneBvh;
+    buildStart = std::chrono::steady_clock::now();
+    sceneBvh.Build(scene, meshes);
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+    std::printf("scene: %zu instances, build %.2f ms\n", sceneBvh.InstanceCount(), buildMs);
+
+    for (rg::Ray& ray : rays) {
+        glm::vec3 origin(yard(rng), 3.0f, yard(rng));
+        glm::vec3 direction(unit(rng), -0.05f - 0.2f * std::fabs(unit(rng)), unit(rng));
+        ray = rg::Ray(origin, glm::normalize(direction), 150.0f);
+    }
+    seconds = bestOfSeconds([&] {
+        hits = 0;
+        rg::SceneHit hit;
+        for (const rg::Ray& ray : rays)
+            hits += sceneBvh.Raycast(ray, hit);
+    });
+    report("scene raycast", NR_RAYS, seconds, hits);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+// Frame draw list (cull, LOD, sort keys, radix sort, gather) for 100k and 1M renderables on 1 to N
+// threads, against the serial cull + build + std::stable_sort. Every run is checked against the
+// serial result first.
+// usage: draw_list_benchmark [max threads]
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/DrawList.h>
+#include <rg/JobSystem.h>
+#include <rg/RadixSort.h>
+#include <rg/Scene.h>
+#include <rg/SceneJobs.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int NR_REPEATS = 7;
+const std::uint16_t NR_MESHES = 8; // each with a coarser LOD at NR_MESHES + mesh
+const std::uint16_t NR_MATERIALS = 4;
+
+template<typename F>
+double bestOfMs(F&& f) {
+    double best = 1e30;
+    for (int r = 0; r < NR_REPEATS; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+void fillScene(rg::Scene& scene, size_t n) {
+    std::mt19937 rng((unsigned int) n);
+    std::uniform_real_distribution<float> pos(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<float> size(0.05f, 0.3f);
+    rg::Aabb local(glm::vec3(-1.0f), glm::vec3(1.0f));
+    scene.Reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::uint8_t flags = i % 5 == 0 ? rg::RenderFlagDoubleSided : 0;
+        scene.CreateRenderable((std::uint16_t) (rng() % NR_MESHES), (std::uint16_t) (rng() % NR_MATERIALS), local,
+                               glm::vec3(pos(rng), pos(rng) * 0.1f, pos(rng)), angle(rng), glm::vec3(size(rng)), flags);
+    }
+    scene.MeshLods.resize(2 * NR_MESHES);
+    for (std::uint16_t mesh = 0; mesh < NR_MESHES; ++mesh)
+        scene.MeshLods[mesh] = rg::LodSwitch{20.0f, (std::uint16_t) (NR_MESHES + mesh)};
+    rg::UpdateWorldTransforms(scene.Renderables, 0, n);
+    rg::UpdateWorldBounds(scene.Renderables, 0, n);
+}
+
+void buildSerial(rg::Scene& scene, const rg::Frustum& frustum, const glm::vec3& viewPosition,
+                 std::vector<rg::DrawItem>& out) {
+    rg::CullRenderables(scene.Renderables, frustum, 0, scene.Renderables.Size());
+    rg::BuildDrawList(scene, viewPosition, out);
+    std::stable_sort(out.begin(), out.end(), [](const rg::DrawItem& a, const rg::DrawItem& b) {
+        return a.SortKey < b.SortKey;
+    });
+}
+
+bool same(const std::vector<rg::DrawItem>& a, const std::vector<rg::DrawItem>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].Row != b[i].Row || a[i].SortKey != b[i].SortKey || a[i].Mesh != b[i].Mesh)
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    unsigned int maxThreads = argc > 1 ? (unsigned int) std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    maxThreads = std::max(maxThreads, 1u);
+    const size_t counts[] = {100000, 1000000};
+
+    glm::vec3 viewPosition(4.0f, 5.0f, 6.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(viewPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    rg::Frustum frustum(projection * view);
+
+    int failures = 0;
+    for (size_t n : counts) {
+        rg::Scene scene;
+        fillScene(scene, n);
+        std::vector<rg::DrawItem> reference;
+        double serialMs = bestOfMs([&] { buildSerial(scene, frustum, viewPosition, reference); });
+
+        // the sort on its own, keys as the frame produces them
+        std::vector<rg::SortEntry> keys(reference.size());
+        std::mt19937 rng(3);
+        for (size_t i = 0; i < reference.size(); ++i)
+            keys[i] = rg::SortEntry{reference[i].SortKey, (std::uint32_t) i};
+        std::shuffle(keys.begin(), keys.end(), rng);
+        std::vector<rg::SortEntry> work;
+        rg::RadixSorter sorter;
+        double radixMs = bestOfMs([&] { work = keys; sorter.Sort(work); });
+        double stdMs = bestOfMs([&] {
+            work = keys;
+            std::stable_sort(work.begin(), work.end(), [](const rg::SortEntry& a, const rg::SortEntry& b) {
+                return a.Key < b.Key;
+            });
+        });
+
+        std::printf("\n%zu renderables, %zu drawn (best of %d)\n", n, reference.size(), NR_REPEATS);
+        std::printf("serial cull + build + stable_sort %9.3f ms\n", serialMs);
+        std::printf("key sort: radix %.3f ms, std::stable_sort %.3f ms (copy included)\n", radixMs, stdMs);
+        std::printf("%-8s %10s %8s\n", "threads", "ms", "speedup");
+        double oneThreadMs = 0.0;
+        for (unsigned int threads = 1; threads <= maxThreads; ++threads) {
+            rg::JobSystem jobs(threads - 1);
+            rg::DrawListBuilder builder;
+            std::vector<rg::DrawItem> draws;
+            builder.Build(scene, frustum, viewPosition, jobs, draws);
+            bool ok = same(draws, reference);
+            failures += !ok;
+            double ms = bestOfMs([&] { builder.Build(scene, frustum, viewPosition, jobs, draws); });
+            if (threads == 1)
+                oneThreadMs = ms;
+            std::printf("%-8u %10.3f %7.2fx%s\n", threads, ms, oneThreadMs / ms, ok ? "" : "  MISMATCH");
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
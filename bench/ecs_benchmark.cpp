@@ -0,0 +1,103 @@
+// Iterates 1M entities through the scene systems (transform, bounds, culling) and compares the
+// SoA tables with the array-of-objects layout main() used before.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/Scene.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+const size_t NR_ENTITIES = 1000000;
+const int NR_REPEATS = 5;
+
+// what a Model local + hand-written draw block amounts to, one object per entity
+struct ObjectAoS {
+    glm::vec3 position;
+    float rotationY;
+    glm::vec3 scale;
+    glm::mat4 model;
+    rg::Aabb localBounds;
+    rg::Aabb worldBounds;
+    unsigned short mesh;
+    unsigned short material;
+    bool visible;
+};
+
+template<typename F>
+double bestOfMs(F&& f) {
+    double best = 1e30;
+    for (int r = 0; r < NR_REPEATS; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+void report(const char* name, double ms) {
+    std::printf("%-28s %9.3f ms  %7.2f ns/entity\n", name, ms, ms * 1e6 / NR_ENTITIES);
+}
+
+}
+
+int main() {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+    rg::Aabb local(glm::vec3(-1.0f), glm::vec3(1.0f));
+
+    rg::Scene scene;
+    scene.Reserve(NR_ENTITIES);
+    std::vector<ObjectAoS> objects(NR_ENTITIES);
+    for (size_t i = 0; i < NR_ENTITIES; ++i) {
+        glm::vec3 p(pos(rng), 0.0f, pos(rng));
+        float r = angle(rng);
+        glm::vec3 s(size(rng));
+        scene.CreateRenderable((std::uint16_t) (i % 8), (std::uint16_t) (i % 2), local, p, r, s);
+        objects[i] = ObjectAoS{p, r, s, glm::mat4(1.0f), local, local, (unsigned short) (i % 8),
+                               (unsigned short) (i % 2), false};
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(4.0f, 5.0f, 6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    rg::Frustum frustum(projection * view);
+    rg::RenderableTable& t = scene.Renderables;
+
+    std::printf("%zu entities, best of %d runs\n", NR_ENTITIES, NR_REPEATS);
+    report("soa world transforms", bestOfMs([&] { rg::UpdateWorldTransforms(t, 0, t.Size()); }));
+    report("soa world bounds", bestOfMs([&] { rg::UpdateWorldBounds(t, 0, t.Size()); }));
+    size_t visibleSoA = 0;
+    report("soa frustum cull", bestOfMs([&] { visibleSoA = rg::CullRenderables(t, frustum); }));
+
+    report("aos world transforms", bestOfMs([&] {
+        for (ObjectAoS& o : objects) {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), o.position);
+            model = glm::rotate(model, glm::radians(o.rotationY), glm::vec3(0.0f, 1.0f, 0.0f));
+            o.model = glm::scale(model, o.scale);
+        }
+    }));
+    report("aos world bounds", bestOfMs([&] {
+        for (ObjectAoS& o : objects)
+            o.worldBounds = rg::TransformAabb(o.localBounds, o.model);
+    }));
+    size_t visibleAoS = 0;
+    report("aos frustum cull", bestOfMs([&] {
+        visibleAoS = 0;
+        for (ObjectAoS& o : objects) {
+            o.visible = frustum.IntersectsAabb(o.worldBounds);
+            visibleAoS += o.visible;
+        }
+    }));
+
+    std::printf("visible: soa %zu, aos %zu\n", visibleSoA, visibleAoS);
+    return visibleSoA == visibleAoS ? 0 : 1;
+}
@@ -0,0 +1,706 @@
+// Plays a GL trace recorded with --capture-gl (rg/GlCapture.h) as fast as it can, without a window:
+// the startup part once, then the captured frames --loops times. Every call is timed on the CPU (timer
+// overhead calibrated and taken off) and checked for redundant state, i.e. a bind, enable or uniform
+// that sets what is already set. The report lists per call type how often it ran, what it cost and
+// how many of the calls were redundant; the time glFinish waits at each frame end is GPU time and
+// reported apart. Object names and uniform locations are remapped, the default framebuffer is
+// stood in for by an FBO of the captured size.
+// usage: gl_replay trace.rgtrace [--loops N] [--csv file]
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <rg/GlTrace.h>
+#include <rg/OffscreenContext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// a record's arguments (and result) decoded into the types of the GL function, ready to be patched
+// and passed on
+template<typename F>
+struct Decoded;
+
+template<typename R, typename... A>
+struct Decoded<R (APIENTRYP)(A...)> {
+    typedef typename std::conditional<std::is_arithmetic<R>::value, R, int>::type Stored;
+    std::tuple<A...> Args;
+    Stored Result = Stored();
+    const char* Payload = nullptr;
+    size_t PayloadSize = 0;
+
+    explicit Decoded(const rg::GlTraceRecord& record) {
+        rg::GlArgReader reader(record);
+        Args = std::tuple<A...>{reader.template Get<A>()...};
+        readResult(reader, std::is_arithmetic<R>());
+        Payload = reader.Payload();
+        PayloadSize = reader.PayloadSize();
+    }
+
+    template<size_t I>
+    typename std::tuple_element<I, std::tuple<A...>>::type& Arg() {
+        return std::get<I>(Args);
+    }
+
+    R Call(R (APIENTRYP function)(A...)) {
+        return call(function, std::index_sequence_for<A...>());
+    }
+
+private:
+    void readResult(rg::GlArgReader& reader, std::true_type) {
+        Result = reader.template Get<Stored>();
+    }
+    void readResult(rg::GlArgReader&, std::false_type) {}
+
+    template<size_t... I>
+    R call(R (APIENTRYP function)(A...), std::index_sequence<I...>) {
+        return function(std::get<I>(Args)...);
+    }
+};
+
+template<std::uint16_t Op>
+using GlCall = Decoded<typename rg::GlOpTraits<Op>::Function>;
+
+struct ReplayState {
+    std::unordered_map<GLuint, GLuint> Buffers, Textures, VertexArrays, Framebuffers, Renderbuffers, Queries;
+    std::unordered_map<GLuint, GLuint> Programs; // programs and shaders share their names
+    std::map<std::pair<GLuint, GLint>, GLint> Locations; // (captured program, captured location)
+    GLuint CurrentProgram = 0; // captured name
+    GLuint DefaultFramebuffer = 0;
+    std::vector<char> Scratch; // where queries write their answers
+    std::vector<GLuint> Names;
+
+    static GLuint Map(const std::unordered_map<GLuint, GLuint>& names, GLuint name) {
+        if (name == 0)
+            return 0;
+        auto it = names.find(name);
+        return it == names.end() ? name : it->second;
+    }
+
+    GLint Location(GLint location) const {
+        if (location < 0)
+            return location;
+        auto it = Locations.find(std::make_pair(CurrentProgram, location));
+        return it == Locations.end() ? location : it->second;
+    }
+
+    template<typename T>
+    T* ScratchFor(size_t bytes) {
+        if (Scratch.size() < bytes)
+            Scratch.resize(bytes);
+        return (T*) Scratch.data();
+    }
+};
+
+// default: arguments as captured, pointers were offsets into bound buffers
+template<std::uint16_t Op>
+void replay(ReplayState&, const rg::GlTraceRecord& record) {
+    GlCall<Op>(record).Call(rg::GlOpTraits<Op>::Pointer());
+}
+
+// names
+// ------------------------------------------------------------------------
+template<std::uint16_t Op>
+void replayGenerate(ReplayState& state, std::unordered_map<GLuint, GLuint>& names, const rg::GlTraceRecord& record) {
+    GlCall<Op> call(record);
+    GLsizei n = call.template Arg<0>();
+    if (n <= 0)
+        return;
+    state.Names.resize(n);
+    rg::GlOpTraits<Op>::Pointer()(n, state.Names.data());
+    const GLuint* captured = (const GLuint*) call.Payload;
+    for (GLsizei i = 0; captured && i < n && (size_t) (i + 1) * sizeof(GLuint) <= call.PayloadSize; ++i)
+        names[captured[i]] = state.Names[i];
+}
+
+template<std::uint16_t Op>
+void replayDelete(ReplayState& state, std::unordered_map<GLuint, GLuint>& names, const rg::GlTraceRecord& record) {
+    GlCall<Op> call(record);
+    const GLuint* captured = (const GLuint*) call.Payload;
+    size_t n = captured ? std::min((size_t) std::max(call.template Arg<0>(), 0), call.PayloadSize / sizeof(GLuint)) : 0;
+    state.Names.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        state.Names[i] = ReplayState::Map(names, captured[i]);
+        names.erase(captured[i]);
+    }
+    if (n)
+        rg::GlOpTraits<Op>::Pointer()((GLsizei) n, state.Names.data());
+}
+
+#define RG_REPLAY_NAMES(gen, del, table) \
+    template<> \
+    void replay<rg::GlOp##gen>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        replayGenerate<rg::GlOp##gen>(state, state.table, record); \
+    } \
+    template<> \
+    void replay<rg::GlOp##del>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        replayDelete<rg::GlOp##del>(state, state.table, record); \
+    }
+RG_REPLAY_NAMES(GenBuffers, DeleteBuffers, Buffers)
+RG_REPLAY_NAMES(GenTextures, DeleteTextures, Textures)
+RG_REPLAY_NAMES(GenVertexArrays, DeleteVertexArrays, VertexArrays)
+RG_REPLAY_NAMES(GenFramebuffers, DeleteFramebuffers, Framebuffers)
+RG_REPLAY_NAMES(GenRenderbuffers, DeleteRenderbuffers, Renderbuffers)
+RG_REPLAY_NAMES(GenQueries, DeleteQueries, Queries)
+#undef RG_REPLAY_NAMES
+
+// argument I of the call is a name from the given table
+#define RG_REPLAY_MAPPED(name, index, table) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        call.Arg<index>() = ReplayState::Map(state.table, call.Arg<index>()); \
+        call.Call(rg::GlOpTraits<rg::GlOp##name>::Pointer()); \
+    }
+RG_REPLAY_MAPPED(BindBuffer, 1, Buffers)
+RG_REPLAY_MAPPED(BindTexture, 1, Textures)
+RG_REPLAY_MAPPED(BindVertexArray, 0, VertexArrays)
+RG_REPLAY_MAPPED(BindRenderbuffer, 1, Renderbuffers)
+RG_REPLAY_MAPPED(TexBuffer, 2, Buffers)
+RG_REPLAY_MAPPED(FramebufferTexture2D, 3, Textures)
+RG_REPLAY_MAPPED(FramebufferTextureLayer, 2, Textures)
+RG_REPLAY_MAPPED(FramebufferRenderbuffer, 3, Renderbuffers)
+RG_REPLAY_MAPPED(BeginQuery, 1, Queries)
+RG_REPLAY_MAPPED(QueryCounter, 0, Queries)
+RG_REPLAY_MAPPED(CompileShader, 0, Programs)
+RG_REPLAY_MAPPED(LinkProgram, 0, Programs)
+#undef RG_REPLAY_MAPPED
+
+template<>
+void replay<rg::GlOpBindFramebuffer>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpBindFramebuffer> call(record);
+    GLuint framebuffer = call.Arg<1>();
+    call.Arg<1>() = framebuffer == 0 ? state.DefaultFramebuffer : ReplayState::Map(state.Framebuffers, framebuffer);
+    call.Call(glad_glBindFramebuffer);
+}
+
+template<>
+void replay<rg::GlOpUseProgram>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpUseProgram> call(record);
+    state.CurrentProgram = call.Arg<0>();
+    call.Arg<0>() = ReplayState::Map(state.Programs, call.Arg<0>());
+    call.Call(glad_glUseProgram);
+}
+
+template<>
+void replay<rg::GlOpAttachShader>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpAttachShader> call(record);
+    call.Arg<0>() = ReplayState::Map(state.Programs, call.Arg<0>());
+    call.Arg<1>() = ReplayState::Map(state.Programs, call.Arg<1>());
+    call.Call(glad_glAttachShader);
+}
+
+template<>
+void replay<rg::GlOpDetachShader>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpDetachShader> call(record);
+    call.Arg<0>() = ReplayState::Map(state.Programs, call.Arg<0>());
+    call.Arg<1>() = ReplayState::Map(state.Programs, call.Arg<1>());
+    call.Call(glad_glDetachShader);
+}
+
+template<>
+void replay<rg::GlOpCreateShader>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpCreateShader> call(record);
+    state.Programs[call.Result] = call.Call(glad_glCreateShader);
+}
+
+template<>
+void replay<rg::GlOpCreateProgram>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpCreateProgram> call(record);
+    state.Programs[call.Result] = call.Call(glad_glCreateProgram);
+}
+
+template<>
+void replay<rg::GlOpDeleteShader>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpDeleteShader> call(record);
+    GLuint captured = call.Arg<0>();
+    call.Arg<0>() = ReplayState::Map(state.Programs, captured);
+    call.Call(glad_glDeleteShader);
+    state.Programs.erase(captured);
+}
+
+template<>
+void replay<rg::GlOpDeleteProgram>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpDeleteProgram> call(record);
+    GLuint captured = call.Arg<0>();
+    call.Arg<0>() = ReplayState::Map(state.Programs, captured);
+    call.Call(glad_glDeleteProgram);
+    state.Programs.erase(captured);
+}
+
+template<>
+void replay<rg::GlOpShaderSource>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpShaderSource> call(record);
+    std::string source(call.Payload ? call.Payload : "", call.PayloadSize);
+    const GLchar* text = source.c_str();
+    glad_glShaderSource(ReplayState::Map(state.Programs, call.Arg<0>()), 1, &text, nullptr);
+}
+
+template<>
+void replay<rg::GlOpGetUniformLocation>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpGetUniformLocation> call(record);
+    if (!call.Payload)
+        return;
+    GLint location = glad_glGetUniformLocation(ReplayState::Map(state.Programs, call.Arg<0>()), call.Payload);
+    if (call.Result >= 0)
+        state.Locations[std::make_pair(call.Arg<0>(), call.Result)] = location;
+}
+
+template<>
+void replay<rg::GlOpGetAttribLocation>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpGetAttribLocation> call(record);
+    if (call.Payload)
+        glad_glGetAttribLocation(ReplayState::Map(state.Programs, call.Arg<0>()), call.Payload);
+}
+
+// uniforms: locations belong to the program in use
+// ------------------------------------------------------------------------
+#define RG_REPLAY_UNIFORM(name) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        call.Arg<0>() = state.Location(call.Arg<0>()); \
+        call.Call(rg::GlOpTraits<rg::GlOp##name>::Pointer()); \
+    }
+#define RG_REPLAY_UNIFORM_ARRAY(name, index, type) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        call.Arg<0>() = state.Location(call.Arg<0>()); \
+        call.Arg<index>() = (const type*) call.Payload; \
+        call.Call(rg::GlOpTraits<rg::GlOp##name>::Pointer()); \
+    }
+RG_REPLAY_UNIFORM(Uniform1f)
+RG_REPLAY_UNIFORM(Uniform1i)
+RG_REPLAY_UNIFORM(Uniform2f)
+RG_REPLAY_UNIFORM(Uniform3f)
+RG_REPLAY_UNIFORM(Uniform4f)
+RG_REPLAY_UNIFORM_ARRAY(Uniform1fv, 2, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(Uniform1iv, 2, GLint)
+RG_REPLAY_UNIFORM_ARRAY(Uniform2fv, 2, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(Uniform3fv, 2, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(Uniform4fv, 2, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(UniformMatrix2fv, 3, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(UniformMatrix3fv, 3, GLfloat)
+RG_REPLAY_UNIFORM_ARRAY(UniformMatrix4fv, 3, GLfloat)
+#undef RG_REPLAY_UNIFORM
+#undef RG_REPLAY_UNIFORM_ARRAY
+
+// client memory: inputs come from the payload, outputs go to scratch memory
+// ------------------------------------------------------------------------
+#define RG_REPLAY_PAYLOAD(name, index, type) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState&, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        call.Arg<index>() = (type) call.Payload; \
+        call.Call(rg::GlOpTraits<rg::GlOp##name>::Pointer()); \
+    }
+RG_REPLAY_PAYLOAD(BufferData, 2, const void*)
+RG_REPLAY_PAYLOAD(BufferSubData, 3, const void*)
+RG_REPLAY_PAYLOAD(TexImage2D, 8, const void*)
+RG_REPLAY_PAYLOAD(TexImage3D, 9, const void*)
+RG_REPLAY_PAYLOAD(TexSubImage2D, 8, const void*)
+RG_REPLAY_PAYLOAD(TexParameterfv, 2, const GLfloat*)
+RG_REPLAY_PAYLOAD(ClearBufferfv, 2, const GLfloat*)
+RG_REPLAY_PAYLOAD(DrawBuffers, 1, const GLenum*)
+#undef RG_REPLAY_PAYLOAD
+
+template<std::uint16_t Op, size_t Index>
+void replayOutput(ReplayState& state, GlCall<Op>& call) {
+    typedef typename std::tuple_element<Index, decltype(call.Args)>::type Pointer;
+    std::get<Index>(call.Args) = state.ScratchFor<typename std::remove_pointer<Pointer>::type>(256);
+    call.Call(rg::GlOpTraits<Op>::Pointer());
+}
+#define RG_REPLAY_OUTPUT(name, index) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        replayOutput<rg::GlOp##name, index>(state, call); \
+    }
+// _OF: the first argument is a name from the given table
+#define RG_REPLAY_OUTPUT_OF(name, index, table) \
+    template<> \
+    void replay<rg::GlOp##name>(ReplayState& state, const rg::GlTraceRecord& record) { \
+        GlCall<rg::GlOp##name> call(record); \
+        call.Arg<0>() = ReplayState::Map(state.table, call.Arg<0>()); \
+        replayOutput<rg::GlOp##name, index>(state, call); \
+    }
+RG_REPLAY_OUTPUT(GetIntegerv, 1)
+RG_REPLAY_OUTPUT(GetTexLevelParameteriv, 3)
+RG_REPLAY_OUTPUT_OF(GetShaderiv, 2, Programs)
+RG_REPLAY_OUTPUT_OF(GetProgramiv, 2, Programs)
+RG_REPLAY_OUTPUT_OF(GetQueryObjectiv, 2, Queries)
+RG_REPLAY_OUTPUT_OF(GetQueryObjectui64v, 2, Queries)
+#undef RG_REPLAY_OUTPUT
+#undef RG_REPLAY_OUTPUT_OF
+
+template<>
+void replay<rg::GlOpGetShaderInfoLog>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpGetShaderInfoLog> call(record);
+    GLsizei size = std::max(call.Arg<1>(), 1);
+    glad_glGetShaderInfoLog(ReplayState::Map(state.Programs, call.Arg<0>()), size, nullptr,
+                            state.ScratchFor<GLchar>(size));
+}
+
+template<>
+void replay<rg::GlOpGetProgramInfoLog>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpGetProgramInfoLog> call(record);
+    GLsizei size = std::max(call.Arg<1>(), 1);
+    glad_glGetProgramInfoLog(ReplayState::Map(state.Programs, call.Arg<0>()), size, nullptr,
+                             state.ScratchFor<GLchar>(size));
+}
+
+template<>
+void replay<rg::GlOpReadPixels>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpReadPixels> call(record);
+    size_t bytes = (size_t) std::max(call.Arg<2>(), 0) * std::max(call.Arg<3>(), 0) * 16 + 4096;
+    call.Arg<6>() = state.ScratchFor<char>(bytes);
+    call.Call(glad_glReadPixels);
+}
+
+template<>
+void replay<rg::GlOpGetTexImage>(ReplayState& state, const rg::GlTraceRecord& record) {
+    GlCall<rg::GlOpGetTexImage> call(record);
+    GLint width = 0, height = 0, depth = 0;
+    glad_glGetTexLevelParameteriv(call.Arg<0>(), call.Arg<1>(), GL_TEXTURE_WIDTH, &width);
+    glad_glGetTexLevelParameteriv(call.Arg<0>(), call.Arg<1>(), GL_TEXTURE_HEIGHT, &height);
+    glad_glGetTexLevelParameteriv(call.Arg<0>(), call.Arg<1>(), GL_TEXTURE_DEPTH, &depth);
+    size_t bytes = (size_t) width * height * std::max(depth, 1) * 16 + 4096;
+    call.Arg<4>() = state.ScratchFor<char>(bytes);
+    call.Call(glad_glGetTexImage);
+}
+
+void execute(ReplayState& state, const rg::GlTraceRecord& record) {
+    switch (record.Op) {
+#define RG_REPLAY_CASE(name) \
+        case rg::GlOp##name: \
+            replay<rg::GlOp##name>(state, record); \
+            break;
+        RG_GL_TRACE_CALLS(RG_REPLAY_CASE)
+#undef RG_REPLAY_CASE
+        default:
+            break;
+    }
+}
+
+// Redundant state: binds, enables, fixed-function state and uniforms that set what is set already.
+// Tracked on the captured values, before the call is replayed.
+class RedundancyTracker {
+    std::unordered_map<std::string, std::string> m_State;
+    std::unordered_map<GLuint, std::unordered_map<GLint, std::string>> m_Uniforms; // per captured program
+    std::unordered_map<std::string, GLuint> m_BoundTextures; // unit and target -> texture
+    GLuint m_ActiveTexture = GL_TEXTURE0;
+    GLuint m_VertexArray = 0;
+    GLuint m_Program = 0;
+
+    template<typename T>
+    static std::string bytes(const T& value) {
+        return std::string((const char*) &value, sizeof(T));
+    }
+    bool set(const std::string& key, const std::string& value) {
+        auto it = m_State.find(key);
+        if (it != m_State.end() && it->second == value)
+            return true;
+        m_State[key] = value;
+        return false;
+    }
+    bool setAll(std::uint16_t op, const rg::GlTraceRecord& record) {
+        return set(bytes(op), std::string(record.Data, record.Size));
+    }
+    // first argument selects which state, the rest is its value
+    bool setKeyed(std::uint16_t op, const rg::GlTraceRecord& record, size_t keyBytes, const std::string& context = "") {
+        if (record.Size < keyBytes)
+            return false;
+        return set(bytes(op) + context + std::string(record.Data, keyBytes),
+                   std::string(record.Data + keyBytes, record.Size - keyBytes));
+    }
+    bool uniform(const rg::GlTraceRecord& record) {
+        rg::GlArgReader reader(record);
+        GLint location = reader.Get<GLint>();
+        std::string value = bytes(record.Op) + std::string(record.Data + sizeof(GLint), record.Size - sizeof(GLint));
+        std::string& current = m_Uniforms[m_Program][location];
+        if (current == value)
+            return true;
+        current = value;
+        return false;
+    }
+
+public:
+    bool Check(const rg::GlTraceRecord& record) {
+        rg::GlArgReader reader(record);
+        switch (record.Op) {
+            case rg::GlOpActiveTexture:
+                m_ActiveTexture = reader.Get<GLenum>();
+                return setAll(record.Op, record);
+            case rg::GlOpBindTexture: {
+                GLenum target = reader.Get<GLenum>();
+                m_BoundTextures[bytes(m_ActiveTexture) + bytes(target)] = reader.Get<GLuint>();
+                return setKeyed(record.Op, record, sizeof(GLenum), bytes(m_ActiveTexture));
+            }
+            case rg::GlOpBindBuffer: {
+                GLenum target = reader.Get<GLenum>();
+                // the element array binding is part of the vertex array
+                return setKeyed(record.Op, record, sizeof(GLenum),
+                                target == GL_ELEMENT_ARRAY_BUFFER ? bytes(m_VertexArray) : "");
+            }
+            case rg::GlOpBindVertexArray:
+                m_VertexArray = reader.Get<GLuint>();
+                return setAll(record.Op, record);
+            case rg::GlOpUseProgram:
+                m_Program = reader.Get<GLuint>();
+                return setAll(record.Op, record);
+            case rg::GlOpBindFramebuffer: {
+                GLenum target = reader.Get<GLenum>();
+                std::string value = bytes(reader.Get<GLuint>());
+                std::uint16_t op = record.Op;
+                if (target != GL_FRAMEBUFFER)
+                    return set(bytes(op) + bytes(target), value);
+                bool draw = set(bytes(op) + bytes((GLenum) GL_DRAW_FRAMEBUFFER), value);
+                bool read = set(bytes(op) + bytes((GLenum) GL_READ_FRAMEBUFFER), value);
+                return draw && read;
+            }
+            case rg::GlOpEnable:
+            case rg::GlOpDisable:
+                return set("cap" + bytes(reader.Get<GLenum>()), record.Op == rg::GlOpEnable ? "1" : "0");
+            case rg::GlOpBindRenderbuffer:
+            case rg::GlOpBindSampler:
+            case rg::GlOpPixelStorei:
+                return setKeyed(record.Op, record, sizeof(GLenum));
+            case rg::GlOpTexParameteri:
+            case rg::GlOpTexParameterf: {
+                GLenum target = reader.Get<GLenum>();
+                GLuint texture = m_BoundTextures[bytes(m_ActiveTexture) + bytes(target)];
+                return setKeyed(rg::GlOpTexParameteri, record, 2 * sizeof(GLenum), bytes(texture));
+            }
+            case rg::GlOpBlendEquation:
+            case rg::GlOpBlendEquationSeparate:
+            case rg::GlOpBlendFunc:
+            case rg::GlOpBlendFuncSeparate:
+            case rg::GlOpClearColor:
+            case rg::GlOpClearDepth:
+            case rg::GlOpColorMask:
+            case rg::GlOpCullFace:
+            case rg::GlOpDepthFunc:
+            case rg::GlOpDepthMask:
+            case rg::GlOpPolygonMode:
+            case rg::GlOpPolygonOffset:
+            case rg::GlOpScissor:
+            case rg::GlOpViewport:
+                return setAll(record.Op, record);
+            case rg::GlOpLinkProgram:
+                m_Uniforms.erase(reader.Get<GLuint>());
+                return false;
+            case rg::GlOpUniform1f: case rg::GlOpUniform1fv: case rg::GlOpUniform1i: case rg::GlOpUniform1iv:
+            case rg::GlOpUniform2f: case rg::GlOpUniform2fv: case rg::GlOpUniform3f: case rg::GlOpUniform3fv:
+            case rg::GlOpUniform4f: case rg::GlOpUniform4fv: case rg::GlOpUniformMatrix2fv:
+            case rg::GlOpUniformMatrix3fv: case rg::GlOpUniformMatrix4fv:
+                return uniform(record);
+            default:
+                return false;
+        }
+    }
+};
+
+struct OpStats {
+    std::uint64_t Calls = 0;
+    std::uint64_t Redundant = 0;
+    double Ns = 0.0;
+};
+
+// what two clock reads around nothing cost, taken off every timed call
+double timerOverheadNs() {
+    const int samples = 100000;
+    auto start = Clock::now();
+    for (int i = 0; i < samples; ++i) {
+        auto a = Clock::now();
+        auto b = Clock::now();
+        (void) a;
+        (void) b;
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / samples;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::printf("usage: gl_replay trace.rgtrace [--loops N] [--csv file]\n");
+        return 2;
+    }
+    std::string tracePath = argv[1], csvPath;
+    int loops = 1;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--loops" && i + 1 < argc) {
+            loops = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--csv" && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else {
+            std::printf("ERROR::GL_REPLAY::UNKNOWN_ARGUMENT %s\n", arg.c_str());
+            return 2;
+        }
+    }
+    rg::GlTraceReader trace;
+    if (!trace.Load(tracePath))
+        return 1;
+
+    rg::OffscreenContext offscreen;
+    GLFWwindow* window = nullptr;
+    const char* context = "egl-surfaceless";
+    if (offscreen.Create() && offscreen.MakeCurrent()) {
+        gladLoadGLLoader((GLADloadproc) rg::OffscreenContext::GetProcAddress);
+    } else {
+        if (!glfwInit()) {
+            std::printf("Failed to initialize GLFW\n");
+            return 1;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(std::max<int>(trace.Width, 1), std::max<int>(trace.Height, 1), "gl_replay", NULL, NULL);
+        if (!window) {
+            std::printf("Failed to create GLFW window\n");
+            glfwTerminate();
+            return 1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+        gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+        context = "glfw-hidden-window";
+    }
+
+    // stands in for the default framebuffer, in both cases, so results don't depend on the context type
+    ReplayState state;
+    GLuint color = 0, depth = 0;
+    glGenFramebuffers(1, &state.DefaultFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, state.DefaultFramebuffer);
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, std::max<int>(trace.Width, 1), std::max<int>(trace.Height, 1));
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, std::max<int>(trace.Width, 1),
+                          std::max<int>(trace.Height, 1));
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // startup: resources, untimed
+    rg::GlTraceRecord record;
+    bool loaded = false;
+    while (!loaded && trace.Next(record)) {
+        if (record.Op == rg::GlOpLoaded)
+            loaded = true;
+        else if (record.Op != rg::GlOpFrameEnd)
+            execute(state, record);
+    }
+    if (!loaded) {
+        std::printf("ERROR::GL_REPLAY::NO_FRAMES %s\n", tracePath.c_str());
+        return 1;
+    }
+    glFinish();
+    size_t framesStart = trace.Offset();
+
+    double overhead = timerOverheadNs();
+    std::vector<OpStats> stats(rg::GlOpCount);
+    RedundancyTracker redundancy;
+    std::uint64_t frames = 0, calls = 0, glErrors = 0;
+    double finishNs = 0.0;
+    auto replayStart = Clock::now();
+    for (int loop = 0; loop < loops; ++loop) {
+        trace.Seek(framesStart);
+        while (trace.Next(record)) {
+            if (record.Op == rg::GlOpFrameEnd) {
+                auto start = Clock::now();
+                glFinish();
+                finishNs += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+                // a replay that errors isn't measuring what was captured
+                for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError())
+                    ++glErrors;
+                ++frames;
+                continue;
+            }
+            if (record.Op >= rg::GlOpCount)
+                continue;
+            OpStats& op = stats[record.Op];
+            op.Redundant += redundancy.Check(record);
+            auto start = Clock::now();
+            execute(state, record);
+            auto end = Clock::now();
+            op.Ns += std::max(0.0, std::chrono::duration<double, std::nano>(end - start).count() - overhead);
+            ++op.Calls;
+            ++calls;
+        }
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - replayStart).count();
+
+    std::vector<std::uint16_t> order;
+    double callNs = 0.0;
+    std::uint64_t redundant = 0;
+    for (std::uint16_t op = 0; op < rg::GlOpCount; ++op) {
+        if (stats[op].Calls) {
+            order.push_back(op);
+            callNs += stats[op].Ns;
+            redundant += stats[op].Redundant;
+        }
+    }
+    std::sort(order.begin(), order.end(), [&stats](std::uint16_t a, std::uint16_t b) {
+        return stats[a].Ns > stats[b].Ns;
+    });
+
+    double perFrame = frames ? 1.0 / frames : 0.0;
+    std::printf("%s: %llu frames on %s (%s), %d loop(s)\n", tracePath.c_str(), (unsigned long long) frames,
+                (const char*) glGetString(GL_RENDERER), context, loops);
+    std::printf("per frame: %.1f calls, %.3f ms in calls, %.3f ms in glFinish, %.3f ms wall; "
+                "%.1f%% of calls redundant (timer overhead %.1f ns/call taken off)\n",
+                calls * perFrame, callNs * 1e-6 * perFrame, finishNs * 1e-6 * perFrame, wallMs * perFrame,
+                calls ? 100.0 * redundant / calls : 0.0, overhead);
+    std::printf("%-26s %10s %10s %10s %10s %10s %8s\n", "call", "calls", "per frame", "ms", "ns/call", "redundant",
+                "%");
+    for (std::uint16_t op : order) {
+        const OpStats& s = stats[op];
+        std::printf("%-26s %10llu %10.1f %10.3f %10.1f %10llu %7.1f%%\n", rg::GlTraceOpName(op),
+                    (unsigned long long) s.Calls, s.Calls * perFrame, s.Ns * 1e-6, s.Ns / s.Calls,
+                    (unsigned long long) s.Redundant, 100.0 * s.Redundant / s.Calls);
+    }
+
+    int result = 0;
+    if (glErrors) {
+        std::printf("ERROR::GL_REPLAY::GL_ERRORS %llu during the frames\n", (unsigned long long) glErrors);
+        result = 1;
+    }
+    if (!csvPath.empty()) {
+        std::FILE* csv = std::fopen(csvPath.c_str(), "w");
+        if (csv) {
+            std::fprintf(csv, "call,calls,ms,ns_per_call,redundant\n");
+            for (std::uint16_t op : order)
+                std::fprintf(csv, "%s,%llu,%.6f,%.2f,%llu\n", rg::GlTraceOpName(op),
+                             (unsigned long long) stats[op].Calls, stats[op].Ns * 1e-6, stats[op].Ns / stats[op].Calls,
+                             (unsigned long long) stats[op].Redundant);
+            std::fclose(csv);
+        } else {
+            std::printf("ERROR::GL_REPLAY::CANNOT_WRITE %s\n", csvPath.c_str());
+            result = 1;
+        }
+    }
+
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    } else {
+        offscreen.Release();
+    }
+    return result;
+}
@@ -0,0 +1,333 @@
+// Minimal microbenchmark runner with the Google Benchmark interface the bench executable needs, so it
+// builds without the dependency:
+//
+//   void BM_Thing(bench::State& state) {
+//       Setup(state.range(0));
+//       for (auto _ : state)
+//           bench::DoNotOptimize(Thing());
+//       state.SetItemsProcessed(state.iterations() * state.range(0));
+//   }
+//   BENCHMARK(BM_Thing)->Arg(1000)->Arg(100000);
+//   BENCHMARK_MAIN();
+//
+// Each benchmark/argument runs with 1, 10, 100... iterations (scaled by the time the previous run
+// took) until one run lasts --benchmark_min_time seconds; that run is reported.
+// usage: bench [--benchmark_filter=substring] [--benchmark_min_time=seconds] [--benchmark_list_tests]
+//              [--benchmark_out=file.json]
+#ifndef PROJECT_BASE_MICROBENCH_H
+#define PROJECT_BASE_MICROBENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() {
+    asm volatile("" : : : "memory");
+}
+
+class State {
+    typedef std::chrono::steady_clock Clock;
+
+    std::int64_t m_Iterations;
+    std::vector<std::int64_t> m_Args;
+    Clock::time_point m_Start;
+    double m_Seconds = 0.0;
+    bool m_Running = false;
+    std::int64_t m_Items = 0;
+    std::int64_t m_Bytes = 0;
+    std::string m_Label;
+    std::string m_Error;
+
+    void start() {
+        m_Running = true;
+        m_Start = Clock::now();
+    }
+    void stop() {
+        if (m_Running)
+            m_Seconds += std::chrono::duration<double>(Clock::now() - m_Start).count();
+        m_Running = false;
+    }
+
+public:
+    State(std::int64_t iterations, std::vector<std::int64_t> args) : m_Iterations(iterations), m_Args(std::move(args)) {}
+
+    struct __attribute__((unused)) Value {}; // what "for (auto _ : state)" binds, unused by design
+    class Iterator {
+        State* m_State;
+        std::int64_t m_Remaining;
+
+    public:
+        Iterator(State* state, std::int64_t remaining) : m_State(state), m_Remaining(remaining) {}
+        Value operator*() const {
+            return Value();
+        }
+        Iterator& operator++() {
+            --m_Remaining;
+            return *this;
+        }
+        bool operator!=(const Iterator&) {
+            if (m_Remaining > 0)
+                return true;
+            m_State->stop();
+            return false;
+        }
+    };
+
+    Iterator begin() {
+        start();
+        return Iterator(this, m_Error.empty() ? m_Iterations : 0);
+    }
+    Iterator end() {
+        return Iterator(this, 0);
+    }
+
+    // excludes per-iteration setup from the measurement
+    void PauseTiming() {
+        stop();
+    }
+    void ResumeTiming() {
+        start();
+    }
+
+    std::int64_t range(size_t i = 0) const {
+        return i < m_Args.size() ? m_Args[i] : 0;
+    }
+    std::int64_t iterations() const {
+        return m_Iterations;
+    }
+    void SetItemsProcessed(std::int64_t items) {
+        m_Items = items;
+    }
+    void SetBytesProcessed(std::int64_t bytes) {
+        m_Bytes = bytes;
+    }
+    void SetLabel(const std::string& label) {
+        m_Label = label;
+    }
+    // call before the loop: the benchmark reports the message instead of a time
+    void SkipWithError(const std::string& message) {
+        m_Error = message;
+    }
+
+    double Seconds() const {
+        return m_Seconds;
+    }
+    std::int64_t Items() const {
+        return m_Items;
+    }
+    std::int64_t Bytes() const {
+        return m_Bytes;
+    }
+    const std::string& Label() const {
+        return m_Label;
+    }
+    const std::string& Error() const {
+        return m_Error;
+    }
+};
+
+class Benchmark {
+public:
+    std::string Name;
+    std::function<void(State&)> Function;
+    std::vector<std::vector<std::int64_t>> ArgSets;
+
+    Benchmark* Arg(std::int64_t value) {
+        ArgSets.push_back({value});
+        return this;
+    }
+    Benchmark* Args(const std::vector<std::int64_t>& values) {
+        ArgSets.push_back(values);
+        return this;
+    }
+    // Arg for lo, lo * multiplier, ... up to hi
+    Benchmark* Range(std::int64_t lo, std::int64_t hi, std::int64_t multiplier = 8) {
+        for (std::int64_t value = lo; value <= hi; value *= multiplier)
+            Arg(value);
+        return this;
+    }
+};
+
+inline std::vector<std::unique_ptr<Benchmark>>& Registry() {
+    static std::vector<std::unique_ptr<Benchmark>> benchmarks;
+    return benchmarks;
+}
+
+inline Benchmark* Register(const char* name, std::function<void(State&)> function) {
+    Registry().emplace_back(new Benchmark{name, std::move(function), {}});
+    return Registry().back().get();
+}
+
+struct RunResult {
+    std::string Name;
+    std::int64_t Iterations = 0;
+    double NsPerIteration = 0.0;
+    double ItemsPerSecond = 0.0;
+    double BytesPerSecond = 0.0;
+    std::string Label;
+    std::string Error;
+};
+
+inline RunResult RunOne(const Benchmark& benchmark, const std::vector<std::int64_t>& args, double minSeconds) {
+    RunResult result;
+    result.Name = benchmark.Name;
+    for (std::int64_t arg : args)
+        result.Name += "/" + std::to_string(arg);
+    const std::int64_t maxIterations = 1000000000;
+    std::int64_t iterations = 1;
+    while (true) {
+        State state(iterations, args);
+        benchmark.Function(state);
+        if (!state.Error().empty()) {
+            result.Error = state.Error();
+            return result;
+        }
+        double seconds = state.Seconds();
+        if (seconds >= minSeconds || iterations >= maxIterations) {
+            result.Iterations = iterations;
+            result.NsPerIteration = seconds * 1e9 / iterations;
+            result.ItemsPerSecond = seconds > 0.0 ? state.Items() / seconds : 0.0;
+            result.BytesPerSecond = seconds > 0.0 ? state.Bytes() / seconds : 0.0;
+            result.Label = state.Label();
+            return result;
+        }
+        // aim 40% past the minimum, growing at most 10x a step
+        double scale = seconds > 0.0 ? 1.4 * minSeconds / seconds : 10.0;
+        scale = std::min(10.0, std::max(2.0, scale));
+        iterations = std::min(maxIterations, (std::int64_t) (iterations * scale));
+    }
+}
+
+inline std::string FormatTime(double ns) {
+    char buffer[32];
+    if (ns < 1e3)
+        std::snprintf(buffer, sizeof(buffer), "%.1f ns", ns);
+    else if (ns < 1e6)
+        std::snprintf(buffer, sizeof(buffer), "%.2f us", ns / 1e3);
+    else
+        std::snprintf(buffer, sizeof(buffer), "%.2f ms", ns / 1e6);
+    return buffer;
+}
+
+inline std::string FormatRate(double perSecond, const char* unit) {
+    const char* prefixes[] = {"", "k", "M", "G", "T"};
+    int prefix = 0;
+    while (perSecond >= 1000.0 && prefix < 4) {
+        perSecond /= 1000.0;
+        ++prefix;
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3g%s%s/s", perSecond, prefixes[prefix], unit);
+    return buffer;
+}
+
+inline bool WriteJson(const std::string& path, const std::vector<RunResult>& results) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::printf("ERROR::BENCH::CANNOT_WRITE %s\n", path.c_str());
+        return false;
+    }
+    std::fprintf(file, "{\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const RunResult& r = results[i];
+        std::fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %lld, \"real_time\": %.3f, \"time_unit\": \"ns\"",
+                     i ? "," : "", r.Name.c_str(), (long long) r.Iterations, r.NsPerIteration);
+        if (r.ItemsPerSecond > 0.0)
+            std::fprintf(file, ", \"items_per_second\": %.6g", r.ItemsPerSecond);
+        if (r.BytesPerSecond > 0.0)
+            std::fprintf(file, ", \"bytes_per_second\": %.6g", r.BytesPerSecond);
+        if (!r.Label.empty())
+            std::fprintf(file, ", \"label\": \"%s\"", r.Label.c_str());
+        if (!r.Error.empty())
+            std::fprintf(file, ", \"error_occurred\": true, \"error_message\": \"%s\"", r.Error.c_str());
+        std::fprintf(file, "}");
+    }
+    std::fprintf(file, "%s]\n}\n", results.empty() ? "" : "\n  ");
+    return std::fclose(file) == 0;
+}
+
+// returns 1 when a benchmark reported an error
+inline int RunBenchmarks(int argc, char** argv) {
+    std::string filter, output;
+    double minSeconds = 0.5;
+    bool list = false;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (std::strncmp(arg, "--benchmark_filter=", 19) == 0) {
+            filter = arg + 19;
+        } else if (std::strncmp(arg, "--benchmark_min_time=", 21) == 0) {
+            minSeconds = std::atof(arg + 21);
+        } else if (std::strncmp(arg, "--benchmark_out=", 16) == 0) {
+            output = arg + 16;
+        } else if (std::strcmp(arg, "--benchmark_list_tests") == 0) {
+            list = true;
+        } else {
+            std::printf("ERROR::BENCH::UNKNOWN_ARGUMENT %s\n", arg);
+            return 2;
+        }
+    }
+
+    std::vector<RunResult> results;
+    int failures = 0;
+    if (!list)
+        std::printf("%-44s %14s %12s  %s\n", "Benchmark", "Time", "Iterations", "Rate");
+    for (const auto& benchmark : Registry()) {
+        std::vector<std::vector<std::int64_t>> argSets = benchmark->ArgSets;
+        if (argSets.empty())
+            argSets.emplace_back();
+        for (const auto& args : argSets) {
+            std::string name = benchmark->Name;
+            for (std::int64_t arg : args)
+                name += "/" + std::to_string(arg);
+            if (!filter.empty() && name.find(filter) == std::string::npos)
+                continue;
+            if (list) {
+                std::printf("%s\n", name.c_str());
+                continue;
+            }
+            RunResult r = RunOne(*benchmark, args, minSeconds);
+            if (!r.Error.empty()) {
+                std::printf("%-44s ERROR: %s\n", r.Name.c_str(), r.Error.c_str());
+                ++failures;
+            } else {
+                std::string rate;
+                if (r.BytesPerSecond > 0.0)
+                    rate = FormatRate(r.BytesPerSecond, "B");
+                if (r.ItemsPerSecond > 0.0)
+                    rate += (rate.empty() ? "" : " ") + FormatRate(r.ItemsPerSecond, " items");
+                std::printf("%-44s %14s %12lld  %s%s%s\n", r.Name.c_str(), FormatTime(r.NsPerIteration).c_str(),
+                            (long long) r.Iterations, rate.c_str(), r.Label.empty() ? "" : " ", r.Label.c_str());
+            }
+            std::fflush(stdout);
+            results.push_back(r);
+        }
+    }
+    if (!output.empty() && !WriteJson(output, results))
+        return 1;
+    return failures == 0 ? 0 : 1;
+}
+
+}
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCHMARK(function) \
+    static ::bench::Benchmark* BENCH_CONCAT(benchmark_, __LINE__) = ::bench::Register(#function, function)
+#define BENCHMARK_MAIN() \
+    int main(int argc, char** argv) { return ::bench::RunBenchmarks(argc, argv); }
+
+#endif //PROJECT_BASE_MICROBENCH_H
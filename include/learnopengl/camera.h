@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <functional>
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -40,6 +41,8 @@ public:
     float MovementSpeed;
     float MouseSensitivity;
     float Zoom;
+    // optional, maps a requested move (from, to) to the position actually reached, e.g. for collision
+    std::function<glm::vec3(const glm::vec3&, const glm::vec3&)> MovementConstraint;
 
     // constructor with vectors
     Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
@@ -70,14 +73,16 @@ public:
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
         float velocity = MovementSpeed * deltaTime;
+        glm::vec3 target = Position;
         if (direction == FORWARD)
-            Position += Front * velocity;
+            target += Front * velocity;
         if (direction == BACKWARD)
-            Position -= Front * velocity;
+            target -= Front * velocity;
         if (direction == LEFT)
-            Position -= Right * velocity;
+            target -= Right * velocity;
         if (direction == RIGHT)
-            Position += Right * velocity;
+            target += Right * velocity;
+        Position = MovementConstraint ? MovementConstraint(Position, target) : target;
     }
 
     // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
@@ -102,6 +107,28 @@ public:
         updateCameraVectors();
     }
 
+    // places the camera at position looking at target, without going through MovementConstraint (scripted paths)
+    void LookAt(glm::vec3 position, glm::vec3 target)
+    {
+        Position = position;
+        glm::vec3 direction = target - position;
+        if (glm::length(direction) < 1e-6f)
+            return;
+        direction = glm::normalize(direction);
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::clamp(glm::degrees(asin(direction.y)), -89.0f, 89.0f);
+        updateCameraVectors();
+    }
+
+    // places the camera with the given Euler angles, without going through MovementConstraint (playback)
+    void SetPose(glm::vec3 position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Metrics.h>
 
 #include <string>
 #include <vector>
@@ -23,16 +24,33 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
+    // lightmap texCoords, unique per surface point (rg::GenerateLightmapUvs)
+    glm::vec2 LightmapTexCoords;
 };
 
 
 
+// which meshes of a model a draw covers, see Mesh::Transparent
+enum class MeshSelection {
+    All,
+    Opaque,
+    Transparent
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// Sampler units of the material textures: <type>N of TEXTURE_TYPES[t] samples unit
+// (N - 1) * TEXTURE_TYPE_COUNT + t, for N up to TEXTURES_PER_TYPE. A program's samplers are pointed
+// at them once (Mesh::SetSamplerUnits), draws only bind textures. Units from
+// TEXTURE_TYPE_COUNT * TEXTURES_PER_TYPE on are left to the renderer.
+const char* const TEXTURE_TYPES[] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+const int TEXTURE_TYPE_COUNT = 4;
+const int TEXTURES_PER_TYPE = 2;
+
 class Mesh {
 public:
     // mesh Data
@@ -40,62 +58,152 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
-    unsigned int VAO;
-    std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    unsigned int VAO = 0;
+    unsigned int DepthVAO = 0; // positions only, see DrawPositions
+    // per texture, the unit it's bound to; -1 for ones past TEXTURES_PER_TYPE or of another type
+    vector<int> textureUnits;
+    // the material's dissolve; below 1 the mesh is drawn by the transparent pass when there is one
+    float Opacity = 1.0f;
+    // constructor, pass uploadNow = false when not on the GL thread and call Upload() there later
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool uploadNow = true)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        resolveTextureUnits();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        if (uploadNow)
+            setupMesh();
+    }
+
+    // creates the vertex buffers for a mesh constructed with uploadNow = false
+    void Upload()
+    {
         setupMesh();
     }
 
-    // render the mesh
+    // deletes the vertex buffers, on the GL thread. Copies of a mesh share them, only one of them
+    // releases.
+    void Release()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteVertexArrays(1, &DepthVAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &PositionVBO);
+        rg::metrics::Render().GlObjects.Add(-5);
+        VAO = DepthVAO = VBO = EBO = PositionVBO = 0;
+    }
+
+    bool Transparent() const
+    {
+        return Opacity < 1.0f;
+    }
+
+    bool Selected(MeshSelection selection) const
+    {
+        return selection == MeshSelection::All || (selection == MeshSelection::Transparent) == Transparent();
+    }
+
+    // Points the material samplers of a program at their units (see TEXTURE_TYPES), prefix is what
+    // the shader puts before the sampler names, e.g. "material.". Once, when the program is built.
+    static void SetSamplerUnits(Shader &shader, const string &prefix)
+    {
+        shader.use();
+        for (int number = 1; number <= TEXTURES_PER_TYPE; ++number)
+            for (int type = 0; type < TEXTURE_TYPE_COUNT; ++type)
+                shader.setInt((prefix + TEXTURE_TYPES[type] + std::to_string(number)).c_str(),
+                              (number - 1) * TEXTURE_TYPE_COUNT + type);
+    }
+
+    // render the mesh with a program set up by SetSamplerUnits
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        // bind the textures to the units their samplers read
+        unsigned int bound = 0;
+        for (size_t i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
+            if (textureUnits[i] < 0)
+                continue;
+            glActiveTexture(GL_TEXTURE0 + textureUnits[i]);
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            ++bound;
         }
 
-
-
         // draw mesh
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
 
+        rg::metrics::RenderMetrics& metrics = rg::metrics::Render();
+        metrics.TextureBinds.Add(bound);
+        metrics.VaoBinds.Add();
+        metrics.DrawCalls.Add();
+        metrics.Triangles.Add(indices.size() / 3);
+
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // depth-only draw from the position stream, no textures bound
+    void DrawPositions()
+    {
+        glBindVertexArray(DepthVAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        rg::metrics::RenderMetrics& metrics = rg::metrics::Render();
+        metrics.VaoBinds.Add();
+        metrics.DrawCalls.Add();
+        metrics.Triangles.Add(indices.size() / 3);
+    }
+
+    // depth-only draw for a shader that discards on the diffuse alpha: the full vertex stream for the
+    // texture coordinates and the first diffuse texture on unit 0
+    void DrawAlphaTested()
+    {
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (textureUnits[i] == 0) {
+                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                rg::metrics::Render().TextureBinds.Add();
+                break;
+            }
+        }
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        rg::metrics::RenderMetrics& metrics = rg::metrics::Render();
+        metrics.VaoBinds.Add();
+        metrics.DrawCalls.Add();
+        metrics.Triangles.Add(indices.size() / 3);
+    }
+
 private:
     // render data
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0, PositionVBO = 0;
+
+    // the N of <type>N counts the textures of a type in order, as the loader found them
+    void resolveTextureUnits()
+    {
+        int count[TEXTURE_TYPE_COUNT] = {};
+        textureUnits.assign(textures.size(), -1);
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            for (int type = 0; type < TEXTURE_TYPE_COUNT; ++type)
+            {
+                if (textures[i].type == TEXTURE_TYPES[type])
+                {
+                    if (count[type] < TEXTURES_PER_TYPE)
+                        textureUnits[i] = count[type]++ * TEXTURE_TYPE_COUNT + type;
+                    break;
+                }
+            }
+        }
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -132,8 +240,30 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // vertex lightmap coords
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapTexCoords));
 
         glBindVertexArray(0);
+
+        // Positions again, tightly packed, for depth-only passes: 12 bytes a vertex go through the
+        // vertex fetch instead of 64. Shares the index buffer.
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            positions[i] = vertices[i].Position;
+        glGenVertexArrays(1, &DepthVAO);
+        glGenBuffers(1, &PositionVBO);
+        glBindVertexArray(DepthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, PositionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
+
+        rg::metrics::Render().GlObjects.Add(5);
+        rg::metrics::Render().BytesUploaded.Add(vertices.size() * (sizeof(Vertex) + sizeof(glm::vec3))
+                                                + indices.size() * sizeof(unsigned int));
     }
 };
 #endif
\ No newline at end of file
@@ -12,6 +12,7 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/Metrics.h>
 
 #include <string>
 #include <fstream>
@@ -21,7 +22,22 @@
 #include <vector>
 using namespace std;
 
+// decoded pixels waiting for a GL texture, see LoadTextureImage and TextureFromImage
+struct TextureImage {
+    string path;
+    int width = 0, height = 0, nrComponents = 0;
+    unsigned char *data = nullptr;
+};
+
+// the post-processing every model gets on import
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// defined in src/engine/model_loading.cpp (rg_engine)
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+TextureImage LoadTextureImage(const char *path, const string &directory);
+unsigned int TextureFromImage(TextureImage &image);
+unsigned int CopyTexture(unsigned int source);
+void ReadMeshGeometry(const aiMesh *mesh, vector<Vertex> &vertices, vector<unsigned int> &indices);
 
 
 
@@ -35,30 +51,111 @@ public:
     bool gammaCorrection;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // With deferUpload nothing touches GL: meshes and decoded textures wait for UploadToGpu(),
+    // so the constructor can run on a loader thread.
+    Model(string const &path, bool gamma = false, bool deferUpload = false) : gammaCorrection(gamma), uploadDeferred(deferUpload)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // creates the textures and vertex buffers of a model constructed with deferUpload, on the GL thread
+    void UploadToGpu()
+    {
+        for (TextureImage& image : pendingImages) {
+            unsigned int id = TextureFromImage(image);
+            for (Texture& texture : textures_loaded) {
+                if (texture.path == image.path)
+                    texture.id = id;
+            }
+            for (Mesh& mesh : meshes) {
+                for (Texture& texture : mesh.textures) {
+                    if (texture.path == image.path)
+                        texture.id = id;
+                }
+            }
+        }
+        pendingImages.clear();
+        if (uploadDeferred) {
+            for (Mesh& mesh : meshes)
+                mesh.Upload();
+            uploadDeferred = false;
+        }
+    }
+
+    // deletes the textures and vertex buffers, on the GL thread
+    void Release()
+    {
+        for (Mesh& mesh : meshes)
+            mesh.Release();
+        ReleaseTextures();
+    }
+
+    // deletes only the textures, for a copy that shares its vertex buffers with the original
+    void ReleaseTextures()
+    {
+        for (Texture& texture : textures_loaded) {
+            if (!texture.id)
+                continue;
+            glDeleteTextures(1, &texture.id);
+            rg::metrics::Render().GlObjects.Add(-1);
+            for (Mesh& mesh : meshes) {
+                for (Texture& t : mesh.textures) {
+                    if (t.id == texture.id)
+                        t.id = 0;
+                }
+            }
+            texture.id = 0;
+        }
+    }
+
+    // draws the model, and thus all its meshes, or only its opaque or transparent ones; the
+    // transparent ones get their opacity
+    void Draw(Shader &shader, MeshSelection selection = MeshSelection::All)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].Selected(selection))
+                continue;
+            if (selection == MeshSelection::Transparent)
+                shader.setFloat("opacity", meshes[i].Opacity);
             meshes[i].Draw(shader);
+        }
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
-        }
+    // depth-only draws of all meshes, see Mesh::DrawPositions and Mesh::DrawAlphaTested
+    void DrawPositions(MeshSelection selection = MeshSelection::All)
+    {
+        for (Mesh& mesh : meshes)
+            if (mesh.Selected(selection))
+                mesh.DrawPositions();
+    }
+
+    void DrawAlphaTested(MeshSelection selection = MeshSelection::All)
+    {
+        for (Mesh& mesh : meshes)
+            if (mesh.Selected(selection))
+                mesh.DrawAlphaTested();
     }
+
+    // whether a draw with this selection draws anything
+    bool Has(MeshSelection selection) const
+    {
+        for (const Mesh& mesh : meshes)
+            if (mesh.Selected(selection))
+                return true;
+        return false;
+    }
+
 private:
+    bool uploadDeferred;
+    vector<TextureImage> pendingImages;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -98,69 +195,21 @@ private:
         vector<unsigned int> indices;
         vector<Texture> textures;
 
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
-
-
-        }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
-        }
+        ReadMeshGeometry(mesh, vertices, indices);
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to TEXTURES_PER_TYPE.
         // Same applies to other texture as the following list summarizes:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
         aiColor3D color(0.0f, 0.0f, 0.0f);
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
+        // dissolve ("d", or 1 - "Tr" in .mtl); 0 counts as opaque, exporters write Tr 1 for opaque materials
+        float opacity = 1.0f;
+        if (material->Get(AI_MATKEY_OPACITY, opacity) != AI_SUCCESS || opacity <= 0.0f || opacity > 1.0f)
+            opacity = 1.0f;
 
 
         // 1. diffuse maps
@@ -179,7 +228,9 @@ private:
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures, !uploadDeferred);
+        result.Opacity = opacity;
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -205,7 +256,13 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                if (uploadDeferred) {
+                    texture.id = 0;
+                    pendingImages.push_back(LoadTextureImage(str.C_Str(), this->directory));
+                    pendingImages.back().path = str.C_Str();
+                } else {
+                    texture.id = TextureFromFile(str.C_Str(), this->directory);
+                }
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -216,44 +273,4 @@ private:
     }
 };
 
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
 #endif
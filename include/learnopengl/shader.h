@@ -9,6 +9,8 @@
 #include <sstream>
 #include <iostream>
 #include <common.h>
+#include <rg/CpuProfiler.h>
+#include <rg/Metrics.h>
 class Shader
 {
 public:
@@ -17,6 +19,7 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
+        RG_PROFILE_SCOPE("compile shader");
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -79,7 +82,7 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+        unsigned int geometry = 0;
         if(geometryPath != nullptr)
         {
             const char * gShaderCode = geometryCode.c_str();
@@ -90,6 +93,7 @@ public:
         }
         // shader Program
         ID = glCreateProgram();
+        rg::metrics::Render().GlObjects.Add();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
@@ -108,64 +112,111 @@ public:
     void use() 
     { 
         glUseProgram(ID); 
+        rg::metrics::Render().ProgramBinds.Add();
     }
-    // utility uniform functions
+    // utility uniform functions; names are C strings so a literal doesn't turn into a std::string on
+    // every call
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(const char *name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(glGetUniformLocation(ID, name), (int)value); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(const char *name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(glGetUniformLocation(ID, name), value); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(const char *name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(glGetUniformLocation(ID, name), value); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(const char *name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]); 
+        rg::metrics::Render().UniformUploads.Add();
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(const char *name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(glGetUniformLocation(ID, name), x, y); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(const char *name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]); 
+        rg::metrics::Render().UniformUploads.Add();
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(const char *name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(glGetUniformLocation(ID, name), x, y, z); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(const char *name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]); 
+        rg::metrics::Render().UniformUploads.Add();
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(const char *name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(glGetUniformLocation(ID, name), x, y, z, w); 
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(const char *name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(const char *name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
+        rg::metrics::Render().UniformUploads.Add();
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(const char *name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
+        rg::metrics::Render().UniformUploads.Add();
+    }
+    // ------------------------------------------------------------------------
+    void setFloatArray(const char *name, const float *values, int count) const
+    {
+        glUniform1fv(glGetUniformLocation(ID, name), count, values);
+        rg::metrics::Render().UniformUploads.Add();
+    }
+    // ------------------------------------------------------------------------
+    void setMat4Array(const char *name, const glm::mat4 *mats, int count) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name), count, GL_FALSE, &mats[0][0][0]);
+        rg::metrics::Render().UniformUploads.Add();
+    }
+    // uniforms set for every draw: the location is looked up once, then set through it
+    // ------------------------------------------------------------------------
+    GLint getLocation(const char *name) const
+    {
+        return glGetUniformLocation(ID, name);
+    }
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
+        rg::metrics::Render().UniformUploads.Add();
+    }
+    void setVec4(GLint location, const glm::vec4 &value) const
+    {
+        glUniform4fv(location, 1, &value[0]);
+        rg::metrics::Render().UniformUploads.Add();
+    }
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+        rg::metrics::Render().UniformUploads.Add();
     }
 
 private:
@@ -0,0 +1,623 @@
+#ifndef PROJECT_BASE_BATCH_MATH_H
+#define PROJECT_BASE_BATCH_MATH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/Bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define RG_BATCH_SSE 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RG_TARGET_AVX2
+#else
+#define RG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace rg {
+
+// Batch kernels over SoA columns: one call handles a whole range of instances. Every kernel has a
+// scalar glm version plus SSE2 (4 lanes) and AVX2 (8 lanes) versions, picked once at startup from
+// what the CPU supports. Ranges that don't fill a whole register finish on the scalar path.
+
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+inline const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Avx2: return "avx2";
+        case SimdLevel::Sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// translation, rotation around +Y in degrees and scale, one column per component
+struct TrsColumns {
+    const float *PositionX, *PositionY, *PositionZ;
+    const float* RotationY;
+    const float *ScaleX, *ScaleY, *ScaleZ;
+};
+
+struct BoxColumns {
+    const float *MinX, *MinY, *MinZ;
+    const float *MaxX, *MaxY, *MaxZ;
+};
+
+struct BoxOutputColumns {
+    float *MinX, *MinY, *MinZ;
+    float *MaxX, *MaxY, *MaxZ;
+};
+
+struct SphereColumns {
+    const float *CenterX, *CenterY, *CenterZ;
+    const float* Radius;
+};
+
+struct BatchKernels {
+    SimdLevel Level;
+    // out[i] = translate(p) * rotateY(r) * scale(s)
+    void (*ComposeTrs)(const TrsColumns& in, glm::mat4* out, size_t begin, size_t end);
+    // out[i] = lhs * rhs[i], e.g. projection * view * model
+    void (*MultiplyMatrices)(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out, size_t begin, size_t end);
+    // world box around each local box transformed by its matrix
+    void (*TransformBoxes)(const BoxColumns& local, const glm::mat4* world, const BoxOutputColumns& out,
+                           size_t begin, size_t end);
+    // set or clear visibleBit in flags[i], return how many were set
+    size_t (*CullBoxes)(const Frustum& frustum, const BoxColumns& boxes, std::uint8_t* flags, std::uint8_t visibleBit,
+                        size_t begin, size_t end);
+    size_t (*CullSpheres)(const Frustum& frustum, const SphereColumns& spheres, std::uint8_t* flags,
+                          std::uint8_t visibleBit, size_t begin, size_t end);
+    // set or clear bit in flags[i] by whether box i touches the sphere (center xyz, radius w), return
+    // how many do; one light against a run of cluster boxes
+    size_t (*SphereTouchesBoxes)(const glm::vec4& sphere, const BoxColumns& boxes, std::uint8_t* flags,
+                                 std::uint8_t bit, size_t begin, size_t end);
+};
+
+// scalar
+// ------------------------------------------------------------------------
+namespace scalar {
+
+inline void ComposeTrs(const TrsColumns& in, glm::mat4* out, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(in.PositionX[i], in.PositionY[i], in.PositionZ[i]));
+        if (in.RotationY[i] != 0.0f)
+            model = glm::rotate(model, glm::radians(in.RotationY[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+        out[i] = glm::scale(model, glm::vec3(in.ScaleX[i], in.ScaleY[i], in.ScaleZ[i]));
+    }
+}
+
+inline void MultiplyMatrices(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+        out[i] = lhs * rhs[i];
+}
+
+inline void TransformBoxes(const BoxColumns& local, const glm::mat4* world, const BoxOutputColumns& out,
+                           size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        Aabb box = TransformAabb(Aabb(glm::vec3(local.MinX[i], local.MinY[i], local.MinZ[i]),
+                                      glm::vec3(local.MaxX[i], local.MaxY[i], local.MaxZ[i])), world[i]);
+        out.MinX[i] = box.Min.x;
+        out.MinY[i] = box.Min.y;
+        out.MinZ[i] = box.Min.z;
+        out.MaxX[i] = box.Max.x;
+        out.MaxY[i] = box.Max.y;
+        out.MaxZ[i] = box.Max.z;
+    }
+}
+
+inline void setVisible(std::uint8_t* flags, size_t i, std::uint8_t visibleBit, bool visible) {
+    if (visible)
+        flags[i] |= visibleBit;
+    else
+        flags[i] &= (std::uint8_t) ~visibleBit;
+}
+
+inline size_t CullBoxes(const Frustum& frustum, const BoxColumns& boxes, std::uint8_t* flags, std::uint8_t visibleBit,
+                        size_t begin, size_t end) {
+    size_t visible = 0;
+    for (size_t i = begin; i < end; ++i) {
+        bool inside = frustum.IntersectsAabb(glm::vec3(boxes.MinX[i], boxes.MinY[i], boxes.MinZ[i]),
+                                             glm::vec3(boxes.MaxX[i], boxes.MaxY[i], boxes.MaxZ[i]));
+        setVisible(flags, i, visibleBit, inside);
+        visible += inside;
+    }
+    return visible;
+}
+
+inline size_t CullSpheres(const Frustum& frustum, const SphereColumns& spheres, std::uint8_t* flags,
+                          std::uint8_t visibleBit, size_t begin, size_t end) {
+    size_t visible = 0;
+    for (size_t i = begin; i < end; ++i) {
+        bool inside = frustum.IntersectsSphere(glm::vec3(spheres.CenterX[i], spheres.CenterY[i], spheres.CenterZ[i]),
+                                               spheres.Radius[i]);
+        setVisible(flags, i, visibleBit, inside);
+        visible += inside;
+    }
+    return visible;
+}
+
+inline size_t SphereTouchesBoxes(const glm::vec4& sphere, const BoxColumns& boxes, std::uint8_t* flags,
+                                 std::uint8_t bit, size_t begin, size_t end) {
+    size_t touching = 0;
+    for (size_t i = begin; i < end; ++i) {
+        // distance from the centre to the box along each axis, 0 inside its extent
+        float dx = std::max(std::max(boxes.MinX[i] - sphere.x, sphere.x - boxes.MaxX[i]), 0.0f);
+        float dy = std::max(std::max(boxes.MinY[i] - sphere.y, sphere.y - boxes.MaxY[i]), 0.0f);
+        float dz = std::max(std::max(boxes.MinZ[i] - sphere.z, sphere.z - boxes.MaxZ[i]), 0.0f);
+        bool touches = dx * dx + dy * dy + dz * dz <= sphere.w * sphere.w;
+        setVisible(flags, i, bit, touches);
+        touching += touches;
+    }
+    return touching;
+}
+
+}
+
+#ifdef RG_BATCH_SSE
+// sse2
+// ------------------------------------------------------------------------
+namespace sse2 {
+
+// Cephes style sine and cosine of an angle in degrees, good to a couple of ulps in [-360, 360].
+inline void SinCosDegrees(__m128 degrees, __m128& sinOut, __m128& cosOut) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 x = _mm_mul_ps(degrees, _mm_set1_ps(0.017453292519943295f));
+    __m128 signSin = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+    __m128 swapSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+    __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+    __m128 signCos = _mm_castsi128_ps(
+            _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    signSin = _mm_xor_ps(signSin, swapSin);
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 c = _mm_set1_ps(2.443315711809948e-5f);
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+    c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+    __m128 s = _mm_set1_ps(-1.9515295891e-4f);
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+    __m128 sinValue = _mm_or_ps(_mm_and_ps(polyMask, s), _mm_andnot_ps(polyMask, c));
+    __m128 cosValue = _mm_or_ps(_mm_and_ps(polyMask, c), _mm_andnot_ps(polyMask, s));
+    sinOut = _mm_xor_ps(sinValue, signSin);
+    cosOut = _mm_xor_ps(cosValue, signCos);
+}
+
+// c0..c3 hold one matrix column for four instances (lane = instance); writes that column of each.
+inline void storeColumn(glm::mat4* out, int column, __m128 c0, __m128 c1, __m128 c2, __m128 c3) {
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(&out[0][column][0], c0);
+    _mm_storeu_ps(&out[1][column][0], c1);
+    _mm_storeu_ps(&out[2][column][0], c2);
+    _mm_storeu_ps(&out[3][column][0], c3);
+}
+
+// inverse of storeColumn: c0..c3 become rows 0..3 of the column, lane = instance
+inline void loadColumn(const glm::mat4* in, int column, __m128& c0, __m128& c1, __m128& c2, __m128& c3) {
+    c0 = _mm_loadu_ps(&in[0][column][0]);
+    c1 = _mm_loadu_ps(&in[1][column][0]);
+    c2 = _mm_loadu_ps(&in[2][column][0]);
+    c3 = _mm_loadu_ps(&in[3][column][0]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+}
+
+inline void ComposeTrs(const TrsColumns& in, glm::mat4* out, size_t begin, size_t end) {
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 s, c;
+        SinCosDegrees(_mm_loadu_ps(in.RotationY + i), s, c);
+        __m128 sx = _mm_loadu_ps(in.ScaleX + i), sy = _mm_loadu_ps(in.ScaleY + i), sz = _mm_loadu_ps(in.ScaleZ + i);
+        storeColumn(out + i, 0, _mm_mul_ps(c, sx), zero, _mm_sub_ps(zero, _mm_mul_ps(s, sx)), zero);
+        storeColumn(out + i, 1, zero, sy, zero, zero);
+        storeColumn(out + i, 2, _mm_mul_ps(s, sz), zero, _mm_mul_ps(c, sz), zero);
+        storeColumn(out + i, 3, _mm_loadu_ps(in.PositionX + i), _mm_loadu_ps(in.PositionY + i),
+                    _mm_loadu_ps(in.PositionZ + i), one);
+    }
+    scalar::ComposeTrs(in, out, i, end);
+}
+
+inline void MultiplyMatrices(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out, size_t begin, size_t end) {
+    const __m128 l0 = _mm_loadu_ps(&lhs[0][0]), l1 = _mm_loadu_ps(&lhs[1][0]);
+    const __m128 l2 = _mm_loadu_ps(&lhs[2][0]), l3 = _mm_loadu_ps(&lhs[3][0]);
+    for (size_t i = begin; i < end; ++i) {
+        for (int column = 0; column < 4; ++column) {
+            const float* r = &rhs[i][column][0];
+            __m128 v = _mm_mul_ps(l0, _mm_set1_ps(r[0]));
+            v = _mm_add_ps(v, _mm_mul_ps(l1, _mm_set1_ps(r[1])));
+            v = _mm_add_ps(v, _mm_mul_ps(l2, _mm_set1_ps(r[2])));
+            v = _mm_add_ps(v, _mm_mul_ps(l3, _mm_set1_ps(r[3])));
+            _mm_storeu_ps(&out[i][column][0], v);
+        }
+    }
+}
+
+inline void TransformBoxes(const BoxColumns& local, const glm::mat4* world, const BoxOutputColumns& out,
+                           size_t begin, size_t end) {
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 m[4][4]; // m[column][row], lane = instance
+        for (int column = 0; column < 4; ++column)
+            loadColumn(world + i, column, m[column][0], m[column][1], m[column][2], m[column][3]);
+        const __m128 lo[3] = {_mm_loadu_ps(local.MinX + i), _mm_loadu_ps(local.MinY + i), _mm_loadu_ps(local.MinZ + i)};
+        const __m128 hi[3] = {_mm_loadu_ps(local.MaxX + i), _mm_loadu_ps(local.MaxY + i), _mm_loadu_ps(local.MaxZ + i)};
+        __m128 min[3], max[3];
+        for (int row = 0; row < 3; ++row) {
+            min[row] = m[3][row];
+            max[row] = m[3][row];
+            for (int column = 0; column < 3; ++column) {
+                __m128 a = _mm_mul_ps(m[column][row], lo[column]);
+                __m128 b = _mm_mul_ps(m[column][row], hi[column]);
+                min[row] = _mm_add_ps(min[row], _mm_min_ps(a, b));
+                max[row] = _mm_add_ps(max[row], _mm_max_ps(a, b));
+            }
+        }
+        _mm_storeu_ps(out.MinX + i, min[0]);
+        _mm_storeu_ps(out.MinY + i, min[1]);
+        _mm_storeu_ps(out.MinZ + i, min[2]);
+        _mm_storeu_ps(out.MaxX + i, max[0]);
+        _mm_storeu_ps(out.MaxY + i, max[1]);
+        _mm_storeu_ps(out.MaxZ + i, max[2]);
+    }
+    scalar::TransformBoxes(local, world, out, i, end);
+}
+
+inline size_t applyMask(std::uint8_t* flags, size_t i, int lanes, int mask, std::uint8_t visibleBit) {
+    size_t visible = 0;
+    for (int lane = 0; lane < lanes; ++lane) {
+        bool inside = (mask >> lane) & 1;
+        scalar::setVisible(flags, i + lane, visibleBit, inside);
+        visible += inside;
+    }
+    return visible;
+}
+
+inline size_t CullBoxes(const Frustum& frustum, const BoxColumns& boxes, std::uint8_t* flags, std::uint8_t visibleBit,
+                        size_t begin, size_t end) {
+    size_t visible = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 minX = _mm_loadu_ps(boxes.MinX + i), minY = _mm_loadu_ps(boxes.MinY + i);
+        const __m128 minZ = _mm_loadu_ps(boxes.MinZ + i), maxX = _mm_loadu_ps(boxes.MaxX + i);
+        const __m128 maxY = _mm_loadu_ps(boxes.MaxY + i), maxZ = _mm_loadu_ps(boxes.MaxZ + i);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.Planes) {
+            // the box corner furthest along the plane normal, picked per plane rather than per lane
+            __m128 px = plane.x >= 0.0f ? maxX : minX;
+            __m128 py = plane.y >= 0.0f ? maxY : minY;
+            __m128 pz = plane.z >= 0.0f ? maxZ : minZ;
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), px), _mm_mul_ps(_mm_set1_ps(plane.y), py));
+            d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), pz)), _mm_set1_ps(plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        visible += applyMask(flags, i, 4, _mm_movemask_ps(inside), visibleBit);
+    }
+    return visible + scalar::CullBoxes(frustum, boxes, flags, visibleBit, i, end);
+}
+
+inline size_t CullSpheres(const Frustum& frustum, const SphereColumns& spheres, std::uint8_t* flags,
+                          std::uint8_t visibleBit, size_t begin, size_t end) {
+    size_t visible = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(spheres.CenterX + i), y = _mm_loadu_ps(spheres.CenterY + i);
+        const __m128 z = _mm_loadu_ps(spheres.CenterZ + i);
+        const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.Radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.Planes) {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y));
+            d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), z)), _mm_set1_ps(plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+        }
+        visible += applyMask(flags, i, 4, _mm_movemask_ps(inside), visibleBit);
+    }
+    return visible + scalar::CullSpheres(frustum, spheres, flags, visibleBit, i, end);
+}
+
+inline size_t SphereTouchesBoxes(const glm::vec4& sphere, const BoxColumns& boxes, std::uint8_t* flags,
+                                 std::uint8_t bit, size_t begin, size_t end) {
+    const __m128 cx = _mm_set1_ps(sphere.x), cy = _mm_set1_ps(sphere.y), cz = _mm_set1_ps(sphere.z);
+    const __m128 radiusSquared = _mm_set1_ps(sphere.w * sphere.w), zero = _mm_setzero_ps();
+    size_t touching = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.MinX + i), cx),
+                                          _mm_sub_ps(cx, _mm_loadu_ps(boxes.MaxX + i))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.MinY + i), cy),
+                                          _mm_sub_ps(cy, _mm_loadu_ps(boxes.MaxY + i))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.MinZ + i), cz),
+                                          _mm_sub_ps(cz, _mm_loadu_ps(boxes.MaxZ + i))), zero);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        touching += applyMask(flags, i, 4, _mm_movemask_ps(_mm_cmple_ps(d, radiusSquared)), bit);
+    }
+    return touching + scalar::SphereTouchesBoxes(sphere, boxes, flags, bit, i, end);
+}
+
+}
+
+// avx2
+// ------------------------------------------------------------------------
+// Everything here is compiled for AVX2 through the target attribute only, so the rest of the
+// program keeps running on SSE2 machines. Never call these without checking the CPU first.
+namespace avx2 {
+
+RG_TARGET_AVX2 inline __m256 combine(__m128 low, __m128 high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+RG_TARGET_AVX2 inline void SinCosDegrees(__m256 degrees, __m256& sinOut, __m256& cosOut) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 x = _mm256_mul_ps(degrees, _mm256_set1_ps(0.017453292519943295f));
+    __m256 signSin = _mm256_and_ps(x, signMask);
+    x = _mm256_andnot_ps(signMask, x);
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+    j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(j);
+    __m256 swapSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+    __m256 polyMask = _mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+    __m256 signCos = _mm256_castsi256_ps(
+            _mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+    signSin = _mm256_xor_ps(signSin, swapSin);
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(0.78515625f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(3.77489497744594108e-8f)));
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 c = _mm256_set1_ps(2.443315711809948e-5f);
+    c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(-1.388731625493765e-3f));
+    c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(4.166664568298827e-2f));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+    c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+    __m256 s = _mm256_set1_ps(-1.9515295891e-4f);
+    s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(8.3321608736e-3f));
+    s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(-1.6666654611e-1f));
+    s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, z), x), x);
+    sinOut = _mm256_xor_ps(_mm256_blendv_ps(c, s, polyMask), signSin);
+    cosOut = _mm256_xor_ps(_mm256_blendv_ps(s, c, polyMask), signCos);
+}
+
+// storeColumn for eight instances: each 128 bit half goes through the SSE transpose
+RG_TARGET_AVX2 inline void storeColumn(glm::mat4* out, int column, __m256 c0, __m256 c1, __m256 c2, __m256 c3) {
+    for (int half = 0; half < 2; ++half) {
+        __m128 r0 = half ? _mm256_extractf128_ps(c0, 1) : _mm256_castps256_ps128(c0);
+        __m128 r1 = half ? _mm256_extractf128_ps(c1, 1) : _mm256_castps256_ps128(c1);
+        __m128 r2 = half ? _mm256_extractf128_ps(c2, 1) : _mm256_castps256_ps128(c2);
+        __m128 r3 = half ? _mm256_extractf128_ps(c3, 1) : _mm256_castps256_ps128(c3);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        glm::mat4* o = out + half * 4;
+        _mm_storeu_ps(&o[0][column][0], r0);
+        _mm_storeu_ps(&o[1][column][0], r1);
+        _mm_storeu_ps(&o[2][column][0], r2);
+        _mm_storeu_ps(&o[3][column][0], r3);
+    }
+}
+
+RG_TARGET_AVX2 inline void loadColumn(const glm::mat4* in, int column, __m256& c0, __m256& c1, __m256& c2, __m256& c3) {
+    __m128 r[2][4];
+    for (int half = 0; half < 2; ++half) {
+        const glm::mat4* m = in + half * 4;
+        r[half][0] = _mm_loadu_ps(&m[0][column][0]);
+        r[half][1] = _mm_loadu_ps(&m[1][column][0]);
+        r[half][2] = _mm_loadu_ps(&m[2][column][0]);
+        r[half][3] = _mm_loadu_ps(&m[3][column][0]);
+        _MM_TRANSPOSE4_PS(r[half][0], r[half][1], r[half][2], r[half][3]);
+    }
+    c0 = combine(r[0][0], r[1][0]);
+    c1 = combine(r[0][1], r[1][1]);
+    c2 = combine(r[0][2], r[1][2]);
+    c3 = combine(r[0][3], r[1][3]);
+}
+
+RG_TARGET_AVX2 inline void ComposeTrs(const TrsColumns& in, glm::mat4* out, size_t begin, size_t end) {
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 s, c;
+        SinCosDegrees(_mm256_loadu_ps(in.RotationY + i), s, c);
+        __m256 sx = _mm256_loadu_ps(in.ScaleX + i), sy = _mm256_loadu_ps(in.ScaleY + i);
+        __m256 sz = _mm256_loadu_ps(in.ScaleZ + i);
+        storeColumn(out + i, 0, _mm256_mul_ps(c, sx), zero, _mm256_sub_ps(zero, _mm256_mul_ps(s, sx)), zero);
+        storeColumn(out + i, 1, zero, sy, zero, zero);
+        storeColumn(out + i, 2, _mm256_mul_ps(s, sz), zero, _mm256_mul_ps(c, sz), zero);
+        storeColumn(out + i, 3, _mm256_loadu_ps(in.PositionX + i), _mm256_loadu_ps(in.PositionY + i),
+                    _mm256_loadu_ps(in.PositionZ + i), one);
+    }
+    sse2::ComposeTrs(in, out, i, end);
+}
+
+// Two output columns per iteration: each 128 bit half of a register works on one column.
+RG_TARGET_AVX2 inline void MultiplyMatrices(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out,
+                                            size_t begin, size_t end) {
+    __m256 l[4];
+    for (int k = 0; k < 4; ++k)
+        l[k] = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&lhs[k][0]));
+    const __m256i pick[4] = {_mm256_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4), _mm256_setr_epi32(1, 1, 1, 1, 5, 5, 5, 5),
+                             _mm256_setr_epi32(2, 2, 2, 2, 6, 6, 6, 6), _mm256_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7)};
+    for (size_t i = begin; i < end; ++i) {
+        for (int column = 0; column < 4; column += 2) {
+            __m256 r = _mm256_loadu_ps(&rhs[i][column][0]);
+            __m256 v = _mm256_mul_ps(l[0], _mm256_permutevar8x32_ps(r, pick[0]));
+            v = _mm256_add_ps(v, _mm256_mul_ps(l[1], _mm256_permutevar8x32_ps(r, pick[1])));
+            v = _mm256_add_ps(v, _mm256_mul_ps(l[2], _mm256_permutevar8x32_ps(r, pick[2])));
+            v = _mm256_add_ps(v, _mm256_mul_ps(l[3], _mm256_permutevar8x32_ps(r, pick[3])));
+            _mm256_storeu_ps(&out[i][column][0], v);
+        }
+    }
+}
+
+RG_TARGET_AVX2 inline void TransformBoxes(const BoxColumns& local, const glm::mat4* world, const BoxOutputColumns& out,
+                                          size_t begin, size_t end) {
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 m[4][4];
+        for (int column = 0; column < 4; ++column)
+            loadColumn(world + i, column, m[column][0], m[column][1], m[column][2], m[column][3]);
+        const __m256 lo[3] = {_mm256_loadu_ps(local.MinX + i), _mm256_loadu_ps(local.MinY + i),
+                              _mm256_loadu_ps(local.MinZ + i)};
+        const __m256 hi[3] = {_mm256_loadu_ps(local.MaxX + i), _mm256_loadu_ps(local.MaxY + i),
+                              _mm256_loadu_ps(local.MaxZ + i)};
+        __m256 min[3], max[3];
+        for (int row = 0; row < 3; ++row) {
+            min[row] = m[3][row];
+            max[row] = m[3][row];
+            for (int column = 0; column < 3; ++column) {
+                __m256 a = _mm256_mul_ps(m[column][row], lo[column]);
+                __m256 b = _mm256_mul_ps(m[column][row], hi[column]);
+                min[row] = _mm256_add_ps(min[row], _mm256_min_ps(a, b));
+                max[row] = _mm256_add_ps(max[row], _mm256_max_ps(a, b));
+            }
+        }
+        _mm256_storeu_ps(out.MinX + i, min[0]);
+        _mm256_storeu_ps(out.MinY + i, min[1]);
+        _mm256_storeu_ps(out.MinZ + i, min[2]);
+        _mm256_storeu_ps(out.MaxX + i, max[0]);
+        _mm256_storeu_ps(out.MaxY + i, max[1]);
+        _mm256_storeu_ps(out.MaxZ + i, max[2]);
+    }
+    sse2::TransformBoxes(local, world, out, i, end);
+}
+
+RG_TARGET_AVX2 inline size_t CullBoxes(const Frustum& frustum, const BoxColumns& boxes, std::uint8_t* flags,
+                                       std::uint8_t visibleBit, size_t begin, size_t end) {
+    size_t visible = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 minX = _mm256_loadu_ps(boxes.MinX + i), minY = _mm256_loadu_ps(boxes.MinY + i);
+        const __m256 minZ = _mm256_loadu_ps(boxes.MinZ + i), maxX = _mm256_loadu_ps(boxes.MaxX + i);
+        const __m256 maxY = _mm256_loadu_ps(boxes.MaxY + i), maxZ = _mm256_loadu_ps(boxes.MaxZ + i);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.Planes) {
+            __m256 px = plane.x >= 0.0f ? maxX : minX;
+            __m256 py = plane.y >= 0.0f ? maxY : minY;
+            __m256 pz = plane.z >= 0.0f ? maxZ : minZ;
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), px), _mm256_mul_ps(_mm256_set1_ps(plane.y), py));
+            d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), pz)), _mm256_set1_ps(plane.w));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        visible += sse2::applyMask(flags, i, 8, _mm256_movemask_ps(inside), visibleBit);
+    }
+    return visible + sse2::CullBoxes(frustum, boxes, flags, visibleBit, i, end);
+}
+
+RG_TARGET_AVX2 inline size_t CullSpheres(const Frustum& frustum, const SphereColumns& spheres, std::uint8_t* flags,
+                                         std::uint8_t visibleBit, size_t begin, size_t end) {
+    size_t visible = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(spheres.CenterX + i), y = _mm256_loadu_ps(spheres.CenterY + i);
+        const __m256 z = _mm256_loadu_ps(spheres.CenterZ + i);
+        const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.Radius + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.Planes) {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y));
+            d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), z)), _mm256_set1_ps(plane.w));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negRadius, _CMP_GE_OQ));
+        }
+        visible += sse2::applyMask(flags, i, 8, _mm256_movemask_ps(inside), visibleBit);
+    }
+    return visible + sse2::CullSpheres(frustum, spheres, flags, visibleBit, i, end);
+}
+
+RG_TARGET_AVX2 inline size_t SphereTouchesBoxes(const glm::vec4& sphere, const BoxColumns& boxes, std::uint8_t* flags,
+                                                std::uint8_t bit, size_t begin, size_t end) {
+    const __m256 cx = _mm256_set1_ps(sphere.x), cy = _mm256_set1_ps(sphere.y), cz = _mm256_set1_ps(sphere.z);
+    const __m256 radiusSquared = _mm256_set1_ps(sphere.w * sphere.w), zero = _mm256_setzero_ps();
+    size_t touching = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(boxes.MinX + i), cx),
+                                                _mm256_sub_ps(cx, _mm256_loadu_ps(boxes.MaxX + i))), zero);
+        __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(boxes.MinY + i), cy),
+                                                _mm256_sub_ps(cy, _mm256_loadu_ps(boxes.MaxY + i))), zero);
+        __m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(boxes.MinZ + i), cz),
+                                                _mm256_sub_ps(cz, _mm256_loadu_ps(boxes.MaxZ + i))), zero);
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        touching += sse2::applyMask(flags, i, 8, _mm256_movemask_ps(_mm256_cmp_ps(d, radiusSquared, _CMP_LE_OQ)), bit);
+    }
+    return touching + sse2::SphereTouchesBoxes(sphere, boxes, flags, bit, i, end);
+}
+
+}
+#endif
+
+// dispatch
+// ------------------------------------------------------------------------
+inline SimdLevel DetectSimdLevel() {
+#ifdef RG_BATCH_SSE
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        if (osSavesYmm && (info[1] & (1 << 5)))
+            return SimdLevel::Avx2;
+    }
+    return SimdLevel::Sse2;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#endif
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Kernels for the given level, or for the best one below it the CPU can run.
+inline const BatchKernels& GetBatchKernels(SimdLevel level) {
+    static const BatchKernels scalarKernels = {SimdLevel::Scalar, scalar::ComposeTrs, scalar::MultiplyMatrices,
+                                               scalar::TransformBoxes, scalar::CullBoxes, scalar::CullSpheres,
+                                               scalar::SphereTouchesBoxes};
+#ifdef RG_BATCH_SSE
+    static const BatchKernels sse2Kernels = {SimdLevel::Sse2, sse2::ComposeTrs, sse2::MultiplyMatrices,
+                                             sse2::TransformBoxes, sse2::CullBoxes, sse2::CullSpheres,
+                                             sse2::SphereTouchesBoxes};
+    static const BatchKernels avx2Kernels = {SimdLevel::Avx2, avx2::ComposeTrs, avx2::MultiplyMatrices,
+                                             avx2::TransformBoxes, avx2::CullBoxes, avx2::CullSpheres,
+                                             avx2::SphereTouchesBoxes};
+    static const SimdLevel supported = DetectSimdLevel();
+    if (level > supported)
+        level = supported;
+    if (level == SimdLevel::Avx2)
+        return avx2Kernels;
+    if (level == SimdLevel::Sse2)
+        return sse2Kernels;
+#endif
+    return scalarKernels;
+}
+
+// Best kernels for this CPU. RG_SIMD=scalar|sse2|avx2 in the environment caps the level, which is
+// handy for comparing paths without rebuilding.
+inline const BatchKernels& GetBatchKernels() {
+    static const BatchKernels& kernels = [] () -> const BatchKernels& {
+        SimdLevel level = SimdLevel::Avx2;
+        if (const char* forced = std::getenv("RG_SIMD")) {
+            if (std::strcmp(forced, "scalar") == 0)
+                level = SimdLevel::Scalar;
+            else if (std::strcmp(forced, "sse2") == 0)
+                level = SimdLevel::Sse2;
+        }
+        return GetBatchKernels(level);
+    }();
+    return kernels;
+}
+
+}
+
+#endif //PROJECT_BASE_BATCH_MATH_H
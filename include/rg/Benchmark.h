@@ -0,0 +1,641 @@
+#ifndef PROJECT_BASE_BENCHMARK_H
+#define PROJECT_BASE_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <rg/Bloom.h>
+#include <rg/CascadedShadows.h>
+#include <rg/DynamicResolution.h>
+#include <rg/GpuProfiler.h>
+#include <rg/Image.h>
+#include <rg/IrradianceProbes.h>
+#include <rg/Lightmap.h>
+#include <rg/Metrics.h>
+#include <rg/StressScene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Command line of the headless benchmark mode:
+//   --benchmark [--frames N] [--warmup N] [--timestep seconds] [--camera-path file] [--output file]
+//   [--budget file]
+// --camera-path takes a keyed path (see CameraPath) or a .rgcam recording (rg/CameraRecording.h).
+// With --views the fixed viewpoints of that file are rendered instead, each checked against its golden
+// image and frame cost in --golden (see CheckGoldenView), and the budget doesn't apply:
+//   [--views file] [--golden dir] [--update-golden] [--delta-e threshold] [--image-tolerance fraction]
+//   [--perf-tolerance fraction] [--perf-runs N]
+// The --stress-* options add a generated load to the scene (see StressSceneOptions); the budget is
+// written for the plain scene, so it doesn't apply to stress runs either:
+//   [--stress-instances N] [--stress-lights N] [--stress-materials N] [--stress-textures N]
+//   [--stress-seed N] [--stress-models name,name]
+// --bloom picks the bloom blur, the dual-filter chain (default) or the old full-size ping-pong:
+//   [--bloom chain|pingpong]
+// --dynamic-resolution lets the scene resolution follow the GPU frame time (see DynamicResolution),
+// holding the given GPU ms per frame with the scale between the two --resolution-* bounds:
+//   [--dynamic-resolution target_ms] [--resolution-min scale] [--resolution-max scale] [--sharpness 0..1]
+// --depth-prepass gives the opaque materials, or all of them, a depth-only pass before the lit one:
+//   [--depth-prepass none|opaque|all]
+// --shadows turns on cascaded shadow maps for the directional light with that many cascades (0 is off):
+//   [--shadows N] [--shadow-resolution texels] [--shadow-distance depth]
+// --lightmaps draws the static renderables with their baked lighting from the asset cache (see
+// rg/Lightmap.h); runs without it don't depend on what is cached:
+//   [--lightmaps]
+// --probes computes spherical-harmonics irradiance probes from the skybox and the static scene at load
+// and takes the directional light's ambient term from them (see rg/IrradianceProbes.h):
+//   [--probes] [--probe-spacing units] [--probe-rays N]
+// --oit draws the meshes whose material has a dissolve below 1 through the weighted blended
+// transparency pass; without it they are drawn opaque:
+//   [--oit]
+// In either mode, --lightmaps and --probes turn on the baked lighting and the irradiance probes (off by
+// default, both add load time), --capture-gl records the startup and the first N frames' GL calls into
+// a trace for bench/gl_replay (see rg/GlCapture.h), and --bake-lightmaps bakes the lightmaps of the
+// loaded scene into the cache before the first frame, with these settings (the ones the cache lookup uses, too):
+//   [--capture-gl file] [--capture-frames N]
+//   [--bake-lightmaps] [--lightmap-density texels_per_unit] [--lightmap-samples N] [--lightmap-bounces N]
+struct BenchmarkOptions {
+    bool Enabled = false;
+    int Frames = 600;
+    int Warmup = 60; // rendered but not measured: shader compiles, driver warm-up, first uploads
+    float Timestep = 1.0f / 60.0f;
+    std::string CameraPath = "resources/benchmark_path.txt";
+    std::string Output = "benchmark.json";
+    std::string Budget = "resources/benchmark_budget.txt"; // empty: no budget check
+    std::string Views;
+    std::string Golden = "tests/golden";
+    bool UpdateGolden = false;
+    double DeltaE = 10.0; // per pixel, on the downsampled image
+    double ImageTolerance = 0.005; // fraction of pixels allowed over DeltaE
+    double PerfTolerance = 0.3; // allowed frame cost increase over the recorded one
+    int PerfRuns = 3; // measured runs of --frames per view, the fastest one is its frame cost
+    StressSceneOptions Stress;
+    BloomMethod Bloom = BloomMethod::MipChain;
+    DynamicResolutionSettings DynamicResolution;
+    std::uint8_t DepthPrepass = 0; // DepthPrepassClass bits
+    ShadowSettings Shadows;
+    bool Lightmaps = false;
+    bool BakeLightmaps = false;
+    LightmapSettings Lightmap;
+    bool Probes = false;
+    ProbeSettings Probe;
+    bool Oit = false;
+    std::string CaptureGl; // empty: no capture
+    int CaptureFrames = 10;
+};
+
+inline bool ParseBenchmarkOptions(int argc, char** argv, BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark") {
+            options.Enabled = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.Frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && hasValue) {
+            options.Warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--timestep" && hasValue) {
+            options.Timestep = (float) std::atof(argv[++i]);
+        } else if (arg == "--camera-path" && hasValue) {
+            options.CameraPath = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.Output = argv[++i];
+        } else if (arg == "--budget" && hasValue) {
+            options.Budget = argv[++i];
+        } else if (arg == "--views" && hasValue) {
+            options.Views = argv[++i];
+        } else if (arg == "--golden" && hasValue) {
+            options.Golden = argv[++i];
+        } else if (arg == "--update-golden") {
+            options.UpdateGolden = true;
+        } else if (arg == "--delta-e" && hasValue) {
+            options.DeltaE = std::atof(argv[++i]);
+        } else if (arg == "--image-tolerance" && hasValue) {
+            options.ImageTolerance = std::atof(argv[++i]);
+        } else if (arg == "--perf-tolerance" && hasValue) {
+            options.PerfTolerance = std::atof(argv[++i]);
+        } else if (arg == "--perf-runs" && hasValue) {
+            options.PerfRuns = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--stress-instances" && hasValue) {
+            options.Stress.Instances = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--stress-lights" && hasValue) {
+            options.Stress.PointLights = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--stress-materials" && hasValue) {
+            options.Stress.MaterialCopies = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--stress-textures" && hasValue) {
+            options.Stress.TextureCopies = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--stress-seed" && hasValue) {
+            options.Stress.Seed = (unsigned int) std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--stress-models" && hasValue) {
+            options.Stress.Models = SplitNames(argv[++i]);
+        } else if (arg == "--bloom" && hasValue) {
+            if (!ParseBloomMethod(argv[++i], options.Bloom)) {
+                std::cout << "ERROR::BENCHMARK::UNKNOWN_BLOOM_METHOD " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--dynamic-resolution" && hasValue) {
+            options.DynamicResolution.Enabled = true;
+            options.DynamicResolution.TargetMs = (float) std::atof(argv[++i]);
+        } else if (arg == "--resolution-min" && hasValue) {
+            options.DynamicResolution.MinScale = (float) std::atof(argv[++i]);
+        } else if (arg == "--resolution-max" && hasValue) {
+            options.DynamicResolution.MaxScale = (float) std::atof(argv[++i]);
+        } else if (arg == "--sharpness" && hasValue) {
+            options.DynamicResolution.Sharpness = (float) std::atof(argv[++i]);
+        } else if (arg == "--depth-prepass" && hasValue) {
+            if (!ParseDepthPrepass(argv[++i], options.DepthPrepass)) {
+                std::cout << "ERROR::BENCHMARK::UNKNOWN_DEPTH_PREPASS " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--shadows" && hasValue) {
+            options.Shadows.Cascades = std::atoi(argv[++i]);
+            options.Shadows.Enabled = options.Shadows.Cascades > 0;
+        } else if (arg == "--shadow-resolution" && hasValue) {
+            options.Shadows.Resolution = std::atoi(argv[++i]);
+        } else if (arg == "--shadow-distance" && hasValue) {
+            options.Shadows.MaxDistance = (float) std::atof(argv[++i]);
+        } else if (arg == "--capture-gl" && hasValue) {
+            options.CaptureGl = argv[++i];
+        } else if (arg == "--capture-frames" && hasValue) {
+            options.CaptureFrames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--lightmaps") {
+            options.Lightmaps = true;
+        } else if (arg == "--bake-lightmaps") {
+            options.BakeLightmaps = true;
+        } else if (arg == "--lightmap-density" && hasValue) {
+            options.Lightmap.TexelsPerUnit = (float) std::atof(argv[++i]);
+        } else if (arg == "--lightmap-samples" && hasValue) {
+            options.Lightmap.Samples = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--lightmap-bounces" && hasValue) {
+            options.Lightmap.Bounces = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--oit") {
+            options.Oit = true;
+        } else if (arg == "--probes") {
+            options.Probes = true;
+        } else if (arg == "--probe-spacing" && hasValue) {
+            options.Probe.Spacing = (float) std::atof(argv[++i]);
+        } else if (arg == "--probe-rays" && hasValue) {
+            options.Probe.Rays = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cout << "ERROR::BENCHMARK::UNKNOWN_ARGUMENT " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.Timestep <= 0.0f) {
+        std::cout << "ERROR::BENCHMARK::TIMESTEP_NOT_POSITIVE" << std::endl;
+        return false;
+    }
+    const DynamicResolutionSettings& resolution = options.DynamicResolution;
+    if (resolution.Enabled && resolution.TargetMs <= 0.0f) {
+        std::cout << "ERROR::BENCHMARK::RESOLUTION_TARGET_NOT_POSITIVE" << std::endl;
+        return false;
+    }
+    // golden images are of full-size frames
+    if (resolution.Enabled && !options.Views.empty()) {
+        std::cout << "ERROR::BENCHMARK::VIEWS_WITH_DYNAMIC_RESOLUTION" << std::endl;
+        return false;
+    }
+    if (resolution.MinScale <= 0.0f || resolution.MinScale > resolution.MaxScale || resolution.MaxScale > 1.0f) {
+        std::cout << "ERROR::BENCHMARK::RESOLUTION_RANGE " << resolution.MinScale << " " << resolution.MaxScale
+                  << std::endl;
+        return false;
+    }
+    const ShadowSettings& shadows = options.Shadows;
+    if (shadows.Enabled && (shadows.Cascades > SHADOW_MAX_CASCADES || shadows.Resolution < 16
+                            || shadows.Resolution > 8192 || shadows.MaxDistance <= 0.0f)) {
+        std::cout << "ERROR::BENCHMARK::SHADOW_SETTINGS " << shadows.Cascades << " " << shadows.Resolution << " "
+                  << shadows.MaxDistance << std::endl;
+        return false;
+    }
+    if (options.Lightmap.TexelsPerUnit <= 0.0f || options.Lightmap.Bounces > 8) {
+        std::cout << "ERROR::BENCHMARK::LIGHTMAP_SETTINGS " << options.Lightmap.TexelsPerUnit << " "
+                  << options.Lightmap.Bounces << std::endl;
+        return false;
+    }
+    if (options.Probe.Spacing <= 0.0f) {
+        std::cout << "ERROR::BENCHMARK::PROBE_SPACING " << options.Probe.Spacing << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct CameraKey {
+    float Time;
+    glm::vec3 Position;
+    glm::vec3 Target;
+};
+
+// Scripted camera: keys of position and look-at point over time, Catmull-Rom interpolated so the
+// flythrough has no kinks at the keys. Before the first and after the last key the camera holds.
+class CameraPath {
+public:
+    std::vector<CameraKey> Keys;
+
+    // one key per line: <time> <position x y z> <target x y z>, times ascending, # starts a comment
+    bool LoadFromFile(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "ERROR::BENCHMARK::CAMERA_PATH_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        Keys.clear();
+        std::string line;
+        for (int number = 1; std::getline(in, line); ++number) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+            std::istringstream ls(line);
+            CameraKey key;
+            if (!(ls >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z
+                    >> key.Target.x >> key.Target.y >> key.Target.z)
+                || (!Keys.empty() && key.Time <= Keys.back().Time)) {
+                std::cout << "ERROR::BENCHMARK::CAMERA_PATH " << path << ":" << number << ": " << line << std::endl;
+                return false;
+            }
+            Keys.push_back(key);
+        }
+        if (Keys.empty()) {
+            std::cout << "ERROR::BENCHMARK::CAMERA_PATH_EMPTY " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    float Duration() const {
+        return Keys.empty() ? 0.0f : Keys.back().Time;
+    }
+
+    CameraKey Evaluate(float time) const {
+        if (Keys.size() < 2 || time <= Keys.front().Time)
+            return Keys.empty() ? CameraKey{time, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)} : Keys.front();
+        if (time >= Keys.back().Time)
+            return Keys.back();
+        size_t i = 1;
+        while (Keys[i].Time < time)
+            ++i;
+        const CameraKey& p0 = Keys[i > 1 ? i - 2 : 0];
+        const CameraKey& p1 = Keys[i - 1];
+        const CameraKey& p2 = Keys[i];
+        const CameraKey& p3 = Keys[std::min(i + 1, Keys.size() - 1)];
+        float t = (time - p1.Time) / (p2.Time - p1.Time);
+        return CameraKey{time, catmullRom(p0.Position, p1.Position, p2.Position, p3.Position, t),
+                         catmullRom(p0.Target, p1.Target, p2.Target, p3.Target, t)};
+    }
+
+private:
+    static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3,
+                                float t) {
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+                       + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+};
+
+struct TimeStats {
+    double Mean = 0.0;
+    double P50 = 0.0;
+    double P95 = 0.0;
+    double P99 = 0.0;
+    double Max = 0.0;
+};
+
+// nearest-rank percentiles
+inline TimeStats ComputeTimeStats(std::vector<double> samples) {
+    TimeStats stats;
+    if (samples.empty())
+        return stats;
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t rank = (size_t) std::ceil(p / 100.0 * samples.size());
+        return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+    double sum = 0.0;
+    for (double s : samples)
+        sum += s;
+    stats.Mean = sum / samples.size();
+    stats.P50 = percentile(50.0);
+    stats.P95 = percentile(95.0);
+    stats.P99 = percentile(99.0);
+    stats.Max = samples.back();
+    return stats;
+}
+
+// A fixed viewpoint of a golden-image run.
+struct BenchmarkView {
+    std::string Name;
+    glm::vec3 Position;
+    glm::vec3 Target;
+};
+
+// one view per line: <name> <position x y z> <target x y z>, # starts a comment
+inline bool LoadBenchmarkViews(const std::string& path, std::vector<BenchmarkView>& views) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "ERROR::BENCHMARK::VIEWS_NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    views.clear();
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream ls(line);
+        BenchmarkView view;
+        if (!(ls >> view.Name >> view.Position.x >> view.Position.y >> view.Position.z
+                >> view.Target.x >> view.Target.y >> view.Target.z)) {
+            std::cout << "ERROR::BENCHMARK::VIEWS " << path << ":" << number << ": " << line << std::endl;
+            return false;
+        }
+        views.push_back(view);
+    }
+    if (views.empty()) {
+        std::cout << "ERROR::BENCHMARK::VIEWS_EMPTY " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct ViewResult {
+    std::string Name;
+    TimeStats FrameMs;
+    double RecordedMs = 0.0; // frame cost the run is held against, 0 if there was none
+    ImageDifference Difference;
+    bool ImagePassed = true;
+    bool CostPassed = true;
+};
+
+// golden images are compared and stored at a quarter of the resolution: a sub-pixel shift of an edge
+// then moves a few percent of a pixel rather than a whole one, and the files stay small
+const int GOLDEN_DOWNSAMPLE = 4;
+
+// Frame costs of the views, "<name> <ms>" per line in <golden dir>/frame_cost.txt: the p50 of the
+// fastest of --perf-runs measured runs. Slow runs on a busy machine don't move the minimum much, a
+// regression moves every run.
+typedef std::vector<std::pair<std::string, double>> FrameCosts;
+
+inline FrameCosts LoadFrameCosts(const std::string& path) {
+    FrameCosts costs;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string name;
+        double ms;
+        if (ls >> name >> ms && name[0] != '#')
+            costs.emplace_back(name, ms);
+    }
+    return costs;
+}
+
+inline bool SaveFrameCosts(const std::string& path, const FrameCosts& costs) {
+    std::ofstream out(path);
+    out << "# frame cost in ms per golden view, p50 of the fastest run, recorded by --update-golden\n";
+    for (const auto& cost : costs)
+        out << cost.first << ' ' << cost.second << '\n';
+    if (!out) {
+        std::cout << "ERROR::BENCHMARK::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Holds a rendered view against <golden dir>/<name>.ppm and its recorded frame cost; runMs holds the
+// frame times of each measured run. A view without a golden image or frame cost fails, --update-golden
+// records both instead. A failing image is written next to the golden as <name>.actual.ppm.
+inline ViewResult CheckGoldenView(const BenchmarkOptions& options, const BenchmarkView& view, const Image& frame,
+                                  const std::vector<std::vector<double>>& runMs, FrameCosts& costs) {
+    ViewResult result;
+    result.Name = view.Name;
+    for (size_t run = 0; run < runMs.size(); ++run) {
+        TimeStats stats = ComputeTimeStats(runMs[run]);
+        if (run == 0 || stats.P50 < result.FrameMs.P50)
+            result.FrameMs = stats;
+    }
+
+    Image image = Downsample(frame, GOLDEN_DOWNSAMPLE);
+    std::string goldenPath = options.Golden + "/" + view.Name + ".ppm";
+    Image golden;
+    if (options.UpdateGolden) {
+        if (WritePpm(goldenPath, image))
+            std::cout << "golden: recorded " << goldenPath << std::endl;
+    } else if (!ReadPpm(goldenPath, golden)) {
+        std::cout << "ERROR::GOLDEN::MISSING " << goldenPath << ", record it with --update-golden" << std::endl;
+        result.ImagePassed = false;
+    } else {
+        result.Difference = CompareImages(golden, image, options.DeltaE);
+        result.ImagePassed = result.Difference.FractionOver <= options.ImageTolerance;
+        if (!result.ImagePassed) {
+            std::cout << "ERROR::GOLDEN::IMAGE " << view.Name << ": " << result.Difference.FractionOver * 100.0
+                      << "% of pixels over delta E " << options.DeltaE << " (mean " << result.Difference.MeanDeltaE
+                      << ", max " << result.Difference.MaxDeltaE << ")" << std::endl;
+            WritePpm(options.Golden + "/" + view.Name + ".actual.ppm", image);
+        }
+    }
+
+    auto recorded = std::find_if(costs.begin(), costs.end(), [&view](const std::pair<std::string, double>& cost) {
+        return cost.first == view.Name;
+    });
+    if (options.UpdateGolden) {
+        if (recorded == costs.end())
+            costs.emplace_back(view.Name, result.FrameMs.P50);
+        else
+            recorded->second = result.FrameMs.P50;
+    } else if (recorded == costs.end()) {
+        std::cout << "ERROR::GOLDEN::MISSING frame cost of " << view.Name << ", record it with --update-golden"
+                  << std::endl;
+        result.CostPassed = false;
+    } else {
+        result.RecordedMs = recorded->second;
+        result.CostPassed = result.FrameMs.P50 <= recorded->second * (1.0 + options.PerfTolerance);
+        if (!result.CostPassed)
+            std::cout << "ERROR::GOLDEN::FRAME_COST " << view.Name << ": " << result.FrameMs.P50 << " ms, recorded "
+                      << recorded->second << " ms" << std::endl;
+    }
+    return result;
+}
+
+// Everything one benchmark run measured. Values() flattens it into the keys a budget file uses:
+// "frame p95", "update p50", "gpu frame avg", "pass <name>" (GPU average), "load <stage>",
+// "render allocations".
+struct BenchmarkReport {
+    std::string Context; // how the GL context was created
+    std::string Renderer; // GL_RENDERER
+    int Frames = 0;
+    int Warmup = 0;
+    float Timestep = 0.0f;
+    TimeStats FrameMs; // between consecutive frames handed to the render thread
+    TimeStats UpdateMs; // main thread work per frame
+    GpuProfile Gpu;
+    std::vector<std::pair<std::string, double>> LoadMs; // in order, "total" last
+    std::vector<metrics::MetricSample> Metrics;
+    std::vector<ViewResult> Views; // golden-image runs only
+    StressSceneOptions Stress;
+    BloomMethod Bloom = BloomMethod::MipChain;
+    DynamicResolutionSettings DynamicResolution;
+    std::uint8_t DepthPrepass = 0;
+    ShadowSettings Shadows;
+    int LightmapInstances = 0; // static renderables drawn from the lightmap, 0 without lightmaps
+    int Probes = 0; // irradiance probes, 0 without them
+    bool Oit = false;
+    // most operator new calls of one measured frame on the render thread, 0 unless the app is built with
+    // RG_COUNT_ALLOCATIONS
+    std::uint64_t RenderAllocations = 0;
+    // what was rendered, after the stress load was added
+    size_t Renderables = 0;
+    size_t Lights = 0;
+    size_t Materials = 0;
+    size_t Models = 0;
+    size_t Textures = 0;
+
+    std::vector<std::pair<std::string, double>> Values() const {
+        std::vector<std::pair<std::string, double>> values = {
+                {"frame mean", FrameMs.Mean}, {"frame p50", FrameMs.P50}, {"frame p95", FrameMs.P95},
+                {"frame p99", FrameMs.P99}, {"frame max", FrameMs.Max},
+                {"update mean", UpdateMs.Mean}, {"update p50", UpdateMs.P50}, {"update p95", UpdateMs.P95},
+                {"update p99", UpdateMs.P99}, {"update max", UpdateMs.Max},
+                {"gpu frame avg", Gpu.Frame.AverageMs}, {"gpu frame max", Gpu.Frame.MaxMs},
+                {"render allocations", (double) RenderAllocations}};
+        for (const GpuPassStats& pass : Gpu.Passes)
+            values.emplace_back(std::string("pass ") + pass.Name, pass.AverageMs);
+        for (const auto& load : LoadMs)
+            values.emplace_back("load " + load.first, load.second);
+        return values;
+    }
+
+    bool WriteJson(const std::string& path) const {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::cout << "ERROR::BENCHMARK::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        std::fprintf(file, "{\n  \"context\": \"%s\",\n  \"renderer\": ", Context.c_str());
+        writeString(file, Renderer);
+        std::fprintf(file, ",\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"timestep\": %g,\n", Frames, Warmup, Timestep);
+        std::fprintf(file, "  \"bloom\": \"%s\",\n", BloomMethodName(Bloom));
+        std::fprintf(file, "  \"dynamic_resolution\": {\"enabled\": %s, \"target_ms\": %g, \"min_scale\": %g, "
+                           "\"max_scale\": %g, \"sharpness\": %g},\n", DynamicResolution.Enabled ? "true" : "false",
+                     DynamicResolution.TargetMs, DynamicResolution.MinScale, DynamicResolution.MaxScale,
+                     DynamicResolution.Sharpness);
+        std::fprintf(file, "  \"depth_prepass\": \"%s\",\n", DepthPrepassName(DepthPrepass));
+        std::fprintf(file, "  \"shadows\": {\"cascades\": %d, \"resolution\": %d, \"distance\": %g},\n",
+                     Shadows.Enabled ? Shadows.Cascades : 0, ShadowResolution(Shadows), Shadows.MaxDistance);
+        std::fprintf(file, "  \"lightmaps\": {\"instances\": %d},\n", LightmapInstances);
+        std::fprintf(file, "  \"probes\": {\"count\": %d},\n", Probes);
+        std::fprintf(file, "  \"oit\": %s,\n", Oit ? "true" : "false");
+        std::fprintf(file, "  \"render_allocations\": %llu,\n", (unsigned long long) RenderAllocations);
+        std::fprintf(file, "  \"scene\": {\"renderables\": %zu, \"lights\": %zu, \"materials\": %zu, \"models\": %zu, "
+                           "\"textures\": %zu},\n", Renderables, Lights, Materials, Models, Textures);
+        std::fprintf(file, "  \"stress\": {\"instances\": %d, \"lights\": %d, \"materials\": %d, \"textures\": %d, "
+                           "\"seed\": %u},\n", Stress.Instances, Stress.PointLights, Stress.MaterialCopies,
+                     Stress.TextureCopies, Stress.Seed);
+        writeStats(file, "frame_ms", FrameMs);
+        writeStats(file, "update_ms", UpdateMs);
+        std::fprintf(file, "  \"gpu_frame_ms\": {\"avg\": %.4f, \"min\": %.4f, \"max\": %.4f, \"dropped\": %llu},\n",
+                     Gpu.Frame.AverageMs, Gpu.Frame.MinMs, Gpu.Frame.MaxMs, (unsigned long long) Gpu.DroppedFrames);
+        std::fprintf(file, "  \"passes\": [");
+        for (size_t i = 0; i < Gpu.Passes.size(); ++i) {
+            const GpuPassStats& pass = Gpu.Passes[i];
+            std::fprintf(file, "%s\n    {\"name\": ", i ? "," : "");
+            writeString(file, pass.Name);
+            std::fprintf(file, ", \"depth\": %d, \"avg_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f}", pass.Depth,
+                         pass.AverageMs, pass.MinMs, pass.MaxMs);
+        }
+        std::fprintf(file, "\n  ],\n  \"load_ms\": {");
+        for (size_t i = 0; i < LoadMs.size(); ++i) {
+            std::fprintf(file, "%s", i ? ", " : "");
+            writeString(file, LoadMs[i].first);
+            std::fprintf(file, ": %.3f", LoadMs[i].second);
+        }
+        std::fprintf(file, "},\n  \"last_frame\": {");
+        for (size_t i = 0; i < Metrics.size(); ++i) {
+            std::fprintf(file, "%s", i ? ", " : "");
+            writeString(file, Metrics[i].Name);
+            std::fprintf(file, ": %lld", (long long) Metrics[i].LastFrame);
+        }
+        std::fprintf(file, "},\n  \"views\": [");
+        for (size_t i = 0; i < Views.size(); ++i) {
+            const ViewResult& view = Views[i];
+            std::fprintf(file, "%s\n    {\"name\": ", i ? "," : "");
+            writeString(file, view.Name);
+            std::fprintf(file, ", \"frame_p50_ms\": %.4f, \"frame_p95_ms\": %.4f, \"recorded_ms\": %.4f, "
+                               "\"mean_delta_e\": %.4f, \"max_delta_e\": %.4f, \"fraction_over\": %.6f, "
+                               "\"image_passed\": %s, \"cost_passed\": %s}",
+                         view.FrameMs.P50, view.FrameMs.P95, view.RecordedMs, view.Difference.MeanDeltaE,
+                         view.Difference.MaxDeltaE, view.Difference.FractionOver, view.ImagePassed ? "true" : "false",
+                         view.CostPassed ? "true" : "false");
+        }
+        std::fprintf(file, "%s]\n}\n", Views.empty() ? "" : "\n  ");
+        std::fclose(file);
+        return true;
+    }
+
+private:
+    static void writeString(std::FILE* file, const std::string& s) {
+        std::fputc('"', file);
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                std::fputc('\\', file);
+            if ((unsigned char) c >= 0x20)
+                std::fputc(c, file);
+        }
+        std::fputc('"', file);
+    }
+
+    static void writeStats(std::FILE* file, const char* name, const TimeStats& stats) {
+        std::fprintf(file, "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+                     name, stats.Mean, stats.P50, stats.P95, stats.P99, stats.Max);
+    }
+};
+
+// Budget file: one "<key> <limit in ms>" per line, keys as in BenchmarkReport::Values (they may contain
+// spaces, the limit is the last word). Prints every key over its limit and every key the report doesn't
+// have, so a renamed pass can't quietly drop out of the check; returns false if there was any.
+inline bool CheckBudget(const std::string& path, const BenchmarkReport& report) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "ERROR::BENCHMARK::BUDGET_NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    std::vector<std::pair<std::string, double>> values = report.Values();
+    bool withinBudget = true;
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        size_t split = line.find_last_of(" \t", last);
+        char* end = nullptr;
+        double limit = split == std::string::npos ? 0.0 : std::strtod(line.c_str() + split + 1, &end);
+        if (split == std::string::npos || split < first || end != line.c_str() + last + 1) {
+            std::cout << "ERROR::BENCHMARK::BUDGET " << path << ":" << number << ": " << line << std::endl;
+            withinBudget = false;
+            continue;
+        }
+        std::string key = line.substr(first, line.find_last_not_of(" \t", split) + 1 - first);
+        auto found = std::find_if(values.begin(), values.end(), [&key](const std::pair<std::string, double>& v) {
+            return v.first == key;
+        });
+        if (found == values.end()) {
+            std::cout << "ERROR::BENCHMARK::BUDGET_UNKNOWN_KEY " << key << std::endl;
+            withinBudget = false;
+        } else if (found->second > limit) {
+            std::cout << "ERROR::BENCHMARK::OVER_BUDGET " << key << ": " << found->second << " ms, budget " << limit
+                      << " ms" << std::endl;
+            withinBudget = false;
+        }
+    }
+    return withinBudget;
+}
+
+}
+
+#endif //PROJECT_BASE_BENCHMARK_H
@@ -0,0 +1,109 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <limits>
+
+namespace rg {
+
+struct Aabb {
+    glm::vec3 Min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 Max = glm::vec3(-std::numeric_limits<float>::max());
+
+    Aabb() = default;
+    Aabb(const glm::vec3& min, const glm::vec3& max) : Min(min), Max(max) {}
+
+    bool IsEmpty() const {
+        return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z;
+    }
+    glm::vec3 Center() const {
+        return (Min + Max) * 0.5f;
+    }
+    glm::vec3 Extent() const {
+        return Max - Min;
+    }
+    // half of the surface area, all the SAH cost needs
+    float HalfArea() const {
+        glm::vec3 e = Extent();
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+    void Grow(const glm::vec3& p) {
+        Min = glm::min(Min, p);
+        Max = glm::max(Max, p);
+    }
+    void Grow(const Aabb& b) {
+        Min = glm::min(Min, b.Min);
+        Max = glm::max(Max, b.Max);
+    }
+    bool Overlaps(const Aabb& b) const {
+        return Min.x <= b.Max.x && Max.x >= b.Min.x
+            && Min.y <= b.Max.y && Max.y >= b.Min.y
+            && Min.z <= b.Max.z && Max.z >= b.Min.z;
+    }
+    float DistanceSquared(const glm::vec3& p) const {
+        glm::vec3 d = glm::max(glm::max(Min - p, p - Max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+};
+
+// Transforms a box by an affine matrix and returns the box around the result (Arvo's method).
+inline Aabb TransformAabb(const Aabb& box, const glm::mat4& m) {
+    glm::vec3 min(m[3]);
+    glm::vec3 max(m[3]);
+    for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+            float a = m[col][row] * box.Min[col];
+            float b = m[col][row] * box.Max[col];
+            min[row] += a < b ? a : b;
+            max[row] += a < b ? b : a;
+        }
+    }
+    return Aabb(min, max);
+}
+
+// Six planes (xyz = inward normal, w = distance) extracted from a projection * view matrix.
+struct Frustum {
+    enum { Left, Right, Bottom, Top, Near, Far };
+    glm::vec4 Planes[6];
+
+    Frustum() = default;
+    explicit Frustum(const glm::mat4& viewProjection) {
+        const glm::mat4& m = viewProjection;
+        for (int i = 0; i < 3; ++i) {
+            glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+            glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+            Planes[i * 2 + 0] = w + row;
+            Planes[i * 2 + 1] = w - row;
+        }
+        for (glm::vec4& plane : Planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+
+    bool IntersectsAabb(const glm::vec3& min, const glm::vec3& max) const {
+        for (const glm::vec4& plane : Planes) {
+            // the box corner furthest along the plane normal
+            glm::vec3 p(plane.x >= 0.0f ? max.x : min.x,
+                        plane.y >= 0.0f ? max.y : min.y,
+                        plane.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+    bool IntersectsAabb(const Aabb& box) const {
+        return IntersectsAabb(box.Min, box.Max);
+    }
+    bool IntersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : Planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BOUNDS_H
@@ -0,0 +1,682 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RG_BVH_SSE 1
+#endif
+
+namespace rg {
+
+struct Ray {
+    glm::vec3 Origin = glm::vec3(0.0f);
+    glm::vec3 Direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    float TMax = std::numeric_limits<float>::max();
+
+    Ray() = default;
+    Ray(const glm::vec3& origin, const glm::vec3& direction, float tMax = std::numeric_limits<float>::max())
+            : Origin(origin), Direction(direction), TMax(tMax) {}
+};
+
+struct TriangleHit {
+    float T = std::numeric_limits<float>::max();
+    float U = 0.0f, V = 0.0f;
+    std::uint32_t Triangle = 0;
+};
+
+// Four children per node with their boxes stored as SoA so one SSE slab test covers the whole node.
+struct alignas(16) BvhNode4 {
+    float MinX[4], MinY[4], MinZ[4];
+    float MaxX[4], MaxY[4], MaxZ[4];
+    // >= 0: index of an inner node, < 0: leaf whose payload is ~Child
+    std::int32_t Child[4];
+    // primitives in a leaf, 0 for inner nodes and unused slots
+    std::uint32_t Count[4];
+
+    bool IsLeaf(int slot) const {
+        return Child[slot] < 0;
+    }
+    bool IsEmpty(int slot) const {
+        return Child[slot] < 0 && Count[slot] == 0;
+    }
+    void SetBounds(int slot, const Aabb& box) {
+        MinX[slot] = box.Min.x; MinY[slot] = box.Min.y; MinZ[slot] = box.Min.z;
+        MaxX[slot] = box.Max.x; MaxY[slot] = box.Max.y; MaxZ[slot] = box.Max.z;
+    }
+    Aabb Bounds(int slot) const {
+        return Aabb(glm::vec3(MinX[slot], MinY[slot], MinZ[slot]), glm::vec3(MaxX[slot], MaxY[slot], MaxZ[slot]));
+    }
+};
+
+// Ray with the reciprocal direction cached for slab tests.
+struct RayPacket1 {
+    glm::vec3 Origin;
+    glm::vec3 InvDirection;
+
+    explicit RayPacket1(const Ray& ray) : Origin(ray.Origin) {
+        for (int i = 0; i < 3; ++i) {
+            float d = ray.Direction[i];
+            InvDirection[i] = 1.0f / (std::fabs(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+        }
+    }
+};
+
+// Returns a bitmask of the children hit within [0, tMax] and writes their entry distances.
+inline int IntersectNode4Scalar(const BvhNode4& n, const RayPacket1& r, float tMax, float tNear[4]) {
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        float tx1 = (n.MinX[i] - r.Origin.x) * r.InvDirection.x, tx2 = (n.MaxX[i] - r.Origin.x) * r.InvDirection.x;
+        float ty1 = (n.MinY[i] - r.Origin.y) * r.InvDirection.y, ty2 = (n.MaxY[i] - r.Origin.y) * r.InvDirection.y;
+        float tz1 = (n.MinZ[i] - r.Origin.z) * r.InvDirection.z, tz2 = (n.MaxZ[i] - r.Origin.z) * r.InvDirection.z;
+        float t0 = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+        float t1 = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), tMax));
+        tNear[i] = t0;
+        if (t0 <= t1)
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+#ifdef RG_BVH_SSE
+inline int IntersectNode4Sse(const BvhNode4& n, const RayPacket1& r, float tMax, float tNear[4]) {
+    const __m128 ox = _mm_set1_ps(r.Origin.x), oy = _mm_set1_ps(r.Origin.y), oz = _mm_set1_ps(r.Origin.z);
+    const __m128 ix = _mm_set1_ps(r.InvDirection.x), iy = _mm_set1_ps(r.InvDirection.y), iz = _mm_set1_ps(r.InvDirection.z);
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MinX), ox), ix);
+    __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MaxX), ox), ix);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MinY), oy), iy);
+    __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MaxY), oy), iy);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MinZ), oz), iz);
+    __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.MaxZ), oz), iz);
+    __m128 t0 = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+                           _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_setzero_ps()));
+    __m128 t1 = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+                           _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_set1_ps(tMax)));
+    _mm_storeu_ps(tNear, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+inline int IntersectNode4(const BvhNode4& n, const RayPacket1& r, float tMax, float tNear[4]) {
+#ifdef RG_BVH_SSE
+    return IntersectNode4Sse(n, r, tMax, tNear);
+#else
+    return IntersectNode4Scalar(n, r, tMax, tNear);
+#endif
+}
+
+// Four triangles in SoA form (first vertex plus two edges), tested together by one Moller-Trumbore pass.
+// Unused lanes are zero, which gives a zero determinant and never hits.
+struct alignas(16) Triangle4 {
+    float V0X[4], V0Y[4], V0Z[4];
+    float E1X[4], E1Y[4], E1Z[4];
+    float E2X[4], E2Y[4], E2Z[4];
+    std::uint32_t Id[4];
+};
+
+inline bool IntersectTriangle4Scalar(const Triangle4& tri, const Ray& ray, float tMax, TriangleHit& hit) {
+    bool found = false;
+    for (int i = 0; i < 4; ++i) {
+        glm::vec3 e1(tri.E1X[i], tri.E1Y[i], tri.E1Z[i]);
+        glm::vec3 e2(tri.E2X[i], tri.E2Y[i], tri.E2Z[i]);
+        glm::vec3 p = glm::cross(ray.Direction, e2);
+        float det = glm::dot(e1, p);
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        float invDet = 1.0f / det;
+        glm::vec3 s = ray.Origin - glm::vec3(tri.V0X[i], tri.V0Y[i], tri.V0Z[i]);
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            continue;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(ray.Direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            continue;
+        float t = glm::dot(e2, q) * invDet;
+        if (t > 1e-6f && t < tMax) {
+            tMax = t;
+            hit.T = t;
+            hit.U = u;
+            hit.V = v;
+            hit.Triangle = tri.Id[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+#ifdef RG_BVH_SSE
+inline bool IntersectTriangle4Sse(const Triangle4& tri, const Ray& ray, float tMax, TriangleHit& hit) {
+    const __m128 dx = _mm_set1_ps(ray.Direction.x), dy = _mm_set1_ps(ray.Direction.y), dz = _mm_set1_ps(ray.Direction.z);
+    const __m128 e1x = _mm_load_ps(tri.E1X), e1y = _mm_load_ps(tri.E1Y), e1z = _mm_load_ps(tri.E1Z);
+    const __m128 e2x = _mm_load_ps(tri.E2X), e2y = _mm_load_ps(tri.E2Y), e2z = _mm_load_ps(tri.E2Z);
+    // p = d x e2
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 valid = _mm_cmpge_ps(absDet, _mm_set1_ps(1e-12f));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    // s = o - v0
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.Origin.x), _mm_load_ps(tri.V0X));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.Origin.y), _mm_load_ps(tri.V0Y));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.Origin.z), _mm_load_ps(tri.V0Z));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+    // q = s x e1
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(1e-6f)));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+    int mask = _mm_movemask_ps(valid);
+    if (!mask)
+        return false;
+    alignas(16) float ts[4], us[4], vs[4];
+    _mm_store_ps(ts, t);
+    _mm_store_ps(us, u);
+    _mm_store_ps(vs, v);
+    int best = -1;
+    for (int i = 0; i < 4; ++i) {
+        if ((mask & (1 << i)) && ts[i] < tMax) {
+            tMax = ts[i];
+            best = i;
+        }
+    }
+    hit.T = ts[best];
+    hit.U = us[best];
+    hit.V = vs[best];
+    hit.Triangle = tri.Id[best];
+    return true;
+}
+#endif
+
+inline bool IntersectTriangle4(const Triangle4& tri, const Ray& ray, float tMax, TriangleHit& hit) {
+#ifdef RG_BVH_SSE
+    return IntersectTriangle4Sse(tri, ray, tMax, hit);
+#else
+    return IntersectTriangle4Scalar(tri, ray, tMax, hit);
+#endif
+}
+
+// Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5).
+inline glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Traversal stack of Bvh4: nodes to visit with their entry distance. STACK_SIZE entries live on the
+// C++ stack, a tree deep enough to need more spills the rest to the heap rather than losing nodes.
+class BvhStack {
+public:
+    static const int STACK_SIZE = 128;
+
+    struct Entry {
+        std::int32_t Node;
+        float Key;
+    };
+
+    bool Empty() const {
+        return m_Top == 0;
+    }
+
+    void Push(std::int32_t node, float key) {
+        if (m_Top < STACK_SIZE)
+            m_Inline[m_Top] = Entry{node, key};
+        else
+            m_Spill.push_back(Entry{node, key});
+        ++m_Top;
+    }
+
+    Entry Pop() {
+        if (--m_Top < STACK_SIZE)
+            return m_Inline[m_Top];
+        Entry entry = m_Spill.back();
+        m_Spill.pop_back();
+        return entry;
+    }
+
+private:
+    Entry m_Inline[STACK_SIZE];
+    std::vector<Entry> m_Spill; // entries past STACK_SIZE
+    int m_Top = 0;
+};
+
+// Bounding volume hierarchy with four children per node. Built top-down with binned SAH as a binary
+// tree, then collapsed so each node holds the best four subtrees. Nodes are stored parent-first,
+// which lets Refit walk them backwards.
+class Bvh4 {
+public:
+    std::vector<BvhNode4> Nodes;
+    // leaf payloads are ranges into this array of primitive ids
+    std::vector<std::uint32_t> Primitives;
+
+    bool Empty() const {
+        return Nodes.empty();
+    }
+
+    void Build(const std::vector<Aabb>& boxes, unsigned int maxLeafSize) {
+        Nodes.clear();
+        Primitives.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+            Primitives[i] = (std::uint32_t) i;
+        if (boxes.empty())
+            return;
+        std::vector<glm::vec3> centroids(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+            centroids[i] = boxes[i].Center();
+        std::vector<BinaryNode> binary;
+        binary.reserve(boxes.size() * 2);
+        binary.push_back(BinaryNode());
+        buildBinary(binary, 0, 0, (std::uint32_t) boxes.size(), boxes, centroids, std::max(1u, maxLeafSize));
+        Nodes.reserve(binary.size() / 2 + 1);
+        collapse(binary, 0);
+    }
+
+    // Recomputes node bounds after primitives moved; the topology stays the same.
+    void Refit(const std::vector<Aabb>& boxes) {
+        for (size_t n = Nodes.size(); n-- > 0;) {
+            BvhNode4& node = Nodes[n];
+            for (int slot = 0; slot < 4; ++slot) {
+                if (node.IsEmpty(slot))
+                    continue;
+                Aabb box;
+                if (node.IsLeaf(slot)) {
+                    std::uint32_t first = ~node.Child[slot];
+                    for (std::uint32_t i = 0; i < node.Count[slot]; ++i)
+                        box.Grow(boxes[Primitives[first + i]]);
+                } else {
+                    const BvhNode4& child = Nodes[node.Child[slot]];
+                    for (int c = 0; c < 4; ++c) {
+                        if (!child.IsEmpty(c))
+                            box.Grow(child.Bounds(c));
+                    }
+                }
+                node.SetBounds(slot, box);
+            }
+        }
+    }
+
+    // Closest-hit traversal. leafFn(first, count, tMax) tests the leaf and returns the new tMax.
+    // Children are visited near to far so tMax shrinks early.
+    template<typename LeafFn>
+    float Traverse(const Ray& ray, LeafFn&& leafFn, bool simd = true) const {
+        float tMax = ray.TMax;
+        if (Nodes.empty())
+            return tMax;
+        RayPacket1 packet(ray);
+        BvhStack stack;
+        stack.Push(0, 0.0f);
+        while (!stack.Empty()) {
+            BvhStack::Entry entry = stack.Pop();
+            if (entry.Key > tMax)
+                continue;
+            const BvhNode4& node = Nodes[entry.Node];
+            float tNear[4];
+            int mask = simd ? IntersectNode4(node, packet, tMax, tNear) : IntersectNode4Scalar(node, packet, tMax, tNear);
+            // sort hit children near to far: leaves are tested nearest first, inner nodes are pushed
+            // farthest first so the nearest one is popped next
+            int order[4], count = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (!(mask & (1 << i)) || node.IsEmpty(i))
+                    continue;
+                int j = count++;
+                while (j > 0 && tNear[order[j - 1]] > tNear[i]) {
+                    order[j] = order[j - 1];
+                    --j;
+                }
+                order[j] = i;
+            }
+            for (int k = 0; k < count; ++k) {
+                int i = order[k];
+                if (node.IsLeaf(i) && tNear[i] <= tMax)
+                    tMax = std::min(tMax, leafFn(~node.Child[i], node.Count[i], tMax));
+            }
+            for (int k = count; k-- > 0;) {
+                int i = order[k];
+                if (!node.IsLeaf(i) && tNear[i] <= tMax)
+                    stack.Push(node.Child[i], tNear[i]);
+            }
+        }
+        return tMax;
+    }
+
+    // Visits every leaf whose path passes boxTest(Aabb). leafFn(first, count).
+    template<typename BoxTest, typename LeafFn>
+    void Query(BoxTest&& boxTest, LeafFn&& leafFn) const {
+        if (Nodes.empty())
+            return;
+        BvhStack stack;
+        stack.Push(0, 0.0f);
+        while (!stack.Empty()) {
+            const BvhNode4& node = Nodes[stack.Pop().Node];
+            for (int i = 0; i < 4; ++i) {
+                if (node.IsEmpty(i) || !boxTest(node.Bounds(i)))
+                    continue;
+                if (node.IsLeaf(i))
+                    leafFn(~node.Child[i], node.Count[i]);
+                else
+                    stack.Push(node.Child[i], 0.0f);
+            }
+        }
+    }
+
+    // Best-first search for the closest primitive. distanceFn(Aabb) is a lower bound on the distance
+    // to anything inside the box, leafFn(first, count, best) returns the new best distance.
+    template<typename DistanceFn, typename LeafFn>
+    float Nearest(float best, DistanceFn&& distanceFn, LeafFn&& leafFn) const {
+        if (Nodes.empty())
+            return best;
+        BvhStack stack;
+        stack.Push(0, 0.0f);
+        while (!stack.Empty()) {
+            BvhStack::Entry entry = stack.Pop();
+            if (entry.Key >= best)
+                continue;
+            const BvhNode4& node = Nodes[entry.Node];
+            int order[4], count = 0;
+            float d[4];
+            for (int i = 0; i < 4; ++i) {
+                if (node.IsEmpty(i))
+                    continue;
+                d[i] = distanceFn(node.Bounds(i));
+                if (d[i] >= best)
+                    continue;
+                int j = count++;
+                while (j > 0 && d[order[j - 1]] > d[i]) {
+                    order[j] = order[j - 1];
+                    --j;
+                }
+                order[j] = i;
+            }
+            for (int k = 0; k < count; ++k) {
+                int i = order[k];
+                if (node.IsLeaf(i) && d[i] < best)
+                    best = std::min(best, leafFn(~node.Child[i], node.Count[i], best));
+            }
+            for (int k = count; k-- > 0;) {
+                int i = order[k];
+                if (!node.IsLeaf(i) && d[i] < best)
+                    stack.Push(node.Child[i], d[i]);
+            }
+        }
+        return best;
+    }
+
+private:
+    struct BinaryNode {
+        Aabb Bounds;
+        std::int32_t Left = -1, Right = -1;
+        std::uint32_t First = 0, Count = 0;
+    };
+    static const int NR_BINS = 16;
+
+    void buildBinary(std::vector<BinaryNode>& nodes, std::int32_t index, std::uint32_t first, std::uint32_t count,
+                     const std::vector<Aabb>& boxes, const std::vector<glm::vec3>& centroids, unsigned int maxLeafSize) {
+        Aabb bounds, centroidBounds;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            bounds.Grow(boxes[Primitives[i]]);
+            centroidBounds.Grow(centroids[Primitives[i]]);
+        }
+        nodes[index].Bounds = bounds;
+        nodes[index].First = first;
+        nodes[index].Count = count;
+        if (count == 1)
+            return;
+
+        // binned SAH over the axis with the widest centroid spread and the other two
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        glm::vec3 extent = centroidBounds.Extent();
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 1e-12f)
+                continue;
+            Aabb binBounds[NR_BINS];
+            std::uint32_t binCount[NR_BINS] = {};
+            float scale = NR_BINS / extent[axis];
+            for (std::uint32_t i = first; i < first + count; ++i) {
+                int b = std::min(NR_BINS - 1, (int) ((centroids[Primitives[i]][axis] - centroidBounds.Min[axis]) * scale));
+                binBounds[b].Grow(boxes[Primitives[i]]);
+                ++binCount[b];
+            }
+            float rightArea[NR_BINS];
+            std::uint32_t rightCount[NR_BINS];
+            Aabb acc;
+            std::uint32_t n = 0;
+            for (int b = NR_BINS - 1; b > 0; --b) {
+                acc.Grow(binBounds[b]);
+                n += binCount[b];
+                rightArea[b] = acc.IsEmpty() ? 0.0f : acc.HalfArea();
+                rightCount[b] = n;
+            }
+            acc = Aabb();
+            n = 0;
+            for (int b = 0; b < NR_BINS - 1; ++b) {
+                acc.Grow(binBounds[b]);
+                n += binCount[b];
+                if (n == 0 || rightCount[b + 1] == 0)
+                    continue;
+                float cost = acc.HalfArea() * n + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float leafCost = bounds.HalfArea() * count;
+        // relative traversal cost of one extra node
+        float splitCost = bestCost + bounds.HalfArea();
+        if (count <= maxLeafSize && (bestAxis < 0 || splitCost >= leafCost))
+            return;
+
+        std::uint32_t mid;
+        if (bestAxis >= 0) {
+            float scale = NR_BINS / extent[bestAxis];
+            float minC = centroidBounds.Min[bestAxis];
+            std::uint32_t* split = std::partition(&Primitives[first], &Primitives[first] + count, [&](std::uint32_t p) {
+                return std::min(NR_BINS - 1, (int) ((centroids[p][bestAxis] - minC) * scale)) <= bestSplit;
+            });
+            mid = (std::uint32_t) (split - &Primitives[0]);
+        } else {
+            // every centroid in the same spot, split in half to keep leaves small
+            mid = first + count / 2;
+        }
+        if (mid == first || mid == first + count)
+            mid = first + count / 2;
+
+        std::int32_t left = (std::int32_t) nodes.size();
+        nodes.push_back(BinaryNode());
+        nodes.push_back(BinaryNode());
+        nodes[index].Left = left;
+        nodes[index].Right = left + 1;
+        buildBinary(nodes, left, first, mid - first, boxes, centroids, maxLeafSize);
+        buildBinary(nodes, left + 1, mid, first + count - mid, boxes, centroids, maxLeafSize);
+    }
+
+    std::int32_t collapse(const std::vector<BinaryNode>& binary, std::int32_t index) {
+        std::int32_t children[4];
+        int count = 0;
+        if (binary[index].Left < 0) {
+            children[count++] = index;
+        } else {
+            children[count++] = binary[index].Left;
+            children[count++] = binary[index].Right;
+        }
+        // open the largest inner child until the node is full
+        while (count < 4) {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (int i = 0; i < count; ++i) {
+                const BinaryNode& c = binary[children[i]];
+                if (c.Left >= 0 && c.Bounds.HalfArea() > bestArea) {
+                    bestArea = c.Bounds.HalfArea();
+                    best = i;
+                }
+            }
+            if (best < 0)
+                break;
+            std::int32_t opened = children[best];
+            children[best] = binary[opened].Left;
+            children[count++] = binary[opened].Right;
+        }
+
+        std::int32_t nodeIndex = (std::int32_t) Nodes.size();
+        Nodes.push_back(BvhNode4());
+        for (int i = 0; i < 4; ++i) {
+            BvhNode4& node = Nodes[nodeIndex];
+            if (i >= count) {
+                node.SetBounds(i, Aabb());
+                node.Child[i] = -1;
+                node.Count[i] = 0;
+                continue;
+            }
+            const BinaryNode& c = binary[children[i]];
+            node.SetBounds(i, c.Bounds);
+            if (c.Left < 0) {
+                node.Child[i] = ~(std::int32_t) c.First;
+                node.Count[i] = c.Count;
+            } else {
+                std::int32_t child = collapse(binary, children[i]);
+                Nodes[nodeIndex].Child[i] = child;
+                Nodes[nodeIndex].Count[i] = 0;
+            }
+        }
+        return nodeIndex;
+    }
+};
+
+// Triangle BVH for one mesh in its local space. Leaves hold up to four triangles, packed into one
+// Triangle4 each so a leaf costs a single SIMD intersection.
+class MeshBvh {
+public:
+    Bvh4 Tree;
+    std::vector<Triangle4> Leaves;
+    std::vector<glm::vec3> Corners; // three per triangle, for normals and nearest point queries
+
+    size_t TriangleCount() const {
+        return Corners.size() / 3;
+    }
+
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<std::uint32_t>& indices) {
+        size_t nrTriangles = indices.size() / 3;
+        Corners.resize(nrTriangles * 3);
+        std::vector<Aabb> boxes(nrTriangles);
+        for (size_t t = 0; t < nrTriangles; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                Corners[t * 3 + k] = positions[indices[t * 3 + k]];
+                boxes[t].Grow(Corners[t * 3 + k]);
+            }
+        }
+        Tree.Build(boxes, 4);
+        // turn every leaf range into a packed Triangle4 and point the leaf at it
+        Leaves.clear();
+        for (BvhNode4& node : Tree.Nodes) {
+            for (int slot = 0; slot < 4; ++slot) {
+                if (!node.IsLeaf(slot) || node.IsEmpty(slot))
+                    continue;
+                std::uint32_t first = ~node.Child[slot];
+                Triangle4 packed = {};
+                for (std::uint32_t i = 0; i < node.Count[slot]; ++i) {
+                    std::uint32_t t = Tree.Primitives[first + i];
+                    glm::vec3 a = Corners[t * 3], e1 = Corners[t * 3 + 1] - a, e2 = Corners[t * 3 + 2] - a;
+                    packed.V0X[i] = a.x; packed.V0Y[i] = a.y; packed.V0Z[i] = a.z;
+                    packed.E1X[i] = e1.x; packed.E1Y[i] = e1.y; packed.E1Z[i] = e1.z;
+                    packed.E2X[i] = e2.x; packed.E2Y[i] = e2.y; packed.E2Z[i] = e2.z;
+                    packed.Id[i] = t;
+                }
+                node.Child[slot] = ~(std::int32_t) Leaves.size();
+                Leaves.push_back(packed);
+            }
+        }
+    }
+
+    bool Intersect(const Ray& ray, TriangleHit& hit, bool simd = true) const {
+        bool found = false;
+        Tree.Traverse(ray, [&](std::uint32_t leaf, std::uint32_t, float tMax) {
+            TriangleHit h;
+            bool ok = simd ? IntersectTriangle4(Leaves[leaf], ray, tMax, h)
+                           : IntersectTriangle4Scalar(Leaves[leaf], ray, tMax, h);
+            if (!ok)
+                return tMax;
+            hit = h;
+            found = true;
+            return h.T;
+        }, simd);
+        return found;
+    }
+
+    bool IntersectScalar(const Ray& ray, TriangleHit& hit) const {
+        return Intersect(ray, hit, false);
+    }
+
+    glm::vec3 TriangleNormal(std::uint32_t t) const {
+        return glm::normalize(glm::cross(Corners[t * 3 + 1] - Corners[t * 3], Corners[t * 3 + 2] - Corners[t * 3]));
+    }
+
+    // Nearest point to p, searched in mesh space but measured in world space through toWorld.
+    // minScale is the smallest scale factor of toWorld, it turns mesh-space box distances into
+    // world-space lower bounds. Returns the new best squared world distance.
+    float NearestPoint(const glm::vec3& p, const glm::mat4& toWorld, float minScale, float bestDistanceSquared,
+                       glm::vec3& bestPoint) const {
+        glm::vec3 worldP(toWorld * glm::vec4(p, 1.0f));
+        float scale2 = minScale * minScale;
+        return Tree.Nearest(bestDistanceSquared, [&](const Aabb& box) {
+            return box.DistanceSquared(p) * scale2;
+        }, [&](std::uint32_t leaf, std::uint32_t count, float best) {
+            const Triangle4& packed = Leaves[leaf];
+            for (std::uint32_t i = 0; i < count; ++i) {
+                std::uint32_t t = packed.Id[i];
+                glm::vec3 c = ClosestPointOnTriangle(p, Corners[t * 3], Corners[t * 3 + 1], Corners[t * 3 + 2]);
+                glm::vec3 w(toWorld * glm::vec4(c, 1.0f));
+                glm::vec3 d = w - worldP;
+                float d2 = glm::dot(d, d);
+                if (d2 < best) {
+                    best = d2;
+                    bestPoint = w;
+                }
+            }
+            return best;
+        });
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BVH_H
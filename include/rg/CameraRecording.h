@@ -0,0 +1,184 @@
+#ifndef PROJECT_BASE_CAMERA_RECORDING_H
+#define PROJECT_BASE_CAMERA_RECORDING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// keys held during a recorded frame
+enum RecordedInput : std::uint16_t {
+    InputForward = 1 << 0,
+    InputBackward = 1 << 1,
+    InputLeft = 1 << 2,
+    InputRight = 1 << 3,
+    InputHdrKey = 1 << 4,
+    InputBloomKey = 1 << 5,
+    InputExposureDown = 1 << 6,
+    InputExposureUp = 1 << 7
+};
+
+// render settings in effect during a recorded frame
+enum RecordedFlags : std::uint8_t {
+    RecordedHdr = 1 << 0,
+    RecordedBloom = 1 << 1
+};
+
+// One frame of a recording: camera pose, the keys held and the settings they lead to. Written to
+// disk as is, so the layout is fixed.
+struct CameraSample {
+    float Time; // seconds since the recording started
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float Zoom;
+    float Exposure;
+    std::uint16_t Input;
+    std::uint8_t Flags;
+    std::uint8_t Reserved;
+};
+static_assert(sizeof(CameraSample) == 36, "CameraSample is written to disk as is");
+
+// Recording file: "RGCR", version, sample size and count as 32-bit values, then the samples;
+// everything in the byte order of the machine that wrote it (little-endian on every target we build).
+const char CAMERA_RECORDING_MAGIC[4] = {'R', 'G', 'C', 'R'};
+const std::uint32_t CAMERA_RECORDING_VERSION = 1;
+
+inline bool SaveCameraRecording(const std::string& path, const std::vector<CameraSample>& samples) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::RECORDING::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    std::uint32_t header[3] = {CAMERA_RECORDING_VERSION, (std::uint32_t) sizeof(CameraSample),
+                               (std::uint32_t) samples.size()};
+    bool ok = std::fwrite(CAMERA_RECORDING_MAGIC, sizeof(CAMERA_RECORDING_MAGIC), 1, file) == 1
+              && std::fwrite(header, sizeof(header), 1, file) == 1
+              && (samples.empty()
+                  || std::fwrite(samples.data(), sizeof(CameraSample), samples.size(), file) == samples.size());
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+        std::cout << "ERROR::RECORDING::CANNOT_WRITE " << path << std::endl;
+    return ok;
+}
+
+inline bool LoadCameraRecording(const std::string& path, std::vector<CameraSample>& samples) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cout << "ERROR::RECORDING::NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    char magic[4];
+    std::uint32_t header[3];
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1 && std::fread(header, sizeof(header), 1, file) == 1
+              && std::memcmp(magic, CAMERA_RECORDING_MAGIC, sizeof(magic)) == 0
+              && header[0] == CAMERA_RECORDING_VERSION && header[1] == sizeof(CameraSample);
+    if (ok) {
+        samples.resize(header[2]);
+        ok = samples.empty()
+             || std::fread(samples.data(), sizeof(CameraSample), samples.size(), file) == samples.size();
+    }
+    std::fclose(file);
+    for (size_t i = 1; ok && i < samples.size(); ++i)
+        ok = samples[i].Time >= samples[i - 1].Time;
+    if (!ok) {
+        std::cout << "ERROR::RECORDING::INVALID " << path << std::endl;
+        samples.clear();
+    }
+    return ok;
+}
+
+// Collects a sample per frame while recording; Stop writes them out.
+class CameraRecorder {
+    std::vector<CameraSample> m_Samples;
+    double m_Start = 0.0;
+    bool m_Recording = false;
+
+public:
+    bool Recording() const {
+        return m_Recording;
+    }
+
+    void Start(double now) {
+        m_Samples.clear();
+        m_Start = now;
+        m_Recording = true;
+    }
+
+    void Record(double now, const glm::vec3& position, float yaw, float pitch, float zoom, float exposure,
+                std::uint16_t input, std::uint8_t flags) {
+        if (!m_Recording)
+            return;
+        m_Samples.push_back(CameraSample{(float) (now - m_Start), position, yaw, pitch, zoom, exposure, input, flags,
+                                         0});
+    }
+
+    bool Stop(const std::string& path) {
+        m_Recording = false;
+        return SaveCameraRecording(path, m_Samples);
+    }
+
+    size_t Size() const {
+        return m_Samples.size();
+    }
+};
+
+// Replays a recording at any time step: pose, zoom and exposure are interpolated between the two
+// samples around the time (yaw along the shorter way round), keys and flags come from the earlier one.
+// Past the end it holds the last sample.
+class CameraPlayback {
+    std::vector<CameraSample> m_Samples;
+
+public:
+    bool Load(const std::string& path) {
+        return LoadCameraRecording(path, m_Samples) && !m_Samples.empty();
+    }
+
+    bool Empty() const {
+        return m_Samples.empty();
+    }
+
+    float Duration() const {
+        return m_Samples.empty() ? 0.0f : m_Samples.back().Time;
+    }
+
+    CameraSample Evaluate(float time) const {
+        if (m_Samples.empty())
+            return CameraSample{time, glm::vec3(0.0f), -90.0f, 0.0f, 45.0f, 1.0f, 0, 0, 0};
+        auto next = std::upper_bound(m_Samples.begin(), m_Samples.end(), time,
+                                     [](float t, const CameraSample& sample) { return t < sample.Time; });
+        if (next == m_Samples.begin())
+            return m_Samples.front();
+        if (next == m_Samples.end())
+            return m_Samples.back();
+        const CameraSample& a = *(next - 1);
+        const CameraSample& b = *next;
+        float span = b.Time - a.Time;
+        float t = span > 0.0f ? (time - a.Time) / span : 1.0f;
+        CameraSample sample = a;
+        sample.Time = time;
+        sample.Position = glm::mix(a.Position, b.Position, t);
+        float yawDelta = std::fmod(b.Yaw - a.Yaw, 360.0f);
+        if (yawDelta > 180.0f)
+            yawDelta -= 360.0f;
+        else if (yawDelta < -180.0f)
+            yawDelta += 360.0f;
+        sample.Yaw = a.Yaw + yawDelta * t;
+        sample.Pitch = a.Pitch + (b.Pitch - a.Pitch) * t;
+        sample.Zoom = a.Zoom + (b.Zoom - a.Zoom) * t;
+        sample.Exposure = a.Exposure + (b.Exposure - a.Exposure) * t;
+        return sample;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_CAMERA_RECORDING_H
@@ -0,0 +1,427 @@
+#ifndef PROJECT_BASE_CASCADED_SHADOWS_H
+#define PROJECT_BASE_CASCADED_SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/filesystem.h>
+#include <learnopengl/shader.h>
+#include <rg/BatchMath.h>
+#include <rg/Bounds.h>
+#include <rg/Metrics.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace rg {
+
+// Must match shadow.gs, object.fs and 3.1.blending.fs.
+const int SHADOW_MAX_CASCADES = 4;
+// A cascade covers its slice's bounding sphere plus this fraction of the radius on every side, and is
+// only moved (and its casters drawn again) once the sphere drifts out of that margin.
+const float SHADOW_CACHE_MARGIN = 0.2f;
+// the shadow map array is bound here for the lit shaders, next to the light clusters
+const int SHADOW_TEXTURE_UNIT = 11;
+
+// Set by the update thread, passed in the frame packet.
+struct ShadowSettings {
+    bool Enabled = false;
+    int Cascades = 3; // 1 to SHADOW_MAX_CASCADES
+    int Resolution = 2048; // texels along each side of every cascade
+    float MaxDistance = 60.0f; // view depth the last cascade reaches
+    float SplitLambda = 0.75f; // 0 spaces the splits evenly, 1 logarithmically
+
+    bool operator==(const ShadowSettings& o) const {
+        return Enabled == o.Enabled && Cascades == o.Cascades && Resolution == o.Resolution
+               && MaxDistance == o.MaxDistance && SplitLambda == o.SplitLambda;
+    }
+};
+
+// the resolution the maps are allocated at, an even number of texels
+inline int ShadowResolution(const ShadowSettings& settings) {
+    return std::min(std::max(settings.Resolution, 16), 8192) & ~1;
+}
+
+struct ShadowCascade {
+    glm::mat4 Matrix = glm::mat4(1.0f); // world to the cascade's clip space
+    float FarDepth = 0.0f; // view depth the cascade covers up to
+    float TexelSize = 0.0f; // world size of one texel
+};
+
+struct ShadowCaster {
+    glm::mat4 World;
+    std::uint16_t Mesh;
+    std::uint16_t Material;
+    std::uint8_t Flags; // RenderFlags
+    std::uint8_t Cascades; // bits of the cascades it touches
+};
+
+// One frame of cascades for the render thread. Only what changed is drawn: the static casters of the
+// cascades in Redraw, and the dynamic ones when DynamicRedraw is set.
+struct ShadowFrame {
+    ShadowSettings Settings;
+    int Cascades = 0; // 0 when shadows are off or there is no directional light
+    ShadowCascade Cascade[SHADOW_MAX_CASCADES];
+    std::uint8_t Redraw = 0;
+    std::vector<ShadowCaster> StaticCasters; // of the cascades in Redraw
+    bool Dynamic = false; // the scene has dynamic casters, they're drawn over a copy of the static maps
+    bool DynamicRedraw = false;
+    std::vector<ShadowCaster> DynamicCasters; // when DynamicRedraw
+};
+
+// Fits the cascades of the first directional light to the camera, on the update thread. Each cascade
+// bounds its slice of the view frustum with a sphere, whose radius only depends on the projection, so
+// rotating the camera doesn't resize it; the light-space centre is snapped to whole texels, so moving
+// it doesn't make the shadow edges crawl. A cascade stays where it is until the sphere leaves its
+// margin, and is drawn again only then, when the light or a setting changed, or when a static caster
+// was added, moved or removed. Renderables with RenderFlagDynamic are kept out of that cache.
+class ShadowCascades {
+public:
+    void Update(const ShadowSettings& settings, const Scene& scene, const glm::mat4& projection, const glm::mat4& view,
+                ShadowFrame& out, const BatchKernels& kernels = GetBatchKernels()) {
+        out.Settings = settings;
+        out.Redraw = 0;
+        out.StaticCasters.clear();
+        out.DynamicCasters.clear();
+        out.DynamicRedraw = false;
+        long light = directionalLight(scene.Lights);
+        if (!settings.Enabled || light < 0) {
+            out.Cascades = 0;
+            m_Valid = false;
+            return;
+        }
+        int count = std::min(std::max(settings.Cascades, 1), SHADOW_MAX_CASCADES);
+        glm::vec3 direction = glm::normalize(scene.Lights.Direction.Get(light));
+        if (!m_Valid || !(settings == m_Settings) || direction != m_Direction
+            || scene.StaticCasterVersion != m_StaticVersion) {
+            m_Settings = settings;
+            m_Direction = direction;
+            m_StaticVersion = scene.StaticCasterVersion;
+            glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            m_LightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+            staticDepthRange(scene.Renderables);
+            for (Cached& cached : m_Cached)
+                cached.Valid = false;
+            m_Valid = true;
+        }
+
+        // view depth splits, between even and logarithmic spacing
+        float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        float farPlane = std::min(settings.MaxDistance, projection[3][2] / (projection[2][2] + 1.0f));
+        float tanX = 1.0f / projection[0][0], tanY = 1.0f / projection[1][1];
+        float diagonal = tanX * tanX + tanY * tanY;
+        glm::mat4 inverseView = glm::inverse(view);
+        float begin = nearPlane;
+        for (int i = 0; i < count; ++i) {
+            float t = (float) (i + 1) / count;
+            float end = settings.SplitLambda * nearPlane * std::pow(farPlane / nearPlane, t)
+                        + (1.0f - settings.SplitLambda) * (nearPlane + (farPlane - nearPlane) * t);
+            // smallest sphere around both ends of the slice, centred on the view axis
+            float centre = std::min(0.5f * (begin + end) * (1.0f + diagonal), end);
+            float radius = std::sqrt(std::max((centre - begin) * (centre - begin) + begin * begin * diagonal,
+                                              (end - centre) * (end - centre) + end * end * diagonal));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            glm::vec3 lightCentre = glm::vec3(m_LightView * inverseView * glm::vec4(0.0f, 0.0f, -centre, 1.0f));
+
+            Cached& cached = m_Cached[i];
+            float extent = radius * (1.0f + SHADOW_CACHE_MARGIN);
+            float texel = 2.0f * extent / ShadowResolution(settings);
+            glm::vec2 drift = glm::abs(glm::vec2(lightCentre) - cached.Centre);
+            if (!cached.Valid || cached.Radius != radius || std::max(drift.x, drift.y) > radius * SHADOW_CACHE_MARGIN) {
+                cached.Valid = true;
+                cached.Radius = radius;
+                cached.Centre = glm::floor(glm::vec2(lightCentre) / texel + 0.5f) * texel;
+                glm::vec2 low = cached.Centre - extent, high = cached.Centre + extent;
+                cached.Matrix = glm::ortho(low.x, high.x, low.y, high.y, m_DepthRange.x, m_DepthRange.y) * m_LightView;
+                // casters between the light and the near plane still shadow the cascade, the pass
+                // clamps their depth: nothing culls them on that side
+                cached.Cull = Frustum(glm::ortho(low.x, high.x, low.y, high.y, -1e5f, m_DepthRange.y) * m_LightView);
+                out.Redraw |= (std::uint8_t) (1u << i);
+            }
+            out.Cascade[i].Matrix = cached.Matrix;
+            out.Cascade[i].FarDepth = end;
+            out.Cascade[i].TexelSize = texel;
+            begin = end;
+        }
+        for (int i = count; i < SHADOW_MAX_CASCADES; ++i)
+            m_Cached[i].Valid = false;
+        out.Cascades = count;
+        metrics::Render().ShadowCascadeDraws.Add((std::uint64_t) popCount(out.Redraw));
+
+        const RenderableTable& t = scene.Renderables;
+        bool dynamicMoved = scene.DynamicCasterVersion != m_DynamicVersion;
+        m_DynamicVersion = scene.DynamicCasterVersion;
+        out.Dynamic = false;
+        for (std::uint8_t flags : t.Flags) {
+            if (flags & RenderFlagDynamic) {
+                out.Dynamic = true;
+                break;
+            }
+        }
+        out.DynamicRedraw = out.Dynamic && (dynamicMoved || out.Redraw || !m_DynamicDrawn);
+        m_DynamicDrawn = out.Dynamic;
+        std::uint8_t wanted = out.DynamicRedraw ? (std::uint8_t) ((1u << count) - 1) : out.Redraw;
+        if (!wanted)
+            return;
+        m_Touched.assign(t.Size(), 0);
+        for (int i = 0; i < count; ++i) {
+            if (wanted & (1u << i))
+                kernels.CullBoxes(m_Cached[i].Cull, WorldBoxColumns(t), m_Touched.data(), (std::uint8_t) (1u << i), 0,
+                                  t.Size());
+        }
+        for (size_t row = 0; row < t.Size(); ++row) {
+            bool dynamic = (t.Flags[row] & RenderFlagDynamic) != 0;
+            std::uint8_t cascades = m_Touched[row] & (dynamic ? wanted : out.Redraw);
+            if (!cascades || (dynamic && !out.DynamicRedraw))
+                continue;
+            ShadowCaster caster{t.World[row], t.Mesh[row], t.Material[row], t.Flags[row], cascades};
+            (dynamic ? out.DynamicCasters : out.StaticCasters).push_back(caster);
+        }
+    }
+
+private:
+    struct Cached {
+        bool Valid = false;
+        float Radius = 0.0f;
+        glm::vec2 Centre = glm::vec2(0.0f); // in light space, snapped to texels
+        glm::mat4 Matrix = glm::mat4(1.0f);
+        Frustum Cull;
+    };
+    Cached m_Cached[SHADOW_MAX_CASCADES];
+    bool m_Valid = false;
+    ShadowSettings m_Settings;
+    glm::vec3 m_Direction = glm::vec3(0.0f);
+    std::uint32_t m_StaticVersion = 0, m_DynamicVersion = 0;
+    bool m_DynamicDrawn = false;
+    glm::mat4 m_LightView = glm::mat4(1.0f);
+    glm::vec2 m_DepthRange = glm::vec2(0.1f, 100.0f); // near and far of the light's ortho projection
+    std::vector<std::uint8_t> m_Touched;
+
+    static long directionalLight(const LightTable& t) {
+        for (size_t i = 0; i < t.Size(); ++i) {
+            if (t.Type[i] == LightDirectional)
+                return (long) i;
+        }
+        return -1;
+    }
+
+    static int popCount(std::uint8_t bits) {
+        int count = 0;
+        for (; bits; bits &= bits - 1)
+            ++count;
+        return count;
+    }
+
+    // light-space depth of every static caster, dynamic ones outside it are clamped by the pass
+    void staticDepthRange(const RenderableTable& t) {
+        float low = 1e30f, high = -1e30f;
+        for (size_t row = 0; row < t.Size(); ++row) {
+            if (t.Flags[row] & RenderFlagDynamic)
+                continue;
+            glm::vec3 lo = t.WorldMin.Get(row), hi = t.WorldMax.Get(row);
+            for (int corner = 0; corner < 8; ++corner) {
+                glm::vec3 p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y, corner & 4 ? hi.z : lo.z);
+                float depth = -(m_LightView * glm::vec4(p, 1.0f)).z;
+                low = std::min(low, depth);
+                high = std::max(high, depth);
+            }
+        }
+        if (low > high)
+            low = high = 0.0f;
+        m_DepthRange = glm::vec2(low - 1.0f, high + 1.0f);
+    }
+};
+
+// GL half: the cascades as layers of a depth texture array, drawn in one pass each time with a
+// geometry shader that sends every triangle to the layers of the cascades its caster touches. The
+// static casters go into the cache array; with dynamic casters in the scene, the cached layers are
+// copied into a second array every time those move and the dynamic casters drawn over them.
+class ShadowMaps {
+public:
+    // draws the casters with the given programs, opaque ones with opaque and alpha-tested ones with
+    // alphaTested, setting "model" and "cascadeMask" (the caster's cascades within layers) per draw
+    using CasterDrawer = std::function<void(const std::vector<ShadowCaster>& casters, Shader& opaque,
+                                            Shader& alphaTested, std::uint8_t layers)>;
+
+    void Init() {
+        m_Shader.reset(new Shader(FileSystem::getPath("resources/shaders/shadow.vs").c_str(),
+                                  FileSystem::getPath("resources/shaders/depth.fs").c_str(),
+                                  FileSystem::getPath("resources/shaders/shadow.gs").c_str()));
+        m_AlphaShader.reset(new Shader(FileSystem::getPath("resources/shaders/shadow.vs").c_str(),
+                                       FileSystem::getPath("resources/shaders/depth_alpha.fs").c_str(),
+                                       FileSystem::getPath("resources/shaders/shadow.gs").c_str()));
+        m_AlphaShader->use();
+        m_AlphaShader->setInt("material.texture_diffuse1", 0);
+        glGenFramebuffers(2, m_LayerFramebuffers);
+        for (GLuint framebuffer : m_LayerFramebuffers) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        metrics::Render().GlObjects.Add(2);
+    }
+
+    void Shutdown() {
+        release();
+        if (m_LayerFramebuffers[0]) {
+            glDeleteFramebuffers(2, m_LayerFramebuffers);
+            metrics::Render().GlObjects.Add(-2);
+            m_LayerFramebuffers[0] = m_LayerFramebuffers[1] = 0;
+        }
+        m_Shader.reset();
+        m_AlphaShader.reset();
+    }
+
+    // Leaves the framebuffer binding and viewport to the next pass.
+    void Render(const ShadowFrame& frame, const CasterDrawer& drawCasters) {
+        m_Cascades = frame.Cascades;
+        if (!m_Cascades) {
+            release();
+            return;
+        }
+        allocate(m_Static, m_StaticFramebuffer, ShadowResolution(frame.Settings));
+        for (int i = 0; i < m_Cascades; ++i)
+            m_Matrices[i] = frame.Cascade[i].Matrix;
+        if (frame.Redraw)
+            drawLayers(m_StaticFramebuffer, m_Static, frame.Redraw, frame.StaticCasters, drawCasters);
+        if (frame.Dynamic) {
+            allocate(m_Live, m_LiveFramebuffer, ShadowResolution(frame.Settings));
+            if (frame.DynamicRedraw) {
+                std::uint8_t all = (std::uint8_t) ((1u << m_Cascades) - 1);
+                for (int i = 0; i < m_Cascades; ++i) {
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_LayerFramebuffers[0]);
+                    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_Static, 0, i);
+                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_LayerFramebuffers[1]);
+                    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_Live, 0, i);
+                    glBlitFramebuffer(0, 0, m_Resolution, m_Resolution, 0, 0, m_Resolution, m_Resolution,
+                                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                }
+                drawLayers(m_LiveFramebuffer, m_Live, 0, frame.DynamicCasters, drawCasters, all);
+            }
+        } else if (m_Live) {
+            destroy(m_Live, m_LiveFramebuffer);
+        }
+        m_Sampled = frame.Dynamic ? m_Live : m_Static;
+        for (int i = 0; i < m_Cascades; ++i) {
+            m_FarDepths[i] = frame.Cascade[i].FarDepth;
+            m_TexelSizes[i] = frame.Cascade[i].TexelSize;
+        }
+    }
+
+    // Binds the array for a lit shader; shadowCascades is 0 when shadows are off.
+    void SetUniforms(const Shader& shader) const {
+        // the sampler is pointed at its own unit even when off: left on 0 it would share the unit with
+        // the material's sampler2D, which fails the draw
+        shader.setInt("shadowMap", SHADOW_TEXTURE_UNIT);
+        shader.setInt("shadowCascades", m_Cascades);
+        if (m_Cascades) {
+            shader.setMat4Array("shadowMatrices", m_Matrices, m_Cascades);
+            shader.setFloatArray("shadowFarDepths", m_FarDepths, m_Cascades);
+            shader.setFloatArray("shadowTexelSizes", m_TexelSizes, m_Cascades);
+        }
+    }
+
+    // before the lit pass: the array, or nothing, on SHADOW_TEXTURE_UNIT
+    void Bind() const {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_Cascades ? m_Sampled : 0);
+        glActiveTexture(GL_TEXTURE0);
+        metrics::Render().TextureBinds.Add();
+    }
+
+private:
+    std::unique_ptr<Shader> m_Shader, m_AlphaShader;
+    GLuint m_Static = 0, m_StaticFramebuffer = 0;
+    GLuint m_Live = 0, m_LiveFramebuffer = 0;
+    GLuint m_LayerFramebuffers[2] = {}; // single layers, for clears and copies
+    GLuint m_Sampled = 0;
+    int m_Resolution = 0;
+    int m_Cascades = 0;
+    glm::mat4 m_Matrices[SHADOW_MAX_CASCADES];
+    float m_FarDepths[SHADOW_MAX_CASCADES] = {};
+    float m_TexelSizes[SHADOW_MAX_CASCADES] = {};
+
+    // clears the layers in clear, then draws the casters into all layers in layers (clear by default)
+    void drawLayers(GLuint framebuffer, GLuint texture, std::uint8_t clear, const std::vector<ShadowCaster>& casters,
+                    const CasterDrawer& drawCasters, std::uint8_t layers = 0) {
+        if (!layers)
+            layers = clear;
+        glViewport(0, 0, m_Resolution, m_Resolution);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_LayerFramebuffers[0]);
+        for (int i = 0; i < m_Cascades; ++i) {
+            if (clear & (1u << i)) {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        for (Shader* shader : {m_Shader.get(), m_AlphaShader.get()}) {
+            shader->use();
+            shader->setMat4Array("lightMatrices", m_Matrices, m_Cascades);
+        }
+        glEnable(GL_DEPTH_CLAMP);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.5f, 2.0f);
+        drawCasters(casters, *m_Shader, *m_AlphaShader, layers);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_DEPTH_CLAMP);
+    }
+
+    void allocate(GLuint& texture, GLuint& framebuffer, int resolution) {
+        if (texture && resolution == m_Resolution)
+            return;
+        if (resolution != m_Resolution) {
+            // every array goes at the new size, the update thread redraws all cascades with it
+            destroy(m_Static, m_StaticFramebuffer);
+            destroy(m_Live, m_LiveFramebuffer);
+            m_Resolution = resolution;
+        }
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, SHADOW_MAX_CASCADES, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        metrics::Render().GlObjects.Add(2);
+    }
+
+    void destroy(GLuint& texture, GLuint& framebuffer) {
+        if (!texture)
+            return;
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &texture);
+        metrics::Render().GlObjects.Add(-2);
+        texture = framebuffer = 0;
+    }
+
+    void release() {
+        destroy(m_Static, m_StaticFramebuffer);
+        destroy(m_Live, m_LiveFramebuffer);
+        m_Resolution = 0;
+        m_Sampled = 0;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_CASCADED_SHADOWS_H
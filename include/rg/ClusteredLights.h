@@ -0,0 +1,259 @@
+#ifndef PROJECT_BASE_CLUSTERED_LIGHTS_H
+#define PROJECT_BASE_CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/BatchMath.h>
+#include <rg/Metrics.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rg {
+
+// The view frustum cut into CLUSTER_X x CLUSTER_Y tiles on screen and CLUSTER_Z slices in depth,
+// spaced exponentially between the near and far plane so clusters stay about as deep as they are
+// wide. Must match object.fs and 3.1.blending.fs.
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// GL 3.3 only promises 65536 texels in a buffer texture, which bounds the index list; pairs past it
+// are dropped and counted
+const int CLUSTER_MAX_INDICES = 65536;
+const int CLUSTER_MAX_LIGHTS = 4096;
+const int CLUSTER_LIGHT_TEXELS = 4;
+// A point light ends where its brightest colour is attenuated below this (as LearnOpenGL sizes its
+// light volumes); the shaders skip it past that point too, so cluster borders never show.
+const float LIGHT_CUTOFF = 5.0f / 256.0f;
+// object.fs and 3.1.blending.fs read the clusters from three buffer textures starting at this unit,
+// above anything a mesh binds
+const int CLUSTER_TEXTURE_UNIT = 8;
+
+// Distance at which the light's brightest component falls to LIGHT_CUTOFF, 0 for a dark light.
+inline float PointLightRange(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular,
+                             float constant, float linear, float quadratic) {
+    float brightest = 0.0f;
+    for (int i = 0; i < 3; ++i)
+        brightest = std::max(brightest, std::max(ambient[i], std::max(diffuse[i], specular[i])));
+    // brightest / (constant + linear d + quadratic d^2) = cutoff
+    float c = constant - brightest / LIGHT_CUTOFF;
+    if (brightest <= 0.0f || c >= 0.0f)
+        return 0.0f;
+    if (quadratic <= 0.0f)
+        return linear > 0.0f ? -c / linear : 1e30f;
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+}
+
+// CPU half of clustered forward shading: the point lights of a LightTable packed for the shaders, and
+// for every cluster of one view the list of lights whose range touches it. Cluster boxes are view
+// space and only depend on the projection (a symmetric perspective one, as glm::perspective makes),
+// so they are rebuilt when it changes. Each light's range is tested against the boxes of the depth
+// slices it spans with BatchKernels::SphereTouchesBoxes, then the pairs are counting-sorted into
+// per-cluster lists. Lights keep their table order within a list.
+class LightClusters {
+public:
+    // CLUSTER_LIGHT_TEXELS per point light: position & material (-1 for all), ambient & constant,
+    // diffuse & linear, specular & quadratic
+    std::vector<glm::vec4> Lights;
+    std::vector<std::uint32_t> Cells; // first index and count per cluster, x fastest, then y, then z
+    std::vector<std::uint16_t> Indices; // into Lights, the lists of all clusters back to back
+    float Near = 0.1f, Far = 100.0f;
+    std::uint32_t Dropped = 0; // light-cluster pairs over CLUSTER_MAX_INDICES, or lights over CLUSTER_MAX_LIGHTS
+
+    void Build(const LightTable& table, const glm::mat4& projection, const glm::mat4& view,
+               const BatchKernels& kernels = GetBatchKernels()) {
+        if (!(projection == m_Projection) || m_Box[0].empty())
+            buildBoxes(projection);
+        Lights.clear();
+        Indices.clear();
+        Cells.assign(2 * CLUSTER_COUNT, 0);
+        m_Pairs.clear();
+        Dropped = 0;
+        const BoxColumns boxes{m_Box[0].data(), m_Box[1].data(), m_Box[2].data(),
+                               m_Box[3].data(), m_Box[4].data(), m_Box[5].data()};
+        for (size_t i = 0; i < table.Size(); ++i) {
+            if (table.Type[i] != LightPoint)
+                continue;
+            glm::vec3 ambient = table.Ambient.Get(i), diffuse = table.Diffuse.Get(i), specular = table.Specular.Get(i);
+            float range = PointLightRange(ambient, diffuse, specular, table.Constant[i], table.Linear[i],
+                                          table.Quadratic[i]);
+            if (range <= 0.0f)
+                continue;
+            glm::vec3 center = glm::vec3(view * glm::vec4(table.Position.Get(i), 1.0f));
+            float depth = -center.z;
+            if (depth + range < Near || depth - range > Far)
+                continue;
+            if (Lights.size() == CLUSTER_MAX_LIGHTS * CLUSTER_LIGHT_TEXELS) {
+                ++Dropped;
+                continue;
+            }
+            std::uint32_t light = (std::uint32_t) (Lights.size() / CLUSTER_LIGHT_TEXELS);
+            float material = table.Material[i] == AllMaterials ? -1.0f : (float) table.Material[i];
+            Lights.emplace_back(table.Position.Get(i), material);
+            Lights.emplace_back(ambient, table.Constant[i]);
+            Lights.emplace_back(diffuse, table.Linear[i]);
+            Lights.emplace_back(specular, table.Quadratic[i]);
+
+            size_t begin = (size_t) Slice(std::max(depth - range, Near)) * CLUSTER_X * CLUSTER_Y;
+            size_t end = (size_t) (Slice(std::min(depth + range, Far)) + 1) * CLUSTER_X * CLUSTER_Y;
+            if (!kernels.SphereTouchesBoxes(glm::vec4(center, range), boxes, m_Touched.data(), 1, begin, end))
+                continue;
+            for (size_t cluster = begin; cluster < end; ++cluster) {
+                if (m_Touched[cluster] & 1)
+                    m_Pairs.push_back((std::uint32_t) cluster << 16 | light);
+            }
+        }
+        if (m_Pairs.size() > (size_t) CLUSTER_MAX_INDICES) {
+            Dropped += (std::uint32_t) (m_Pairs.size() - CLUSTER_MAX_INDICES);
+            m_Pairs.resize(CLUSTER_MAX_INDICES);
+        }
+
+        for (std::uint32_t pair : m_Pairs)
+            ++Cells[2 * (pair >> 16) + 1];
+        std::uint32_t first = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+            Cells[2 * cluster] = first;
+            first += Cells[2 * cluster + 1];
+        }
+        Indices.resize(m_Pairs.size());
+        m_Fill.assign(Cells.begin(), Cells.end());
+        for (std::uint32_t pair : m_Pairs)
+            Indices[m_Fill[2 * (pair >> 16)]++] = (std::uint16_t) (pair & 0xFFFF);
+    }
+
+    // depth slice of a view depth (positive, in front of the camera), as the shaders compute it
+    int Slice(float depth) const {
+        glm::vec2 slicing = DepthSlicing();
+        int slice = (int) std::floor(std::log(std::max(depth, Near)) * slicing.x + slicing.y);
+        return std::min(std::max(slice, 0), CLUSTER_Z - 1);
+    }
+
+    // slice = log(depth) * x + y
+    glm::vec2 DepthSlicing() const {
+        float scale = CLUSTER_Z / std::log(Far / Near);
+        return glm::vec2(scale, -std::log(Near) * scale);
+    }
+
+    size_t LightCount() const {
+        return Lights.size() / CLUSTER_LIGHT_TEXELS;
+    }
+
+private:
+    glm::mat4 m_Projection = glm::mat4(0.0f);
+    std::vector<float> m_Box[6]; // min xyz, max xyz of each cluster in view space
+    std::vector<std::uint8_t> m_Touched;
+    std::vector<std::uint32_t> m_Pairs; // cluster << 16 | light
+    std::vector<std::uint32_t> m_Fill;
+
+    void buildBoxes(const glm::mat4& projection) {
+        m_Projection = projection;
+        Near = projection[3][2] / (projection[2][2] - 1.0f);
+        Far = projection[3][2] / (projection[2][2] + 1.0f);
+        for (std::vector<float>& column : m_Box)
+            column.resize(CLUSTER_COUNT);
+        m_Touched.assign(CLUSTER_COUNT, 0);
+        for (int z = 0; z < CLUSTER_Z; ++z) {
+            float near = Near * std::pow(Far / Near, (float) z / CLUSTER_Z);
+            float far = Near * std::pow(Far / Near, (float) (z + 1) / CLUSTER_Z);
+            for (int y = 0; y < CLUSTER_Y; ++y) {
+                float y0 = -1.0f + 2.0f * y / CLUSTER_Y, y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+                for (int x = 0; x < CLUSTER_X; ++x) {
+                    float x0 = -1.0f + 2.0f * x / CLUSTER_X, x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+                    // the tile's side planes go through the eye, so its extent grows with depth:
+                    // the box spans both ends of the slice
+                    int i = x + CLUSTER_X * (y + CLUSTER_Y * z);
+                    m_Box[0][i] = std::min(x0 * near, x0 * far) / projection[0][0];
+                    m_Box[3][i] = std::max(x1 * near, x1 * far) / projection[0][0];
+                    m_Box[1][i] = std::min(y0 * near, y0 * far) / projection[1][1];
+                    m_Box[4][i] = std::max(y1 * near, y1 * far) / projection[1][1];
+                    m_Box[2][i] = -far;
+                    m_Box[5][i] = -near;
+                }
+            }
+        }
+    }
+};
+
+// GL half: the three buffer textures the lit shaders read a LightClusters from, bound on units
+// CLUSTER_TEXTURE_UNIT to CLUSTER_TEXTURE_UNIT + 2. Upload once a frame before the scene is drawn,
+// SetUniforms on every program that shades with them.
+class ClusteredLightBuffers {
+    GLuint m_Buffers[3] = {};
+    GLuint m_Textures[3] = {};
+    glm::vec2 m_TileSize = glm::vec2(1.0f);
+    glm::vec2 m_Slicing = glm::vec2(0.0f);
+    glm::vec2 m_NearFar = glm::vec2(0.1f, 100.0f);
+
+public:
+    void Init() {
+        static const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+        glGenBuffers(3, m_Buffers);
+        glGenTextures(3, m_Textures);
+        for (int i = 0; i < 3; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_Buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        metrics::Render().GlObjects.Add(6);
+    }
+
+    void Shutdown() {
+        if (!m_Buffers[0])
+            return;
+        glDeleteTextures(3, m_Textures);
+        glDeleteBuffers(3, m_Buffers);
+        metrics::Render().GlObjects.Add(-6);
+        std::fill(m_Buffers, m_Buffers + 3, 0u);
+        std::fill(m_Textures, m_Textures + 3, 0u);
+    }
+
+    // targetWidth/Height: size of the framebuffer the scene is drawn into, the tiles divide it
+    void Upload(const LightClusters& clusters, int targetWidth, int targetHeight) {
+        upload(0, clusters.Lights.data(), clusters.Lights.size() * sizeof(glm::vec4));
+        upload(1, clusters.Cells.data(), clusters.Cells.size() * sizeof(std::uint32_t));
+        upload(2, clusters.Indices.data(), clusters.Indices.size() * sizeof(std::uint16_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        metrics::Render().TextureBinds.Add(3);
+        m_TileSize = glm::vec2((float) targetWidth / CLUSTER_X, (float) targetHeight / CLUSTER_Y);
+        m_Slicing = clusters.DepthSlicing();
+        m_NearFar = glm::vec2(clusters.Near, clusters.Far);
+        metrics::Render().ClusteredLights.Set((std::int64_t) clusters.LightCount());
+        metrics::Render().ClusterLightIndices.Set((std::int64_t) clusters.Indices.size());
+    }
+
+    void SetUniforms(const Shader& shader) const {
+        shader.setInt("clusterLights", CLUSTER_TEXTURE_UNIT);
+        shader.setInt("clusterCells", CLUSTER_TEXTURE_UNIT + 1);
+        shader.setInt("clusterIndices", CLUSTER_TEXTURE_UNIT + 2);
+        shader.setVec2("clusterTileSize", m_TileSize);
+        shader.setVec2("clusterSlicing", m_Slicing);
+        shader.setVec2("clusterNearFar", m_NearFar);
+    }
+
+private:
+    // orphans the old storage, the GPU may still be reading last frame's
+    void upload(int i, const void* data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t) 16), nullptr, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        metrics::Render().BytesUploaded.Add(bytes);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_CLUSTERED_LIGHTS_H
@@ -0,0 +1,195 @@
+#ifndef PROJECT_BASE_CPU_PROFILER_H
+#define PROJECT_BASE_CPU_PROFILER_H
+
+// CPU scope profiler. RG_PROFILE_SCOPE("name") records the enclosing block on the calling thread,
+// RG_PROFILE_THREAD("name") labels the thread in the trace, and rg::profiler::WriteChromeTrace
+// writes everything still in the buffers as chrome://tracing / Perfetto JSON.
+//
+// Every thread appends to its own ring of events; only that thread writes it, so recording takes
+// no lock: two timestamp reads, one store and a release of the write counter. Timestamps are
+// rdtsc where available, scaled to microseconds against steady_clock at export. Without
+// RG_PROFILER defined the macros expand to nothing and no profiler code is compiled in.
+
+#include <cstdint>
+#include <string>
+
+#ifdef RG_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace rg {
+namespace profiler {
+
+// events kept per thread, older ones are overwritten
+const size_t THREAD_EVENTS = 1 << 16;
+
+struct Event {
+    const char* Name;
+    std::uint64_t Start;
+    std::uint64_t End;
+};
+
+inline std::uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+namespace detail {
+
+struct ThreadBuffer {
+    std::vector<Event> Events = std::vector<Event>(THREAD_EVENTS);
+    std::atomic<std::uint64_t> Written{0};
+    unsigned int Id = 0;
+    std::string Name; // guarded by Registry::Lock
+};
+
+// Owns the buffers of every thread that ever recorded, so a trace still has threads that finished.
+struct Registry {
+    std::mutex Lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> Buffers;
+    std::uint64_t StartTicks = Now();
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+};
+
+inline Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+inline ThreadBuffer& CurrentBuffer() {
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.Lock);
+        registry.Buffers.emplace_back(new ThreadBuffer);
+        buffer = registry.Buffers.back().get();
+        buffer->Id = (unsigned int) registry.Buffers.size();
+    }
+    return *buffer;
+}
+
+inline void WriteJsonString(std::FILE* file, const char* s) {
+    std::fputc('"', file);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            std::fputc('\\', file);
+        if ((unsigned char) *s >= 0x20)
+            std::fputc(*s, file);
+    }
+    std::fputc('"', file);
+}
+
+}
+
+inline void Record(const char* name, std::uint64_t start, std::uint64_t end) {
+    detail::ThreadBuffer& buffer = detail::CurrentBuffer();
+    std::uint64_t written = buffer.Written.load(std::memory_order_relaxed);
+    buffer.Events[written % THREAD_EVENTS] = Event{name, start, end};
+    buffer.Written.store(written + 1, std::memory_order_release);
+}
+
+inline void SetThreadName(const std::string& name) {
+    detail::ThreadBuffer& buffer = detail::CurrentBuffer();
+    std::lock_guard<std::mutex> lock(detail::GetRegistry().Lock);
+    buffer.Name = name;
+}
+
+class Scope {
+    const char* m_Name;
+    std::uint64_t m_Start;
+public:
+    explicit Scope(const char* name) : m_Name(name), m_Start(Now()) {}
+    ~Scope() {
+        Record(m_Name, m_Start, Now());
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+// Can run while other threads keep recording: events overwritten during the copy are left out.
+inline bool WriteChromeTrace(const std::string& path) {
+    detail::Registry& registry = detail::GetRegistry();
+    std::uint64_t ticks = Now();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.StartTime).count();
+    double ticksPerMicrosecond = seconds > 0.0 ? (double) (ticks - registry.StartTicks) / (seconds * 1e6) : 1.0;
+    if (ticksPerMicrosecond <= 0.0)
+        ticksPerMicrosecond = 1.0;
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cout << "ERROR::PROFILER::CANNOT_WRITE_TRACE " << path << std::endl;
+        return false;
+    }
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    std::lock_guard<std::mutex> lock(registry.Lock);
+    std::vector<Event> events;
+    for (const auto& buffer : registry.Buffers) {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                     first ? "" : ",\n", buffer->Id);
+        detail::WriteJsonString(file, buffer->Name.empty() ? "thread" : buffer->Name.c_str());
+        std::fprintf(file, "}}");
+        first = false;
+
+        std::uint64_t end = buffer->Written.load(std::memory_order_acquire);
+        std::uint64_t begin = end > THREAD_EVENTS ? end - THREAD_EVENTS : 0;
+        events.clear();
+        for (std::uint64_t i = begin; i < end; ++i)
+            events.push_back(buffer->Events[i % THREAD_EVENTS]);
+        // slots the owner reused while we copied
+        std::uint64_t now = buffer->Written.load(std::memory_order_acquire);
+        std::uint64_t valid = now >= THREAD_EVENTS ? now - THREAD_EVENTS + 1 : 0;
+        for (std::uint64_t i = std::max(begin, valid); i < end; ++i) {
+            const Event& e = events[i - begin];
+            std::fprintf(file, ",\n{\"name\":");
+            detail::WriteJsonString(file, e.Name);
+            std::fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->Id,
+                         (double) (std::int64_t) (e.Start - registry.StartTicks) / ticksPerMicrosecond,
+                         (double) (e.End - e.Start) / ticksPerMicrosecond);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+    return true;
+}
+
+}
+}
+
+#define RG_PROFILE_CONCAT_INNER(a, b) a##b
+#define RG_PROFILE_CONCAT(a, b) RG_PROFILE_CONCAT_INNER(a, b)
+#define RG_PROFILE_SCOPE(name) ::rg::profiler::Scope RG_PROFILE_CONCAT(rgProfileScope, __LINE__)(name)
+#define RG_PROFILE_THREAD(name) ::rg::profiler::SetThreadName(name)
+
+#else
+
+namespace rg {
+namespace profiler {
+
+inline bool WriteChromeTrace(const std::string&) {
+    return false;
+}
+
+}
+}
+
+#define RG_PROFILE_SCOPE(name) do {} while (0)
+#define RG_PROFILE_THREAD(name) do {} while (0)
+
+#endif
+
+#endif //PROJECT_BASE_CPU_PROFILER_H
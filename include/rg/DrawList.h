@@ -0,0 +1,107 @@
+#ifndef PROJECT_BASE_DRAW_LIST_H
+#define PROJECT_BASE_DRAW_LIST_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+#include <rg/Scene.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// One draw of the frame: a copy of what the renderable row needs, with the mesh its LOD picked.
+// Self-contained so a draw list can be handed to another thread while the scene keeps changing.
+struct DrawItem {
+    glm::mat4 World;
+    std::uint64_t SortKey;
+    std::uint32_t Row;
+    Entity Owner; // rows move, the render thread looks baked data up by entity
+    std::uint16_t Mesh;
+    std::uint16_t Material;
+    std::uint8_t Flags;
+};
+
+// How a material's draws get into the depth pre-pass (SceneRenderer::DrawDepthPrepass); the frame
+// packet holds the classes that get one, the rest are drawn with a plain depth test.
+enum DepthPrepassClass : std::uint8_t {
+    DepthPrepassOpaque = 1u << 0,      // position-only stream, no fragment work
+    DepthPrepassAlphaTested = 1u << 1, // the material discards on the diffuse alpha, so the pre-pass does too
+    DepthPrepassAll = DepthPrepassOpaque | DepthPrepassAlphaTested
+};
+
+// "none", "opaque" or "all", the settings the benchmark and the F7 key cycle through
+inline const char* DepthPrepassName(std::uint8_t classes) {
+    if (classes == 0)
+        return "none";
+    if (classes == DepthPrepassOpaque)
+        return "opaque";
+    if (classes == DepthPrepassAlphaTested)
+        return "alpha tested";
+    return "all";
+}
+
+inline bool ParseDepthPrepass(const std::string& name, std::uint8_t& classes) {
+    if (name == "none")
+        classes = 0;
+    else if (name == "opaque")
+        classes = DepthPrepassOpaque;
+    else if (name == "all")
+        classes = DepthPrepassAll;
+    else
+        return false;
+    return true;
+}
+
+// Follows the mesh's LOD switches for a renderable at the given squared distance from the camera.
+inline std::uint16_t SelectLod(const std::vector<LodSwitch>& lods, std::uint16_t mesh, float distanceSquared) {
+    // bounded, so a cycle in the scene description can't hang the frame
+    for (int level = 0; level < 8 && mesh < lods.size() && lods[mesh].Distance > 0.0f; ++level) {
+        if (distanceSquared <= lods[mesh].Distance * lods[mesh].Distance)
+            break;
+        mesh = lods[mesh].Mesh;
+    }
+    return mesh;
+}
+
+// Submission order: material first (program switches are the expensive part), then cull state and
+// mesh, then front to back so the depth test rejects more. The distance is the top 24 bits of the
+// float, whose bit pattern orders like the value for non-negative floats.
+inline std::uint64_t MakeSortKey(std::uint16_t material, std::uint8_t flags, std::uint16_t mesh, float distanceSquared) {
+    std::uint32_t distance;
+    std::memcpy(&distance, &distanceSquared, sizeof(distance));
+    return (std::uint64_t) material << 48 | (std::uint64_t) (flags & RenderFlagDoubleSided) << 40
+           | (std::uint64_t) mesh << 24 | distance >> 8;
+}
+
+// Appends the visible renderables of rows [begin, end) to out, LOD already applied. Distances are
+// measured to the world box, so the camera standing inside a big object keeps it at full detail.
+inline void BuildDrawItems(const Scene& scene, const glm::vec3& viewPosition, size_t begin, size_t end,
+                           std::vector<DrawItem>& out) {
+    const RenderableTable& t = scene.Renderables;
+    for (size_t i = begin; i < end; ++i) {
+        if (!(t.Flags[i] & RenderFlagVisible))
+            continue;
+        std::uint16_t mesh = t.Mesh[i];
+        float distanceSquared = Aabb(t.WorldMin.Get(i), t.WorldMax.Get(i)).DistanceSquared(viewPosition);
+        if (!scene.MeshLods.empty()) {
+            mesh = SelectLod(scene.MeshLods, mesh, distanceSquared);
+            if (mesh == NoMesh)
+                continue;
+        }
+        std::uint64_t key = MakeSortKey(t.Material[i], t.Flags[i], mesh, distanceSquared);
+        out.push_back(DrawItem{t.World[i], key, (std::uint32_t) i, t.Owner[i], mesh, t.Material[i], t.Flags[i]});
+    }
+}
+
+// row order; DrawListBuilder in SceneJobs.h produces the sorted list the renderer draws
+inline void BuildDrawList(const Scene& scene, const glm::vec3& viewPosition, std::vector<DrawItem>& out) {
+    out.clear();
+    BuildDrawItems(scene, viewPosition, 0, scene.Renderables.Size(), out);
+}
+
+}
+
+#endif //PROJECT_BASE_DRAW_LIST_H
@@ -0,0 +1,87 @@
+#ifndef PROJECT_BASE_DYNAMIC_RESOLUTION_H
+#define PROJECT_BASE_DYNAMIC_RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+
+namespace rg {
+
+// Set by the update thread, passed in the frame packet.
+struct DynamicResolutionSettings {
+    bool Enabled = false;
+    float TargetMs = 1000.0f / 60.0f; // GPU time per frame to hold
+    float MinScale = 0.5f;
+    float MaxScale = 1.0f;
+    float Sharpness = 0.5f; // of the upscale in the HDR composite, 0 to 1
+};
+
+// The scale moves in steps of this, each one re-declares the frame graph at the new size.
+const float DYNAMIC_RESOLUTION_STEP = 0.05f;
+// Frames after a change during which GPU times are ignored: the profiler reads a frame's queries
+// GPU_PROFILER_FRAMES frames later, so the first ones that come back were still drawn at the old size.
+const int DYNAMIC_RESOLUTION_COOLDOWN = 8;
+// Between this fraction of the target and the target itself the scale stays put; changes aim for
+// DYNAMIC_RESOLUTION_AIM of it. The band is wider than the cost of one step, so the scale settles
+// instead of flipping between two neighbouring ones.
+const float DYNAMIC_RESOLUTION_LOW = 0.75f;
+const float DYNAMIC_RESOLUTION_AIM = 0.85f;
+
+// Picks the internal resolution of the scene from the GPU frame time. The time is smoothed, and when
+// it leaves the band around the target the scale jumps to where the cost would be back at the aim,
+// assuming it goes with the pixel count (scale squared). Most passes do, the UI and the composite
+// don't, so a step down tends to fall a bit short and the next one finishes the job after the
+// cooldown. Plain CPU code, fed on the render thread with the profiler's frame times.
+class DynamicResolution {
+    float m_Scale = 1.0f;
+    float m_FilteredMs = 0.0f;
+    int m_Samples = 0;
+    int m_Cooldown = 0;
+
+public:
+    // Once per frame with the GPU time of the newest frame that came back, 0 when none did. Returns
+    // the scale to draw the next frame at.
+    float Update(const DynamicResolutionSettings& settings, float gpuMs) {
+        if (m_Cooldown > 0)
+            --m_Cooldown;
+        if (!settings.Enabled) {
+            change(1.0f);
+            return m_Scale;
+        }
+        float low = std::min(std::max(settings.MinScale, 0.1f), 1.0f);
+        float high = std::min(std::max(settings.MaxScale, low), 1.0f);
+        if (m_Scale < low || m_Scale > high)
+            change(std::min(std::max(m_Scale, low), high));
+        if (gpuMs <= 0.0f || m_Cooldown > 0 || settings.TargetMs <= 0.0f)
+            return m_Scale;
+
+        m_FilteredMs = m_Samples++ ? m_FilteredMs + 0.2f * (gpuMs - m_FilteredMs) : gpuMs;
+        if (m_Samples < 4 || (m_FilteredMs <= settings.TargetMs && m_FilteredMs >= DYNAMIC_RESOLUTION_LOW * settings.TargetMs))
+            return m_Scale;
+        float ideal = m_Scale * std::sqrt(DYNAMIC_RESOLUTION_AIM * settings.TargetMs / m_FilteredMs);
+        float next = std::floor(ideal / DYNAMIC_RESOLUTION_STEP + 1e-3f) * DYNAMIC_RESOLUTION_STEP;
+        change(std::min(std::max(next, low), high));
+        return m_Scale;
+    }
+
+    float Scale() const {
+        return m_Scale;
+    }
+
+    // smoothed GPU frame time the last decision was made on
+    float FilteredMs() const {
+        return m_FilteredMs;
+    }
+
+private:
+    void change(float scale) {
+        if (std::fabs(scale - m_Scale) < 1e-4f)
+            return;
+        m_Scale = scale;
+        m_Samples = 0;
+        m_Cooldown = DYNAMIC_RESOLUTION_COOLDOWN;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_DYNAMIC_RESOLUTION_H
@@ -0,0 +1,74 @@
+#ifndef PROJECT_BASE_FRAME_ALLOCATOR_H
+#define PROJECT_BASE_FRAME_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace rg {
+
+// Linear allocator for memory that only lives until the end of the frame: allocations bump an offset
+// through one block and are all dropped at once by Reset. A frame that doesn't fit gets extra blocks
+// from the heap; the next Reset replaces them with one block big enough for that whole frame, so once
+// the frames stop growing nothing is allocated any more. Only for trivially destructible types, no
+// destructors run. One per thread using it.
+class FrameAllocator {
+    std::unique_ptr<unsigned char[]> m_Block;
+    size_t m_Capacity = 0;
+    size_t m_Offset = 0;
+    std::vector<std::unique_ptr<unsigned char[]>> m_Overflow; // this frame's extra blocks
+    size_t m_OverflowBytes = 0; // with alignment slack, what they'd take in the block
+
+public:
+    explicit FrameAllocator(size_t capacity = 64 * 1024)
+        : m_Block(new unsigned char[capacity]), m_Capacity(capacity) {}
+
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    // alignment is a power of two no larger than alignof(std::max_align_t)
+    void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        size_t offset = (m_Offset + alignment - 1) & ~(alignment - 1);
+        if (offset + bytes <= m_Capacity) {
+            m_Offset = offset + bytes;
+            return m_Block.get() + offset;
+        }
+        m_Overflow.emplace_back(new unsigned char[bytes ? bytes : 1]);
+        m_OverflowBytes += bytes + alignment;
+        return m_Overflow.back().get();
+    }
+
+    // count elements set to value
+    template<typename T>
+    T* Allocate(size_t count, const T& value = T()) {
+        static_assert(std::is_trivially_destructible<T>::value, "frame memory is dropped without destructors");
+        T* items = static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+        std::uninitialized_fill(items, items + count, value);
+        return items;
+    }
+
+    // Drops everything allocated since the last Reset. Call it where nothing from the frame that
+    // ended is used any more, e.g. at the top of the next one.
+    void Reset() {
+        if (!m_Overflow.empty()) {
+            m_Capacity = Used() + Used() / 4;
+            m_Overflow.clear();
+            m_Block.reset(new unsigned char[m_Capacity]);
+        }
+        m_Offset = 0;
+        m_OverflowBytes = 0;
+    }
+
+    size_t Capacity() const {
+        return m_Capacity;
+    }
+
+    size_t Used() const {
+        return m_Offset + m_OverflowBytes;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRAME_ALLOCATOR_H
@@ -0,0 +1,233 @@
+#ifndef PROJECT_BASE_FRAME_PACKET_H
+#define PROJECT_BASE_FRAME_PACKET_H
+
+#include "imgui.h"
+#include <glm/glm.hpp>
+#include <rg/Bloom.h>
+#include <rg/CascadedShadows.h>
+#include <rg/ClusteredLights.h>
+#include <rg/DrawList.h>
+#include <rg/DynamicResolution.h>
+#include <rg/Scene.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace rg {
+
+// Copy of one ImGui frame's draw data. ImGui reuses its own buffers on the next NewFrame, the
+// render thread may still be drawing the previous frame by then. The copies are kept from frame to
+// frame and only grow.
+class UiDrawData {
+    std::vector<ImDrawList*> m_Lists;
+    int m_Count = 0; // lists in use
+    ImVec2 m_DisplayPos, m_DisplaySize, m_FramebufferScale;
+
+    template<typename T>
+    static void copy(ImVector<T>& to, const ImVector<T>& from) {
+        to.resize(from.Size);
+        if (from.Size)
+            memcpy(to.Data, from.Data, (size_t) from.Size * sizeof(T));
+    }
+public:
+    UiDrawData() = default;
+    UiDrawData(const UiDrawData&) = delete;
+    UiDrawData& operator=(const UiDrawData&) = delete;
+    ~UiDrawData() {
+        for (ImDrawList* list : m_Lists)
+            IM_DELETE(list);
+    }
+
+    void Capture(const ImDrawData* data) {
+        Clear();
+        if (!data || !data->Valid)
+            return;
+        for (int i = 0; i < data->CmdListsCount; ++i) {
+            const ImDrawList* source = data->CmdLists[i];
+            if (m_Count == (int) m_Lists.size())
+                m_Lists.push_back(IM_NEW(ImDrawList)(source->_Data));
+            ImDrawList* list = m_Lists[m_Count++];
+            copy(list->CmdBuffer, source->CmdBuffer);
+            copy(list->IdxBuffer, source->IdxBuffer);
+            copy(list->VtxBuffer, source->VtxBuffer);
+            list->Flags = source->Flags;
+        }
+        m_DisplayPos = data->DisplayPos;
+        m_DisplaySize = data->DisplaySize;
+        m_FramebufferScale = data->FramebufferScale;
+    }
+
+    void Clear() {
+        m_Count = 0;
+    }
+
+    bool Empty() const {
+        return m_Count == 0;
+    }
+
+    // ImDrawData pointing at the copies, valid while this object is unchanged
+    ImDrawData View() const {
+        ImDrawData data;
+        data.Valid = m_Count > 0;
+        data.CmdLists = const_cast<ImDrawList**>(m_Lists.data());
+        data.CmdListsCount = m_Count;
+        for (int i = 0; i < m_Count; ++i) {
+            data.TotalVtxCount += m_Lists[i]->VtxBuffer.Size;
+            data.TotalIdxCount += m_Lists[i]->IdxBuffer.Size;
+        }
+        data.DisplayPos = m_DisplayPos;
+        data.DisplaySize = m_DisplaySize;
+        data.FramebufferScale = m_FramebufferScale;
+        return data;
+    }
+};
+
+// Pixels of a rendered frame, read back by the render thread for a packet that asks for them
+// (golden-image tests). RGB8, top row first.
+class FrameCapture {
+    std::mutex m_Lock;
+    std::condition_variable m_Stored;
+    std::uint64_t m_Frame = 0;
+    bool m_HasFrame = false;
+    int m_Width = 0, m_Height = 0;
+    std::vector<std::uint8_t> m_Pixels;
+
+public:
+    // render thread
+    void Store(std::uint64_t frame, int width, int height, std::vector<std::uint8_t>& pixels) {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Frame = frame;
+            m_HasFrame = true;
+            m_Width = width;
+            m_Height = height;
+            m_Pixels.swap(pixels);
+        }
+        m_Stored.notify_all();
+    }
+
+    // blocks until the given frame was stored, then hands its pixels over
+    void Take(std::uint64_t frame, int& width, int& height, std::vector<std::uint8_t>& pixels) {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Stored.wait(lock, [this, frame] { return m_HasFrame && m_Frame >= frame; });
+        width = m_Width;
+        height = m_Height;
+        pixels.swap(m_Pixels);
+        m_HasFrame = false;
+    }
+};
+
+// Everything the render thread needs for one frame. Filled by the update thread, then only read.
+struct FramePacket {
+    std::uint64_t Frame = 0;
+    int FramebufferWidth = 0, FramebufferHeight = 0;
+    glm::vec3 ClearColor = glm::vec3(0.0f);
+    // camera
+    glm::mat4 Projection = glm::mat4(1.0f);
+    glm::mat4 View = glm::mat4(1.0f);
+    glm::vec3 ViewPosition = glm::vec3(0.0f);
+    // scene
+    std::vector<DrawItem> Draws;
+    LightTable Lights;
+    LightClusters Clusters; // point lights of Lights binned for this view
+    ShadowFrame Shadows;
+    std::uint8_t DepthPrepass = 0; // DepthPrepassClass bits of the materials that get a depth pre-pass
+    bool Lightmaps = false; // static renderables with a baked rect read it instead of the lights
+    bool Probes = false; // dirLight's ambient term from the irradiance probes, when there are any
+    bool Oit = false; // transparent meshes through the weighted blended pass rather than drawn opaque
+    // post processing
+    bool Hdr = false;
+    bool Bloom = false;
+    rg::BloomMethod BloomMethod = rg::BloomMethod::MipChain;
+    float Exposure = 1.0f;
+    DynamicResolutionSettings DynamicResolution;
+    UiDrawData Ui;
+    FrameCapture* Capture = nullptr; // read the finished frame back into this
+    bool Measured = false; // a benchmark frame: its render is held to no heap allocations
+};
+
+// Fixed set of packets cycling between the producer and the consumer. With two packets the update
+// thread fills frame N + 1 while frame N renders, and blocks rather than running further ahead.
+template<typename Packet, size_t N = 2>
+class FramePipeline {
+    // packets in handover order; never more than N of them
+    class Queue {
+        Packet* m_Items[N] = {};
+        size_t m_Head = 0, m_Size = 0;
+    public:
+        bool Empty() const {
+            return m_Size == 0;
+        }
+        void PushBack(Packet* packet) {
+            m_Items[(m_Head + m_Size++) % N] = packet;
+        }
+        Packet* PopFront() {
+            Packet* packet = m_Items[m_Head];
+            m_Head = (m_Head + 1) % N;
+            --m_Size;
+            return packet;
+        }
+    };
+
+    Packet m_Packets[N];
+    Queue m_Free;
+    Queue m_Ready;
+    bool m_Closed = false;
+    std::mutex m_Lock;
+    std::condition_variable m_Changed;
+
+public:
+    FramePipeline() {
+        for (Packet& packet : m_Packets)
+            m_Free.PushBack(&packet);
+    }
+
+    // producer: blocks until a packet is free, nullptr once closed
+    Packet* AcquireForWrite() {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Changed.wait(lock, [this] { return m_Closed || !m_Free.Empty(); });
+        if (m_Closed)
+            return nullptr;
+        return m_Free.PopFront();
+    }
+
+    void Submit(Packet* packet) {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Ready.PushBack(packet);
+        }
+        m_Changed.notify_all();
+    }
+
+    // consumer: blocks until a packet was submitted, nullptr once closed and drained
+    const Packet* AcquireForRead() {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Changed.wait(lock, [this] { return m_Closed || !m_Ready.Empty(); });
+        if (m_Ready.Empty())
+            return nullptr;
+        return m_Ready.PopFront();
+    }
+
+    void Release(const Packet* packet) {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Free.PushBack(const_cast<Packet*>(packet));
+        }
+        m_Changed.notify_all();
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Closed = true;
+        }
+        m_Changed.notify_all();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRAME_PACKET_H
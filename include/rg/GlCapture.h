@@ -0,0 +1,324 @@
+#ifndef PROJECT_BASE_GL_CAPTURE_H
+#define PROJECT_BASE_GL_CAPTURE_H
+
+#include <rg/GlTrace.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace rg {
+
+// Records the GL calls of the render thread into a trace (see rg/GlTrace.h). Start swaps every glad
+// function pointer in RG_GL_TRACE_CALLS for a wrapper that writes the call and then makes it, so
+// it has to run right after gladLoadGLLoader for the trace to hold every resource it later uses.
+// Startup is recorded up to MarkLoaded, then Frames frames; after the last EndFrame the original
+// pointers are back and the file is closed. One capture at a time, GL thread only.
+namespace detail {
+
+// what pointer arguments point to, written before (inputs) or after (outputs) the call
+template<std::uint16_t Op>
+struct GlCapturePayload {
+    template<typename... A>
+    static void Before(GlTraceWriter&, A...) {}
+    template<typename... A>
+    static void After(GlTraceWriter&, A...) {}
+};
+
+template<std::uint16_t Op, typename F>
+struct GlHook;
+
+template<std::uint16_t Op, typename R, typename... A>
+struct GlHook<Op, R (APIENTRYP)(A...)> {
+    static R (APIENTRYP Original)(A...);
+    static GlTraceWriter* Writer;
+
+    static void begin(A... args) {
+        Writer->Begin(Op);
+        int unused[] = {0, (Writer->Put(args), 0)...};
+        (void) unused;
+        GlCapturePayload<Op>::Before(*Writer, args...);
+    }
+
+    template<typename T = R>
+    static typename std::enable_if<std::is_void<T>::value>::type APIENTRY Call(A... args) {
+        begin(args...);
+        Original(args...);
+        GlCapturePayload<Op>::After(*Writer, args...);
+        Writer->End();
+    }
+    template<typename T = R>
+    static typename std::enable_if<!std::is_void<T>::value, T>::type APIENTRY Call(A... args) {
+        begin(args...);
+        T result = Original(args...);
+        Writer->PutResult(result);
+        GlCapturePayload<Op>::After(*Writer, args...);
+        Writer->End();
+        return result;
+    }
+};
+
+template<std::uint16_t Op, typename R, typename... A>
+R (APIENTRYP GlHook<Op, R (APIENTRYP)(A...)>::Original)(A...) = nullptr;
+template<std::uint16_t Op, typename R, typename... A>
+GlTraceWriter* GlHook<Op, R (APIENTRYP)(A...)>::Writer = nullptr;
+
+template<std::uint16_t Op>
+struct GlOpHook : GlHook<Op, typename GlOpTraits<Op>::Function> {};
+
+// queried through the original pointer, so the query itself isn't recorded
+inline GLint glCaptureInteger(GLenum name) {
+    GLint value = 0;
+    if (GlOpHook<GlOpGetIntegerv>::Original)
+        GlOpHook<GlOpGetIntegerv>::Original(name, &value);
+    return value;
+}
+
+// names created by glGen*: after the call; names deleted: before
+#define RG_GL_CAPTURE_GENERATED_NAMES(name) \
+    template<> \
+    struct GlCapturePayload<GlOp##name> { \
+        static void Before(GlTraceWriter&, GLsizei, GLuint*) {} \
+        static void After(GlTraceWriter& w, GLsizei n, GLuint* names) { \
+            w.PutPayload(names, n > 0 ? n * sizeof(GLuint) : 0); \
+        } \
+    };
+#define RG_GL_CAPTURE_DELETED_NAMES(name) \
+    template<> \
+    struct GlCapturePayload<GlOp##name> { \
+        static void Before(GlTraceWriter& w, GLsizei n, const GLuint* names) { \
+            w.PutPayload(names, n > 0 ? n * sizeof(GLuint) : 0); \
+        } \
+        static void After(GlTraceWriter&, GLsizei, const GLuint*) {} \
+    };
+RG_GL_CAPTURE_GENERATED_NAMES(GenBuffers)
+RG_GL_CAPTURE_GENERATED_NAMES(GenFramebuffers)
+RG_GL_CAPTURE_GENERATED_NAMES(GenQueries)
+RG_GL_CAPTURE_GENERATED_NAMES(GenRenderbuffers)
+RG_GL_CAPTURE_GENERATED_NAMES(GenTextures)
+RG_GL_CAPTURE_GENERATED_NAMES(GenVertexArrays)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteBuffers)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteFramebuffers)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteQueries)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteRenderbuffers)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteTextures)
+RG_GL_CAPTURE_DELETED_NAMES(DeleteVertexArrays)
+#undef RG_GL_CAPTURE_GENERATED_NAMES
+#undef RG_GL_CAPTURE_DELETED_NAMES
+
+// glUniform*v and glUniformMatrix*fv: count elements of the given number of values
+#define RG_GL_CAPTURE_UNIFORM_ARRAY(name, type, values) \
+    template<> \
+    struct GlCapturePayload<GlOp##name> { \
+        static void Before(GlTraceWriter& w, GLint, GLsizei count, const type* data) { \
+            w.PutPayload(data, count > 0 ? count * (values) * sizeof(type) : 0); \
+        } \
+        static void After(GlTraceWriter&, GLint, GLsizei, const type*) {} \
+    };
+#define RG_GL_CAPTURE_UNIFORM_MATRIX(name, values) \
+    template<> \
+    struct GlCapturePayload<GlOp##name> { \
+        static void Before(GlTraceWriter& w, GLint, GLsizei count, GLboolean, const GLfloat* data) { \
+            w.PutPayload(data, count > 0 ? count * (values) * sizeof(GLfloat) : 0); \
+        } \
+        static void After(GlTraceWriter&, GLint, GLsizei, GLboolean, const GLfloat*) {} \
+    };
+RG_GL_CAPTURE_UNIFORM_ARRAY(Uniform1fv, GLfloat, 1)
+RG_GL_CAPTURE_UNIFORM_ARRAY(Uniform1iv, GLint, 1)
+RG_GL_CAPTURE_UNIFORM_ARRAY(Uniform2fv, GLfloat, 2)
+RG_GL_CAPTURE_UNIFORM_ARRAY(Uniform3fv, GLfloat, 3)
+RG_GL_CAPTURE_UNIFORM_ARRAY(Uniform4fv, GLfloat, 4)
+RG_GL_CAPTURE_UNIFORM_MATRIX(UniformMatrix2fv, 4)
+RG_GL_CAPTURE_UNIFORM_MATRIX(UniformMatrix3fv, 9)
+RG_GL_CAPTURE_UNIFORM_MATRIX(UniformMatrix4fv, 16)
+#undef RG_GL_CAPTURE_UNIFORM_ARRAY
+#undef RG_GL_CAPTURE_UNIFORM_MATRIX
+
+template<>
+struct GlCapturePayload<GlOpBufferData> {
+    static void Before(GlTraceWriter& w, GLenum, GLsizeiptr size, const void* data, GLenum) {
+        w.PutPayload(data, size > 0 ? (size_t) size : 0);
+    }
+    static void After(GlTraceWriter&, GLenum, GLsizeiptr, const void*, GLenum) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpBufferSubData> {
+    static void Before(GlTraceWriter& w, GLenum, GLintptr, GLsizeiptr size, const void* data) {
+        w.PutPayload(data, size > 0 ? (size_t) size : 0);
+    }
+    static void After(GlTraceWriter&, GLenum, GLintptr, GLsizeiptr, const void*) {}
+};
+
+// client memory as the unpack state describes it; skip pixels/rows are left at 0 by all our code
+inline size_t glCaptureUnpackBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type) {
+    if (glCaptureInteger(GL_PIXEL_UNPACK_BUFFER_BINDING) != 0)
+        return 0; // pixels is an offset into a buffer, nothing to copy
+    size_t slice = GlImageBytes(width, height, format, type, glCaptureInteger(GL_UNPACK_ROW_LENGTH),
+                                glCaptureInteger(GL_UNPACK_ALIGNMENT));
+    if (depth <= 1)
+        return slice;
+    size_t pixel = GlPixelBytes(format, type);
+    size_t row = (size_t) width * pixel;
+    GLint alignment = glCaptureInteger(GL_UNPACK_ALIGNMENT);
+    row = (row + alignment - 1) / alignment * alignment;
+    return row * height * (depth - 1) + slice;
+}
+
+template<>
+struct GlCapturePayload<GlOpTexImage2D> {
+    static void Before(GlTraceWriter& w, GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format,
+                       GLenum type, const void* pixels) {
+        if (pixels)
+            w.PutPayload(pixels, glCaptureUnpackBytes(width, height, 1, format, type));
+    }
+    static void After(GlTraceWriter&, GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpTexImage3D> {
+    static void Before(GlTraceWriter& w, GLenum, GLint, GLint, GLsizei width, GLsizei height, GLsizei depth, GLint,
+                       GLenum format, GLenum type, const void* pixels) {
+        if (pixels)
+            w.PutPayload(pixels, glCaptureUnpackBytes(width, height, depth, format, type));
+    }
+    static void After(GlTraceWriter&, GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum,
+                      const void*) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpTexSubImage2D> {
+    static void Before(GlTraceWriter& w, GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format,
+                       GLenum type, const void* pixels) {
+        if (pixels)
+            w.PutPayload(pixels, glCaptureUnpackBytes(width, height, 1, format, type));
+    }
+    static void After(GlTraceWriter&, GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpTexParameterfv> {
+    static void Before(GlTraceWriter& w, GLenum, GLenum pname, const GLfloat* params) {
+        w.PutPayload(params, (pname == GL_TEXTURE_BORDER_COLOR ? 4 : 1) * sizeof(GLfloat));
+    }
+    static void After(GlTraceWriter&, GLenum, GLenum, const GLfloat*) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpClearBufferfv> {
+    static void Before(GlTraceWriter& w, GLenum buffer, GLint, const GLfloat* value) {
+        w.PutPayload(value, (buffer == GL_COLOR ? 4 : 1) * sizeof(GLfloat));
+    }
+    static void After(GlTraceWriter&, GLenum, GLint, const GLfloat*) {}
+};
+
+template<>
+struct GlCapturePayload<GlOpDrawBuffers> {
+    static void Before(GlTraceWriter& w, GLsizei n, const GLenum* buffers) {
+        w.PutPayload(buffers, n > 0 ? n * sizeof(GLenum) : 0);
+    }
+    static void After(GlTraceWriter&, GLsizei, const GLenum*) {}
+};
+
+// all strings joined, the replay passes them as one
+template<>
+struct GlCapturePayload<GlOpShaderSource> {
+    static void Before(GlTraceWriter& w, GLuint, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+        for (GLsizei i = 0; i < count; ++i) {
+            size_t length = lengths && lengths[i] >= 0 ? (size_t) lengths[i] : std::strlen(strings[i]);
+            w.PutPayload(strings[i], length);
+        }
+    }
+    static void After(GlTraceWriter&, GLuint, GLsizei, const GLchar* const*, const GLint*) {}
+};
+
+#define RG_GL_CAPTURE_LOCATION_NAME(name) \
+    template<> \
+    struct GlCapturePayload<GlOp##name> { \
+        static void Before(GlTraceWriter& w, GLuint, const GLchar* location) { \
+            w.PutPayload(location, std::strlen(location) + 1); \
+        } \
+        static void After(GlTraceWriter&, GLuint, const GLchar*) {} \
+    };
+RG_GL_CAPTURE_LOCATION_NAME(GetUniformLocation)
+RG_GL_CAPTURE_LOCATION_NAME(GetAttribLocation)
+#undef RG_GL_CAPTURE_LOCATION_NAME
+
+}
+
+class GlCapture {
+    GlTraceWriter m_Writer;
+    std::string m_Path;
+    int m_Frames = 0;
+    int m_FramesLeft = 0;
+    bool m_Loaded = false;
+
+    void install() {
+#define RG_GL_CAPTURE_INSTALL(name) \
+        detail::GlOpHook<GlOp##name>::Original = glad_gl##name; \
+        detail::GlOpHook<GlOp##name>::Writer = &m_Writer; \
+        if (glad_gl##name) \
+            glad_gl##name = &detail::GlOpHook<GlOp##name>::Call;
+        RG_GL_TRACE_CALLS(RG_GL_CAPTURE_INSTALL)
+#undef RG_GL_CAPTURE_INSTALL
+    }
+    void uninstall() {
+#define RG_GL_CAPTURE_UNINSTALL(name) \
+        if (detail::GlOpHook<GlOp##name>::Original) \
+            glad_gl##name = detail::GlOpHook<GlOp##name>::Original;
+        RG_GL_TRACE_CALLS(RG_GL_CAPTURE_UNINSTALL)
+#undef RG_GL_CAPTURE_UNINSTALL
+    }
+
+public:
+    ~GlCapture() {
+        Stop();
+    }
+
+    bool Active() const {
+        return m_Writer.IsOpen();
+    }
+
+    // width and height of the default framebuffer, the replay sizes its stand-in for it from them
+    bool Start(const std::string& path, int frames, int width, int height) {
+        if (Active() || !m_Writer.Open(path, (std::uint32_t) width, (std::uint32_t) height))
+            return false;
+        m_Path = path;
+        m_Frames = m_FramesLeft = frames;
+        m_Loaded = false;
+        install();
+        return true;
+    }
+
+    void MarkLoaded() {
+        if (Active() && !m_Loaded) {
+            m_Writer.Marker(GlOpLoaded);
+            m_Loaded = true;
+        }
+    }
+
+    // after the frame is presented; stops once the requested frames are in
+    void EndFrame() {
+        if (!Active() || !m_Loaded)
+            return;
+        m_Writer.Marker(GlOpFrameEnd);
+        if (--m_FramesLeft <= 0)
+            Stop();
+    }
+
+    void Stop() {
+        if (!Active())
+            return;
+        uninstall();
+        std::uint64_t records = m_Writer.Records();
+        std::uint64_t bytes = m_Writer.Bytes();
+        if (m_Writer.Close())
+            std::cout << "GL capture: " << (m_Frames - m_FramesLeft) << " frames, " << records << " records, "
+                      << bytes / (1024.0 * 1024.0) << " MB -> " << m_Path << std::endl;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_GL_CAPTURE_H
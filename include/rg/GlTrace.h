@@ -0,0 +1,340 @@
+#ifndef PROJECT_BASE_GL_TRACE_H
+#define PROJECT_BASE_GL_TRACE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace rg {
+
+// Binary GL command trace, written by GlCapture and played back by bench/gl_replay.cpp.
+//
+// File: "RGGT", then version, width and height of the default framebuffer as 32-bit values, then one
+// record per call: 16-bit op, 32-bit size of the rest, the arguments, the result (calls returning
+// a value other than a pointer) and the payload (what pointer arguments point to: buffer and texture
+// data, shader sources, uniform arrays, generated names). Arguments take their native size, pointers
+// 64 bits; everything is in the byte order and type sizes of the capturing machine, so traces are
+// replayed on the same kind of machine they come from.
+//
+// Every GL function the renderer, ImGui and the loaders call is listed here; a call to a function
+// missing from the list simply isn't recorded, so new GL calls belong here as well.
+#define RG_GL_TRACE_CALLS(X) \
+    X(ActiveTexture) X(AttachShader) X(BeginQuery) X(BindBuffer) X(BindFramebuffer) X(BindRenderbuffer) \
+    X(BindSampler) X(BindTexture) X(BindVertexArray) X(BlendEquation) X(BlendEquationSeparate) X(BlendFunc) \
+    X(BlendFuncSeparate) X(BlitFramebuffer) X(BufferData) X(BufferSubData) X(CheckFramebufferStatus) X(Clear) \
+    X(ClearBufferfv) X(ClearColor) X(ClearDepth) X(ColorMask) X(CompileShader) X(CreateProgram) X(CreateShader) \
+    X(CullFace) X(DeleteBuffers) X(DeleteFramebuffers) X(DeleteProgram) X(DeleteQueries) X(DeleteRenderbuffers) \
+    X(DeleteShader) X(DeleteTextures) X(DeleteVertexArrays) X(DepthFunc) X(DepthMask) X(DetachShader) X(Disable) \
+    X(DrawArrays) X(DrawArraysInstanced) X(DrawBuffer) X(DrawBuffers) X(DrawElements) X(DrawElementsBaseVertex) \
+    X(DrawElementsInstanced) X(Enable) X(EnableVertexAttribArray) X(EndQuery) X(Finish) X(Flush) \
+    X(FramebufferRenderbuffer) X(FramebufferTexture2D) X(FramebufferTextureLayer) X(GenBuffers) \
+    X(GenFramebuffers) X(GenQueries) X(GenRenderbuffers) X(GenTextures) X(GenVertexArrays) X(GenerateMipmap) \
+    X(GetAttribLocation) X(GetError) X(GetIntegerv) X(GetProgramInfoLog) X(GetProgramiv) X(GetQueryObjectiv) \
+    X(GetQueryObjectui64v) X(GetShaderInfoLog) X(GetShaderiv) X(GetString) X(GetTexImage) \
+    X(GetTexLevelParameteriv) X(GetUniformLocation) X(IsEnabled) X(LinkProgram) X(PixelStorei) X(PolygonMode) \
+    X(PolygonOffset) X(QueryCounter) X(ReadBuffer) X(ReadPixels) X(RenderbufferStorage) X(Scissor) \
+    X(ShaderSource) X(TexBuffer) X(TexImage2D) X(TexImage3D) X(TexParameterf) X(TexParameterfv) X(TexParameteri) \
+    X(TexSubImage2D) X(Uniform1f) X(Uniform1fv) X(Uniform1i) X(Uniform1iv) X(Uniform2f) X(Uniform2fv) \
+    X(Uniform3f) X(Uniform3fv) X(Uniform4f) X(Uniform4fv) X(UniformMatrix2fv) X(UniformMatrix3fv) \
+    X(UniformMatrix4fv) X(UseProgram) X(VertexAttribDivisor) X(VertexAttribPointer) X(Viewport)
+
+enum GlTraceOp : std::uint16_t {
+#define RG_GL_TRACE_OP(name) GlOp##name,
+    RG_GL_TRACE_CALLS(RG_GL_TRACE_OP)
+#undef RG_GL_TRACE_OP
+    GlOpCount,
+    GlOpLoaded = 0xfffe, // marker: everything before is startup (resources), everything after frames
+    GlOpFrameEnd = 0xffff // marker: a frame was presented
+};
+
+inline const char* GlTraceOpName(std::uint16_t op) {
+    static const char* names[] = {
+#define RG_GL_TRACE_NAME(name) "gl" #name,
+            RG_GL_TRACE_CALLS(RG_GL_TRACE_NAME)
+#undef RG_GL_TRACE_NAME
+    };
+    if (op == GlOpLoaded)
+        return "<loaded>";
+    if (op == GlOpFrameEnd)
+        return "<frame end>";
+    return op < GlOpCount ? names[op] : "<unknown>";
+}
+
+// the glad function pointer of each op: GlOpTraits<GlOpBindTexture>::Pointer() is glad_glBindTexture
+template<std::uint16_t Op>
+struct GlOpTraits;
+#define RG_GL_TRACE_TRAITS(name) \
+    template<> \
+    struct GlOpTraits<GlOp##name> { \
+        typedef decltype(glad_gl##name) Function; \
+        static Function& Pointer() { \
+            return glad_gl##name; \
+        } \
+    };
+RG_GL_TRACE_CALLS(RG_GL_TRACE_TRAITS)
+#undef RG_GL_TRACE_TRAITS
+
+const char GL_TRACE_MAGIC[4] = {'R', 'G', 'G', 'T'};
+const std::uint32_t GL_TRACE_VERSION = 1;
+
+// bytes of one pixel in client memory for a format/type pair, 0 when unknown
+inline size_t GlPixelBytes(GLenum format, GLenum type) {
+    switch (type) {
+        case GL_UNSIGNED_INT_24_8:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_5_9_9_9_REV:
+        case GL_UNSIGNED_INT_8_8_8_8:
+        case GL_UNSIGNED_INT_8_8_8_8_REV:
+            return 4;
+        default:
+            break;
+    }
+    size_t components = 0;
+    switch (format) {
+        case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: components = 1; break;
+        case GL_RG: case GL_RG_INTEGER: components = 2; break;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+        case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: components = 4; break;
+        default: return 0;
+    }
+    switch (type) {
+        case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+        case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+        case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return components * 4;
+        default: return 0;
+    }
+}
+
+// bytes a width x height image takes in client memory with the given row length (0: width) and
+// alignment, i.e. what glTexImage2D reads or glReadPixels writes
+inline size_t GlImageBytes(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint rowLength,
+                           GLint alignment) {
+    size_t pixel = GlPixelBytes(format, type);
+    if (width <= 0 || height <= 0 || pixel == 0)
+        return 0;
+    size_t row = (size_t) (rowLength > 0 ? rowLength : width) * pixel;
+    if (alignment > 1)
+        row = (row + alignment - 1) / alignment * alignment;
+    return row * (height - 1) + (size_t) width * pixel;
+}
+
+// Builds one record at a time and appends it to a file through a large buffer.
+class GlTraceWriter {
+    std::FILE* m_File = nullptr;
+    std::vector<char> m_Buffer;
+    std::vector<char> m_Args;
+    std::vector<char> m_Payload;
+    std::uint16_t m_Op = 0;
+    std::uint64_t m_Records = 0;
+    std::uint64_t m_Bytes = 0;
+
+    static const size_t FLUSH_BYTES = 4u << 20;
+
+    void append(std::vector<char>& out, const void* data, size_t size) {
+        const char* bytes = (const char*) data;
+        out.insert(out.end(), bytes, bytes + size);
+    }
+    bool flush() {
+        bool ok = m_Buffer.empty() || std::fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) == m_Buffer.size();
+        m_Bytes += m_Buffer.size();
+        m_Buffer.clear();
+        return ok;
+    }
+
+public:
+    ~GlTraceWriter() {
+        Close();
+    }
+
+    bool Open(const std::string& path, std::uint32_t width, std::uint32_t height) {
+        m_File = std::fopen(path.c_str(), "wb");
+        if (!m_File) {
+            std::cout << "ERROR::GL_TRACE::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        m_Buffer.reserve(FLUSH_BYTES + (1u << 20));
+        std::uint32_t header[3] = {GL_TRACE_VERSION, width, height};
+        append(m_Buffer, GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC));
+        append(m_Buffer, header, sizeof(header));
+        m_Records = 0;
+        m_Bytes = 0;
+        return true;
+    }
+
+    bool Close() {
+        if (!m_File)
+            return true;
+        bool ok = flush();
+        ok = std::fclose(m_File) == 0 && ok;
+        m_File = nullptr;
+        if (!ok)
+            std::cout << "ERROR::GL_TRACE::WRITE_FAILED" << std::endl;
+        return ok;
+    }
+
+    bool IsOpen() const {
+        return m_File != nullptr;
+    }
+    std::uint64_t Records() const {
+        return m_Records;
+    }
+    std::uint64_t Bytes() const {
+        return m_Bytes + m_Buffer.size();
+    }
+
+    void Begin(std::uint16_t op) {
+        m_Op = op;
+        m_Args.clear();
+        m_Payload.clear();
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type Put(T value) {
+        append(m_Args, &value, sizeof(T));
+    }
+    template<typename T>
+    void Put(T* pointer) {
+        std::uint64_t value = (std::uint64_t) (std::uintptr_t) pointer;
+        append(m_Args, &value, sizeof(value));
+    }
+    // results go right after the arguments; pointer results (glGetString) aren't kept
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type PutResult(T value) {
+        append(m_Args, &value, sizeof(T));
+    }
+    template<typename T>
+    void PutResult(T*) {}
+
+    void PutPayload(const void* data, size_t size) {
+        if (data && size)
+            append(m_Payload, data, size);
+    }
+
+    void End() {
+        std::uint32_t size = (std::uint32_t) (m_Args.size() + m_Payload.size());
+        append(m_Buffer, &m_Op, sizeof(m_Op));
+        append(m_Buffer, &size, sizeof(size));
+        m_Buffer.insert(m_Buffer.end(), m_Args.begin(), m_Args.end());
+        m_Buffer.insert(m_Buffer.end(), m_Payload.begin(), m_Payload.end());
+        ++m_Records;
+        if (m_Buffer.size() >= FLUSH_BYTES && !flush())
+            std::cout << "ERROR::GL_TRACE::WRITE_FAILED" << std::endl;
+    }
+
+    void Marker(std::uint16_t op) {
+        Begin(op);
+        End();
+    }
+};
+
+struct GlTraceRecord {
+    std::uint16_t Op;
+    const char* Data; // arguments, result, payload
+    std::uint32_t Size;
+};
+
+// Loads a whole trace into memory and hands out its records in order.
+class GlTraceReader {
+    std::vector<char> m_Data;
+    size_t m_Offset = 0;
+
+public:
+    std::uint32_t Width = 0;
+    std::uint32_t Height = 0;
+
+    bool Load(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            std::cout << "ERROR::GL_TRACE::NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        m_Data.resize(size > 0 ? (size_t) size : 0);
+        bool ok = !m_Data.empty() && std::fread(m_Data.data(), 1, m_Data.size(), file) == m_Data.size();
+        std::fclose(file);
+        std::uint32_t header[3];
+        ok = ok && m_Data.size() >= sizeof(GL_TRACE_MAGIC) + sizeof(header)
+             && std::memcmp(m_Data.data(), GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC)) == 0;
+        if (ok) {
+            std::memcpy(header, m_Data.data() + sizeof(GL_TRACE_MAGIC), sizeof(header));
+            ok = header[0] == GL_TRACE_VERSION;
+            Width = header[1];
+            Height = header[2];
+        }
+        if (!ok) {
+            std::cout << "ERROR::GL_TRACE::INVALID " << path << std::endl;
+            m_Data.clear();
+            return false;
+        }
+        Rewind();
+        return true;
+    }
+
+    void Rewind() {
+        m_Offset = sizeof(GL_TRACE_MAGIC) + 3 * sizeof(std::uint32_t);
+    }
+    size_t Offset() const {
+        return m_Offset;
+    }
+    void Seek(size_t offset) {
+        m_Offset = offset;
+    }
+
+    // false at the end, or when the last record is cut short
+    bool Next(GlTraceRecord& record) {
+        const size_t headerBytes = sizeof(std::uint16_t) + sizeof(std::uint32_t);
+        if (m_Offset + headerBytes > m_Data.size())
+            return false;
+        std::memcpy(&record.Op, &m_Data[m_Offset], sizeof(record.Op));
+        std::memcpy(&record.Size, &m_Data[m_Offset + sizeof(record.Op)], sizeof(record.Size));
+        if (m_Offset + headerBytes + record.Size > m_Data.size())
+            return false;
+        record.Data = m_Data.data() + m_Offset + headerBytes;
+        m_Offset += headerBytes + record.Size;
+        return true;
+    }
+};
+
+// Reads the arguments of a record back in the order they were written.
+class GlArgReader {
+    const char* m_Data;
+    const char* m_End;
+
+public:
+    explicit GlArgReader(const GlTraceRecord& record) : m_Data(record.Data), m_End(record.Data + record.Size) {}
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value, T>::type Get() {
+        T value = T();
+        if (m_Data + sizeof(T) <= m_End)
+            std::memcpy(&value, m_Data, sizeof(T));
+        m_Data += sizeof(T);
+        return value;
+    }
+    template<typename T>
+    typename std::enable_if<std::is_pointer<T>::value, T>::type Get() {
+        std::uint64_t value = Get<std::uint64_t>();
+        return (T) (std::uintptr_t) value;
+    }
+
+    // what is left after the arguments and result: the payload
+    const char* Payload() const {
+        return m_Data < m_End ? m_Data : nullptr;
+    }
+    size_t PayloadSize() const {
+        return m_Data < m_End ? (size_t) (m_End - m_Data) : 0;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_GL_TRACE_H
@@ -0,0 +1,305 @@
+#ifndef PROJECT_BASE_GPU_PROFILER_H
+#define PROJECT_BASE_GPU_PROFILER_H
+
+#include <glad/glad.h>
+#include <rg/CpuProfiler.h>
+#include <rg/Metrics.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace rg {
+
+// GPU time of one pass, in milliseconds. Last* are from the newest frame that came back, the rest
+// over the last GPU_PROFILER_HISTORY of them.
+struct GpuPassStats {
+    const char* Name = "";
+    int Depth = 0;
+    float LastStartMs = 0.0f; // since the start of the frame
+    float LastMs = 0.0f;
+    float AverageMs = 0.0f;
+    float MinMs = 0.0f;
+    float MaxMs = 0.0f;
+};
+
+struct GpuProfile {
+    GpuPassStats Frame;
+    std::vector<GpuPassStats> Passes; // in the order they were first seen
+    std::uint64_t DroppedFrames = 0;
+};
+
+const int GPU_PROFILER_HISTORY = 120;
+const int GPU_PROFILER_FRAMES = 4;
+const int GPU_PROFILER_MAX_SCOPES = 32;
+
+// Per-pass GPU timings from timer queries. Each pass gets a GL_TIMESTAMP query at its start and its
+// end, the whole frame a GL_TIME_ELAPSED one. Queries cycle through GPU_PROFILER_FRAMES sets, so a
+// frame's results are read that many frames later when the GPU is long done with them; a set that
+// still isn't available is dropped rather than waited for. All GL calls belong on the thread owning
+// the context, Snapshot can be called from any thread. With RG_PROFILER scopes also go to the CPU
+// profiler, so the trace shows what each pass cost to submit.
+class GpuProfiler {
+public:
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    void Init() {
+        for (FrameQueries& frame : m_Frames) {
+            glGenQueries(2 * GPU_PROFILER_MAX_SCOPES, frame.Timestamps);
+            glGenQueries(1, &frame.FrameStart);
+            glGenQueries(1, &frame.Elapsed);
+        }
+        metrics::Render().GlObjects.Add(GPU_PROFILER_FRAMES * (2 * GPU_PROFILER_MAX_SCOPES + 2));
+        m_Initialized = true;
+    }
+
+    void Shutdown() {
+        if (!m_Initialized)
+            return;
+        for (FrameQueries& frame : m_Frames) {
+            glDeleteQueries(2 * GPU_PROFILER_MAX_SCOPES, frame.Timestamps);
+            glDeleteQueries(1, &frame.FrameStart);
+            glDeleteQueries(1, &frame.Elapsed);
+            frame.Pending = false;
+        }
+        metrics::Render().GlObjects.Add(-GPU_PROFILER_FRAMES * (2 * GPU_PROFILER_MAX_SCOPES + 2));
+        m_Initialized = false;
+    }
+
+    void BeginFrame() {
+        FrameQueries& frame = m_Frames[m_Frame % GPU_PROFILER_FRAMES];
+        if (frame.Pending)
+            collect(frame);
+        frame.ScopeCount = 0;
+        m_Stack.clear();
+#ifdef RG_PROFILER
+        m_CpuStack.clear();
+#endif
+        glQueryCounter(frame.FrameStart, GL_TIMESTAMP);
+        glBeginQuery(GL_TIME_ELAPSED, frame.Elapsed);
+    }
+
+    void EndFrame() {
+        FrameQueries& frame = m_Frames[m_Frame % GPU_PROFILER_FRAMES];
+        glEndQuery(GL_TIME_ELAPSED);
+        frame.Pending = true;
+        ++m_Frame;
+    }
+
+    // name must outlive the profiler, string literals in practice
+    void BeginScope(const char* name) {
+        FrameQueries& frame = m_Frames[m_Frame % GPU_PROFILER_FRAMES];
+#ifdef RG_PROFILER
+        m_CpuStack.push_back(CpuScope{name, profiler::Now()});
+#endif
+        if (frame.ScopeCount == GPU_PROFILER_MAX_SCOPES) {
+            m_Stack.push_back(-1);
+            return;
+        }
+        int scope = frame.ScopeCount++;
+        frame.Names[scope] = name;
+        frame.Depths[scope] = (int) m_Stack.size();
+        glQueryCounter(frame.Timestamps[2 * scope], GL_TIMESTAMP);
+        m_Stack.push_back(scope);
+    }
+
+    void EndScope() {
+        int scope = m_Stack.back();
+        m_Stack.pop_back();
+        if (scope >= 0)
+            glQueryCounter(m_Frames[m_Frame % GPU_PROFILER_FRAMES].Timestamps[2 * scope + 1], GL_TIMESTAMP);
+#ifdef RG_PROFILER
+        profiler::Record(m_CpuStack.back().Name, m_CpuStack.back().Start, profiler::Now());
+        m_CpuStack.pop_back();
+#endif
+    }
+
+    GpuProfile Snapshot() const {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        GpuProfile profile;
+        profile.Frame = m_FrameRecord.Stats();
+        for (const PassRecord& record : m_Passes)
+            profile.Passes.push_back(record.Stats());
+        profile.DroppedFrames = m_Dropped;
+        return profile;
+    }
+
+    // GPU time of the newest frame that came back since the last call, 0 when none did. Same thread
+    // as BeginFrame, for code that reacts to the frame time (DynamicResolution).
+    float TakeFrameMs() {
+        float ms = m_NewFrameMs;
+        m_NewFrameMs = 0.0f;
+        return ms;
+    }
+
+private:
+    struct FrameQueries {
+        GLuint Timestamps[2 * GPU_PROFILER_MAX_SCOPES] = {};
+        GLuint FrameStart = 0;
+        GLuint Elapsed = 0;
+        const char* Names[GPU_PROFILER_MAX_SCOPES] = {};
+        int Depths[GPU_PROFILER_MAX_SCOPES] = {};
+        int ScopeCount = 0;
+        bool Pending = false;
+    };
+
+    struct PassRecord {
+        GpuPassStats Last;
+        float History[GPU_PROFILER_HISTORY] = {};
+        int Count = 0;
+        int Next = 0;
+
+        void Add(float startMs, float ms) {
+            Last.LastStartMs = startMs;
+            Last.LastMs = ms;
+            History[Next] = ms;
+            Next = (Next + 1) % GPU_PROFILER_HISTORY;
+            Count = std::min(Count + 1, GPU_PROFILER_HISTORY);
+        }
+
+        GpuPassStats Stats() const {
+            GpuPassStats stats = Last;
+            if (Count == 0)
+                return stats;
+            float sum = 0.0f;
+            stats.MinMs = stats.MaxMs = History[0];
+            for (int i = 0; i < Count; ++i) {
+                sum += History[i];
+                stats.MinMs = std::min(stats.MinMs, History[i]);
+                stats.MaxMs = std::max(stats.MaxMs, History[i]);
+            }
+            stats.AverageMs = sum / Count;
+            return stats;
+        }
+    };
+
+    // the elapsed query ends after every timestamp of its frame, once it is in the rest are too
+    void collect(FrameQueries& frame) {
+        frame.Pending = false;
+        GLint available = 0;
+        glGetQueryObjectiv(frame.Elapsed, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            ++m_Dropped;
+            return;
+        }
+        GLuint64 elapsed = 0, frameStart = 0;
+        glGetQueryObjectui64v(frame.Elapsed, GL_QUERY_RESULT, &elapsed);
+        glGetQueryObjectui64v(frame.FrameStart, GL_QUERY_RESULT, &frameStart);
+        GLuint64 times[2 * GPU_PROFILER_MAX_SCOPES];
+        for (int i = 0; i < 2 * frame.ScopeCount; ++i)
+            glGetQueryObjectui64v(frame.Timestamps[i], GL_QUERY_RESULT, &times[i]);
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_FrameRecord.Last.Name = "frame";
+        m_FrameRecord.Add(0.0f, (float) (elapsed * 1e-6));
+        m_NewFrameMs = (float) (elapsed * 1e-6);
+        for (int scope = 0; scope < frame.ScopeCount; ++scope) {
+            GLuint64 begin = times[2 * scope], end = std::max(times[2 * scope + 1], begin);
+            PassRecord& record = find(frame.Names[scope], frame.Depths[scope]);
+            record.Add((float) ((begin - std::min(begin, frameStart)) * 1e-6), (float) ((end - begin) * 1e-6));
+        }
+    }
+
+    PassRecord& find(const char* name, int depth) {
+        for (PassRecord& record : m_Passes) {
+            if (record.Last.Depth == depth && (record.Last.Name == name || std::strcmp(record.Last.Name, name) == 0))
+                return record;
+        }
+        m_Passes.emplace_back();
+        m_Passes.back().Last.Name = name;
+        m_Passes.back().Last.Depth = depth;
+        return m_Passes.back();
+    }
+
+    FrameQueries m_Frames[GPU_PROFILER_FRAMES];
+    std::uint64_t m_Frame = 0;
+    std::vector<int> m_Stack; // open scopes, -1 for ones past GPU_PROFILER_MAX_SCOPES
+#ifdef RG_PROFILER
+    struct CpuScope {
+        const char* Name;
+        std::uint64_t Start;
+    };
+
+    std::vector<CpuScope> m_CpuStack;
+#endif
+    bool m_Initialized = false;
+    float m_NewFrameMs = 0.0f;
+
+    mutable std::mutex m_Lock;
+    PassRecord m_FrameRecord;
+    std::vector<PassRecord> m_Passes;
+    std::uint64_t m_Dropped = 0;
+};
+
+// Samples that passed the depth test between Begin and End, from a GL_SAMPLES_PASSED query per frame.
+// Around a lit pass that is the number of fragments it shaded, overdraw included; divided by the
+// target's pixels it's the overdraw factor. Read back GPU_PROFILER_FRAMES frames late like the timer
+// queries, a query that isn't done by then is skipped. One per frame, queries of a kind don't nest.
+class FragmentCounter {
+    GLuint m_Queries[GPU_PROFILER_FRAMES] = {};
+    bool m_Pending[GPU_PROFILER_FRAMES] = {};
+    std::uint64_t m_Frame = 0;
+    std::uint64_t m_Last = 0;
+
+public:
+    void Init() {
+        glGenQueries(GPU_PROFILER_FRAMES, m_Queries);
+        metrics::Render().GlObjects.Add(GPU_PROFILER_FRAMES);
+    }
+
+    void Shutdown() {
+        if (!m_Queries[0])
+            return;
+        glDeleteQueries(GPU_PROFILER_FRAMES, m_Queries);
+        metrics::Render().GlObjects.Add(-GPU_PROFILER_FRAMES);
+        std::fill(m_Queries, m_Queries + GPU_PROFILER_FRAMES, 0u);
+    }
+
+    void Begin() {
+        int slot = (int) (m_Frame % GPU_PROFILER_FRAMES);
+        if (m_Pending[slot]) {
+            GLint available = 0;
+            glGetQueryObjectiv(m_Queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 samples = 0;
+                glGetQueryObjectui64v(m_Queries[slot], GL_QUERY_RESULT, &samples);
+                m_Last = samples;
+            }
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, m_Queries[slot]);
+    }
+
+    void End() {
+        glEndQuery(GL_SAMPLES_PASSED);
+        m_Pending[m_Frame % GPU_PROFILER_FRAMES] = true;
+        ++m_Frame;
+    }
+
+    // newest frame that came back
+    std::uint64_t Last() const {
+        return m_Last;
+    }
+};
+
+// Times the enclosing block as one pass.
+class GpuScope {
+    GpuProfiler& m_Profiler;
+public:
+    GpuScope(GpuProfiler& profiler, const char* name) : m_Profiler(profiler) {
+        m_Profiler.BeginScope(name);
+    }
+    ~GpuScope() {
+        m_Profiler.EndScope();
+    }
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+};
+
+}
+
+#endif //PROJECT_BASE_GPU_PROFILER_H
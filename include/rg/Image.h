@@ -0,0 +1,144 @@
+#ifndef PROJECT_BASE_IMAGE_H
+#define PROJECT_BASE_IMAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// 8-bit RGB, top row first.
+struct Image {
+    int Width = 0;
+    int Height = 0;
+    std::vector<std::uint8_t> Pixels;
+
+    bool Empty() const {
+        return Pixels.empty();
+    }
+};
+
+// binary PPM (P6): no image library needed and trivially diffable by other tools
+inline bool WritePpm(const std::string& path, const Image& image) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::IMAGE::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    std::fprintf(file, "P6\n%d %d\n255\n", image.Width, image.Height);
+    bool ok = std::fwrite(image.Pixels.data(), 1, image.Pixels.size(), file) == image.Pixels.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+        std::cout << "ERROR::IMAGE::CANNOT_WRITE " << path << std::endl;
+    return ok;
+}
+
+// quiet when the file doesn't exist, callers decide whether that is an error
+inline bool ReadPpm(const std::string& path, Image& image) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    int width = 0, height = 0, maxValue = 0;
+    bool ok = std::fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) == 3 && std::fgetc(file) != EOF
+              && width > 0 && height > 0 && maxValue == 255;
+    if (ok) {
+        image.Width = width;
+        image.Height = height;
+        image.Pixels.resize((size_t) width * height * 3);
+        ok = std::fread(image.Pixels.data(), 1, image.Pixels.size(), file) == image.Pixels.size();
+    }
+    std::fclose(file);
+    if (!ok)
+        std::cout << "ERROR::IMAGE::INVALID_PPM " << path << std::endl;
+    return ok;
+}
+
+// averages factor x factor blocks; edges that don't fill a block are dropped
+inline Image Downsample(const Image& image, int factor) {
+    Image result;
+    result.Width = image.Width / factor;
+    result.Height = image.Height / factor;
+    result.Pixels.resize((size_t) result.Width * result.Height * 3);
+    for (int y = 0; y < result.Height; ++y) {
+        for (int x = 0; x < result.Width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int dy = 0; dy < factor; ++dy) {
+                    const std::uint8_t* row = &image.Pixels[((size_t) (y * factor + dy) * image.Width + x * factor) * 3];
+                    for (int dx = 0; dx < factor; ++dx)
+                        sum += row[dx * 3 + c];
+                }
+                result.Pixels[((size_t) y * result.Width + x) * 3 + c] = (std::uint8_t) ((sum + factor * factor / 2)
+                                                                                         / (factor * factor));
+            }
+        }
+    }
+    return result;
+}
+
+struct ImageDifference {
+    double MeanDeltaE = 0.0;
+    double MaxDeltaE = 0.0;
+    double FractionOver = 0.0; // of the pixels whose difference is above the threshold
+};
+
+namespace detail {
+
+inline float SrgbToLinear(std::uint8_t value) {
+    float c = value / 255.0f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float LabF(float t) {
+    return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+// sRGB to CIELAB (D65)
+inline void ToLab(const std::uint8_t* rgb, float lab[3]) {
+    float r = SrgbToLinear(rgb[0]), g = SrgbToLinear(rgb[1]), b = SrgbToLinear(rgb[2]);
+    float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+    float y = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+    float fx = LabF(x), fy = LabF(y), fz = LabF(z);
+    lab[0] = 116.0f * fy - 16.0f;
+    lab[1] = 500.0f * (fx - fy);
+    lab[2] = 200.0f * (fy - fz);
+}
+
+}
+
+// Perceptual difference: CIE76 delta E per pixel in CIELAB, where about 2.3 is just noticeable.
+// Images of different sizes count as entirely different.
+inline ImageDifference CompareImages(const Image& a, const Image& b, double deltaEThreshold) {
+    ImageDifference difference;
+    if (a.Width != b.Width || a.Height != b.Height || a.Pixels.size() != b.Pixels.size()) {
+        difference.MeanDeltaE = difference.MaxDeltaE = 100.0;
+        difference.FractionOver = 1.0;
+        return difference;
+    }
+    size_t pixels = (size_t) a.Width * a.Height, over = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < pixels; ++i) {
+        float labA[3], labB[3];
+        detail::ToLab(&a.Pixels[i * 3], labA);
+        detail::ToLab(&b.Pixels[i * 3], labB);
+        double dl = labA[0] - labB[0], da = labA[1] - labB[1], db = labA[2] - labB[2];
+        double deltaE = std::sqrt(dl * dl + da * da + db * db);
+        sum += deltaE;
+        difference.MaxDeltaE = std::max(difference.MaxDeltaE, deltaE);
+        over += deltaE > deltaEThreshold;
+    }
+    if (pixels > 0) {
+        difference.MeanDeltaE = sum / pixels;
+        difference.FractionOver = (double) over / pixels;
+    }
+    return difference;
+}
+
+}
+
+#endif //PROJECT_BASE_IMAGE_H
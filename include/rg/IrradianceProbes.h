@@ -0,0 +1,375 @@
+#ifndef PROJECT_BASE_IRRADIANCE_PROBES_H
+#define PROJECT_BASE_IRRADIANCE_PROBES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader.h>
+#include <rg/JobSystem.h>
+#include <rg/Lightmap.h>
+#include <rg/Metrics.h>
+#include <rg/Scene.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Image-based ambient light: a coarse grid of probes over the static scene, each holding the light
+// arriving from every direction as L2 spherical harmonics, nine RGB coefficients. A probe sees the
+// skybox where its rays escape and the directly lit static surfaces where they hit, so it carries the
+// sky's colour and occlusion plus one bounce of the local lights. The shaders interpolate the nearest
+// probes for the surface normal in place of dirLight's flat ambient term. Computed once at load.
+
+const int PROBE_TEXTURE_UNIT = 13;
+const int SH_COEFFICIENTS = 9;
+
+struct ProbeSettings {
+    float Spacing = 2.0f;    // world units between neighbouring probes, at most
+    int MaxPerAxis = 32;     // the spacing grows for scenes larger than this many probes across
+    int Rays = 128;          // per probe
+    float SkyIntensity = 1.0f;
+    float Albedo = 0.5f;     // of every surface a probe ray hits, as in LightmapSettings
+};
+
+// L2 spherical harmonics of an RGB function on the sphere
+struct ShL2 {
+    glm::vec3 C[SH_COEFFICIENTS];
+
+    ShL2() {
+        for (glm::vec3& c : C)
+            c = glm::vec3(0.0f);
+    }
+};
+
+// the real SH basis, in the order the shaders read it
+inline void ShBasis(const glm::vec3& d, float out[SH_COEFFICIENTS]) {
+    out[0] = 0.282095f;
+    out[1] = 0.488603f * d.y;
+    out[2] = 0.488603f * d.z;
+    out[3] = 0.488603f * d.x;
+    out[4] = 1.092548f * d.x * d.y;
+    out[5] = 1.092548f * d.y * d.z;
+    out[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    out[7] = 1.092548f * d.x * d.z;
+    out[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+inline void ShAddSample(ShL2& sh, const glm::vec3& direction, const glm::vec3& radiance, float weight) {
+    float basis[SH_COEFFICIENTS];
+    ShBasis(direction, basis);
+    for (int i = 0; i < SH_COEFFICIENTS; ++i)
+        sh.C[i] += radiance * (basis[i] * weight);
+}
+
+inline glm::vec3 ShEvaluate(const ShL2& sh, const glm::vec3& direction) {
+    float basis[SH_COEFFICIENTS];
+    ShBasis(direction, basis);
+    glm::vec3 result(0.0f);
+    for (int i = 0; i < SH_COEFFICIENTS; ++i)
+        result += sh.C[i] * basis[i];
+    return result;
+}
+
+// Radiance to irradiance over pi: the clamped cosine lobe convolved in (Ramamoorthi and Hanrahan 2001,
+// A_l / pi per band), so evaluating the result for a normal gives what multiplies the diffuse texture.
+// A sky of constant radiance L evaluates to L.
+inline ShL2 ShConvolveLambert(const ShL2& radiance) {
+    const float band[3] = {1.0f, 2.0f / 3.0f, 0.25f};
+    ShL2 out;
+    for (int i = 0; i < SH_COEFFICIENTS; ++i)
+        out.C[i] = radiance.C[i] * band[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+    return out;
+}
+
+// Skybox on the CPU, linear RGB, the faces in GL's order (+X, -X, +Y, -Y, +Z, -Z) and orientation, as
+// the skybox pass samples them.
+struct Cubemap {
+    int Size = 0;
+    std::vector<glm::vec3> Faces[6]; // Size * Size, the row at t = 0 first
+
+    bool Empty() const {
+        return Size == 0;
+    }
+
+    // direction through the centre of a texel, and the solid angle it covers
+    glm::vec3 Direction(int face, int x, int y, float& solidAngle) const {
+        float sc = 2.0f * (x + 0.5f) / Size - 1.0f, tc = 2.0f * (y + 0.5f) / Size - 1.0f;
+        float texel = 2.0f / Size;
+        solidAngle = texel * texel / std::pow(1.0f + sc * sc + tc * tc, 1.5f);
+        glm::vec3 d;
+        switch (face) {
+            case 0: d = glm::vec3(1.0f, -tc, -sc); break;
+            case 1: d = glm::vec3(-1.0f, -tc, sc); break;
+            case 2: d = glm::vec3(sc, 1.0f, tc); break;
+            case 3: d = glm::vec3(sc, -1.0f, -tc); break;
+            case 4: d = glm::vec3(sc, -tc, 1.0f); break;
+            default: d = glm::vec3(-sc, -tc, -1.0f); break;
+        }
+        return glm::normalize(d);
+    }
+
+    // nearest texel
+    glm::vec3 Sample(const glm::vec3& d) const {
+        glm::vec3 a(std::fabs(d.x), std::fabs(d.y), std::fabs(d.z));
+        int face;
+        float sc, tc, major;
+        if (a.x >= a.y && a.x >= a.z) {
+            face = d.x > 0.0f ? 0 : 1;
+            major = a.x;
+            sc = d.x > 0.0f ? -d.z : d.z;
+            tc = -d.y;
+        } else if (a.y >= a.z) {
+            face = d.y > 0.0f ? 2 : 3;
+            major = a.y;
+            sc = d.x;
+            tc = d.y > 0.0f ? d.z : -d.z;
+        } else {
+            face = d.z > 0.0f ? 4 : 5;
+            major = a.z;
+            sc = d.z > 0.0f ? d.x : -d.x;
+            tc = -d.y;
+        }
+        int x = std::min(std::max((int) ((sc / major + 1.0f) * 0.5f * Size), 0), Size - 1);
+        int y = std::min(std::max((int) ((tc / major + 1.0f) * 0.5f * Size), 0), Size - 1);
+        return Faces[face][(size_t) y * Size + x];
+    }
+};
+
+// The six faces from image files, decoded on workers. Unflipped, as loadCubemap uploads them.
+inline bool LoadCubemap(const std::vector<std::string>& paths, JobSystem& jobs, Cubemap& out) {
+    out = Cubemap();
+    if (paths.size() != 6)
+        return false;
+    int sizes[6] = {0, 0, 0, 0, 0, 0};
+    jobs.Wait(jobs.ParallelFor(0, 6, 1, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face) {
+            int width, height, components;
+            unsigned char* data = stbi_load(paths[face].c_str(), &width, &height, &components, 3);
+            if (!data)
+                continue;
+            if (width == height) {
+                out.Faces[face].resize((size_t) width * height);
+                for (size_t i = 0; i < out.Faces[face].size(); ++i)
+                    out.Faces[face][i] = glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.0f;
+                sizes[face] = width;
+            }
+            stbi_image_free(data);
+        }
+    }));
+    for (int face = 0; face < 6; ++face) {
+        if (sizes[face] == 0 || sizes[face] != sizes[0]) {
+            std::cout << "ERROR::PROBES::CUBEMAP_FACE " << paths[face] << std::endl;
+            out = Cubemap();
+            return false;
+        }
+    }
+    out.Size = sizes[0];
+    return true;
+}
+
+// Radiance of the whole sky, each face's rows on a worker and the sums in a fixed order.
+inline ShL2 ProjectCubemap(const Cubemap& sky, JobSystem& jobs) {
+    ShL2 result;
+    if (sky.Empty())
+        return result;
+    std::vector<ShL2> rows((size_t) 6 * sky.Size);
+    jobs.Wait(jobs.ParallelFor(0, rows.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            int face = (int) (row / sky.Size), y = (int) (row % sky.Size);
+            for (int x = 0; x < sky.Size; ++x) {
+                float solidAngle;
+                glm::vec3 d = sky.Direction(face, x, y, solidAngle);
+                ShAddSample(rows[row], d, sky.Faces[face][(size_t) y * sky.Size + x], solidAngle);
+            }
+        }
+    }));
+    for (const ShL2& row : rows) {
+        for (int i = 0; i < SH_COEFFICIENTS; ++i)
+            result.C[i] += row.C[i];
+    }
+    return result;
+}
+
+// Probes at the centres of the cells of a box, Min + Cell * ((x, y, z) + 0.5), x fastest, convolved
+// for diffuse lighting (ShConvolveLambert).
+struct IrradianceProbeGrid {
+    glm::vec3 Min = glm::vec3(0.0f);
+    glm::vec3 Cell = glm::vec3(1.0f);
+    int Size[3] = {0, 0, 0};
+    std::vector<ShL2> Probes;
+
+    bool Empty() const {
+        return Probes.empty();
+    }
+
+    glm::vec3 Position(int x, int y, int z) const {
+        return Min + Cell * (glm::vec3((float) x, (float) y, (float) z) + 0.5f);
+    }
+
+    // trilinear between the eight nearest probes, clamped to the grid: what the shaders compute
+    glm::vec3 Irradiance(const glm::vec3& position, const glm::vec3& normal) const {
+        if (Empty())
+            return glm::vec3(0.0f);
+        glm::vec3 p = (position - Min) / Cell - 0.5f;
+        int base[3];
+        float f[3];
+        for (int k = 0; k < 3; ++k) {
+            float c = std::min(std::max(p[k], 0.0f), (float) (Size[k] - 1));
+            base[k] = std::min((int) c, std::max(Size[k] - 2, 0));
+            f[k] = Size[k] > 1 ? c - base[k] : 0.0f;
+        }
+        glm::vec3 result(0.0f);
+        for (int corner = 0; corner < 8; ++corner) {
+            int x = std::min(base[0] + (corner & 1), Size[0] - 1);
+            int y = std::min(base[1] + (corner >> 1 & 1), Size[1] - 1);
+            int z = std::min(base[2] + (corner >> 2 & 1), Size[2] - 1);
+            float w = (corner & 1 ? f[0] : 1.0f - f[0]) * (corner & 2 ? f[1] : 1.0f - f[1])
+                      * (corner & 4 ? f[2] : 1.0f - f[2]);
+            result += ShEvaluate(Probes[((size_t) z * Size[1] + y) * Size[0] + x], normal) * w;
+        }
+        return glm::max(result, glm::vec3(0.0f));
+    }
+};
+
+// Fills grid with probes over the world bounds of the static renderables, a probe per job: Rays
+// directions on a spherical Fibonacci lattice, the same for every probe, so the result doesn't depend
+// on the number of threads. Escaping rays take the sky's radiance, hits Albedo times the light the
+// surface gets from the scene's lights. Returns the rays traced.
+inline std::uint64_t ComputeIrradianceProbes(const Scene& scene, const StaticSceneLighting& lighting,
+                                             const Cubemap& sky, const ProbeSettings& settings, JobSystem& jobs,
+                                             IrradianceProbeGrid& grid) {
+    grid = IrradianceProbeGrid();
+    const RenderableTable& t = scene.Renderables;
+    Aabb bounds;
+    for (size_t row = 0; row < t.Size(); ++row) {
+        if (!(t.Flags[row] & RenderFlagDynamic))
+            bounds.Grow(Aabb(t.WorldMin.Get(row), t.WorldMax.Get(row)));
+    }
+    if (bounds.IsEmpty())
+        return 0;
+    glm::vec3 extent = bounds.Max - bounds.Min;
+    for (int k = 0; k < 3; ++k) {
+        float spacing = std::max(settings.Spacing, extent[k] / std::max(settings.MaxPerAxis, 1));
+        grid.Size[k] = std::max((int) std::ceil(extent[k] / spacing), 1);
+        grid.Cell[k] = std::max(extent[k] / grid.Size[k], 1e-3f);
+    }
+    grid.Min = bounds.Min;
+    grid.Probes.resize((size_t) grid.Size[0] * grid.Size[1] * grid.Size[2]);
+
+    int rayCount = std::max(settings.Rays, 1);
+    std::vector<glm::vec3> directions(rayCount);
+    for (int i = 0; i < rayCount; ++i) {
+        float z = 1.0f - (2.0f * i + 1.0f) / rayCount;
+        float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+        float phi = 2.39996323f * i; // golden angle
+        directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+    float weight = 4.0f * 3.14159265f / rayCount;
+
+    std::vector<std::uint64_t> rays(grid.Probes.size(), 0);
+    jobs.Wait(jobs.ParallelFor(0, grid.Probes.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t probe = begin; probe < end; ++probe) {
+            int x = (int) (probe % grid.Size[0]);
+            int y = (int) (probe / grid.Size[0] % grid.Size[1]);
+            int z = (int) (probe / ((size_t) grid.Size[0] * grid.Size[1]));
+            glm::vec3 origin = grid.Position(x, y, z);
+            ShL2 radiance;
+            for (const glm::vec3& direction : directions) {
+                SceneHit hit;
+                glm::vec3 light(0.0f);
+                if (!lighting.Trace(Ray(origin, direction), hit, rays[probe])) {
+                    if (!sky.Empty())
+                        light = sky.Sample(direction) * settings.SkyIntensity;
+                } else {
+                    light = lighting.Direct(lighting.MaterialOf(hit.Hit), hit.Position, hit.Normal, false, rays[probe])
+                            * settings.Albedo;
+                }
+                ShAddSample(radiance, direction, light, weight);
+            }
+            grid.Probes[probe] = ShConvolveLambert(radiance);
+        }
+    }));
+    std::uint64_t total = 0;
+    for (std::uint64_t count : rays)
+        total += count;
+    return total;
+}
+
+// GL half: the grid as one RGB16F 3D texture on PROBE_TEXTURE_UNIT, nine slabs of Size[2] layers,
+// one per coefficient. The shaders clamp inside a slab, so hardware trilinear filtering never mixes
+// two coefficients.
+class IrradianceProbeTexture {
+public:
+    void Upload(const IrradianceProbeGrid& grid) {
+        Shutdown();
+        if (grid.Empty())
+            return;
+        m_Min = grid.Min;
+        m_Cell = grid.Cell;
+        m_Size = glm::vec3((float) grid.Size[0], (float) grid.Size[1], (float) grid.Size[2]);
+        size_t layer = (size_t) grid.Size[0] * grid.Size[1];
+        std::vector<glm::vec3> texels(grid.Probes.size() * SH_COEFFICIENTS);
+        for (int k = 0; k < SH_COEFFICIENTS; ++k) {
+            for (size_t probe = 0; probe < grid.Probes.size(); ++probe)
+                texels[k * grid.Size[2] * layer + probe] = grid.Probes[probe].C[k];
+        }
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_3D, m_Texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, grid.Size[0], grid.Size[1], grid.Size[2] * SH_COEFFICIENTS, 0, GL_RGB,
+                     GL_FLOAT, texels.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        metrics::Render().GlObjects.Add();
+        metrics::Render().BytesUploaded.Add(texels.size() * 3 * 2);
+        metrics::Render().IrradianceProbes.Set((std::int64_t) grid.Probes.size());
+    }
+
+    void Shutdown() {
+        if (m_Texture) {
+            glDeleteTextures(1, &m_Texture);
+            metrics::Render().GlObjects.Add(-1);
+            m_Texture = 0;
+        }
+        metrics::Render().IrradianceProbes.Set(0);
+    }
+
+    bool Empty() const {
+        return m_Texture == 0;
+    }
+
+    void Bind() const {
+        glActiveTexture(GL_TEXTURE0 + PROBE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_3D, m_Texture);
+        glActiveTexture(GL_TEXTURE0);
+        metrics::Render().TextureBinds.Add();
+    }
+
+    // probes == nullptr turns them off for the shader, it falls back to the lights' ambient terms
+    static void SetUniforms(const IrradianceProbeTexture* probes, Shader& shader) {
+        bool enabled = probes && !probes->Empty();
+        shader.setInt("probesEnabled", enabled);
+        shader.setInt("probeGrid", PROBE_TEXTURE_UNIT);
+        if (!enabled)
+            return;
+        shader.setVec3("probeGridMin", probes->m_Min);
+        shader.setVec3("probeGridCell", probes->m_Cell);
+        shader.setVec3("probeGridSize", probes->m_Size);
+    }
+
+private:
+    GLuint m_Texture = 0;
+    glm::vec3 m_Min = glm::vec3(0.0f), m_Cell = glm::vec3(1.0f), m_Size = glm::vec3(0.0f);
+};
+
+}
+
+#endif //PROJECT_BASE_IRRADIANCE_PROBES_H
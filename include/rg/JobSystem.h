@@ -0,0 +1,551 @@
+#ifndef PROJECT_BASE_JOB_SYSTEM_H
+#define PROJECT_BASE_JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <rg/CpuProfiler.h>
+
+namespace rg {
+
+class JobSystem;
+
+// closures up to this size are stored in the job itself, bigger ones on the heap
+const size_t JOB_INLINE_BYTES = 64;
+// jobs the pool makes at a time, and slots every queue starts with
+const size_t JOB_BATCH = 64;
+// continuations a new job has room for, most have one (a ParallelFor join) or none
+const size_t JOB_CONTINUATIONS = 4;
+
+namespace detail {
+
+// Type-erased void() callable that keeps small closures inline, so scheduling the usual lambdas
+// (a few references and a range) doesn't allocate.
+class JobFunction {
+    typename std::aligned_storage<JOB_INLINE_BYTES, alignof(std::max_align_t)>::type m_Storage;
+    void* m_Target = nullptr; // m_Storage or a heap copy
+    void (*m_Invoke)(void*) = nullptr;
+    void (*m_Destroy)(void*) = nullptr;
+
+public:
+    JobFunction() = default;
+    JobFunction(const JobFunction&) = delete;
+    JobFunction& operator=(const JobFunction&) = delete;
+    ~JobFunction() {
+        Reset();
+    }
+
+    template<typename F>
+    void Set(F&& fn) {
+        typedef typename std::decay<F>::type Closure;
+        Reset();
+        store<Closure>(std::forward<F>(fn), std::integral_constant<bool, sizeof(Closure) <= JOB_INLINE_BYTES
+                                                                  && alignof(Closure) <= alignof(std::max_align_t)>());
+        m_Invoke = [](void* target) { (*static_cast<Closure*>(target))(); };
+    }
+
+    void operator()() {
+        m_Invoke(m_Target);
+    }
+
+    // drops the closure and what it captured
+    void Reset() {
+        if (m_Destroy)
+            m_Destroy(m_Target);
+        m_Target = nullptr;
+        m_Invoke = nullptr;
+        m_Destroy = nullptr;
+    }
+private:
+    template<typename Closure, typename F>
+    void store(F&& fn, std::true_type) {
+        m_Target = new (&m_Storage) Closure(std::forward<F>(fn));
+        m_Destroy = [](void* target) { static_cast<Closure*>(target)->~Closure(); };
+    }
+
+    template<typename Closure, typename F>
+    void store(F&& fn, std::false_type) {
+        m_Target = new Closure(std::forward<F>(fn));
+        m_Destroy = [](void* target) { delete static_cast<Closure*>(target); };
+    }
+};
+
+struct JobState {
+    JobFunction Fn;
+    std::atomic<int> Dependencies{1}; // unfinished dependencies, plus one until Schedule is done wiring them
+    std::atomic<int> References{1};
+    std::atomic<bool> Done{false};
+    bool MainThreadOnly = false;
+    std::mutex Lock; // guards Continuations and the Done transition
+    std::vector<JobState*> Continuations;
+};
+
+// Jobs whose last reference is gone wait here to be scheduled again rather than going back to the
+// heap, continuation list capacity included. New ones are made JOB_BATCH at a time, so once the pool
+// holds more than are ever alive at once, scheduling allocates nothing.
+class JobPool {
+    std::mutex m_Lock;
+    std::vector<JobState*> m_Free;
+
+public:
+    ~JobPool() {
+        for (JobState* job : m_Free)
+            delete job;
+    }
+
+    JobState* Acquire() {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (m_Free.empty()) {
+            // room for every job there is, so the ones coming back never grow the list
+            m_Free.reserve(m_Free.capacity() + JOB_BATCH);
+            for (size_t i = 0; i < JOB_BATCH; ++i) {
+                m_Free.push_back(new JobState);
+                m_Free.back()->Continuations.reserve(JOB_CONTINUATIONS);
+            }
+        }
+        JobState* job = m_Free.back();
+        m_Free.pop_back();
+        return job;
+    }
+
+    void Recycle(JobState* job) {
+        job->Fn.Reset();
+        job->Dependencies.store(1, std::memory_order_relaxed);
+        job->References.store(1, std::memory_order_relaxed);
+        job->Done.store(false, std::memory_order_relaxed);
+        job->MainThreadOnly = false;
+        job->Continuations.clear();
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Free.push_back(job);
+    }
+};
+
+inline JobPool& GetJobPool() {
+    static JobPool pool;
+    return pool;
+}
+
+inline void Retain(JobState* job) {
+    job->References.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void Release(JobState* job) {
+    if (job->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        GetJobPool().Recycle(job);
+}
+
+// Ring of queued jobs, pushed and popped at the back, popped at the front. Grows by doubling and
+// never shrinks, so a queue that has seen its busiest frame doesn't allocate again.
+class JobQueue {
+    std::vector<JobState*> m_Ring = std::vector<JobState*>(JOB_BATCH); // size is a power of two
+    size_t m_Head = 0, m_Size = 0;
+
+public:
+    bool Empty() const {
+        return m_Size == 0;
+    }
+
+    size_t Size() const {
+        return m_Size;
+    }
+
+    JobState* operator[](size_t i) const {
+        return m_Ring[(m_Head + i) & (m_Ring.size() - 1)];
+    }
+
+    void PushBack(JobState* job) {
+        if (m_Size == m_Ring.size()) {
+            std::vector<JobState*> grown(2 * m_Ring.size());
+            for (size_t i = 0; i < m_Size; ++i)
+                grown[i] = (*this)[i];
+            m_Ring.swap(grown);
+            m_Head = 0;
+        }
+        m_Ring[(m_Head + m_Size++) & (m_Ring.size() - 1)] = job;
+    }
+
+    JobState* PopBack() {
+        return m_Ring[(m_Head + --m_Size) & (m_Ring.size() - 1)];
+    }
+
+    JobState* PopFront() {
+        JobState* job = m_Ring[m_Head];
+        m_Head = (m_Head + 1) & (m_Ring.size() - 1);
+        --m_Size;
+        return job;
+    }
+};
+
+struct ThreadSlot {
+    JobSystem* Owner = nullptr;
+    unsigned int Index = 0;
+};
+
+inline ThreadSlot& CurrentThreadSlot() {
+    static thread_local ThreadSlot slot;
+    return slot;
+}
+
+}
+
+// Reference to a scheduled job. Cheap to copy; the job itself lives until it has run and every
+// handle to it is gone.
+class JobHandle {
+    detail::JobState* m_Job = nullptr;
+    friend class JobSystem;
+
+    explicit JobHandle(detail::JobState* job) : m_Job(job) {}
+public:
+    JobHandle() = default;
+    JobHandle(const JobHandle& other) : m_Job(other.m_Job) {
+        if (m_Job)
+            detail::Retain(m_Job);
+    }
+    JobHandle(JobHandle&& other) noexcept : m_Job(other.m_Job) {
+        other.m_Job = nullptr;
+    }
+    JobHandle& operator=(JobHandle other) {
+        std::swap(m_Job, other.m_Job);
+        return *this;
+    }
+    ~JobHandle() {
+        if (m_Job)
+            detail::Release(m_Job);
+    }
+
+    bool Valid() const {
+        return m_Job != nullptr;
+    }
+    // an empty handle counts as done, so it can be passed as a dependency unconditionally
+    bool IsDone() const {
+        return !m_Job || m_Job->Done.load(std::memory_order_acquire);
+    }
+};
+
+struct WorkerStats {
+    std::uint64_t JobsExecuted = 0;
+    std::uint64_t JobsStolen = 0;
+    std::uint64_t BusyNanoseconds = 0;
+};
+
+// Work-stealing scheduler. Every thread of the system (slot 0 is the thread that created it, the
+// rest are workers) owns a deque: it pushes and pops at the back, idle threads steal from the
+// front of the others. Jobs may depend on other jobs and only start once those are finished.
+// Main-thread jobs (GL calls) go to a separate queue that only the main thread drains, through
+// RunMainThreadJobs or while it waits. The main thread is the creating one unless SetMainThread
+// moved it.
+class JobSystem {
+    struct Queue {
+        std::mutex Lock;
+        detail::JobQueue Jobs;
+        std::atomic<std::uint64_t> JobsExecuted{0};
+        std::atomic<std::uint64_t> JobsStolen{0};
+        std::atomic<std::uint64_t> BusyNanoseconds{0};
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_Queues; // one per thread slot
+    std::vector<std::thread> m_Workers;
+    std::mutex m_MainLock;
+    detail::JobQueue m_MainJobs;
+    std::atomic<int> m_Queued{0};
+    std::atomic<bool> m_Running{true};
+    std::atomic<std::thread::id> m_MainThread;
+    std::mutex m_SleepLock;
+    std::condition_variable m_WakeUp;
+
+public:
+    // one worker per hardware thread besides the calling one
+    static const unsigned int HardwareWorkers = ~0u;
+
+    // With no workers every job runs on the thread that waits for it.
+    explicit JobSystem(unsigned int workers = HardwareWorkers) {
+        if (workers == HardwareWorkers) {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            workers = hardware > 1 ? hardware - 1 : 1;
+        }
+        for (unsigned int i = 0; i <= workers; ++i)
+            m_Queues.emplace_back(new Queue);
+        detail::CurrentThreadSlot() = detail::ThreadSlot{this, 0};
+        m_MainThread = std::this_thread::get_id();
+        for (unsigned int i = 1; i <= workers; ++i)
+            m_Workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(m_SleepLock);
+            m_Running = false;
+        }
+        m_WakeUp.notify_all();
+        for (std::thread& worker : m_Workers)
+            worker.join();
+        // whatever never ran (e.g. waiting on a job that was dropped) is just freed
+        for (auto& queue : m_Queues) {
+            for (size_t i = 0; i < queue->Jobs.Size(); ++i)
+                detail::Release(queue->Jobs[i]);
+        }
+        for (size_t i = 0; i < m_MainJobs.Size(); ++i)
+            detail::Release(m_MainJobs[i]);
+        if (detail::CurrentThreadSlot().Owner == this)
+            detail::CurrentThreadSlot() = detail::ThreadSlot{};
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // threads including the main one
+    unsigned int ThreadCount() const {
+        return (unsigned int) m_Queues.size();
+    }
+
+    // fn is any void() callable; up to JOB_INLINE_BYTES of closure are kept without an allocation
+    template<typename F>
+    JobHandle Schedule(F&& fn) {
+        return schedule(std::forward<F>(fn), nullptr, nullptr, false);
+    }
+    template<typename F>
+    JobHandle Schedule(F&& fn, std::initializer_list<JobHandle> dependencies) {
+        return schedule(std::forward<F>(fn), dependencies.begin(), dependencies.end(), false);
+    }
+    template<typename F>
+    JobHandle Schedule(F&& fn, const std::vector<JobHandle>& dependencies) {
+        return schedule(std::forward<F>(fn), dependencies.data(), dependencies.data() + dependencies.size(), false);
+    }
+
+    // continuation: runs once job is done
+    template<typename F>
+    JobHandle Then(const JobHandle& job, F&& fn) {
+        return schedule(std::forward<F>(fn), &job, &job + 1, false);
+    }
+
+    // Hands the main-thread queue to the calling thread, e.g. a render thread that took over the GL
+    // context. Only that thread drains it from then on.
+    void SetMainThread() {
+        m_MainThread = std::this_thread::get_id();
+    }
+
+    // for work that has to happen on the thread owning the GL context
+    template<typename F>
+    JobHandle RunOnMainThread(F&& fn) {
+        return schedule(std::forward<F>(fn), nullptr, nullptr, true);
+    }
+    template<typename F>
+    JobHandle RunOnMainThread(F&& fn, std::initializer_list<JobHandle> dependencies) {
+        return schedule(std::forward<F>(fn), dependencies.begin(), dependencies.end(), true);
+    }
+
+    // Splits [begin, end) into chunks of about grain elements and calls fn(chunkBegin, chunkEnd) for each.
+    // The returned handle is done when all chunks are. The chunks continue straight into the joining
+    // job, so no handles are collected for them.
+    template<typename F>
+    JobHandle ParallelFor(size_t begin, size_t end, size_t grain, F fn) {
+        grain = std::max<size_t>(grain, 1);
+        detail::JobState* join = newJob([] {}, false);
+        detail::Retain(join); // the scheduler's reference, dropped once the join has run
+        for (size_t chunk = begin; chunk < end; chunk += grain) {
+            size_t chunkEnd = std::min(end, chunk + grain);
+            // only the scheduler holds the chunk
+            detail::JobState* job = newJob([fn, chunk, chunkEnd] { fn(chunk, chunkEnd); }, false);
+            join->Dependencies.fetch_add(1, std::memory_order_relaxed);
+            job->Continuations.push_back(join);
+            job->Dependencies.store(0, std::memory_order_relaxed);
+            enqueue(job);
+        }
+        if (join->Dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            enqueue(join);
+        return JobHandle(join);
+    }
+
+    // Keeps the calling thread busy with other jobs until job is done. On the main thread this also
+    // runs main-thread jobs, so waiting on a GL upload from there can't deadlock.
+    void Wait(const JobHandle& job) {
+        unsigned int spins = 0;
+        while (!job.IsDone()) {
+            if (runOne()) {
+                spins = 0;
+            } else if (++spins > 64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void Wait(const std::vector<JobHandle>& jobs) {
+        for (const JobHandle& job : jobs)
+            Wait(job);
+    }
+
+    // Runs the queued main-thread jobs, returns how many ran. Call once per frame from the main thread.
+    size_t RunMainThreadJobs() {
+        size_t count = 0;
+        while (detail::JobState* job = popMainJob()) {
+            execute(job, 0, false);
+            ++count;
+        }
+        return count;
+    }
+
+    // counters since the last ResetStats, indexed by thread slot (0 = main thread)
+    std::vector<WorkerStats> Stats() const {
+        std::vector<WorkerStats> stats(m_Queues.size());
+        for (size_t i = 0; i < m_Queues.size(); ++i) {
+            stats[i].JobsExecuted = m_Queues[i]->JobsExecuted.load(std::memory_order_relaxed);
+            stats[i].JobsStolen = m_Queues[i]->JobsStolen.load(std::memory_order_relaxed);
+            stats[i].BusyNanoseconds = m_Queues[i]->BusyNanoseconds.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    void ResetStats() {
+        for (auto& queue : m_Queues) {
+            queue->JobsExecuted = 0;
+            queue->JobsStolen = 0;
+            queue->BusyNanoseconds = 0;
+        }
+    }
+
+private:
+    template<typename F>
+    static detail::JobState* newJob(F&& fn, bool mainThread) {
+        detail::JobState* job = detail::GetJobPool().Acquire();
+        job->Fn.Set(std::forward<F>(fn));
+        job->MainThreadOnly = mainThread;
+        return job;
+    }
+
+    template<typename F>
+    JobHandle schedule(F&& fn, const JobHandle* first, const JobHandle* last, bool mainThread) {
+        detail::JobState* job = newJob(std::forward<F>(fn), mainThread);
+        detail::Retain(job); // the scheduler's reference, dropped once the job has run
+        for (const JobHandle* dependency = first; dependency != last; ++dependency) {
+            detail::JobState* d = dependency->m_Job;
+            if (!d)
+                continue;
+            std::lock_guard<std::mutex> lock(d->Lock);
+            if (!d->Done.load(std::memory_order_relaxed)) {
+                job->Dependencies.fetch_add(1, std::memory_order_relaxed);
+                d->Continuations.push_back(job);
+            }
+        }
+        if (job->Dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            enqueue(job);
+        return JobHandle(job);
+    }
+
+    void enqueue(detail::JobState* job) {
+        if (job->MainThreadOnly) {
+            std::lock_guard<std::mutex> lock(m_MainLock);
+            m_MainJobs.PushBack(job);
+            return;
+        }
+        const detail::ThreadSlot& slot = detail::CurrentThreadSlot();
+        Queue& queue = *m_Queues[slot.Owner == this ? slot.Index : 0];
+        {
+            std::lock_guard<std::mutex> lock(queue.Lock);
+            queue.Jobs.PushBack(job);
+        }
+        m_Queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_SleepLock);
+        }
+        m_WakeUp.notify_one();
+    }
+
+    detail::JobState* popMainJob() {
+        std::lock_guard<std::mutex> lock(m_MainLock);
+        if (m_MainJobs.Empty())
+            return nullptr;
+        return m_MainJobs.PopFront();
+    }
+
+    // own deque first (newest job, still warm in cache), then the oldest job of another thread
+    detail::JobState* take(unsigned int self, bool& stolen) {
+        {
+            Queue& own = *m_Queues[self];
+            std::lock_guard<std::mutex> lock(own.Lock);
+            if (!own.Jobs.Empty()) {
+                stolen = false;
+                return own.Jobs.PopBack();
+            }
+        }
+        size_t count = m_Queues.size();
+        for (size_t offset = 1; offset < count; ++offset) {
+            Queue& victim = *m_Queues[(self + offset) % count];
+            std::lock_guard<std::mutex> lock(victim.Lock);
+            if (!victim.Jobs.Empty()) {
+                stolen = true;
+                return victim.Jobs.PopFront();
+            }
+        }
+        return nullptr;
+    }
+
+    bool runOne() {
+        const detail::ThreadSlot& slot = detail::CurrentThreadSlot();
+        unsigned int self = slot.Owner == this ? slot.Index : 0;
+        if (std::this_thread::get_id() == m_MainThread.load(std::memory_order_relaxed)) {
+            if (detail::JobState* job = popMainJob()) {
+                execute(job, 0, false);
+                return true;
+            }
+        }
+        bool stolen = false;
+        if (detail::JobState* job = take(self, stolen)) {
+            m_Queued.fetch_sub(1, std::memory_order_relaxed);
+            execute(job, self, stolen);
+            return true;
+        }
+        return false;
+    }
+
+    void execute(detail::JobState* job, unsigned int self, bool stolen) {
+        auto start = std::chrono::steady_clock::now();
+        job->Fn();
+        job->Fn.Reset(); // drop captures now rather than when the last handle goes
+        {
+            std::lock_guard<std::mutex> lock(job->Lock);
+            job->Done.store(true, std::memory_order_release);
+        }
+        // nothing is added once Done is set; the list keeps its capacity for the job's next use
+        for (detail::JobState* next : job->Continuations) {
+            if (next->Dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                enqueue(next);
+        }
+        job->Continuations.clear();
+        Queue& stats = *m_Queues[self];
+        auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        stats.BusyNanoseconds.fetch_add((std::uint64_t) busy.count(), std::memory_order_relaxed);
+        stats.JobsExecuted.fetch_add(1, std::memory_order_relaxed);
+        if (stolen)
+            stats.JobsStolen.fetch_add(1, std::memory_order_relaxed);
+        detail::Release(job);
+    }
+
+    void workerLoop(unsigned int index) {
+        detail::CurrentThreadSlot() = detail::ThreadSlot{this, index};
+        RG_PROFILE_THREAD("worker " + std::to_string(index));
+        while (m_Running.load(std::memory_order_acquire)) {
+            if (runOne())
+                continue;
+            std::unique_lock<std::mutex> lock(m_SleepLock);
+            m_WakeUp.wait_for(lock, std::chrono::milliseconds(2), [this] {
+                return m_Queued.load(std::memory_order_acquire) > 0 || !m_Running.load(std::memory_order_acquire);
+            });
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_JOB_SYSTEM_H
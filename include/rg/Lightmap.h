@@ -0,0 +1,362 @@
+#ifndef PROJECT_BASE_LIGHTMAP_H
+#define PROJECT_BASE_LIGHTMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/filesystem.h>
+#include <learnopengl/shader.h>
+#include <rg/Bvh.h>
+#include <rg/ClusteredLights.h>
+#include <rg/JobSystem.h>
+#include <rg/Metrics.h>
+#include <rg/Scene.h>
+#include <rg/SceneQueries.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Baked lighting for the static scene. Every model gets a second UV set at import (GenerateLightmapUvs),
+// every static renderable a rect of one atlas, and LightmapBaker path-traces the irradiance of each
+// atlas texel on the CPU: dirLight and the point lights with shadow rays, plus diffuse bounces. The
+// result goes to the asset cache under cache/lightmaps, keyed by everything it depends on; at runtime
+// draws with a rect read it instead of running the light loop.
+
+const int LIGHTMAP_CHART_RESOLUTION = 64; // texels across a model's UV square the chart gutters are sized for
+const int LIGHTMAP_PADDING = 2;           // texels between charts and between atlas rects
+const int LIGHTMAP_MIN_SIZE = 16;         // texels across the smallest instance rect
+const int LIGHTMAP_TEXTURE_UNIT = 12;
+const float LIGHTMAP_RAY_OFFSET = 1e-3f;  // rays start this far off the surface, against self-hits
+
+struct LightmapSettings {
+    float TexelsPerUnit = 8.0f; // across the square root of an instance's world-space area
+    int MaxSize = 256;          // texels across one instance
+    int AtlasSize = 2048;       // largest atlas; smaller ones are tried first
+    int Samples = 32;           // hemisphere rays per texel for the bounced light
+    int Bounces = 2;            // 0: direct light only
+    float Albedo = 0.5f;        // of every surface a bounce ray hits, the textures live on the GPU only
+};
+
+// A model's triangles in model space with their lightmap UVs, what the baker rasterizes and traces.
+struct LightmapMesh {
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;
+    std::vector<glm::vec2> Uvs;
+    std::vector<std::uint32_t> Indices;
+    int Resolution = LIGHTMAP_CHART_RESOLUTION; // the chart gutters are LIGHTMAP_PADDING texels at this size
+
+    bool Empty() const {
+        return Indices.empty();
+    }
+};
+
+// UV generation
+// ------------------------------------------------------------------------
+// Lightmap UVs for a triangle list. Triangles are grouped into charts, connected and facing the same
+// of the six axis directions; each chart is projected onto that axis' plane without distortion, and
+// the charts are shelf-packed into the unit square at one scale, LIGHTMAP_PADDING texels apart at the
+// returned resolution (LIGHTMAP_CHART_RESOLUTION, doubled while the gutters would eat half of it).
+// Vertices on chart borders are split: remap[i] is the input vertex output vertex i came from,
+// outIndices index the output vertices.
+int GenerateLightmapUvs(const std::vector<glm::vec3>& positions, const std::vector<std::uint32_t>& indices,
+                        std::vector<std::uint32_t>& remap, std::vector<std::uint32_t>& outIndices,
+                        std::vector<glm::vec2>& uvs);
+
+// Shared-exponent RGB as GL_RGB9_E5 stores it (EXT_texture_shared_exponent): 4 bytes a texel for HDR
+// irradiance, read by the texture unit without unpacking in the shader.
+inline std::uint32_t PackRgb9e5(const glm::vec3& rgb) {
+    const float maxValue = 511.0f / 512.0f * 65536.0f;
+    float r = std::min(std::max(rgb.r, 0.0f), maxValue);
+    float g = std::min(std::max(rgb.g, 0.0f), maxValue);
+    float b = std::min(std::max(rgb.b, 0.0f), maxValue);
+    float brightest = std::max(r, std::max(g, b));
+    if (!(brightest > 0.0f))
+        return 0;
+    int exponent = std::max(-16, (int) std::floor(std::log2(brightest))) + 1 + 15;
+    float scale = std::ldexp(1.0f, exponent - 15 - 9);
+    if ((int) std::floor(brightest / scale + 0.5f) == 512) {
+        ++exponent;
+        scale *= 2.0f;
+    }
+    std::uint32_t rs = (std::uint32_t) std::floor(r / scale + 0.5f);
+    std::uint32_t gs = (std::uint32_t) std::floor(g / scale + 0.5f);
+    std::uint32_t bs = (std::uint32_t) std::floor(b / scale + 0.5f);
+    return rs | gs << 9 | bs << 18 | (std::uint32_t) exponent << 27;
+}
+
+inline glm::vec3 UnpackRgb9e5(std::uint32_t packed) {
+    float scale = std::ldexp(1.0f, (int) (packed >> 27) - 15 - 9);
+    return glm::vec3((float) (packed & 511u), (float) (packed >> 9 & 511u), (float) (packed >> 18 & 511u)) * scale;
+}
+
+// Irradiance of the baked renderables, one rect each in a square atlas. A rect maps the model's
+// lightmap UVs into the atlas: uv * xy + zw.
+struct LightmapAtlas {
+    int Size = 0;
+    std::vector<std::uint32_t> Texels; // Size * Size, RGB9E5, the row at v = 0 first
+    std::vector<Entity> Entities;
+    std::vector<glm::vec4> Rects; // per entry of Entities
+
+    bool Empty() const {
+        return Entities.empty();
+    }
+};
+
+struct LightmapBakeStats {
+    int Instances = 0;
+    int Dropped = 0; // static renderables that didn't fit the atlas even at the smallest size
+    size_t Texels = 0; // texels covered by a triangle
+    std::uint64_t Rays = 0;
+};
+
+// What the bakers see of the static scene: rays through a SceneBvh of the static renderables
+// (four-wide SSE nodes over four-wide SSE triangle leaves), and the direct light at a surface point
+// as the shaders compute it, with shadow rays. Read-only once built, so jobs can share it.
+class StaticSceneLighting {
+public:
+    // the scene's world transforms must be up to date; meshBvhs are indexed by mesh handle
+    void Build(const Scene& scene, const std::vector<MeshBvh>& meshBvhs) {
+        m_Bvh.Build(scene, meshBvhs, RenderFlagDynamic);
+        m_Scene = &scene;
+        gatherLights(scene);
+    }
+
+    bool Trace(const Ray& ray, SceneHit& hit, std::uint64_t& rays) const {
+        ++rays;
+        return m_Bvh.Raycast(ray, hit);
+    }
+
+    std::uint16_t MaterialOf(Entity e) const {
+        long row = m_Scene->RenderableRow(e);
+        return row < 0 ? 0 : m_Scene->Renderables.Material[row];
+    }
+
+    // light arriving at a surface point, in the shaders' units (the diffuse texture multiplies it)
+    glm::vec3 Direct(std::uint16_t material, const glm::vec3& position, const glm::vec3& normal, bool ambient,
+                     std::uint64_t& rays) const {
+        const LightTable& lights = m_Scene->Lights;
+        const MaterialLights& set = m_Lights[std::min<size_t>(material, m_Lights.size() - 1)];
+        glm::vec3 result(0.0f);
+        if (set.Directional >= 0) {
+            long i = set.Directional;
+            glm::vec3 toLight = glm::normalize(-lights.Direction.Get(i));
+            if (ambient)
+                result += lights.Ambient.Get(i);
+            float diffuse = glm::dot(normal, toLight);
+            if (diffuse > 0.0f && !occluded(position, normal, toLight, 1e4f, rays))
+                result += lights.Diffuse.Get(i) * diffuse;
+        }
+        for (size_t k = 0; k < set.Points.size(); ++k) {
+            std::uint32_t i = set.Points[k];
+            glm::vec3 toLight = lights.Position.Get(i) - position;
+            float distance = glm::length(toLight);
+            if (distance > set.Ranges[k])
+                continue;
+            float attenuation = 1.0f / (lights.Constant[i] + lights.Linear[i] * distance
+                                        + lights.Quadratic[i] * distance * distance);
+            glm::vec3 light(0.0f);
+            if (ambient)
+                light += lights.Ambient.Get(i);
+            toLight /= std::max(distance, 1e-6f);
+            float diffuse = glm::dot(normal, toLight);
+            if (diffuse > 0.0f && !occluded(position, normal, toLight, distance, rays))
+                light += lights.Diffuse.Get(i) * diffuse;
+            result += light * attenuation;
+        }
+        return result;
+    }
+
+private:
+    struct MaterialLights {
+        long Directional = -1;
+        std::vector<std::uint32_t> Points;
+        std::vector<float> Ranges;
+    };
+    SceneBvh m_Bvh;
+    const Scene* m_Scene = nullptr;
+    std::vector<MaterialLights> m_Lights; // per material handle
+
+    // as the shaders see them: the last directional light for the material, and every point light
+    // for it within its cut-off range
+    void gatherLights(const Scene& scene) {
+        const LightTable& lights = scene.Lights;
+        m_Lights.assign(std::max<size_t>(scene.MaterialNames.size(), 1), MaterialLights());
+        for (size_t material = 0; material < m_Lights.size(); ++material) {
+            MaterialLights& out = m_Lights[material];
+            for (std::uint32_t i = 0; i < lights.Size(); ++i) {
+                if (lights.Material[i] != AllMaterials && lights.Material[i] != material)
+                    continue;
+                if (lights.Type[i] == LightDirectional) {
+                    out.Directional = i;
+                    continue;
+                }
+                float range = PointLightRange(lights.Ambient.Get(i), lights.Diffuse.Get(i), lights.Specular.Get(i),
+                                              lights.Constant[i], lights.Linear[i], lights.Quadratic[i]);
+                if (range > 0.0f) {
+                    out.Points.push_back(i);
+                    out.Ranges.push_back(range);
+                }
+            }
+        }
+    }
+
+    bool occluded(const glm::vec3& position, const glm::vec3& normal, const glm::vec3& direction, float distance,
+                  std::uint64_t& rays) const {
+        SceneHit hit;
+        return Trace(Ray(position + normal * LIGHTMAP_RAY_OFFSET, direction, distance), hit, rays);
+    }
+};
+
+// The baker. Texels are spread over the job system, each with its own random sequence, so the result
+// doesn't depend on the number of threads.
+class LightmapBaker {
+public:
+    // meshes and meshBvhs are indexed by mesh handle; the scene's world transforms must be up to date.
+    LightmapBakeStats Bake(const Scene& scene, const std::vector<LightmapMesh>& meshes,
+                           const std::vector<MeshBvh>& meshBvhs, const LightmapSettings& settings, JobSystem& jobs,
+                           LightmapAtlas& out);
+
+private:
+    StaticSceneLighting m_Lighting;
+    const Scene* m_Scene = nullptr;
+    LightmapSettings m_Settings;
+    int m_Size = 0;
+    std::vector<glm::vec3> m_Position, m_Normal;
+    std::vector<std::int32_t> m_Instance; // index into m_Rows, -1 where no triangle covers the texel
+    std::vector<std::uint32_t> m_Rows;
+
+    static std::uint32_t hash(std::uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static float random(std::uint32_t& state) {
+        state = hash(state + 0x9e3779b9u);
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static glm::vec3 cosineSample(const glm::vec3& n, std::uint32_t& state) {
+        // orthonormal basis around n (Duff et al. 2017)
+        float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        glm::vec3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        glm::vec3 bitangent(b, sign + n.y * n.y * a, -n.y);
+        float u = random(state), v = random(state);
+        float r = std::sqrt(u), phi = 6.2831853f * v;
+        return tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + n * std::sqrt(std::max(1.0f - u, 0.0f));
+    }
+
+    // direct light plus the mean light of cosine-distributed paths: the cosine and the pdf cancel,
+    // every hit passes on Albedo times what arrives there
+    glm::vec3 shadeTexel(std::uint32_t texel, std::uint64_t& rays) const;
+
+    void rasterize(const LightmapMesh& mesh, const glm::mat4& world, const glm::vec4& rect, std::int32_t instance);
+
+    // texels no triangle covers take the mean of their covered neighbours, so bilinear taps at chart
+    // edges don't pull in black
+    void dilate(std::vector<glm::vec3>& irradiance);
+
+    // the atlas at its largest, biggest instances first, the ones that don't fit are left out
+    static int placeWhatFits(const std::vector<int>& sizes, int atlasSize, std::vector<int>& x, std::vector<int>& y,
+                             std::vector<bool>& placed);
+};
+
+// Asset cache
+// ------------------------------------------------------------------------
+// A baked atlas is only valid for the exact static scene, lights and settings it was baked from:
+// the cache key hashes all of them, and names the file.
+const char LIGHTMAP_CACHE_MAGIC[4] = {'R', 'G', 'L', 'M'};
+const std::uint32_t LIGHTMAP_CACHE_VERSION = 1;
+
+// FNV-1a over the settings, the static renderables with their geometry, and the lights
+std::uint64_t LightmapCacheKey(const Scene& scene, const std::vector<LightmapMesh>& meshes,
+                               const LightmapSettings& settings);
+
+inline std::string LightmapCacheDirectory() {
+    return FileSystem::getPath("cache/lightmaps");
+}
+
+inline std::string LightmapCachePath(const std::string& directory, std::uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.rglm", (unsigned long long) key);
+    return directory + name;
+}
+
+// File: "RGLM", version, atlas size and rect count as 32-bit values, the 64-bit key, then per rect the
+// entity and four floats, then the texels; in the byte order of the machine that wrote it.
+bool SaveLightmapCache(const std::string& directory, std::uint64_t key, const LightmapAtlas& atlas);
+
+// false, quietly, when nothing is cached for key
+bool LoadLightmapCache(const std::string& directory, std::uint64_t key, LightmapAtlas& atlas);
+
+// GL half: the atlas as an RGB9_E5 texture on LIGHTMAP_TEXTURE_UNIT, and the rect of every baked
+// entity for the draws.
+class LightmapTexture {
+public:
+    void Upload(const LightmapAtlas& atlas) {
+        Shutdown();
+        if (atlas.Empty())
+            return;
+        glGenTextures(1, &m_Texture);
+        glBindTexture(GL_TEXTURE_2D, m_Texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB9_E5, atlas.Size, atlas.Size, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV,
+                     atlas.Texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        Entity last = *std::max_element(atlas.Entities.begin(), atlas.Entities.end());
+        m_Rects.assign((size_t) last + 1, glm::vec4(0.0f));
+        for (size_t i = 0; i < atlas.Entities.size(); ++i)
+            m_Rects[atlas.Entities[i]] = atlas.Rects[i];
+        metrics::Render().GlObjects.Add();
+        metrics::Render().BytesUploaded.Add(atlas.Texels.size() * sizeof(std::uint32_t));
+        metrics::Render().LightmapInstances.Set((std::int64_t) atlas.Entities.size());
+    }
+
+    void Shutdown() {
+        if (m_Texture) {
+            glDeleteTextures(1, &m_Texture);
+            metrics::Render().GlObjects.Add(-1);
+            m_Texture = 0;
+        }
+        m_Rects.clear();
+        metrics::Render().LightmapInstances.Set(0);
+    }
+
+    bool Empty() const {
+        return m_Texture == 0;
+    }
+
+    // uv scale and offset of the entity's rect, zero for one that wasn't baked
+    glm::vec4 Rect(Entity e) const {
+        return e < m_Rects.size() ? m_Rects[e] : glm::vec4(0.0f);
+    }
+
+    void Bind() const {
+        glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_Texture);
+        glActiveTexture(GL_TEXTURE0);
+        metrics::Render().TextureBinds.Add();
+    }
+
+private:
+    GLuint m_Texture = 0;
+    std::vector<glm::vec4> m_Rects; // indexed by entity
+};
+
+}
+
+#endif //PROJECT_BASE_LIGHTMAP_H
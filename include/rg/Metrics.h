@@ -0,0 +1,229 @@
+#ifndef PROJECT_BASE_METRICS_H
+#define PROJECT_BASE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rg {
+namespace metrics {
+
+// Only ever goes up; per-frame numbers are the difference between two frames.
+class Counter {
+    std::atomic<std::uint64_t> m_Value{0};
+public:
+    void Add(std::uint64_t n = 1) {
+        m_Value.fetch_add(n, std::memory_order_relaxed);
+    }
+    std::uint64_t Value() const {
+        return m_Value.load(std::memory_order_relaxed);
+    }
+};
+
+// A level that goes both ways, e.g. objects alive.
+class Gauge {
+    std::atomic<std::int64_t> m_Value{0};
+public:
+    void Add(std::int64_t n = 1) {
+        m_Value.fetch_add(n, std::memory_order_relaxed);
+    }
+    void Set(std::int64_t value) {
+        m_Value.store(value, std::memory_order_relaxed);
+    }
+    std::int64_t Value() const {
+        return m_Value.load(std::memory_order_relaxed);
+    }
+};
+
+enum MetricKind : std::uint8_t {
+    MetricCounter,
+    MetricGauge
+};
+
+struct MetricSample {
+    std::string Name;
+    MetricKind Kind;
+    std::int64_t Total; // counter total or gauge value
+    std::int64_t LastFrame; // counters: added during the last finished frame, gauges: value at its end
+};
+
+// Named counters and gauges. Registering takes a lock and is meant for startup; the metrics
+// themselves are plain relaxed atomics, cheap enough for per-draw updates from any thread.
+// EndFrame marks frame boundaries, the exporters write snapshots as Prometheus text or CSV.
+class Registry {
+    struct Entry {
+        std::string Name;
+        std::string Help;
+        MetricKind Kind;
+        std::unique_ptr<Counter> CounterValue;
+        std::unique_ptr<Gauge> GaugeValue;
+        std::int64_t FrameStart = 0;
+        std::int64_t LastFrame = 0;
+
+        std::int64_t Value() const {
+            return Kind == MetricCounter ? (std::int64_t) CounterValue->Value() : GaugeValue->Value();
+        }
+    };
+
+    mutable std::mutex m_Lock;
+    std::vector<std::unique_ptr<Entry>> m_Entries;
+    std::uint64_t m_Frames = 0;
+    std::chrono::steady_clock::time_point m_Start = std::chrono::steady_clock::now();
+    bool m_CsvHeaderWritten = false;
+
+    Entry& find(const std::string& name, const std::string& help, MetricKind kind) {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for (auto& entry : m_Entries) {
+            if (entry->Name == name)
+                return *entry;
+        }
+        m_Entries.emplace_back(new Entry{name, help, kind, nullptr, nullptr});
+        Entry& entry = *m_Entries.back();
+        if (kind == MetricCounter)
+            entry.CounterValue.reset(new Counter);
+        else
+            entry.GaugeValue.reset(new Gauge);
+        return entry;
+    }
+
+public:
+    // names follow Prometheus conventions: snake_case, counters end in _total
+    Counter& GetCounter(const std::string& name, const std::string& help) {
+        Entry& entry = find(name, help, MetricCounter);
+        return *entry.CounterValue;
+    }
+
+    Gauge& GetGauge(const std::string& name, const std::string& help) {
+        Entry& entry = find(name, help, MetricGauge);
+        return *entry.GaugeValue;
+    }
+
+    // called by the thread that finishes frames (the render thread)
+    void EndFrame() {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for (auto& entry : m_Entries) {
+            std::int64_t value = entry->Value();
+            entry->LastFrame = entry->Kind == MetricCounter ? value - entry->FrameStart : value;
+            entry->FrameStart = value;
+        }
+        ++m_Frames;
+    }
+
+    std::uint64_t Frames() const {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        return m_Frames;
+    }
+
+    std::vector<MetricSample> Snapshot() const {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        std::vector<MetricSample> samples;
+        for (const auto& entry : m_Entries)
+            samples.push_back(MetricSample{entry->Name, entry->Kind, entry->Value(), entry->LastFrame});
+        return samples;
+    }
+
+    // Prometheus text exposition format, replacing the file through a rename so a scraper (e.g. the
+    // node_exporter textfile collector) never reads half of it.
+    bool WritePrometheus(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "w");
+        if (!file) {
+            std::cout << "ERROR::METRICS::CANNOT_WRITE " << temporary << std::endl;
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            for (const auto& entry : m_Entries) {
+                const char* type = entry->Kind == MetricCounter ? "counter" : "gauge";
+                std::fprintf(file, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", entry->Name.c_str(), entry->Help.c_str(),
+                             entry->Name.c_str(), type, entry->Name.c_str(), (long long) entry->Value());
+            }
+            std::fprintf(file, "# HELP rg_frames_total Frames rendered.\n# TYPE rg_frames_total counter\n"
+                               "rg_frames_total %llu\n", (unsigned long long) m_Frames);
+        }
+        std::fclose(file);
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cout << "ERROR::METRICS::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // One row per call: seconds since start, frame, then every metric's last-frame value. The header
+    // is written by the first call, so register every metric before exporting.
+    bool AppendCsv(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), m_CsvHeaderWritten ? "a" : "w");
+        if (!file) {
+            std::cout << "ERROR::METRICS::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (!m_CsvHeaderWritten) {
+            std::fprintf(file, "seconds,frame");
+            // the rows hold per-frame values, so counters drop their _total
+            for (const auto& entry : m_Entries) {
+                std::string name = entry->Name;
+                if (entry->Kind == MetricCounter && name.size() > 6 && name.compare(name.size() - 6, 6, "_total") == 0)
+                    name.resize(name.size() - 6);
+                std::fprintf(file, ",%s", name.c_str());
+            }
+            std::fprintf(file, "\n");
+            m_CsvHeaderWritten = true;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+        std::fprintf(file, "%.3f,%llu", seconds, (unsigned long long) m_Frames);
+        for (const auto& entry : m_Entries)
+            std::fprintf(file, ",%lld", (long long) entry->LastFrame);
+        std::fprintf(file, "\n");
+        std::fclose(file);
+        return true;
+    }
+
+    // .csv appends a row, anything else is rewritten in Prometheus format
+    bool WriteSnapshot(const std::string& path) {
+        bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        return csv ? AppendCsv(path) : WritePrometheus(path);
+    }
+};
+
+inline Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+// The renderer's own metrics, hooked into Mesh::Draw, Shader and the GL resource paths.
+struct RenderMetrics {
+    Counter& DrawCalls = GetRegistry().GetCounter("rg_draw_calls_total", "Draw calls issued.");
+    Counter& Triangles = GetRegistry().GetCounter("rg_triangles_total", "Triangles submitted.");
+    Counter& ProgramBinds = GetRegistry().GetCounter("rg_program_binds_total", "glUseProgram calls.");
+    Counter& TextureBinds = GetRegistry().GetCounter("rg_texture_binds_total", "glBindTexture calls while drawing.");
+    Counter& VaoBinds = GetRegistry().GetCounter("rg_vao_binds_total", "Vertex array binds while drawing.");
+    Counter& UniformUploads = GetRegistry().GetCounter("rg_uniform_uploads_total", "glUniform* calls.");
+    Counter& BytesUploaded = GetRegistry().GetCounter("rg_uploaded_bytes_total", "Bytes of buffer and texture data sent to the GPU.");
+    Gauge& GlObjects = GetRegistry().GetGauge("rg_gl_objects", "GL objects created and not yet deleted.");
+    Gauge& RenderTargetTextures = GetRegistry().GetGauge("rg_render_target_textures", "Textures backing the render graph's targets.");
+    Gauge& RenderTargetBytes = GetRegistry().GetGauge("rg_render_target_bytes", "Memory of the render graph's target textures.");
+    Gauge& SceneFragments = GetRegistry().GetGauge("rg_scene_fragments", "Fragments the lit scene pass shaded, newest frame measured.");
+    Gauge& RenderScale = GetRegistry().GetGauge("rg_render_scale_percent", "Internal scene resolution, percent of the viewport.");
+    Gauge& ClusteredLights = GetRegistry().GetGauge("rg_clustered_lights", "Point lights in range of the view, uploaded for clustered shading.");
+    Gauge& ClusterLightIndices = GetRegistry().GetGauge("rg_cluster_light_indices", "Light-cluster pairs in the clustered shading index list.");
+    Counter& ShadowCascadeDraws = GetRegistry().GetCounter("rg_shadow_cascade_draws_total", "Shadow cascades whose static casters were drawn again.");
+    Gauge& LightmapInstances = GetRegistry().GetGauge("rg_lightmap_instances", "Static renderables drawn with baked lighting.");
+    Gauge& IrradianceProbes = GetRegistry().GetGauge("rg_irradiance_probes", "Spherical-harmonics probes lighting the ambient term.");
+};
+
+inline RenderMetrics& Render() {
+    static RenderMetrics metrics;
+    return metrics;
+}
+
+}
+}
+
+#endif //PROJECT_BASE_METRICS_H
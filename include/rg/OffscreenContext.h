@@ -0,0 +1,136 @@
+#ifndef PROJECT_BASE_OFFSCREEN_CONTEXT_H
+#define PROJECT_BASE_OFFSCREEN_CONTEXT_H
+
+// GL 3.3 core context without a window or display server, for the headless benchmark. Uses EGL's
+// Mesa surfaceless platform when there is one (llvmpipe in CI), otherwise the default EGL display;
+// either way the context is made current without a surface, so everything has to go to FBOs.
+// Without RG_EGL (CMake didn't find EGL) Create always fails and callers fall back to a window.
+
+#ifdef RG_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace rg {
+
+class OffscreenContext {
+    EGLDisplay m_Display = EGL_NO_DISPLAY;
+    EGLContext m_Context = EGL_NO_CONTEXT;
+
+public:
+    OffscreenContext() = default;
+    OffscreenContext(const OffscreenContext&) = delete;
+    OffscreenContext& operator=(const OffscreenContext&) = delete;
+    ~OffscreenContext() {
+        Destroy();
+    }
+
+    bool Create() {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (m_Display == EGL_NO_DISPLAY)
+            m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major = 0, minor = 0;
+        if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &major, &minor)) {
+            std::cout << "ERROR::OFFSCREEN::NO_EGL_DISPLAY" << std::endl;
+            m_Display = EGL_NO_DISPLAY;
+            return false;
+        }
+        const char* extensions = eglQueryString(m_Display, EGL_EXTENSIONS);
+        if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context")
+            || !std::strstr(extensions, "EGL_KHR_create_context") || !eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "ERROR::OFFSCREEN::EGL_" << major << "." << minor
+                      << "_LACKS_SURFACELESS_DESKTOP_GL" << std::endl;
+            Destroy();
+            return false;
+        }
+
+        const EGLint configAttributes[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglChooseConfig(m_Display, configAttributes, &config, 1, &configs) || configs == 0) {
+            std::cout << "ERROR::OFFSCREEN::NO_EGL_CONFIG" << std::endl;
+            Destroy();
+            return false;
+        }
+        const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+                EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                EGL_NONE
+        };
+        m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (m_Context == EGL_NO_CONTEXT) {
+            std::cout << "ERROR::OFFSCREEN::CANNOT_CREATE_GL_3_3_CORE_CONTEXT" << std::endl;
+            Destroy();
+            return false;
+        }
+        return true;
+    }
+
+    void Destroy() {
+        if (m_Display == EGL_NO_DISPLAY)
+            return;
+        if (m_Context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_Display, m_Context);
+        eglTerminate(m_Display);
+        m_Context = EGL_NO_CONTEXT;
+        m_Display = EGL_NO_DISPLAY;
+    }
+
+    // on the thread that is going to use the context
+    bool MakeCurrent() {
+        return eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context) == EGL_TRUE;
+    }
+
+    void Release() {
+        eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    static void* GetProcAddress(const char* name) {
+        return (void*) eglGetProcAddress(name);
+    }
+};
+
+}
+
+#else
+
+#include <iostream>
+
+namespace rg {
+
+class OffscreenContext {
+public:
+    bool Create() {
+        std::cout << "ERROR::OFFSCREEN::BUILT_WITHOUT_EGL" << std::endl;
+        return false;
+    }
+    void Destroy() {}
+    bool MakeCurrent() {
+        return false;
+    }
+    void Release() {}
+    static void* GetProcAddress(const char*) {
+        return nullptr;
+    }
+};
+
+}
+
+#endif
+
+#endif //PROJECT_BASE_OFFSCREEN_CONTEXT_H
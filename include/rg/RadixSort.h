@@ -0,0 +1,106 @@
+#ifndef PROJECT_BASE_RADIX_SORT_H
+#define PROJECT_BASE_RADIX_SORT_H
+
+#include <rg/CpuProfiler.h>
+#include <rg/JobSystem.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace rg {
+
+// 64-bit key with a 32-bit payload, usually the index of what the key belongs to.
+struct SortEntry {
+    std::uint64_t Key;
+    std::uint32_t Value;
+};
+
+// entries per block; every block gets its own histogram and is one job
+const size_t RADIX_SORT_GRAIN = 16384;
+
+// Stable LSD radix sort on the 64-bit keys, 8 bits per pass. Bytes that are the same in every key
+// are skipped, so keys with few distinct high bits cost only the passes they need. Each pass counts
+// digits per block, turns the counts into per-block output positions, then scatters every block in
+// parallel. Keeps its buffers between calls.
+class RadixSorter {
+    static const unsigned int RADIX = 256;
+
+    std::vector<SortEntry> m_Scratch;
+    std::vector<std::uint32_t> m_Counts; // RADIX per block
+    std::vector<std::uint64_t> m_Differences; // per block, bits that differ from the first key
+
+public:
+    // jobs == nullptr sorts on the calling thread
+    void Sort(std::vector<SortEntry>& entries, JobSystem* jobs = nullptr, size_t grain = RADIX_SORT_GRAIN) {
+        RG_PROFILE_SCOPE("radix sort");
+        size_t n = entries.size();
+        if (n < 2)
+            return;
+        size_t blocks = (n + grain - 1) / grain;
+        m_Scratch.resize(n);
+        m_Counts.resize(blocks * RADIX);
+        m_Differences.resize(blocks);
+
+        const SortEntry* src = entries.data();
+        SortEntry* dst = m_Scratch.data();
+        std::uint64_t first = src[0].Key;
+        forEachBlock(jobs, n, grain, [&](size_t block, size_t begin, size_t end) {
+            std::uint64_t differences = 0;
+            for (size_t i = begin; i < end; ++i)
+                differences |= src[i].Key ^ first;
+            m_Differences[block] = differences;
+        });
+        std::uint64_t differences = 0;
+        for (std::uint64_t d : m_Differences)
+            differences |= d;
+
+        for (unsigned int shift = 0; shift < 64; shift += 8) {
+            if (((differences >> shift) & 0xff) == 0)
+                continue;
+            forEachBlock(jobs, n, grain, [&](size_t block, size_t begin, size_t end) {
+                std::uint32_t* counts = &m_Counts[block * RADIX];
+                for (unsigned int d = 0; d < RADIX; ++d)
+                    counts[d] = 0;
+                for (size_t i = begin; i < end; ++i)
+                    ++counts[(src[i].Key >> shift) & 0xff];
+            });
+            // digit-major, block-minor: keeps equal digits in block order, which is what keeps it stable
+            std::uint32_t position = 0;
+            for (unsigned int d = 0; d < RADIX; ++d) {
+                for (size_t block = 0; block < blocks; ++block) {
+                    std::uint32_t count = m_Counts[block * RADIX + d];
+                    m_Counts[block * RADIX + d] = position;
+                    position += count;
+                }
+            }
+            forEachBlock(jobs, n, grain, [&](size_t block, size_t begin, size_t end) {
+                std::uint32_t* positions = &m_Counts[block * RADIX];
+                for (size_t i = begin; i < end; ++i)
+                    dst[positions[(src[i].Key >> shift) & 0xff]++] = src[i];
+            });
+            const SortEntry* sorted = dst;
+            dst = const_cast<SortEntry*>(src);
+            src = sorted;
+        }
+        if (src != entries.data())
+            entries.swap(m_Scratch);
+    }
+
+private:
+    template<typename F>
+    static void forEachBlock(JobSystem* jobs, size_t n, size_t grain, F&& fn) {
+        if (!jobs) {
+            for (size_t begin = 0; begin < n; begin += grain)
+                fn(begin / grain, begin, std::min(n, begin + grain));
+            return;
+        }
+        jobs->Wait(jobs->ParallelFor(0, n, grain, [&fn, grain](size_t begin, size_t end) {
+            fn(begin / grain, begin, end);
+        }));
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RADIX_SORT_H
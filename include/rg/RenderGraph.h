@@ -0,0 +1,479 @@
+#ifndef PROJECT_BASE_RENDER_GRAPH_H
+#define PROJECT_BASE_RENDER_GRAPH_H
+
+#include <glad/glad.h>
+#include <rg/Metrics.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Frame graph over the offscreen render targets. Passes are declared in execution order, each with
+// the targets it creates, reads and writes, and a callback that draws. Compile then:
+//   - culls every pass whose results nobody reads (back from the passes marked SideEffect, the ones
+//     that reach the screen), so e.g. the bloom blur goes away when the composite doesn't use it;
+//   - gives each surviving target the span of passes it is alive for and lets targets of the same
+//     size and format share one texture when their spans don't overlap. GL has no placement of
+//     textures in shared memory, so sharing the texture object is how targets alias here;
+//   - takes the textures from a pool kept across compiles: a texture no target got this time is
+//     deleted, so a resize or a culled pass frees what it no longer needs.
+// The graph is declared again only when what it depends on changes (size, settings), not per frame;
+// Execute just binds and runs the compiled passes.
+typedef std::uint16_t RenderResource;
+const RenderResource RENDER_RESOURCE_NONE = 0xffff;
+
+struct RenderTargetDesc {
+    GLenum Format = GL_RGBA16F; // sized internal format, GL_DEPTH_COMPONENT24 for depth
+    float Scale = 1.0f; // of the graph's size
+};
+
+inline bool IsDepthFormat(GLenum format) {
+    return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+           || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+// bytes per texel of the formats render targets use, for the memory statistics
+inline int RenderTargetTexelBytes(GLenum format) {
+    switch (format) {
+        case GL_R8:
+            return 1;
+        case GL_R16F:
+        case GL_RG8:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGBA16F:
+        case GL_RG32F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        case GL_DEPTH32F_STENCIL8:
+            return 8;
+        default:
+            return 4; // RGBA8, R11F_G11F_B10F, R32F, RG16F, DEPTH_COMPONENT24/32F, DEPTH24_STENCIL8
+    }
+}
+
+// what a Compile produced, for the UI and tests
+struct RenderGraphStats {
+    int Passes = 0;
+    int CulledPasses = 0;
+    int Targets = 0; // targets of the surviving passes
+    int Textures = 0; // textures backing them
+    std::uint64_t Bytes = 0; // of those textures
+    std::uint64_t UnaliasedBytes = 0; // had every target its own texture
+};
+
+class RenderGraph {
+public:
+    typedef std::function<void(const RenderGraph&)> PassFunction;
+
+    class PassBuilder {
+        RenderGraph& m_Graph;
+        size_t m_Pass;
+
+    public:
+        PassBuilder(RenderGraph& graph, size_t pass) : m_Graph(graph), m_Pass(pass) {}
+
+        // a new target, written by this pass first
+        RenderResource Create(const char* name, const RenderTargetDesc& desc) {
+            RenderResource resource = (RenderResource) m_Graph.m_Resources.size();
+            Resource r;
+            r.Name = name;
+            r.Desc = desc;
+            m_Graph.m_Resources.push_back(r);
+            return Write(resource);
+        }
+        RenderResource Read(RenderResource resource) {
+            if (resource != RENDER_RESOURCE_NONE)
+                m_Graph.m_Passes[m_Pass].Reads.push_back(resource);
+            return resource;
+        }
+        // color targets attach in the order they are written, the depth target to the depth attachment
+        RenderResource Write(RenderResource resource) {
+            if (resource != RENDER_RESOURCE_NONE)
+                m_Graph.m_Passes[m_Pass].Writes.push_back(resource);
+            return resource;
+        }
+        // reaches the screen or the CPU: kept, and everything it reads with it
+        void SideEffect() {
+            m_Graph.m_Passes[m_Pass].SideEffect = true;
+        }
+        // sets the function the pass runs, for passes that need their own targets' handles in it
+        void Execute(PassFunction function) {
+            m_Graph.m_Passes[m_Pass].Function = std::move(function);
+        }
+        // the pass draws to its targets one at a time, through TargetFramebuffer, rather than to one
+        // framebuffer of all of them bound for it
+        void Unbound() {
+            m_Graph.m_Passes[m_Pass].BindTargets = false;
+        }
+    };
+
+private:
+    struct Resource {
+        const char* Name = "";
+        RenderTargetDesc Desc;
+        int Width = 0, Height = 0;
+        int Physical = -1; // index into m_Physical after Compile, -1 when culled
+        int First = -1, Last = -1; // surviving pass span
+    };
+    struct Pass {
+        const char* Name = "";
+        PassFunction Function;
+        std::vector<RenderResource> Reads;
+        std::vector<RenderResource> Writes;
+        bool SideEffect = false;
+        bool BindTargets = true;
+        bool Culled = false;
+        GLuint Framebuffer = 0;
+    };
+    struct Physical {
+        int Width = 0, Height = 0;
+        GLenum Format = GL_RGBA16F;
+        int Last = -1; // last pass of the newest target it holds
+        GLuint Texture = 0;
+        GLuint Framebuffer = 0; // the texture alone, for TargetFramebuffer
+    };
+    struct PoolTexture {
+        int Width = 0, Height = 0;
+        GLenum Format = GL_RGBA16F;
+        GLuint Texture = 0;
+        bool Taken = false;
+    };
+
+    int m_Width = 0, m_Height = 0;
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    std::vector<Physical> m_Physical;
+    std::vector<PoolTexture> m_Pool;
+    std::vector<GLuint> m_Framebuffers; // every framebuffer the compiled graph made
+    RenderGraphStats m_Stats;
+    bool m_Realized = false;
+
+    static void textureFormat(GLenum internalFormat, GLenum& format, GLenum& type) {
+        if (IsDepthFormat(internalFormat)) {
+            bool stencil = internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+            format = stencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+            type = internalFormat == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8
+                   : internalFormat == GL_DEPTH32F_STENCIL8 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV
+                   : GL_FLOAT;
+        } else if (internalFormat == GL_R8 || internalFormat == GL_R16F || internalFormat == GL_R32F) {
+            format = GL_RED;
+            type = GL_FLOAT;
+        } else if (internalFormat == GL_RG8 || internalFormat == GL_RG16F || internalFormat == GL_RG32F) {
+            format = GL_RG;
+            type = GL_FLOAT;
+        } else if (internalFormat == GL_R11F_G11F_B10F) {
+            format = GL_RGB;
+            type = GL_FLOAT;
+        } else {
+            format = GL_RGBA;
+            type = GL_FLOAT;
+        }
+    }
+
+    GLuint makeFramebuffer(const std::vector<RenderResource>& writes) {
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        GLenum drawBuffers[8];
+        GLsizei colors = 0;
+        for (RenderResource resource : writes) {
+            const Resource& r = m_Resources[resource];
+            GLuint texture = m_Physical[r.Physical].Texture;
+            if (IsDepthFormat(r.Desc.Format)) {
+                GLenum attachment = r.Desc.Format == GL_DEPTH24_STENCIL8 || r.Desc.Format == GL_DEPTH32F_STENCIL8
+                                    ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+                glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+            } else if (colors < 8) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colors, GL_TEXTURE_2D, texture, 0);
+                drawBuffers[colors] = GL_COLOR_ATTACHMENT0 + colors;
+                ++colors;
+            }
+        }
+        if (colors)
+            glDrawBuffers(colors, drawBuffers);
+        else
+            glDrawBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_NOT_COMPLETE " << writes.size() << " targets" << std::endl;
+        m_Framebuffers.push_back(framebuffer);
+        return framebuffer;
+    }
+
+    void deleteFramebuffers() {
+        if (!m_Framebuffers.empty()) {
+            glDeleteFramebuffers((GLsizei) m_Framebuffers.size(), m_Framebuffers.data());
+            metrics::Render().GlObjects.Add(-(std::int64_t) m_Framebuffers.size());
+            m_Framebuffers.clear();
+        }
+    }
+
+    // textures from the pool (made where missing, released where unused) and the framebuffers
+    void realize() {
+        deleteFramebuffers();
+        for (PoolTexture& texture : m_Pool)
+            texture.Taken = false;
+        for (Physical& physical : m_Physical) {
+            auto it = std::find_if(m_Pool.begin(), m_Pool.end(), [&physical](const PoolTexture& t) {
+                return !t.Taken && t.Width == physical.Width && t.Height == physical.Height
+                       && t.Format == physical.Format;
+            });
+            if (it == m_Pool.end()) {
+                PoolTexture texture;
+                texture.Width = physical.Width;
+                texture.Height = physical.Height;
+                texture.Format = physical.Format;
+                GLenum format, type;
+                textureFormat(physical.Format, format, type);
+                glGenTextures(1, &texture.Texture);
+                glBindTexture(GL_TEXTURE_2D, texture.Texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, physical.Format, physical.Width, physical.Height, 0, format, type, NULL);
+                GLint filter = IsDepthFormat(physical.Format) ? GL_NEAREST : GL_LINEAR;
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                metrics::Render().GlObjects.Add();
+                m_Pool.push_back(texture);
+                it = m_Pool.end() - 1;
+            }
+            it->Taken = true;
+            physical.Texture = it->Texture;
+        }
+        for (size_t i = m_Pool.size(); i-- > 0;) {
+            if (!m_Pool[i].Taken) {
+                glDeleteTextures(1, &m_Pool[i].Texture);
+                metrics::Render().GlObjects.Add(-1);
+                m_Pool.erase(m_Pool.begin() + i);
+            }
+        }
+        for (Physical& physical : m_Physical)
+            physical.Framebuffer = 0;
+        for (Pass& pass : m_Passes) {
+            pass.Framebuffer = 0;
+            if (pass.Culled || pass.Writes.empty())
+                continue;
+            if (pass.BindTargets) {
+                pass.Framebuffer = makeFramebuffer(pass.Writes);
+                continue;
+            }
+            for (RenderResource resource : pass.Writes) {
+                Physical& physical = m_Physical[m_Resources[resource].Physical];
+                if (!physical.Framebuffer)
+                    physical.Framebuffer = makeFramebuffer(std::vector<RenderResource>(1, resource));
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        metrics::Render().GlObjects.Add((std::int64_t) m_Framebuffers.size());
+        metrics::Render().RenderTargetTextures.Set(m_Stats.Textures);
+        metrics::Render().RenderTargetBytes.Set((std::int64_t) m_Stats.Bytes);
+        m_Realized = true;
+    }
+
+public:
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+    ~RenderGraph() {
+        if (m_Realized)
+            Shutdown();
+    }
+
+    // starts declaring a graph for targets of width x height; the pool is kept
+    void Reset(int width, int height) {
+        m_Width = std::max(width, 1);
+        m_Height = std::max(height, 1);
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Physical.clear();
+        m_Stats = RenderGraphStats();
+        m_Realized = false;
+    }
+
+    PassBuilder AddPass(const char* name, PassFunction function = PassFunction()) {
+        Pass pass;
+        pass.Name = name;
+        pass.Function = std::move(function);
+        m_Passes.push_back(std::move(pass));
+        return PassBuilder(*this, m_Passes.size() - 1);
+    }
+
+    // culling, target spans and the texture assignment; makes no GL calls, Execute does those
+    void Compile() {
+        // how many surviving readers each target has and how many read targets each pass writes
+        std::vector<int> readers(m_Resources.size(), 0);
+        std::vector<int> needed(m_Passes.size(), 0);
+        // a pass reading what it writes itself doesn't keep itself alive
+        auto readsOwn = [](const Pass& pass, RenderResource resource) {
+            return std::find(pass.Writes.begin(), pass.Writes.end(), resource) != pass.Writes.end();
+        };
+        for (const Pass& pass : m_Passes)
+            for (RenderResource resource : pass.Reads)
+                readers[resource] += !readsOwn(pass, resource);
+        std::vector<size_t> unneeded;
+        for (size_t i = 0; i < m_Passes.size(); ++i) {
+            Pass& pass = m_Passes[i];
+            pass.Culled = false;
+            for (RenderResource resource : pass.Writes)
+                needed[i] += readers[resource] > 0;
+            if (!pass.SideEffect && needed[i] == 0)
+                unneeded.push_back(i);
+        }
+        while (!unneeded.empty()) {
+            Pass& pass = m_Passes[unneeded.back()];
+            unneeded.pop_back();
+            pass.Culled = true;
+            for (RenderResource resource : pass.Reads) {
+                if (readsOwn(pass, resource) || --readers[resource] > 0)
+                    continue;
+                // nothing reads it any more: its writers may have lost their last reason to run
+                for (size_t i = 0; i < m_Passes.size(); ++i) {
+                    Pass& writer = m_Passes[i];
+                    if (writer.Culled || writer.SideEffect
+                        || std::find(writer.Writes.begin(), writer.Writes.end(), resource) == writer.Writes.end())
+                        continue;
+                    if (--needed[i] == 0 && std::find(unneeded.begin(), unneeded.end(), i) == unneeded.end())
+                        unneeded.push_back(i);
+                }
+            }
+        }
+
+        for (Resource& r : m_Resources) {
+            r.First = r.Last = -1;
+            r.Physical = -1;
+            r.Width = std::max(1, (int) (m_Width * r.Desc.Scale));
+            r.Height = std::max(1, (int) (m_Height * r.Desc.Scale));
+        }
+        m_Stats = RenderGraphStats();
+        for (size_t i = 0; i < m_Passes.size(); ++i) {
+            const Pass& pass = m_Passes[i];
+            ++m_Stats.Passes;
+            if (pass.Culled) {
+                ++m_Stats.CulledPasses;
+                continue;
+            }
+            auto touch = [this, i](RenderResource resource) {
+                Resource& r = m_Resources[resource];
+                if (r.First < 0)
+                    r.First = (int) i;
+                r.Last = (int) i;
+            };
+            std::for_each(pass.Reads.begin(), pass.Reads.end(), touch);
+            std::for_each(pass.Writes.begin(), pass.Writes.end(), touch);
+        }
+
+        // in order of first use: the first texture of the right size and format whose last target
+        // is done before this one starts, or a new one
+        std::vector<RenderResource> order;
+        for (size_t i = 0; i < m_Resources.size(); ++i)
+            if (m_Resources[i].First >= 0)
+                order.push_back((RenderResource) i);
+        std::stable_sort(order.begin(), order.end(), [this](RenderResource a, RenderResource b) {
+            return m_Resources[a].First < m_Resources[b].First;
+        });
+        for (RenderResource resource : order) {
+            Resource& r = m_Resources[resource];
+            int physical = -1;
+            for (size_t i = 0; i < m_Physical.size() && physical < 0; ++i) {
+                const Physical& p = m_Physical[i];
+                if (p.Width == r.Width && p.Height == r.Height && p.Format == r.Desc.Format && p.Last < r.First)
+                    physical = (int) i;
+            }
+            if (physical < 0) {
+                Physical p;
+                p.Width = r.Width;
+                p.Height = r.Height;
+                p.Format = r.Desc.Format;
+                m_Physical.push_back(p);
+                physical = (int) m_Physical.size() - 1;
+                m_Stats.Bytes += (std::uint64_t) r.Width * r.Height * RenderTargetTexelBytes(r.Desc.Format);
+            }
+            m_Physical[physical].Last = r.Last;
+            r.Physical = physical;
+            ++m_Stats.Targets;
+            m_Stats.UnaliasedBytes += (std::uint64_t) r.Width * r.Height * RenderTargetTexelBytes(r.Desc.Format);
+        }
+        m_Stats.Textures = (int) m_Physical.size();
+        m_Realized = false;
+    }
+
+    // runs the surviving passes in order, each with its targets bound and the viewport at their size
+    void Execute() {
+        if (!m_Realized)
+            realize();
+        for (const Pass& pass : m_Passes) {
+            if (pass.Culled)
+                continue;
+            if (pass.Framebuffer) {
+                const Resource& target = m_Resources[pass.Writes[0]];
+                glBindFramebuffer(GL_FRAMEBUFFER, pass.Framebuffer);
+                glViewport(0, 0, target.Width, target.Height);
+            }
+            if (pass.Function)
+                pass.Function(*this);
+        }
+    }
+
+    // deletes every texture and framebuffer; the graph has to be declared again after this
+    void Shutdown() {
+        deleteFramebuffers();
+        for (PoolTexture& texture : m_Pool)
+            glDeleteTextures(1, &texture.Texture);
+        metrics::Render().GlObjects.Add(-(std::int64_t) m_Pool.size());
+        metrics::Render().RenderTargetTextures.Set(0);
+        metrics::Render().RenderTargetBytes.Set(0);
+        m_Pool.clear();
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Physical.clear();
+        m_Realized = false;
+    }
+
+    int Width() const {
+        return m_Width;
+    }
+    int Height() const {
+        return m_Height;
+    }
+    const RenderGraphStats& Stats() const {
+        return m_Stats;
+    }
+    bool Culled(const char* pass) const {
+        for (const Pass& p : m_Passes)
+            if (std::strcmp(p.Name, pass) == 0)
+                return p.Culled;
+        return true;
+    }
+    // same value for targets that share a texture, -1 for culled targets; for tests
+    int PhysicalIndex(RenderResource resource) const {
+        return m_Resources[resource].Physical;
+    }
+
+    // during Execute
+    GLuint Texture(RenderResource resource) const {
+        const Resource& r = m_Resources[resource];
+        return r.Physical < 0 ? 0 : m_Physical[r.Physical].Texture;
+    }
+    int Width(RenderResource resource) const {
+        return m_Resources[resource].Width;
+    }
+    int Height(RenderResource resource) const {
+        return m_Resources[resource].Height;
+    }
+    // a framebuffer with only this target attached, for the Unbound passes that write it
+    GLuint TargetFramebuffer(RenderResource resource) const {
+        const Resource& r = m_Resources[resource];
+        return r.Physical < 0 ? 0 : m_Physical[r.Physical].Framebuffer;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDER_GRAPH_H
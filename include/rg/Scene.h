@@ -0,0 +1,372 @@
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <rg/BatchMath.h>
+#include <rg/Bounds.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Entities are plain ids. Components live in tables of parallel arrays (one table per component
+// combination), so systems walk contiguous memory instead of chasing per-object pointers.
+using Entity = std::uint32_t;
+const Entity NullEntity = 0xffffffffu;
+const std::uint16_t AllMaterials = 0xffffu;
+const std::uint16_t NoMesh = 0xffffu;
+
+enum RenderFlags : std::uint8_t {
+    RenderFlagDoubleSided = 1u << 0, // drawn with GL_CULL_FACE disabled
+    RenderFlagVisible = 1u << 1,     // written by CullRenderables every frame
+    RenderFlagDynamic = 1u << 2,     // may move at runtime: kept out of the cached shadow cascades
+};
+
+enum LightType : std::uint8_t {
+    LightDirectional,
+    LightPoint,
+};
+
+struct Vec3Column {
+    std::vector<float> X, Y, Z;
+
+    glm::vec3 Get(size_t i) const {
+        return glm::vec3(X[i], Y[i], Z[i]);
+    }
+    void Set(size_t i, const glm::vec3& v) {
+        X[i] = v.x;
+        Y[i] = v.y;
+        Z[i] = v.z;
+    }
+    void Push(const glm::vec3& v) {
+        X.push_back(v.x);
+        Y.push_back(v.y);
+        Z.push_back(v.z);
+    }
+    void Move(size_t to, size_t from) {
+        X[to] = X[from];
+        Y[to] = Y[from];
+        Z[to] = Z[from];
+    }
+    void Pop() {
+        X.pop_back();
+        Y.pop_back();
+        Z.pop_back();
+    }
+    void Reserve(size_t n) {
+        X.reserve(n);
+        Y.reserve(n);
+        Z.reserve(n);
+    }
+};
+
+// transform + bounds + renderable
+struct RenderableTable {
+    std::vector<Entity> Owner;
+    // transform
+    Vec3Column Position;
+    std::vector<float> RotationY; // degrees around the world up axis
+    Vec3Column Scale;
+    std::vector<glm::mat4> World;
+    // bounds, local ones come from the mesh, world ones are refreshed by UpdateWorldBounds
+    Vec3Column LocalMin, LocalMax;
+    Vec3Column WorldMin, WorldMax;
+    // renderable
+    std::vector<std::uint16_t> Mesh;     // index into Scene::MeshNames
+    std::vector<std::uint16_t> Material; // index into Scene::MaterialNames
+    std::vector<std::uint8_t> Flags;
+
+    size_t Size() const {
+        return Owner.size();
+    }
+};
+
+// transform + light
+struct LightTable {
+    std::vector<Entity> Owner;
+    std::vector<std::uint8_t> Type;
+    std::vector<std::uint16_t> Material; // lights can be tuned per material, AllMaterials otherwise
+    Vec3Column Position;
+    Vec3Column Direction;
+    Vec3Column Ambient, Diffuse, Specular;
+    std::vector<float> Constant, Linear, Quadratic;
+
+    size_t Size() const {
+        return Owner.size();
+    }
+};
+
+// Per mesh handle: renderables further than Distance from the camera draw Mesh instead
+// (NoMesh skips them). A Distance of 0 means the mesh has no coarser level.
+struct LodSwitch {
+    float Distance = 0.0f;
+    std::uint16_t Mesh = NoMesh;
+};
+
+struct LightDesc {
+    LightType Type = LightPoint;
+    std::uint16_t Material = AllMaterials;
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 Ambient = glm::vec3(0.05f);
+    glm::vec3 Diffuse = glm::vec3(0.8f);
+    glm::vec3 Specular = glm::vec3(1.0f);
+    float Constant = 1.0f;
+    float Linear = 0.09f;
+    float Quadratic = 0.032f;
+};
+
+class Scene {
+    enum TableId : std::uint8_t { TableNone, TableRenderable, TableLight };
+    struct EntityRecord {
+        TableId Table;
+        std::uint32_t Row;
+    };
+    std::vector<EntityRecord> m_Records;
+    std::vector<Entity> m_FreeEntities;
+
+    Entity allocateEntity(TableId table, std::uint32_t row) {
+        Entity e;
+        if (!m_FreeEntities.empty()) {
+            e = m_FreeEntities.back();
+            m_FreeEntities.pop_back();
+        } else {
+            e = (Entity) m_Records.size();
+            m_Records.push_back(EntityRecord{TableNone, 0});
+        }
+        m_Records[e] = EntityRecord{table, row};
+        return e;
+    }
+public:
+    RenderableTable Renderables;
+    LightTable Lights;
+    std::vector<std::string> MeshNames;
+    std::vector<std::string> MaterialNames;
+    std::vector<LodSwitch> MeshLods; // indexed by mesh handle, may be shorter than MeshNames
+    bool TransformsDirty = false;
+    // bumped when a caster without, or with, RenderFlagDynamic is added, moved or removed
+    std::uint32_t StaticCasterVersion = 0;
+    std::uint32_t DynamicCasterVersion = 0;
+
+    std::uint16_t FindOrAddMesh(const std::string& name) {
+        return findOrAdd(MeshNames, name);
+    }
+    std::uint16_t FindOrAddMaterial(const std::string& name) {
+        return findOrAdd(MaterialNames, name);
+    }
+    std::uint16_t FindMaterial(const std::string& name) const {
+        for (size_t i = 0; i < MaterialNames.size(); ++i) {
+            if (MaterialNames[i] == name)
+                return (std::uint16_t) i;
+        }
+        return AllMaterials;
+    }
+
+    void Reserve(size_t renderables) {
+        RenderableTable& t = Renderables;
+        t.Owner.reserve(renderables);
+        t.Position.Reserve(renderables);
+        t.RotationY.reserve(renderables);
+        t.Scale.Reserve(renderables);
+        t.World.reserve(renderables);
+        t.LocalMin.Reserve(renderables);
+        t.LocalMax.Reserve(renderables);
+        t.WorldMin.Reserve(renderables);
+        t.WorldMax.Reserve(renderables);
+        t.Mesh.reserve(renderables);
+        t.Material.reserve(renderables);
+        t.Flags.reserve(renderables);
+        m_Records.reserve(m_Records.size() + renderables);
+    }
+
+    Entity CreateRenderable(std::uint16_t mesh, std::uint16_t material, const Aabb& localBounds,
+                            const glm::vec3& position, float rotationY, const glm::vec3& scale,
+                            std::uint8_t flags = 0) {
+        RenderableTable& t = Renderables;
+        Entity e = allocateEntity(TableRenderable, (std::uint32_t) t.Size());
+        t.Owner.push_back(e);
+        t.Position.Push(position);
+        t.RotationY.push_back(rotationY);
+        t.Scale.Push(scale);
+        t.World.push_back(glm::mat4(1.0f));
+        t.LocalMin.Push(localBounds.Min);
+        t.LocalMax.Push(localBounds.Max);
+        t.WorldMin.Push(localBounds.Min);
+        t.WorldMax.Push(localBounds.Max);
+        t.Mesh.push_back(mesh);
+        t.Material.push_back(material);
+        t.Flags.push_back(flags);
+        TransformsDirty = true;
+        casterChanged(flags);
+        return e;
+    }
+
+    Entity CreateLight(const LightDesc& desc) {
+        LightTable& t = Lights;
+        Entity e = allocateEntity(TableLight, (std::uint32_t) t.Size());
+        t.Owner.push_back(e);
+        t.Type.push_back(desc.Type);
+        t.Material.push_back(desc.Material);
+        t.Position.Push(desc.Position);
+        t.Direction.Push(desc.Direction);
+        t.Ambient.Push(desc.Ambient);
+        t.Diffuse.Push(desc.Diffuse);
+        t.Specular.Push(desc.Specular);
+        t.Constant.push_back(desc.Constant);
+        t.Linear.push_back(desc.Linear);
+        t.Quadratic.push_back(desc.Quadratic);
+        return e;
+    }
+
+    // Removes the entity by moving the last row of its table into the freed slot.
+    void Destroy(Entity e) {
+        EntityRecord record = m_Records[e];
+        if (record.Table == TableRenderable) {
+            RenderableTable& t = Renderables;
+            size_t last = t.Size() - 1;
+            size_t row = record.Row;
+            casterChanged(t.Flags[row]);
+            t.Owner[row] = t.Owner[last];
+            t.Position.Move(row, last);
+            t.RotationY[row] = t.RotationY[last];
+            t.Scale.Move(row, last);
+            t.World[row] = t.World[last];
+            t.LocalMin.Move(row, last);
+            t.LocalMax.Move(row, last);
+            t.WorldMin.Move(row, last);
+            t.WorldMax.Move(row, last);
+            t.Mesh[row] = t.Mesh[last];
+            t.Material[row] = t.Material[last];
+            t.Flags[row] = t.Flags[last];
+            t.Owner.pop_back();
+            t.Position.Pop();
+            t.RotationY.pop_back();
+            t.Scale.Pop();
+            t.World.pop_back();
+            t.LocalMin.Pop();
+            t.LocalMax.Pop();
+            t.WorldMin.Pop();
+            t.WorldMax.Pop();
+            t.Mesh.pop_back();
+            t.Material.pop_back();
+            t.Flags.pop_back();
+            if (row != last)
+                m_Records[t.Owner[row]].Row = (std::uint32_t) row;
+        } else if (record.Table == TableLight) {
+            LightTable& t = Lights;
+            size_t last = t.Size() - 1;
+            size_t row = record.Row;
+            t.Owner[row] = t.Owner[last];
+            t.Type[row] = t.Type[last];
+            t.Material[row] = t.Material[last];
+            t.Position.Move(row, last);
+            t.Direction.Move(row, last);
+            t.Ambient.Move(row, last);
+            t.Diffuse.Move(row, last);
+            t.Specular.Move(row, last);
+            t.Constant[row] = t.Constant[last];
+            t.Linear[row] = t.Linear[last];
+            t.Quadratic[row] = t.Quadratic[last];
+            t.Owner.pop_back();
+            t.Type.pop_back();
+            t.Material.pop_back();
+            t.Position.Pop();
+            t.Direction.Pop();
+            t.Ambient.Pop();
+            t.Diffuse.Pop();
+            t.Specular.Pop();
+            t.Constant.pop_back();
+            t.Linear.pop_back();
+            t.Quadratic.pop_back();
+            if (row != last)
+                m_Records[t.Owner[row]].Row = (std::uint32_t) row;
+        } else {
+            return;
+        }
+        m_Records[e] = EntityRecord{TableNone, 0};
+        m_FreeEntities.push_back(e);
+    }
+
+    // row of a renderable entity in Renderables, -1 if it has none
+    long RenderableRow(Entity e) const {
+        if (e >= m_Records.size() || m_Records[e].Table != TableRenderable)
+            return -1;
+        return m_Records[e].Row;
+    }
+
+    void SetPosition(Entity e, const glm::vec3& position) {
+        long row = RenderableRow(e);
+        if (row < 0)
+            return;
+        Renderables.Position.Set(row, position);
+        TransformsDirty = true;
+        casterChanged(Renderables.Flags[row]);
+    }
+
+private:
+    void casterChanged(std::uint8_t flags) {
+        if (flags & RenderFlagDynamic)
+            ++DynamicCasterVersion;
+        else
+            ++StaticCasterVersion;
+    }
+
+    static std::uint16_t findOrAdd(std::vector<std::string>& names, const std::string& name) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (names[i] == name)
+                return (std::uint16_t) i;
+        }
+        names.push_back(name);
+        return (std::uint16_t) (names.size() - 1);
+    }
+};
+
+// systems
+// ------------------------------------------------------------------------
+inline TrsColumns TransformColumns(const RenderableTable& t) {
+    return TrsColumns{t.Position.X.data(), t.Position.Y.data(), t.Position.Z.data(), t.RotationY.data(),
+                      t.Scale.X.data(), t.Scale.Y.data(), t.Scale.Z.data()};
+}
+
+inline BoxColumns WorldBoxColumns(const RenderableTable& t) {
+    return BoxColumns{t.WorldMin.X.data(), t.WorldMin.Y.data(), t.WorldMin.Z.data(),
+                      t.WorldMax.X.data(), t.WorldMax.Y.data(), t.WorldMax.Z.data()};
+}
+
+inline void UpdateWorldTransforms(RenderableTable& t, size_t begin, size_t end) {
+    GetBatchKernels().ComposeTrs(TransformColumns(t), t.World.data(), begin, end);
+}
+
+inline void UpdateWorldBounds(RenderableTable& t, size_t begin, size_t end) {
+    BoxColumns local{t.LocalMin.X.data(), t.LocalMin.Y.data(), t.LocalMin.Z.data(),
+                     t.LocalMax.X.data(), t.LocalMax.Y.data(), t.LocalMax.Z.data()};
+    BoxOutputColumns world{t.WorldMin.X.data(), t.WorldMin.Y.data(), t.WorldMin.Z.data(),
+                           t.WorldMax.X.data(), t.WorldMax.Y.data(), t.WorldMax.Z.data()};
+    GetBatchKernels().TransformBoxes(local, t.World.data(), world, begin, end);
+}
+
+// Returns true when something moved, so spatial structures know to refit.
+inline bool UpdateTransforms(Scene& scene) {
+    if (!scene.TransformsDirty)
+        return false;
+    RenderableTable& t = scene.Renderables;
+    UpdateWorldTransforms(t, 0, t.Size());
+    UpdateWorldBounds(t, 0, t.Size());
+    scene.TransformsDirty = false;
+    return true;
+}
+
+// Sets RenderFlagVisible on rows whose world box touches the frustum, returns the visible count.
+inline size_t CullRenderables(RenderableTable& t, const Frustum& frustum, size_t begin, size_t end) {
+    return GetBatchKernels().CullBoxes(frustum, WorldBoxColumns(t), t.Flags.data(), RenderFlagVisible, begin, end);
+}
+
+inline size_t CullRenderables(RenderableTable& t, const Frustum& frustum) {
+    return CullRenderables(t, frustum, 0, t.Size());
+}
+
+}
+
+#endif //PROJECT_BASE_SCENE_H
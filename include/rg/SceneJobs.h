@@ -0,0 +1,112 @@
+#ifndef PROJECT_BASE_SCENE_JOBS_H
+#define PROJECT_BASE_SCENE_JOBS_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+#include <rg/CpuProfiler.h>
+#include <rg/DrawList.h>
+#include <rg/JobSystem.h>
+#include <rg/RadixSort.h>
+#include <rg/Scene.h>
+
+#include <atomic>
+#include <vector>
+
+namespace rg {
+
+// The per-frame scene systems spread over the job system. Each one splits the renderable rows into
+// chunks of SCENE_JOB_GRAIN, which keeps a chunk's columns within a few pages, and returns once
+// every chunk is done (the calling thread helps).
+const size_t SCENE_JOB_GRAIN = 2048;
+
+inline bool UpdateTransforms(Scene& scene, JobSystem& jobs) {
+    if (!scene.TransformsDirty)
+        return false;
+    RenderableTable& t = scene.Renderables;
+    jobs.Wait(jobs.ParallelFor(0, t.Size(), SCENE_JOB_GRAIN, [&t](size_t begin, size_t end) {
+        RG_PROFILE_SCOPE("transform chunk");
+        UpdateWorldTransforms(t, begin, end);
+        UpdateWorldBounds(t, begin, end);
+    }));
+    scene.TransformsDirty = false;
+    return true;
+}
+
+inline size_t CullRenderables(RenderableTable& t, const Frustum& frustum, JobSystem& jobs) {
+    std::atomic<size_t> visible{0};
+    jobs.Wait(jobs.ParallelFor(0, t.Size(), SCENE_JOB_GRAIN, [&t, &frustum, &visible](size_t begin, size_t end) {
+        visible.fetch_add(CullRenderables(t, frustum, begin, end), std::memory_order_relaxed);
+    }));
+    return visible.load();
+}
+
+// Same result and order as the serial BuildDrawList: every chunk fills its own list, the lists are
+// joined in chunk order at the end.
+inline void BuildDrawList(const Scene& scene, const glm::vec3& viewPosition, JobSystem& jobs, std::vector<DrawItem>& out) {
+    size_t rows = scene.Renderables.Size();
+    std::vector<std::vector<DrawItem>> chunks((rows + SCENE_JOB_GRAIN - 1) / SCENE_JOB_GRAIN);
+    jobs.Wait(jobs.ParallelFor(0, rows, SCENE_JOB_GRAIN, [&](size_t begin, size_t end) {
+        BuildDrawItems(scene, viewPosition, begin, end, chunks[begin / SCENE_JOB_GRAIN]);
+    }));
+    out.clear();
+    for (const std::vector<DrawItem>& chunk : chunks)
+        out.insert(out.end(), chunk.begin(), chunk.end());
+}
+
+// The frame's draw list. Every chunk of rows is culled, gets its LODs picked and its sort keys made
+// by one job, into that chunk's own list. The keys of all lists are then radix sorted together and
+// the items gathered in key order, ready for the single submission pass on the GL thread. The lists
+// and sort buffers are kept between frames.
+class DrawListBuilder {
+    std::vector<std::vector<DrawItem>> m_Chunks;
+    std::vector<size_t> m_Offsets; // first key of every chunk
+    std::vector<SortEntry> m_Keys;
+    RadixSorter m_Sorter;
+
+public:
+    void Build(Scene& scene, const Frustum& frustum, const glm::vec3& viewPosition, JobSystem& jobs,
+               std::vector<DrawItem>& out) {
+        RG_PROFILE_SCOPE("build draw list");
+        RenderableTable& t = scene.Renderables;
+        size_t rows = t.Size();
+        size_t chunks = (rows + SCENE_JOB_GRAIN - 1) / SCENE_JOB_GRAIN;
+        if (m_Chunks.size() < chunks)
+            m_Chunks.resize(chunks);
+        jobs.Wait(jobs.ParallelFor(0, rows, SCENE_JOB_GRAIN, [&](size_t begin, size_t end) {
+            RG_PROFILE_SCOPE("draw list chunk");
+            std::vector<DrawItem>& list = m_Chunks[begin / SCENE_JOB_GRAIN];
+            list.clear();
+            CullRenderables(t, frustum, begin, end);
+            BuildDrawItems(scene, viewPosition, begin, end, list);
+        }));
+
+        // a key's value locates its item: chunk * SCENE_JOB_GRAIN + index in the chunk's list
+        m_Offsets.resize(chunks);
+        size_t total = 0;
+        for (size_t c = 0; c < chunks; ++c) {
+            m_Offsets[c] = total;
+            total += m_Chunks[c].size();
+        }
+        m_Keys.resize(total);
+        jobs.Wait(jobs.ParallelFor(0, chunks, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                const std::vector<DrawItem>& list = m_Chunks[c];
+                for (size_t i = 0; i < list.size(); ++i)
+                    m_Keys[m_Offsets[c] + i] = SortEntry{list[i].SortKey, (std::uint32_t) (c * SCENE_JOB_GRAIN + i)};
+            }
+        }));
+        m_Sorter.Sort(m_Keys, &jobs);
+
+        out.resize(total);
+        jobs.Wait(jobs.ParallelFor(0, total, SCENE_JOB_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                std::uint32_t item = m_Keys[i].Value;
+                out[i] = m_Chunks[item / SCENE_JOB_GRAIN][item % SCENE_JOB_GRAIN];
+            }
+        }));
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENE_JOBS_H
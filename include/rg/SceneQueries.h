@@ -0,0 +1,217 @@
+#ifndef PROJECT_BASE_SCENE_QUERIES_H
+#define PROJECT_BASE_SCENE_QUERIES_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+#include <rg/Bvh.h>
+#include <rg/Scene.h>
+
+#include <cmath>
+#include <vector>
+
+namespace rg {
+
+struct SceneHit {
+    Entity Hit = NullEntity;
+    float T = 0.0f;
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Normal = glm::vec3(0.0f); // world space, facing the ray origin
+};
+
+struct NearestHit {
+    Entity Hit = NullEntity;
+    float Distance = 0.0f;
+    glm::vec3 Point = glm::vec3(0.0f);
+};
+
+// Ray through a point given in normalized device coordinates, from the near to the far plane.
+inline Ray ScreenPointToRay(float ndcX, float ndcY, const glm::mat4& inverseViewProjection) {
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 delta = glm::vec3(farPoint) / farPoint.w - origin;
+    float length = glm::length(delta);
+    return Ray(origin, delta / length, length);
+}
+
+// Instance level BVH over the scene's renderables, with one MeshBvh per mesh handle below it.
+// Rays are moved into mesh space with the cached inverse world matrix, so hit distances stay in
+// world units without re-normalizing the direction.
+class SceneBvh {
+    Bvh4 m_Tree;
+    const std::vector<MeshBvh>* m_Meshes = nullptr;
+    std::vector<Aabb> m_Boxes;
+    std::vector<glm::mat4> m_World;
+    std::vector<glm::mat4> m_InverseWorld;
+    std::vector<float> m_MinScale;
+    std::vector<Entity> m_Entity;
+    std::vector<std::uint16_t> m_Mesh;
+    std::uint8_t m_ExcludeFlags = 0;
+    size_t m_SceneRows = 0;
+
+    void copyInstances(const Scene& scene) {
+        const RenderableTable& t = scene.Renderables;
+        size_t n = 0;
+        for (size_t row = 0; row < t.Size(); ++row)
+            n += !(t.Flags[row] & m_ExcludeFlags);
+        m_SceneRows = t.Size();
+        m_Boxes.resize(n);
+        m_World.resize(n);
+        m_InverseWorld.resize(n);
+        m_MinScale.resize(n);
+        m_Entity.resize(n);
+        m_Mesh.resize(n);
+        size_t i = 0;
+        for (size_t row = 0; row < t.Size(); ++row) {
+            if (t.Flags[row] & m_ExcludeFlags)
+                continue;
+            m_Boxes[i] = Aabb(t.WorldMin.Get(row), t.WorldMax.Get(row));
+            m_World[i] = t.World[row];
+            m_InverseWorld[i] = glm::inverse(t.World[row]);
+            glm::mat3 basis(t.World[row]);
+            m_MinScale[i] = std::min(glm::length(basis[0]), std::min(glm::length(basis[1]), glm::length(basis[2])));
+            m_Entity[i] = t.Owner[row];
+            m_Mesh[i] = t.Mesh[row];
+            ++i;
+        }
+    }
+
+    bool hasMesh(std::uint32_t instance) const {
+        return m_Meshes && m_Mesh[instance] < m_Meshes->size() && !(*m_Meshes)[m_Mesh[instance]].Tree.Empty();
+    }
+
+public:
+    // meshes is indexed by mesh handle and must outlive the SceneBvh. Renderables with any of
+    // excludeFlags are left out, e.g. RenderFlagDynamic for a tracer that sees the static scene only.
+    void Build(const Scene& scene, const std::vector<MeshBvh>& meshes, std::uint8_t excludeFlags = 0) {
+        m_Meshes = &meshes;
+        m_ExcludeFlags = excludeFlags;
+        copyInstances(scene);
+        m_Tree.Build(m_Boxes, 2);
+    }
+
+    // For moving objects: same renderables, new transforms. Falls back to a rebuild when rows were
+    // added or removed.
+    void Refit(const Scene& scene) {
+        if (scene.Renderables.Size() != m_SceneRows) {
+            Build(scene, *m_Meshes, m_ExcludeFlags);
+            return;
+        }
+        copyInstances(scene);
+        m_Tree.Refit(m_Boxes);
+    }
+
+    size_t InstanceCount() const {
+        return m_Entity.size();
+    }
+
+    bool Raycast(const Ray& ray, SceneHit& hit) const {
+        bool found = false;
+        float t = m_Tree.Traverse(ray, [&](std::uint32_t first, std::uint32_t count, float tMax) {
+            for (std::uint32_t k = 0; k < count; ++k) {
+                std::uint32_t instance = m_Tree.Primitives[first + k];
+                if (!hasMesh(instance))
+                    continue;
+                const glm::mat4& inv = m_InverseWorld[instance];
+                Ray local(glm::vec3(inv * glm::vec4(ray.Origin, 1.0f)), glm::vec3(inv * glm::vec4(ray.Direction, 0.0f)), tMax);
+                TriangleHit triangle;
+                const MeshBvh& mesh = (*m_Meshes)[m_Mesh[instance]];
+                if (mesh.Intersect(local, triangle) && triangle.T < tMax) {
+                    tMax = triangle.T;
+                    glm::vec3 n = glm::mat3(glm::transpose(inv)) * mesh.TriangleNormal(triangle.Triangle);
+                    n = glm::normalize(n);
+                    hit.Hit = m_Entity[instance];
+                    hit.Normal = glm::dot(n, ray.Direction) > 0.0f ? -n : n;
+                    found = true;
+                }
+            }
+            return tMax;
+        });
+        if (found) {
+            hit.T = t;
+            hit.Position = ray.Origin + ray.Direction * t;
+        }
+        return found;
+    }
+
+    void OverlapAabb(const Aabb& region, std::vector<Entity>& out) const {
+        m_Tree.Query([&](const Aabb& box) { return box.Overlaps(region); },
+                     [&](std::uint32_t first, std::uint32_t count) {
+                         for (std::uint32_t k = 0; k < count; ++k) {
+                             std::uint32_t instance = m_Tree.Primitives[first + k];
+                             if (m_Boxes[instance].Overlaps(region))
+                                 out.push_back(m_Entity[instance]);
+                         }
+                     });
+    }
+
+    void OverlapFrustum(const Frustum& frustum, std::vector<Entity>& out) const {
+        m_Tree.Query([&](const Aabb& box) { return frustum.IntersectsAabb(box); },
+                     [&](std::uint32_t first, std::uint32_t count) {
+                         for (std::uint32_t k = 0; k < count; ++k) {
+                             std::uint32_t instance = m_Tree.Primitives[first + k];
+                             if (frustum.IntersectsAabb(m_Boxes[instance]))
+                                 out.push_back(m_Entity[instance]);
+                         }
+                     });
+    }
+
+    // Closest surface point within maxDistance of p, measured on the triangles.
+    bool Nearest(const glm::vec3& p, float maxDistance, NearestHit& hit) const {
+        bool found = false;
+        float best = m_Tree.Nearest(maxDistance * maxDistance, [&](const Aabb& box) {
+            return box.DistanceSquared(p);
+        }, [&](std::uint32_t first, std::uint32_t count, float bestSq) {
+            for (std::uint32_t k = 0; k < count; ++k) {
+                std::uint32_t instance = m_Tree.Primitives[first + k];
+                if (!hasMesh(instance) || m_Boxes[instance].DistanceSquared(p) >= bestSq)
+                    continue;
+                glm::vec3 local(m_InverseWorld[instance] * glm::vec4(p, 1.0f));
+                glm::vec3 point;
+                float d2 = (*m_Meshes)[m_Mesh[instance]].NearestPoint(local, m_World[instance], m_MinScale[instance], bestSq, point);
+                if (d2 < bestSq) {
+                    bestSq = d2;
+                    hit.Hit = m_Entity[instance];
+                    hit.Point = point;
+                    found = true;
+                }
+            }
+            return bestSq;
+        });
+        if (found)
+            hit.Distance = std::sqrt(best);
+        return found;
+    }
+
+    // Moves a sphere of the given radius from `from` towards `to`: stops at the first surface along the
+    // way, slides along it, then pushes the sphere out of anything it still overlaps.
+    glm::vec3 ConstrainMovement(const glm::vec3& from, const glm::vec3& to, float radius) const {
+        glm::vec3 position = to;
+        glm::vec3 delta = to - from;
+        float length = glm::length(delta);
+        if (length > 1e-6f) {
+            glm::vec3 direction = delta / length;
+            SceneHit hit;
+            if (Raycast(Ray(from, direction, length + radius), hit)) {
+                position = from + direction * std::max(hit.T - radius, 0.0f);
+                glm::vec3 remaining = to - position;
+                position += remaining - hit.Normal * glm::dot(remaining, hit.Normal);
+            }
+        }
+        for (int iteration = 0; iteration < 4; ++iteration) {
+            NearestHit nearest;
+            if (!Nearest(position, radius, nearest))
+                break;
+            glm::vec3 away = position - nearest.Point;
+            float distance = glm::length(away);
+            if (distance < 1e-6f)
+                return from;
+            position = nearest.Point + away * (radius / distance);
+        }
+        return position;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENE_QUERIES_H
@@ -0,0 +1,611 @@
+#ifndef PROJECT_BASE_SCENE_RENDERER_H
+#define PROJECT_BASE_SCENE_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/filesystem.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <rg/Bvh.h>
+#include <rg/CascadedShadows.h>
+#include <rg/ClusteredLights.h>
+#include <rg/CpuProfiler.h>
+#include <rg/DrawList.h>
+#include <rg/FrameAllocator.h>
+#include <rg/IrradianceProbes.h>
+#include <rg/JobSystem.h>
+#include <rg/Lightmap.h>
+#include <rg/Scene.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+inline Aabb ModelBounds(const Model& model) {
+    Aabb bounds;
+    for (const Mesh& mesh : model.meshes) {
+        for (const Vertex& v : mesh.vertices)
+            bounds.Grow(v.Position);
+    }
+    if (bounds.IsEmpty())
+        bounds = Aabb(glm::vec3(0.0f), glm::vec3(0.0f));
+    return bounds;
+}
+
+// Triangle BVH over all meshes of a model, in model space.
+inline MeshBvh BuildMeshBvh(const Model& model) {
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    for (const Mesh& mesh : model.meshes) {
+        std::uint32_t base = (std::uint32_t) positions.size();
+        for (const Vertex& v : mesh.vertices)
+            positions.push_back(v.Position);
+        for (unsigned int index : mesh.indices)
+            indices.push_back(base + index);
+    }
+    MeshBvh bvh;
+    bvh.Build(positions, indices);
+    return bvh;
+}
+
+// Unwraps all meshes of a model into one lightmap UV square and writes the coordinates into their
+// vertices, splitting the ones on chart borders; before the upload. Returns the model-space geometry
+// the lightmap baker works on.
+inline LightmapMesh GenerateModelLightmap(Model& model) {
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    for (const Mesh& mesh : model.meshes) {
+        std::uint32_t base = (std::uint32_t) positions.size();
+        for (const Vertex& v : mesh.vertices)
+            positions.push_back(v.Position);
+        for (unsigned int index : mesh.indices)
+            indices.push_back(base + index);
+    }
+    LightmapMesh out;
+    std::vector<std::uint32_t> remap;
+    out.Resolution = GenerateLightmapUvs(positions, indices, remap, out.Indices, out.Uvs);
+    out.Positions.resize(remap.size());
+    out.Normals.resize(remap.size());
+
+    // split vertices stay with their mesh, the triangles keep their order
+    size_t triangle = 0;
+    std::uint32_t base = 0;
+    std::unordered_map<std::uint32_t, unsigned int> local;
+    for (Mesh& mesh : model.meshes) {
+        std::vector<Vertex> vertices;
+        local.clear();
+        for (unsigned int& index : mesh.indices) {
+            std::uint32_t split = out.Indices[triangle++];
+            auto found = local.find(split);
+            if (found == local.end()) {
+                found = local.emplace(split, (unsigned int) vertices.size()).first;
+                Vertex v = mesh.vertices[remap[split] - base];
+                v.LightmapTexCoords = out.Uvs[split];
+                vertices.push_back(v);
+                out.Positions[split] = v.Position;
+                out.Normals[split] = v.Normal;
+            }
+            index = found->second;
+        }
+        base += (std::uint32_t) mesh.vertices.size();
+        mesh.vertices.swap(vertices);
+    }
+    return out;
+}
+
+// Owns the GL side of the scene: one Model per mesh handle and one Shader per material handle.
+class SceneRenderer {
+public:
+    std::vector<std::unique_ptr<Model>> Models;
+    std::vector<Aabb> ModelLocalBounds;
+    std::vector<MeshBvh> MeshBvhs; // per mesh handle, for picking and collision
+    std::vector<LightmapMesh> LightmapMeshes; // per mesh handle, for the lightmap baker
+    std::vector<std::unique_ptr<Shader>> Materials;
+    std::vector<DepthPrepassClass> MaterialDepthClasses; // per material handle
+
+    // Reads a scene description; see resources/scene.txt for the format. Materials and models are
+    // set up first, everything else follows in file order once the models are in. With a job system
+    // the models are imported on workers and only their GL upload runs on this thread.
+    bool LoadSceneDescription(const std::string& path, Scene& scene, JobSystem* jobs = nullptr) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "ERROR::SCENE:: could not open " << path << std::endl;
+            return false;
+        }
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(in, line))
+            lines.push_back(line);
+
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t i = 0; i < lines.size(); ++i) {
+                std::istringstream ls(lines[i]);
+                std::string keyword;
+                if (!(ls >> keyword) || keyword[0] == '#')
+                    continue;
+                bool resource = keyword == "material" || keyword == "model";
+                if (resource != (pass == 0))
+                    continue;
+                if (!parseLine(keyword, ls, scene)) {
+                    std::cout << "ERROR::SCENE:: " << path << ":" << i + 1 << ": " << lines[i] << std::endl;
+                    return false;
+                }
+            }
+            if (pass == 0)
+                loadModels(scene, jobs);
+        }
+        m_DepthShader.reset(new Shader(FileSystem::getPath("resources/shaders/depth.vs").c_str(),
+                                       FileSystem::getPath("resources/shaders/depth.fs").c_str()));
+        m_DepthAlphaShader.reset(new Shader(FileSystem::getPath("resources/shaders/depth.vs").c_str(),
+                                            FileSystem::getPath("resources/shaders/depth_alpha.fs").c_str()));
+        m_DepthAlphaShader->use();
+        m_DepthAlphaShader->setInt("material.texture_diffuse1", 0);
+        return true;
+    }
+
+    // Deletes the models' GL objects and the programs, on the render thread. The CPU side (bounds,
+    // BVHs, lightmap meshes) stays.
+    void Shutdown() {
+        for (size_t i = 0; i < Models.size(); ++i) {
+            if (!Models[i])
+                continue;
+            if (i < m_SharedMeshes.size() && m_SharedMeshes[i])
+                Models[i]->ReleaseTextures();
+            else
+                Models[i]->Release();
+        }
+        releaseProgram(m_DepthShader.get());
+        releaseProgram(m_DepthAlphaShader.get());
+        for (std::unique_ptr<Shader>& shader : Materials)
+            releaseProgram(shader.get());
+    }
+
+    // Once per frame on the render thread, before the first draw: drops the previous frame's scratch.
+    void BeginFrame() {
+        m_Frame.Reset();
+    }
+
+    // Uploads the directional light meant for the given material, the last one in table order wins.
+    // Point lights reach the shaders through the light clusters.
+    void ApplyLights(const LightTable& t, std::uint16_t material, Shader& shader) const {
+        for (size_t i = 0; i < t.Size(); ++i) {
+            if (t.Material[i] != AllMaterials && t.Material[i] != material)
+                continue;
+            if (t.Type[i] == LightDirectional) {
+                shader.setVec3("dirLight.direction", t.Direction.Get(i));
+                shader.setVec3("dirLight.ambient", t.Ambient.Get(i));
+                shader.setVec3("dirLight.diffuse", t.Diffuse.Get(i));
+                shader.setVec3("dirLight.specular", t.Specular.Get(i));
+            }
+        }
+    }
+
+    // Depth-only pass over the draws whose material class is in classes: opaque ones from the position
+    // stream, then alpha-tested ones, each front to back. Colour writes are off; Draw with the same
+    // classes then shades each covered pixel once. With the transparent pass on, meshes is Opaque: what
+    // is seen through glass mustn't fail the equal test against the glass.
+    void DrawDepthPrepass(const std::vector<DrawItem>& drawList, const glm::mat4& projection, const glm::mat4& view,
+                          std::uint8_t classes, MeshSelection meshes = MeshSelection::All) {
+        m_DepthOrder.clear();
+        for (std::uint32_t i = 0; i < (std::uint32_t) drawList.size(); ++i) {
+            if ((classes & MaterialDepthClasses[drawList[i].Material])
+                && (meshes == MeshSelection::All || Models[drawList[i].Mesh]->Has(meshes)))
+                m_DepthOrder.push_back(i);
+        }
+        if (m_DepthOrder.empty())
+            return;
+        // the low 24 bits of the sort key are the distance
+        std::sort(m_DepthOrder.begin(), m_DepthOrder.end(), [this, &drawList](std::uint32_t a, std::uint32_t b) {
+            std::uint8_t classA = MaterialDepthClasses[drawList[a].Material];
+            std::uint8_t classB = MaterialDepthClasses[drawList[b].Material];
+            if (classA != classB)
+                return classA < classB;
+            return (drawList[a].SortKey & 0xFFFFFF) < (drawList[b].SortKey & 0xFFFFFF);
+        });
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glActiveTexture(GL_TEXTURE0);
+        Shader* current = nullptr;
+        GLint model = -1;
+        bool cullFace = glIsEnabled(GL_CULL_FACE);
+        for (std::uint32_t index : m_DepthOrder) {
+            const DrawItem& item = drawList[index];
+            bool alphaTested = MaterialDepthClasses[item.Material] == DepthPrepassAlphaTested;
+            Shader* shader = alphaTested ? m_DepthAlphaShader.get() : m_DepthShader.get();
+            if (shader != current) {
+                shader->use();
+                shader->setMat4("projection", projection);
+                shader->setMat4("view", view);
+                model = shader->getLocation("model");
+                current = shader;
+            }
+            setCullFace(item, cullFace);
+            shader->setMat4(model, item.World);
+            if (alphaTested)
+                Models[item.Mesh]->DrawAlphaTested(meshes);
+            else
+                Models[item.Mesh]->DrawPositions(meshes);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    // Draws the draw list, switching programs only when the material changes.
+    // Per-material uniforms (camera, lights, shadows) are uploaded the first time a material is used in
+    // a frame, point lights come from clusters and the shadow cascades are bound for this frame already.
+    // Draws of the prepassed classes only shade what the depth pre-pass left visible: GL_EQUAL, no
+    // depth writes. With lightmaps, the baked renderables read their lighting from the bound atlas
+    // (a zero lightmapRect means lit as usual). With probes, dirLight's ambient term comes from them.
+    // meshes picks the opaque or the transparent meshes of each model when the transparent pass is on;
+    // for Transparent the shaders write to the weighted blended targets (oitPass), in draw list order.
+    // Nothing is allocated: the per-draw uniforms go through locations found when the material was
+    // built and the per-material state lives in the frame's scratch memory (BeginFrame).
+    void Draw(const std::vector<DrawItem>& drawList, const LightTable& lights, const ClusteredLightBuffers& clusters,
+              const ShadowMaps& shadows, const LightmapTexture* lightmaps, const IrradianceProbeTexture* probes,
+              const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPosition,
+              std::uint8_t prepassed = 0, MeshSelection meshes = MeshSelection::All) {
+        bool* prepared = m_Frame.Allocate<bool>(Materials.size(), false);
+        glm::vec4* lightmapRects = m_Frame.Allocate<glm::vec4>(Materials.size(), glm::vec4(-1.0f)); // last uploaded
+        std::uint16_t currentMaterial = AllMaterials;
+        bool cullFace = glIsEnabled(GL_CULL_FACE);
+        bool depthEqual = false;
+        for (const DrawItem& item : drawList) {
+            if (meshes != MeshSelection::All && !Models[item.Mesh]->Has(meshes))
+                continue;
+            std::uint16_t material = item.Material;
+            Shader& shader = *Materials[material];
+            const DrawUniforms& uniforms = m_DrawUniforms[material];
+            bool wantEqual = (prepassed & MaterialDepthClasses[material]) != 0;
+            if (wantEqual != depthEqual) {
+                glDepthFunc(wantEqual ? GL_EQUAL : GL_LESS);
+                glDepthMask(wantEqual ? GL_FALSE : GL_TRUE);
+                depthEqual = wantEqual;
+            }
+            if (material != currentMaterial) {
+                shader.use();
+                currentMaterial = material;
+                if (!prepared[material]) {
+                    RG_PROFILE_SCOPE("material uniforms");
+                    shader.setVec3("viewPosition", viewPosition);
+                    shader.setFloat("material.shininess", 32.0f);
+                    shader.setMat4("projection", projection);
+                    shader.setMat4("view", view);
+                    ApplyLights(lights, material, shader);
+                    clusters.SetUniforms(shader);
+                    shadows.SetUniforms(shader);
+                    shader.setInt("lightMaterial", material);
+                    shader.setInt("lightmap", LIGHTMAP_TEXTURE_UNIT);
+                    IrradianceProbeTexture::SetUniforms(probes, shader);
+                    shader.setInt("oitPass", meshes == MeshSelection::Transparent);
+                    prepared[material] = true;
+                }
+            }
+            // the draws that aren't baked share the zero rect, only changes go out
+            glm::vec4 rect = lightmaps ? lightmaps->Rect(item.Owner) : glm::vec4(0.0f);
+            if (rect != lightmapRects[material]) {
+                shader.setVec4(uniforms.LightmapRect, rect);
+                lightmapRects[material] = rect;
+            }
+            setCullFace(item, cullFace);
+            shader.setMat4(uniforms.Model, item.World);
+            Models[item.Mesh]->Draw(shader, meshes);
+        }
+        if (depthEqual) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
+    // Shadow casters into the cascades in layers (see ShadowMaps::CasterDrawer): the opaque ones from
+    // the position stream, then the alpha-tested ones.
+    void DrawShadowCasters(const std::vector<ShadowCaster>& casters, Shader& opaque, Shader& alphaTested,
+                           std::uint8_t layers) {
+        glActiveTexture(GL_TEXTURE0);
+        bool cullFace = glIsEnabled(GL_CULL_FACE);
+        for (int alpha = 0; alpha < 2; ++alpha) {
+            Shader& shader = alpha ? alphaTested : opaque;
+            bool used = false;
+            GLint model = -1, cascadeMask = -1;
+            for (const ShadowCaster& caster : casters) {
+                std::uint8_t mask = caster.Cascades & layers;
+                if (!mask || (MaterialDepthClasses[caster.Material] == DepthPrepassAlphaTested) != (alpha == 1))
+                    continue;
+                if (!used) {
+                    shader.use();
+                    model = shader.getLocation("model");
+                    cascadeMask = shader.getLocation("cascadeMask");
+                    used = true;
+                }
+                setCullFace(caster.Flags, cullFace);
+                shader.setMat4(model, caster.World);
+                shader.setInt(cascadeMask, mask);
+                if (alpha)
+                    Models[caster.Mesh]->DrawAlphaTested();
+                else
+                    Models[caster.Mesh]->DrawPositions();
+            }
+        }
+    }
+
+    // Copy of a material with a program of its own, built from the same shaders. Returns its handle.
+    std::uint16_t DuplicateMaterial(Scene& scene, std::uint16_t material, const std::string& name) {
+        std::uint16_t handle = scene.FindOrAddMaterial(name);
+        if (handle >= Materials.size())
+            resizeMaterials(handle + 1);
+        m_MaterialSources[handle] = m_MaterialSources[material];
+        MaterialDepthClasses[handle] = MaterialDepthClasses[material];
+        buildMaterial(handle);
+        return handle;
+    }
+
+    // Copy of a loaded model that shares its vertex buffers but has its own copies of every texture, on
+    // the GL thread. Returns its mesh handle.
+    std::uint16_t DuplicateModel(Scene& scene, std::uint16_t mesh, const std::string& name) {
+        std::uint16_t handle = scene.FindOrAddMesh(name);
+        if (handle >= Models.size()) {
+            Models.resize(handle + 1);
+            ModelLocalBounds.resize(handle + 1);
+            MeshBvhs.resize(handle + 1);
+            LightmapMeshes.resize(handle + 1);
+        }
+        if (handle >= m_SharedMeshes.size())
+            m_SharedMeshes.resize(handle + 1, false);
+        m_SharedMeshes[handle] = true;
+        Model* copy = new Model(*Models[mesh]);
+        Models[handle].reset(copy);
+        for (Texture& texture : copy->textures_loaded) {
+            unsigned int source = texture.id;
+            texture.id = CopyTexture(source);
+            for (Mesh& m : copy->meshes) {
+                for (Texture& t : m.textures) {
+                    if (t.id == source)
+                        t.id = texture.id;
+                }
+            }
+        }
+        ModelLocalBounds[handle] = ModelLocalBounds[mesh];
+        MeshBvhs[handle] = MeshBvhs[mesh];
+        LightmapMeshes[handle] = LightmapMeshes[mesh];
+        return handle;
+    }
+
+private:
+    struct MaterialSource {
+        std::string VertexPath;
+        std::string FragmentPath;
+    };
+    std::vector<MaterialSource> m_MaterialSources; // per material handle
+    // uniforms set for every draw, looked up when the material's program is built
+    struct DrawUniforms {
+        GLint Model = -1;
+        GLint LightmapRect = -1;
+    };
+    std::vector<DrawUniforms> m_DrawUniforms; // per material handle
+    struct PendingModel {
+        std::uint16_t Handle;
+        std::string Path;
+    };
+    std::vector<PendingModel> m_PendingModels;
+    std::vector<bool> m_SharedMeshes; // per mesh handle, DuplicateModel copies don't own their vertex buffers
+    std::unique_ptr<Shader> m_DepthShader, m_DepthAlphaShader;
+    std::vector<std::uint32_t> m_DepthOrder; // draw list indices, reused every frame
+    FrameAllocator m_Frame; // render thread scratch, reset by BeginFrame
+
+    static void releaseProgram(Shader* shader) {
+        if (!shader || !shader->ID)
+            return;
+        glDeleteProgram(shader->ID);
+        metrics::Render().GlObjects.Add(-1);
+        shader->ID = 0;
+    }
+
+    static void setCullFace(const DrawItem& item, bool& cullFace) {
+        setCullFace(item.Flags, cullFace);
+    }
+
+    static void setCullFace(std::uint8_t flags, bool& cullFace) {
+        bool wantCull = !(flags & RenderFlagDoubleSided);
+        if (wantCull != cullFace) {
+            if (wantCull)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+            cullFace = wantCull;
+        }
+    }
+
+    void loadModels(const Scene& scene, JobSystem* jobs) {
+        Models.resize(scene.MeshNames.size());
+        ModelLocalBounds.resize(scene.MeshNames.size());
+        MeshBvhs.resize(scene.MeshNames.size());
+        LightmapMeshes.resize(scene.MeshNames.size());
+        std::vector<JobHandle> uploads;
+        for (const PendingModel& pending : m_PendingModels) {
+            std::uint16_t handle = pending.Handle;
+            std::string path = FileSystem::getPath(pending.Path);
+            if (!jobs) {
+                RG_PROFILE_SCOPE("load model");
+                Models[handle].reset(new Model(path, false, true));
+                finishModel(handle);
+                Models[handle]->UploadToGpu();
+                continue;
+            }
+            // every job owns its slot of the vectors, which were sized above and don't move any more
+            JobHandle import = jobs->Schedule([this, handle, path] {
+                RG_PROFILE_SCOPE("load model");
+                Models[handle].reset(new Model(path, false, true));
+                finishModel(handle);
+            });
+            uploads.push_back(jobs->RunOnMainThread([this, handle] {
+                RG_PROFILE_SCOPE("upload model");
+                Models[handle]->UploadToGpu();
+            }, {import}));
+        }
+        if (jobs)
+            jobs->Wait(uploads);
+        m_PendingModels.clear();
+    }
+
+    void resizeMaterials(size_t count) {
+        Materials.resize(count);
+        MaterialDepthClasses.resize(count, DepthPrepassOpaque);
+        m_MaterialSources.resize(count);
+        m_DrawUniforms.resize(count);
+    }
+
+    // the material's program, with the mesh samplers pointed at their units
+    void buildMaterial(std::uint16_t handle) {
+        const MaterialSource& source = m_MaterialSources[handle];
+        Materials[handle].reset(new Shader(source.VertexPath.c_str(), source.FragmentPath.c_str()));
+        Shader& shader = *Materials[handle];
+        Mesh::SetSamplerUnits(shader, "material.");
+        m_DrawUniforms[handle].Model = shader.getLocation("model");
+        m_DrawUniforms[handle].LightmapRect = shader.getLocation("lightmapRect");
+    }
+
+    // CPU side work after a model is imported, before its upload
+    void finishModel(std::uint16_t handle) {
+        LightmapMeshes[handle] = GenerateModelLightmap(*Models[handle]);
+        ModelLocalBounds[handle] = ModelBounds(*Models[handle]);
+        MeshBvhs[handle] = BuildMeshBvh(*Models[handle]);
+    }
+
+    static bool readVec3(std::istream& in, glm::vec3& v) {
+        return (bool) (in >> v.x >> v.y >> v.z);
+    }
+
+    bool parseLine(const std::string& keyword, std::istringstream& ls, Scene& scene) {
+        if (keyword == "material") {
+            // material <name> "<vertex shader>" "<fragment shader>" [alpha_tested]
+            std::string name, vs, fs, flag;
+            if (!(ls >> name >> std::quoted(vs) >> std::quoted(fs)))
+                return false;
+            DepthPrepassClass depthClass = DepthPrepassOpaque;
+            while (ls >> flag) {
+                if (flag == "alpha_tested")
+                    depthClass = DepthPrepassAlphaTested;
+                else
+                    return false;
+            }
+            std::uint16_t handle = scene.FindOrAddMaterial(name);
+            if (handle >= Materials.size())
+                resizeMaterials(handle + 1);
+            MaterialDepthClasses[handle] = depthClass;
+            m_MaterialSources[handle] = MaterialSource{FileSystem::getPath(vs), FileSystem::getPath(fs)};
+            buildMaterial(handle);
+            return true;
+        }
+        if (keyword == "model") {
+            // model <name> "<path>"
+            std::string name, path;
+            if (!(ls >> name >> std::quoted(path)))
+                return false;
+            m_PendingModels.push_back(PendingModel{scene.FindOrAddMesh(name), path});
+            return true;
+        }
+        if (keyword == "lod") {
+            // lod <model> <distance> <coarser model|none>
+            std::string model, coarser;
+            float distance;
+            if (!(ls >> model >> distance >> coarser) || distance <= 0.0f)
+                return false;
+            std::uint16_t mesh = scene.FindOrAddMesh(model);
+            std::uint16_t next = coarser == "none" ? NoMesh : scene.FindOrAddMesh(coarser);
+            if (mesh >= Models.size() || !Models[mesh] || (next != NoMesh && (next >= Models.size() || !Models[next])))
+                return false;
+            if (mesh >= scene.MeshLods.size())
+                scene.MeshLods.resize(mesh + 1);
+            scene.MeshLods[mesh] = LodSwitch{distance, next};
+            return true;
+        }
+        if (keyword == "instance") {
+            // instance <model> <material> <x y z> <rotationY> <sx sy sz> [double_sided] [dynamic]
+            std::string model, material, flag;
+            glm::vec3 position, scale;
+            float rotationY;
+            if (!(ls >> model >> material) || !readVec3(ls, position) || !(ls >> rotationY) || !readVec3(ls, scale))
+                return false;
+            std::uint8_t flags = 0;
+            while (ls >> flag) {
+                if (flag == "double_sided")
+                    flags |= RenderFlagDoubleSided;
+                else if (flag == "dynamic")
+                    flags |= RenderFlagDynamic;
+                else
+                    return false;
+            }
+            return addInstance(scene, model, material, position, rotationY, scale, flags);
+        }
+        if (keyword == "scatter") {
+            // scatter <model> <material> <count> <seed> <minX> <rangeX> <y> <minZ> <rangeZ> <scale>
+            std::string model, material;
+            unsigned int count, seed;
+            int minX, rangeX, minZ, rangeZ;
+            float y, scale;
+            if (!(ls >> model >> material >> count >> seed >> minX >> rangeX >> y >> minZ >> rangeZ >> scale))
+                return false;
+            // a range of 0 keeps that coordinate at its min
+            if (rangeX < 0 || rangeZ < 0)
+                return false;
+            srand(seed);
+            for (unsigned int i = 0; i < count; ++i) {
+                float x = (float) ((rangeX > 0 ? rand() % rangeX : 0) + minX);
+                float z = (float) ((rangeZ > 0 ? rand() % rangeZ : 0) + minZ);
+                if (!addInstance(scene, model, material, glm::vec3(x, y, z), 0.0f, glm::vec3(scale), 0))
+                    return false;
+            }
+            return true;
+        }
+        if (keyword == "dirlight" || keyword == "pointlight") {
+            // dirlight <material|*> <direction> <ambient> <diffuse> <specular>
+            // pointlight <material|*> <position> <ambient> <diffuse> <specular> <constant> <linear> <quadratic>
+            LightDesc desc;
+            std::string material;
+            if (!(ls >> material))
+                return false;
+            if (material != "*") {
+                desc.Material = scene.FindMaterial(material);
+                if (desc.Material == AllMaterials)
+                    return false;
+            }
+            bool ok;
+            if (keyword == "dirlight") {
+                desc.Type = LightDirectional;
+                ok = readVec3(ls, desc.Direction) && readVec3(ls, desc.Ambient) && readVec3(ls, desc.Diffuse)
+                     && readVec3(ls, desc.Specular);
+            } else {
+                desc.Type = LightPoint;
+                ok = readVec3(ls, desc.Position) && readVec3(ls, desc.Ambient) && readVec3(ls, desc.Diffuse)
+                     && readVec3(ls, desc.Specular) && (ls >> desc.Constant >> desc.Linear >> desc.Quadratic);
+            }
+            if (ok)
+                scene.CreateLight(desc);
+            return ok;
+        }
+        return false;
+    }
+
+    bool addInstance(Scene& scene, const std::string& model, const std::string& material,
+                     const glm::vec3& position, float rotationY, const glm::vec3& scale, std::uint8_t flags) {
+        std::uint16_t mesh = scene.FindOrAddMesh(model);
+        std::uint16_t mat = scene.FindMaterial(material);
+        if (mesh >= Models.size() || !Models[mesh] || mat == AllMaterials) {
+            std::cout << "ERROR::SCENE:: unknown model or material " << model << " / " << material << std::endl;
+            return false;
+        }
+        scene.CreateRenderable(mesh, mat, ModelLocalBounds[mesh], position, rotationY, scale, flags);
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENE_RENDERER_H
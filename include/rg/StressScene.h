@@ -0,0 +1,131 @@
+#ifndef PROJECT_BASE_STRESS_SCENE_H
+#define PROJECT_BASE_STRESS_SCENE_H
+
+#include <glm/glm.hpp>
+#include <rg/Scene.h>
+#include <rg/SceneRenderer.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Synthetic load added on top of the scene description, so the benchmark can measure how the renderer
+// scales: Instances copies of the loaded models, PointLights extra lights, MaterialCopies extra shader
+// programs and TextureCopies models whose textures are duplicated in GPU memory. Everything is placed
+// from Seed, so two runs with the same options render the same scene.
+struct StressSceneOptions {
+    int Instances = 0;
+    int PointLights = 0;
+    int MaterialCopies = 0;
+    int TextureCopies = 0;
+    unsigned int Seed = 1;
+    float Extent = 60.0f; // instances and lights go in [-Extent, Extent] on x and z
+    std::vector<std::string> Models; // mesh names to place, all loaded models when empty
+
+    bool Active() const {
+        return Instances > 0 || PointLights > 0 || MaterialCopies > 0 || TextureCopies > 0;
+    }
+};
+
+// comma separated mesh names, as given to --stress-models
+inline std::vector<std::string> SplitNames(const std::string& list) {
+    std::vector<std::string> names;
+    std::istringstream in(list);
+    std::string name;
+    while (std::getline(in, name, ',')) {
+        if (!name.empty())
+            names.push_back(name);
+    }
+    return names;
+}
+
+// On the GL thread, after the scene description is loaded. Instances sit on the ground (y = -1) with a
+// random rotation and a scale that brings the model's largest extent to 0.5..3 units.
+inline bool GenerateStressScene(const StressSceneOptions& options, Scene& scene, SceneRenderer& renderer) {
+    std::vector<std::uint16_t> meshes;
+    if (options.Models.empty()) {
+        for (size_t i = 0; i < renderer.Models.size(); ++i) {
+            if (renderer.Models[i])
+                meshes.push_back((std::uint16_t) i);
+        }
+    }
+    for (const std::string& name : options.Models) {
+        auto it = std::find(scene.MeshNames.begin(), scene.MeshNames.end(), name);
+        size_t mesh = it - scene.MeshNames.begin();
+        if (it == scene.MeshNames.end() || mesh >= renderer.Models.size() || !renderer.Models[mesh]) {
+            std::cout << "ERROR::STRESS::UNKNOWN_MODEL " << name << std::endl;
+            return false;
+        }
+        meshes.push_back((std::uint16_t) mesh);
+    }
+    std::vector<std::uint16_t> materials;
+    for (size_t i = 0; i < renderer.Materials.size(); ++i) {
+        if (renderer.Materials[i])
+            materials.push_back((std::uint16_t) i);
+    }
+    if ((options.Instances > 0 || options.TextureCopies > 0) && meshes.empty()) {
+        std::cout << "ERROR::STRESS::NO_MODELS" << std::endl;
+        return false;
+    }
+    if ((options.Instances > 0 || options.MaterialCopies > 0) && materials.empty()) {
+        std::cout << "ERROR::STRESS::NO_MATERIALS" << std::endl;
+        return false;
+    }
+
+    std::mt19937 random(options.Seed);
+    auto uniform = [&random](float low, float high) {
+        return std::uniform_real_distribution<float>(low, high)(random);
+    };
+    auto pick = [&random](const std::vector<std::uint16_t>& handles) {
+        return handles[std::uniform_int_distribution<size_t>(0, handles.size() - 1)(random)];
+    };
+
+    std::vector<std::uint16_t> instanceMeshes = meshes;
+    for (int i = 0; i < options.TextureCopies; ++i) {
+        std::uint16_t source = meshes[i % meshes.size()];
+        instanceMeshes.push_back(renderer.DuplicateModel(scene, source, scene.MeshNames[source] + "#" + std::to_string(i)));
+    }
+    std::vector<std::uint16_t> instanceMaterials = materials;
+    for (int i = 0; i < options.MaterialCopies; ++i) {
+        std::uint16_t source = materials[i % materials.size()];
+        instanceMaterials.push_back(
+                renderer.DuplicateMaterial(scene, source, scene.MaterialNames[source] + "#" + std::to_string(i)));
+    }
+
+    scene.Reserve(scene.Renderables.Size() + options.Instances);
+    for (int i = 0; i < options.Instances; ++i) {
+        std::uint16_t mesh = pick(instanceMeshes);
+        const Aabb& bounds = renderer.ModelLocalBounds[mesh];
+        glm::vec3 size = bounds.Max - bounds.Min;
+        float largest = std::max(size.x, std::max(size.y, size.z));
+        float scale = largest > 0.0f ? uniform(0.5f, 3.0f) / largest : 1.0f;
+        glm::vec3 position(uniform(-options.Extent, options.Extent), -1.0f - bounds.Min.y * scale,
+                           uniform(-options.Extent, options.Extent));
+        scene.CreateRenderable(mesh, pick(instanceMaterials), bounds, position, uniform(0.0f, 360.0f),
+                               glm::vec3(scale));
+    }
+
+    for (int i = 0; i < options.PointLights; ++i) {
+        LightDesc light;
+        light.Type = LightPoint;
+        light.Position = glm::vec3(uniform(-options.Extent, options.Extent), uniform(0.0f, 4.0f),
+                                   uniform(-options.Extent, options.Extent));
+        light.Ambient = glm::vec3(0.0f);
+        light.Diffuse = glm::vec3(uniform(0.2f, 1.0f), uniform(0.2f, 1.0f), uniform(0.2f, 1.0f));
+        light.Specular = light.Diffuse;
+        // lamp sized, about 10 units of range, so each one lands in a handful of light clusters
+        light.Linear = 0.35f;
+        light.Quadratic = 0.44f;
+        scene.CreateLight(light);
+    }
+    return true;
+}
+
+}
+
+#endif //PROJECT_BASE_STRESS_SCENE_H
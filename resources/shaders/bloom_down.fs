@@ -0,0 +1,18 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+
+// dual-filter downsample to half size: the centre tap and four diagonal ones a source texel out all
+// land between texels, so bilinear filtering averages a 2x2 block per tap, 16 texels in 5 taps
+void main(){
+    vec2 texel = 1.0 / textureSize(image, 0);
+    vec3 result = texture(image, TexCoords).rgb * 4.0;
+    result += texture(image, TexCoords + vec2(-texel.x, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(-texel.x,  texel.y)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x,  texel.y)).rgb;
+    FragColor = result / 8.0;
+}
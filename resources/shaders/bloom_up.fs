@@ -0,0 +1,21 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+
+// dual-filter upsample to double size: a tent of four edge taps a texel out and four diagonal ones
+// half a texel out at double weight, bilinear filtering does the rest
+void main(){
+    vec2 texel = 1.0 / textureSize(image, 0);
+    vec3 result = texture(image, TexCoords + vec2(-texel.x, 0.0)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x, 0.0)).rgb;
+    result += texture(image, TexCoords + vec2(0.0, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(0.0,  texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(-texel.x, -texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2( texel.x, -texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2(-texel.x,  texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2( texel.x,  texel.y) * 0.5).rgb * 2.0;
+    FragColor = result / 12.0;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+
+in vec2 TexCoords;
+
+uniform Material material;
+
+// same cut-off as 3.1.blending.fs
+void main()
+{
+    if(texture(material.texture_diffuse1, TexCoords).a < 0.1)
+        discard;
+}
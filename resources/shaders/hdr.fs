@@ -10,25 +10,45 @@ uniform bool hdr;
 uniform bool bloom;
 
 uniform float exposure;
+// > 0 when hdrBuffer is smaller than the output (dynamic resolution), see main()
+uniform float sharpness;
 
-void main(){             
+vec3 display(vec3 hdrColor, vec3 bloomColor){
     const float gamma = 2.2;
-    vec3 hdrColor = texture(hdrBuffer, TexCoords).rgb;
-    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
     if(hdr){
         if(bloom)
-            hdrColor += bloomColor; 
+            hdrColor += bloomColor;
+
 
-        
          vec3 result = hdrColor / (hdrColor + vec3(1.0));
-       
+
          result = vec3(1.0) - exp(-hdrColor * exposure);
-          
-        result = pow(result, vec3(1.0 / gamma));
-        FragColor = vec4(result, 1.0);
+
+        return pow(result, vec3(1.0 / gamma));
     }
     else{
-        vec3 result = pow(hdrColor, vec3(1.0 / gamma));
-        FragColor = vec4(result, 1.0);
+        return pow(hdrColor, vec3(1.0 / gamma));
+    }
+}
+
+void main(){
+    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
+    vec3 result = display(texture(hdrBuffer, TexCoords).rgb, bloomColor);
+    if(sharpness > 0.0){
+        // Contrast-adaptive sharpening of the bilinear upscale (after AMD's CAS): a negative-lobe cross
+        // on the tonemapped neighbours, weighted down where the neighbourhood is already near black,
+        // white or high contrast so edges don't ring. The bloom is blurry anyway, the centre's is reused.
+        vec2 texel = 1.0 / vec2(textureSize(hdrBuffer, 0));
+        vec3 c = clamp(result, 0.0, 1.0);
+        vec3 n = clamp(display(texture(hdrBuffer, TexCoords + vec2(0.0, texel.y)).rgb, bloomColor), 0.0, 1.0);
+        vec3 s = clamp(display(texture(hdrBuffer, TexCoords - vec2(0.0, texel.y)).rgb, bloomColor), 0.0, 1.0);
+        vec3 e = clamp(display(texture(hdrBuffer, TexCoords + vec2(texel.x, 0.0)).rgb, bloomColor), 0.0, 1.0);
+        vec3 w = clamp(display(texture(hdrBuffer, TexCoords - vec2(texel.x, 0.0)).rgb, bloomColor), 0.0, 1.0);
+        vec3 lo = min(c, min(min(n, s), min(e, w)));
+        vec3 hi = max(c, max(max(n, s), max(e, w)));
+        vec3 amount = sqrt(clamp(min(lo, 1.0 - hi) / max(hi, vec3(1e-4)), 0.0, 1.0));
+        vec3 weight = -amount / mix(8.0, 5.0, clamp(sharpness, 0.0, 1.0));
+        result = clamp((c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
     }
-}
\ No newline at end of file
+    FragColor = vec4(result, 1.0);
+}
@@ -1,5 +1,10 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
+// In the weighted blended transparency pass (oitPass) FragColor sums the weighted premultiplied colour
+// and multiplies its alpha down to the revealage, BrightColor.r sums the weights; zero in the lit pass.
+layout (location = 1) out vec4 BrightColor;
+uniform bool oitPass;
+uniform float opacity; // of the transparent mesh
 
 
 
@@ -29,17 +34,106 @@ struct Material {
     float shininess;
 };
 
-#define NR_POINT_LIGHTS 2
+// Point lights come clustered (rg/ClusteredLights.h): the view is cut into CLUSTER_X x CLUSTER_Y
+// screen tiles and CLUSTER_Z exponential depth slices, clusterCells holds where each cluster's list
+// starts in clusterIndices and how long it is, clusterLights four texels per light.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define LIGHT_CUTOFF (5.0 / 256.0)
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterCells;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterSlicing; // slice = log(view depth) * x + y
+uniform vec2 clusterNearFar;
+uniform int lightMaterial;
+
+// Shadows of dirLight from the cascades in shadowMap (rg/CascadedShadows.h), none when shadowCascades is 0.
+#define SHADOW_MAX_CASCADES 4
+uniform sampler2DArrayShadow shadowMap;
+uniform int shadowCascades;
+uniform mat4 shadowMatrices[SHADOW_MAX_CASCADES];
+uniform float shadowFarDepths[SHADOW_MAX_CASCADES];
+uniform float shadowTexelSizes[SHADOW_MAX_CASCADES];
+
 uniform DirLight dirLight;
 uniform Material material;
 
 uniform vec3 viewPosition;
+
+// baked lighting of static renderables, none where lightmapRect is zero
+in vec2 LightmapCoords;
+uniform sampler2D lightmap;
+uniform vec4 lightmapRect;
+
+// spherical-harmonics irradiance probes over the static scene, in place of dirLight's flat ambient;
+// probeGrid stacks the nine coefficients as slabs of probeGridSize.z layers
+uniform bool probesEnabled;
+uniform sampler3D probeGrid;
+uniform vec3 probeGridMin;
+uniform vec3 probeGridCell;
+uniform vec3 probeGridSize;
+
+vec3 ProbeCoefficient(vec3 cell, int k)
+{
+    // clamped to the slab's own texel centres so filtering never reaches the next coefficient
+    vec3 p = clamp(cell, vec3(0.5), probeGridSize - 0.5);
+    p.z += float(k) * probeGridSize.z;
+    return texture(probeGrid, p / vec3(probeGridSize.xy, probeGridSize.z * 9.0)).rgb;
+}
+
+// irradiance over pi for the normal, interpolated between the eight nearest probes
+vec3 ProbeIrradiance(vec3 position, vec3 n)
+{
+    vec3 cell = (position - probeGridMin) / probeGridCell;
+    vec3 result = 0.282095 * ProbeCoefficient(cell, 0);
+    result += 0.488603 * (n.y * ProbeCoefficient(cell, 1) + n.z * ProbeCoefficient(cell, 2)
+                          + n.x * ProbeCoefficient(cell, 3));
+    result += 1.092548 * (n.x * n.y * ProbeCoefficient(cell, 4) + n.y * n.z * ProbeCoefficient(cell, 5)
+                          + n.x * n.z * ProbeCoefficient(cell, 7));
+    result += 0.315392 * (3.0 * n.z * n.z - 1.0) * ProbeCoefficient(cell, 6);
+    result += 0.546274 * (n.x * n.x - n.y * n.y) * ProbeCoefficient(cell, 8);
+    return max(result, vec3(0.0));
+}
+
+// view depth of the fragment, back from the window depth for the glm::perspective near and far planes
+float ViewDepth()
+{
+    float n = clusterNearFar.x;
+    float f = clusterNearFar.y;
+    return 2.0 * n * f / (f + n - (2.0 * gl_FragCoord.z - 1.0) * (f - n));
+}
+
+// 1 lit, 0 in shadow: 3x3 taps of bilinear comparisons in the first cascade that reaches the fragment
+float CalcShadow(vec3 normal, vec3 lightDir)
+{
+    float depth = ViewDepth();
+    int cascade = 0;
+    while(cascade < shadowCascades && depth > shadowFarDepths[cascade])
+        cascade++;
+    if(cascade >= shadowCascades)
+        return 1.0;
+    // normal offset against acne, more where the light grazes the surface
+    float slope = 1.0 - max(dot(normal, lightDir), 0.0);
+    vec3 position = FragPos + normal * shadowTexelSizes[cascade] * (1.0 + 2.0 * slope);
+    vec3 coords = (shadowMatrices[cascade] * vec4(position, 1.0)).xyz * 0.5 + 0.5;
+    if(coords.z > 1.0)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++){
+        for(int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    }
+    return lit / 9.0;
+}
+
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
@@ -62,6 +156,40 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
+vec3 CalcClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    float depth = ViewDepth();
+    ivec3 tile = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(depth) * clusterSlicing.x + clusterSlicing.y)));
+    tile = clamp(tile, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    uvec2 cell = texelFetch(clusterCells, tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * tile.z)).xy;
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < cell.y; i++){
+        int texel = 4 * int(texelFetch(clusterIndices, int(cell.x + i)).r);
+        vec4 positionMaterial = texelFetch(clusterLights, texel);
+        if(positionMaterial.w >= 0.0 && int(positionMaterial.w) != lightMaterial)
+            continue;
+        PointLight light;
+        light.position = positionMaterial.xyz;
+        vec4 ambientConstant = texelFetch(clusterLights, texel + 1);
+        vec4 diffuseLinear = texelFetch(clusterLights, texel + 2);
+        vec4 specularQuadratic = texelFetch(clusterLights, texel + 3);
+        light.ambient = ambientConstant.rgb;
+        light.diffuse = diffuseLinear.rgb;
+        light.specular = specularQuadratic.rgb;
+        light.constant = ambientConstant.w;
+        light.linear = diffuseLinear.w;
+        light.quadratic = specularQuadratic.w;
+        // past its range the light is cut off, as the clusters were built for
+        float distance = length(light.position - fragPos);
+        vec3 brightest = max(light.ambient, max(light.diffuse, light.specular));
+        float attenuation = light.constant + light.linear * distance + light.quadratic * (distance * distance);
+        if(max(brightest.r, max(brightest.g, brightest.b)) < LIGHT_CUTOFF * attenuation)
+            continue;
+        result += CalcPointLight(light, normal, fragPos, viewDir);
+    }
+    return result;
+}
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
@@ -72,10 +200,11 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 halfwayDir = normalize(lightDir+ viewDir);
     float spec = pow(max(dot(normal1, halfwayDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 ambient = (probesEnabled ? ProbeIrradiance(FragPos, normal) : light.ambient)
+                   * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
+    return ambient + (diffuse + specular) * CalcShadow(normal, lightDir);
 }
 
 
@@ -83,12 +212,25 @@ void main()
 {
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcDirLight(dirLight, normal, viewDir);
-    for(int i = 0; i < NR_POINT_LIGHTS; i++){
-        result += CalcPointLight(pointLights[i], normal, FragPos, viewDir); 
+    vec3 result;
+    if (lightmapRect.x > 0.0)
+        result = texture(lightmap, LightmapCoords).rgb * vec3(texture(material.texture_diffuse1, TexCoords));
+    else {
+        result = CalcDirLight(dirLight, normal, viewDir);
+        result += CalcClusteredLights(normal, FragPos, viewDir);
     }
 
+    if (oitPass) {
+        // McGuire and Bavoil 2013, eq. 7: nearer surfaces weigh more, no sorting needed
+        float alpha = opacity * texture(material.texture_diffuse1, TexCoords).a;
+        float z = ViewDepth();
+        float weight = clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+        FragColor = vec4(result * alpha * weight, alpha);
+        BrightColor = vec4(alpha * weight, 0.0, 0.0, alpha);
+        return;
+    }
     FragColor =vec4(result, 1.0);
+    BrightColor = vec4(0.0);
 
 }
 
@@ -2,14 +2,20 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in vec2 aLightmapCoords;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+out vec2 LightmapCoords;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec4 lightmapRect; // the renderable's rect of the lightmap atlas, xy scale and zw offset
+
+// matches depth.vs exactly, for the GL_EQUAL test after the depth pre-pass
+invariant gl_Position;
 
 void main()
 {
@@ -17,5 +23,6 @@ void main()
     //Normal = transpose(inverse(mat3(model)))*aNormal;
     Normal=aNormal;
     TexCoords = aTexCoords;    
+    LightmapCoords = aLightmapCoords * lightmapRect.xy + lightmapRect.zw;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
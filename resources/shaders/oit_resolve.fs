@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D accumulation; // weighted premultiplied colour, revealage in alpha
+uniform sampler2D weights;
+
+// weighted blended transparency resolve over the lit scene: the weighted average colour of the
+// transparent surfaces, covering 1 - revealage of what is behind them (blended with src alpha). The
+// bright target is blended the same way, so bloom behind the surfaces dims with the revealage and
+// their own colour blooms past the threshold of the lit passes.
+void main(){
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accumulated = texelFetch(accumulation, texel, 0);
+    float revealage = accumulated.a;
+    if (revealage >= 1.0)
+        discard;
+    float weight = texelFetch(weights, texel, 0).r;
+    vec3 color = accumulated.rgb / max(weight, 1e-5);
+    FragColor = vec4(color, 1.0 - revealage);
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    BrightColor = vec4(brightness > 1.0 ? color : vec3(0.0), 1.0 - revealage);
+}
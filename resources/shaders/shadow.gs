@@ -0,0 +1,41 @@
+#version 330 core
+#define SHADOW_MAX_CASCADES 4
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 12) out; // 3 per cascade
+
+in vec2 vTexCoords[];
+
+out vec2 TexCoords;
+
+uniform mat4 lightMatrices[SHADOW_MAX_CASCADES];
+uniform int cascadeMask; // cascades the caster touches and that are drawn now
+
+// Every caster goes into all its cascades in one draw: the triangle is emitted once per layer.
+void main()
+{
+    for(int cascade = 0; cascade < SHADOW_MAX_CASCADES; cascade++){
+        if((cascadeMask & (1 << cascade)) == 0)
+            continue;
+        vec4 p0 = lightMatrices[cascade] * gl_in[0].gl_Position;
+        vec4 p1 = lightMatrices[cascade] * gl_in[1].gl_Position;
+        vec4 p2 = lightMatrices[cascade] * gl_in[2].gl_Position;
+        // orthographic, w is 1: skip triangles off one side of the cascade, depth is clamped instead
+        vec2 low = min(p0.xy, min(p1.xy, p2.xy));
+        vec2 high = max(p0.xy, max(p1.xy, p2.xy));
+        if(any(lessThan(high, vec2(-1.0))) || any(greaterThan(low, vec2(1.0))))
+            continue;
+        gl_Layer = cascade;
+        gl_Position = p0;
+        TexCoords = vTexCoords[0];
+        EmitVertex();
+        gl_Layer = cascade;
+        gl_Position = p1;
+        TexCoords = vTexCoords[1];
+        EmitVertex();
+        gl_Layer = cascade;
+        gl_Position = p2;
+        TexCoords = vTexCoords[2];
+        EmitVertex();
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords; // only bound for alpha-tested casters
+
+out vec2 vTexCoords;
+
+uniform mat4 model;
+
+// world space, shadow.gs projects into each cascade
+void main()
+{
+    vTexCoords = aTexCoords;
+    gl_Position = model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,571 @@
+// Out-of-line parts of rg/Lightmap.h: UV generation, the baker and the asset cache. Compiled once
+// into rg_engine rather than in every file that includes the scene renderer.
+#include <rg/Lightmap.h>
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <unordered_map>
+
+namespace rg {
+
+// UV generation
+// ------------------------------------------------------------------------
+namespace detail {
+
+std::uint32_t findRoot(std::vector<std::uint32_t>& parent, std::uint32_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const {
+        std::uint32_t bits[3];
+        std::memcpy(bits, &p.x, sizeof(float));
+        std::memcpy(bits + 1, &p.y, sizeof(float));
+        std::memcpy(bits + 2, &p.z, sizeof(float));
+        return (size_t) (bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual {
+    bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+};
+
+// Shelf-packs w x h rects, tallest first, with padding between them into a size x size square.
+// Writes the corners to x and y; returns false when they don't all fit.
+bool packShelves(const std::vector<int>& w, const std::vector<int>& h, int size, int padding,
+                 std::vector<int>& x, std::vector<int>& y) {
+    std::vector<std::uint32_t> order(w.size());
+    for (std::uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&h](std::uint32_t a, std::uint32_t b) { return h[a] > h[b]; });
+    x.assign(w.size(), 0);
+    y.assign(w.size(), 0);
+    int cursorX = 0, shelfY = 0, shelfHeight = 0;
+    for (std::uint32_t i : order) {
+        if (w[i] > size)
+            return false;
+        if (cursorX + w[i] > size) {
+            shelfY += shelfHeight + padding;
+            cursorX = 0;
+            shelfHeight = 0;
+        }
+        if (shelfY + h[i] > size)
+            return false;
+        x[i] = cursorX;
+        y[i] = shelfY;
+        cursorX += w[i] + padding;
+        shelfHeight = std::max(shelfHeight, h[i]);
+    }
+    return true;
+}
+
+}
+
+int GenerateLightmapUvs(const std::vector<glm::vec3>& positions, const std::vector<std::uint32_t>& indices,
+                        std::vector<std::uint32_t>& remap, std::vector<std::uint32_t>& outIndices,
+                        std::vector<glm::vec2>& uvs) {
+    size_t nrTriangles = indices.size() / 3;
+    remap.clear();
+    outIndices.clear();
+    uvs.clear();
+    if (nrTriangles == 0)
+        return LIGHTMAP_CHART_RESOLUTION;
+
+    // vertices at the same position are one, whatever their normals and texture coordinates
+    std::unordered_map<glm::vec3, std::uint32_t, detail::PositionHash, detail::PositionEqual> welded;
+    std::vector<std::uint32_t> weld(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+        weld[i] = welded.emplace(positions[i], (std::uint32_t) welded.size()).first->second;
+
+    std::vector<std::uint8_t> axis(nrTriangles);
+    for (size_t t = 0; t < nrTriangles; ++t) {
+        glm::vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+        glm::vec3 n = glm::cross(b - a, c - a);
+        int k = std::fabs(n.x) >= std::fabs(n.y) ? (std::fabs(n.x) >= std::fabs(n.z) ? 0 : 2)
+                                                   : (std::fabs(n.y) >= std::fabs(n.z) ? 1 : 2);
+        axis[t] = (std::uint8_t) (2 * k + (n[k] < 0.0f));
+    }
+
+    // charts: triangles sharing a welded vertex and an axis direction
+    std::vector<std::uint32_t> parent(nrTriangles);
+    for (std::uint32_t t = 0; t < nrTriangles; ++t)
+        parent[t] = t;
+    std::vector<std::int32_t> firstAtCorner(welded.size() * 6, -1);
+    for (std::uint32_t t = 0; t < nrTriangles; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            std::int32_t& first = firstAtCorner[weld[indices[t * 3 + k]] * 6 + axis[t]];
+            if (first < 0)
+                first = (std::int32_t) t;
+            else
+                parent[detail::findRoot(parent, t)] = detail::findRoot(parent, (std::uint32_t) first);
+        }
+    }
+    std::vector<std::uint32_t> chartOf(nrTriangles);
+    std::vector<std::int32_t> chartOfRoot(nrTriangles, -1);
+    std::vector<std::uint8_t> chartAxis;
+    for (std::uint32_t t = 0; t < nrTriangles; ++t) {
+        std::uint32_t root = detail::findRoot(parent, t);
+        if (chartOfRoot[root] < 0) {
+            chartOfRoot[root] = (std::int32_t) chartAxis.size();
+            chartAxis.push_back(axis[t]);
+        }
+        chartOf[t] = (std::uint32_t) chartOfRoot[root];
+    }
+    size_t nrCharts = chartAxis.size();
+
+    // projections and their bounds
+    auto project = [](const glm::vec3& p, std::uint8_t direction) {
+        int k = direction / 2;
+        return k == 0 ? glm::vec2(p.z, p.y) : (k == 1 ? glm::vec2(p.x, p.z) : glm::vec2(p.x, p.y));
+    };
+    std::vector<glm::vec2> low(nrCharts, glm::vec2(1e30f)), high(nrCharts, glm::vec2(-1e30f));
+    for (size_t t = 0; t < nrTriangles; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            glm::vec2 p = project(positions[indices[t * 3 + k]], axis[t]);
+            low[chartOf[t]] = glm::min(low[chartOf[t]], p);
+            high[chartOf[t]] = glm::max(high[chartOf[t]], p);
+        }
+    }
+    double area = 0.0;
+    float largest = 0.0f;
+    for (size_t c = 0; c < nrCharts; ++c) {
+        glm::vec2 extent = high[c] - low[c];
+        area += (double) extent.x * extent.y;
+        largest = std::max(largest, std::max(extent.x, extent.y));
+    }
+
+    // every chart costs at least a texel plus its gutter
+    int resolution = LIGHTMAP_CHART_RESOLUTION;
+    while (resolution < 1024 && nrCharts * (1 + LIGHTMAP_PADDING) * (1 + LIGHTMAP_PADDING) * 2
+                                > (size_t) resolution * resolution)
+        resolution *= 2;
+    // world size of a texel: from a perfect fit upwards until the charts pack
+    float texel = std::max((float) std::sqrt(area) / resolution, largest / (resolution - 1));
+    texel = std::max(texel, 1e-6f);
+    std::vector<int> w(nrCharts), h(nrCharts), x, y;
+    for (int attempt = 0;; ++attempt) {
+        for (size_t c = 0; c < nrCharts; ++c) {
+            glm::vec2 extent = high[c] - low[c];
+            w[c] = (int) std::ceil(extent.x / texel) + 1;
+            h[c] = (int) std::ceil(extent.y / texel) + 1;
+        }
+        if (detail::packShelves(w, h, resolution, LIGHTMAP_PADDING, x, y) || attempt == 200)
+            break;
+        texel *= 1.05f;
+    }
+
+    // a vertex per input vertex and chart
+    std::unordered_map<std::uint64_t, std::uint32_t> vertexOf;
+    outIndices.resize(nrTriangles * 3);
+    for (size_t t = 0; t < nrTriangles; ++t) {
+        std::uint32_t chart = chartOf[t];
+        for (int k = 0; k < 3; ++k) {
+            std::uint32_t source = indices[t * 3 + k];
+            std::uint64_t key = (std::uint64_t) source << 32 | chart;
+            auto found = vertexOf.find(key);
+            if (found == vertexOf.end()) {
+                found = vertexOf.emplace(key, (std::uint32_t) remap.size()).first;
+                remap.push_back(source);
+                glm::vec2 local = (project(positions[source], chartAxis[chart]) - low[chart]) / texel;
+                uvs.push_back((glm::vec2((float) x[chart], (float) y[chart]) + 0.5f + local) / (float) resolution);
+            }
+            outIndices[t * 3 + k] = found->second;
+        }
+    }
+    return resolution;
+}
+
+// The baker
+// ------------------------------------------------------------------------
+LightmapBakeStats LightmapBaker::Bake(const Scene& scene, const std::vector<LightmapMesh>& meshes,
+                                      const std::vector<MeshBvh>& meshBvhs, const LightmapSettings& settings,
+                                      JobSystem& jobs, LightmapAtlas& out) {
+    LightmapBakeStats stats;
+    out = LightmapAtlas();
+    const RenderableTable& t = scene.Renderables;
+    m_Lighting.Build(scene, meshBvhs);
+    m_Scene = &scene;
+    m_Settings = settings;
+
+    // instances and their sizes from their world-space area
+    std::vector<std::uint32_t> rows;
+    std::vector<float> areas;
+    std::vector<int> minimum; // at half the chart resolution the gutters are still a texel wide
+    for (std::uint32_t row = 0; row < t.Size(); ++row) {
+        if ((t.Flags[row] & RenderFlagDynamic) || t.Mesh[row] >= meshes.size() || meshes[t.Mesh[row]].Empty())
+            continue;
+        const LightmapMesh& mesh = meshes[t.Mesh[row]];
+        float area = 0.0f;
+        minimum.push_back(std::max(LIGHTMAP_MIN_SIZE, mesh.Resolution / 2));
+        for (size_t i = 0; i < mesh.Indices.size(); i += 3) {
+            glm::vec3 a(t.World[row] * glm::vec4(mesh.Positions[mesh.Indices[i]], 1.0f));
+            glm::vec3 b(t.World[row] * glm::vec4(mesh.Positions[mesh.Indices[i + 1]], 1.0f));
+            glm::vec3 c(t.World[row] * glm::vec4(mesh.Positions[mesh.Indices[i + 2]], 1.0f));
+            area += 0.5f * glm::length(glm::cross(b - a, c - a));
+        }
+        rows.push_back(row);
+        areas.push_back(area);
+    }
+    if (rows.empty())
+        return stats;
+
+    // the smallest atlas that holds everything, then lower densities, then whatever fits
+    std::vector<int> sizes(rows.size()), x, y;
+    int atlasSize = 0;
+    float density = settings.TexelsPerUnit;
+    std::vector<bool> placed(rows.size(), true);
+    for (int attempt = 0; !atlasSize; ++attempt) {
+        for (size_t i = 0; i < rows.size(); ++i)
+            sizes[i] = std::min(std::max((int) std::ceil(std::sqrt(areas[i]) * density), minimum[i]),
+                                std::max(settings.MaxSize, minimum[i]));
+        for (int size = 256; size <= settings.AtlasSize; size *= 2) {
+            if (detail::packShelves(sizes, sizes, size - LIGHTMAP_PADDING, LIGHTMAP_PADDING, x, y)) {
+                atlasSize = size;
+                break;
+            }
+        }
+        bool smallest = true;
+        for (size_t i = 0; i < sizes.size(); ++i)
+            smallest &= sizes[i] == minimum[i];
+        if (!atlasSize && smallest) {
+            atlasSize = placeWhatFits(sizes, settings.AtlasSize, x, y, placed);
+            stats.Dropped = (int) std::count(placed.begin(), placed.end(), false);
+        }
+        density *= 0.8f;
+    }
+
+    out.Size = atlasSize;
+    m_Size = atlasSize;
+    m_Position.assign((size_t) atlasSize * atlasSize, glm::vec3(0.0f));
+    m_Normal.assign((size_t) atlasSize * atlasSize, glm::vec3(0.0f));
+    m_Instance.assign((size_t) atlasSize * atlasSize, -1);
+    m_Rows.clear();
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (!placed[i])
+            continue;
+        // a texel of border on every side is left to the padding and the dilation
+        float scale = (float) sizes[i] / atlasSize;
+        glm::vec2 offset = glm::vec2((float) x[i] + LIGHTMAP_PADDING, (float) y[i] + LIGHTMAP_PADDING) / (float) atlasSize;
+        out.Entities.push_back(t.Owner[rows[i]]);
+        out.Rects.push_back(glm::vec4(scale, scale, offset.x, offset.y));
+        m_Rows.push_back(rows[i]);
+    }
+    stats.Instances = (int) m_Rows.size();
+
+    // surface position and normal under every texel centre, an instance per job
+    jobs.Wait(jobs.ParallelFor(0, m_Rows.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            rasterize(meshes[t.Mesh[m_Rows[i]]], t.World[m_Rows[i]], out.Rects[i], (std::int32_t) i);
+    }));
+    std::vector<std::uint32_t> texels;
+    for (std::uint32_t i = 0; i < m_Instance.size(); ++i) {
+        if (m_Instance[i] >= 0)
+            texels.push_back(i);
+    }
+    stats.Texels = texels.size();
+
+    std::vector<glm::vec3> irradiance((size_t) atlasSize * atlasSize, glm::vec3(0.0f));
+    std::vector<std::uint64_t> rays(texels.size());
+    jobs.Wait(jobs.ParallelFor(0, texels.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::uint32_t texel = texels[i];
+            std::uint64_t count = 0;
+            irradiance[texel] = shadeTexel(texel, count);
+            rays[i] = count;
+        }
+    }));
+    for (std::uint64_t count : rays)
+        stats.Rays += count;
+
+    dilate(irradiance);
+    out.Texels.resize(irradiance.size());
+    for (size_t i = 0; i < irradiance.size(); ++i)
+        out.Texels[i] = PackRgb9e5(irradiance[i]);
+    m_Position.clear();
+    m_Normal.clear();
+    m_Instance.clear();
+    return stats;
+}
+
+glm::vec3 LightmapBaker::shadeTexel(std::uint32_t texel, std::uint64_t& rays) const {
+    const glm::vec3& position = m_Position[texel];
+    const glm::vec3& normal = m_Normal[texel];
+    std::uint16_t material = m_Scene->Renderables.Material[m_Rows[m_Instance[texel]]];
+    glm::vec3 result = m_Lighting.Direct(material, position, normal, true, rays);
+    if (m_Settings.Bounces <= 0 || m_Settings.Samples <= 0)
+        return result;
+    std::uint32_t state = hash(texel);
+    glm::vec3 bounced(0.0f);
+    for (int sample = 0; sample < m_Settings.Samples; ++sample) {
+        glm::vec3 origin = position, surface = normal;
+        float throughput = 1.0f;
+        for (int bounce = 0; bounce < m_Settings.Bounces; ++bounce) {
+            glm::vec3 direction = cosineSample(surface, state);
+            SceneHit hit;
+            if (!m_Lighting.Trace(Ray(origin + surface * LIGHTMAP_RAY_OFFSET, direction, 1e4f), hit, rays))
+                break;
+            throughput *= m_Settings.Albedo;
+            bounced += throughput * m_Lighting.Direct(m_Lighting.MaterialOf(hit.Hit), hit.Position, hit.Normal, false,
+                                                      rays);
+            origin = hit.Position;
+            surface = hit.Normal;
+        }
+    }
+    return result + bounced / (float) m_Settings.Samples;
+}
+
+void LightmapBaker::rasterize(const LightmapMesh& mesh, const glm::mat4& world, const glm::vec4& rect,
+                              std::int32_t instance) {
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+    for (size_t i = 0; i < mesh.Indices.size(); i += 3) {
+        std::uint32_t corner[3] = {mesh.Indices[i], mesh.Indices[i + 1], mesh.Indices[i + 2]};
+        glm::vec2 p[3];
+        for (int k = 0; k < 3; ++k)
+            p[k] = (mesh.Uvs[corner[k]] * glm::vec2(rect.x, rect.y) + glm::vec2(rect.z, rect.w)) * (float) m_Size;
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (std::fabs(area) < 1e-12f)
+            continue;
+        glm::vec3 a = mesh.Positions[corner[0]], b = mesh.Positions[corner[1]], c = mesh.Positions[corner[2]];
+        glm::vec3 face = glm::normalize(normalMatrix * glm::cross(b - a, c - a));
+        int x0 = std::max((int) std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x))), 0);
+        int y0 = std::max((int) std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y))), 0);
+        int x1 = std::min((int) std::ceil(std::max(p[0].x, std::max(p[1].x, p[2].x))), m_Size - 1);
+        int y1 = std::min((int) std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y))), m_Size - 1);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                glm::vec2 centre((float) x + 0.5f, (float) y + 0.5f);
+                float w0 = ((p[1].x - centre.x) * (p[2].y - centre.y) - (p[2].x - centre.x) * (p[1].y - centre.y)) / area;
+                float w1 = ((p[2].x - centre.x) * (p[0].y - centre.y) - (p[0].x - centre.x) * (p[2].y - centre.y)) / area;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f)
+                    continue;
+                size_t texel = (size_t) y * m_Size + x;
+                glm::vec3 local = a * w0 + b * w1 + c * w2;
+                m_Position[texel] = glm::vec3(world * glm::vec4(local, 1.0f));
+                glm::vec3 n = mesh.Normals.empty() ? glm::vec3(0.0f)
+                                                   : mesh.Normals[corner[0]] * w0 + mesh.Normals[corner[1]] * w1
+                                                     + mesh.Normals[corner[2]] * w2;
+                n = normalMatrix * n;
+                m_Normal[texel] = glm::dot(n, n) > 1e-12f ? glm::normalize(n) : face;
+                m_Instance[texel] = instance;
+            }
+        }
+    }
+}
+
+void LightmapBaker::dilate(std::vector<glm::vec3>& irradiance) {
+    std::vector<std::int32_t> next;
+    for (int pass = 0; pass < LIGHTMAP_PADDING; ++pass) {
+        next = m_Instance;
+        std::vector<glm::vec3> source = irradiance;
+        for (int y = 0; y < m_Size; ++y) {
+            for (int x = 0; x < m_Size; ++x) {
+                size_t texel = (size_t) y * m_Size + x;
+                if (m_Instance[texel] >= 0)
+                    continue;
+                glm::vec3 sum(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= m_Size || ny >= m_Size)
+                            continue;
+                        size_t neighbour = (size_t) ny * m_Size + nx;
+                        if (m_Instance[neighbour] >= 0) {
+                            sum += source[neighbour];
+                            ++count;
+                        }
+                    }
+                }
+                if (count) {
+                    irradiance[texel] = sum / (float) count;
+                    next[texel] = 0; // covered from the next pass on
+                }
+            }
+        }
+        m_Instance.swap(next);
+    }
+}
+
+int LightmapBaker::placeWhatFits(const std::vector<int>& sizes, int atlasSize, std::vector<int>& x,
+                                 std::vector<int>& y, std::vector<bool>& placed) {
+    std::vector<int> kept;
+    std::vector<std::uint32_t> index;
+    int capacity = atlasSize - LIGHTMAP_PADDING;
+    size_t budget = (size_t) capacity * capacity;
+    size_t used = 0;
+    for (std::uint32_t i = 0; i < sizes.size(); ++i) {
+        size_t cost = (size_t) (sizes[i] + LIGHTMAP_PADDING) * (sizes[i] + LIGHTMAP_PADDING);
+        placed[i] = used + cost <= budget;
+        if (placed[i])
+            used += cost;
+    }
+    // shelves waste a little, drop from the back until they pack
+    for (;;) {
+        kept.clear();
+        index.clear();
+        for (std::uint32_t i = 0; i < sizes.size(); ++i) {
+            if (placed[i]) {
+                kept.push_back(sizes[i]);
+                index.push_back(i);
+            }
+        }
+        std::vector<int> keptX, keptY;
+        if (detail::packShelves(kept, kept, capacity, LIGHTMAP_PADDING, keptX, keptY) || index.empty()) {
+            x.assign(sizes.size(), 0);
+            y.assign(sizes.size(), 0);
+            for (size_t k = 0; k < index.size(); ++k) {
+                x[index[k]] = keptX[k];
+                y[index[k]] = keptY[k];
+            }
+            return atlasSize;
+        }
+        placed[index.back()] = false;
+    }
+}
+
+// Asset cache
+// ------------------------------------------------------------------------
+namespace detail {
+
+void hashBytes(std::uint64_t& h, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+}
+
+template<typename T>
+void hashValue(std::uint64_t& h, const T& value) {
+    hashBytes(h, &value, sizeof(T));
+}
+
+template<typename T>
+void hashVector(std::uint64_t& h, const std::vector<T>& values) {
+    hashValue(h, values.size());
+    if (!values.empty())
+        hashBytes(h, values.data(), values.size() * sizeof(T));
+}
+
+void hashColumn(std::uint64_t& h, const Vec3Column& column) {
+    hashVector(h, column.X);
+    hashVector(h, column.Y);
+    hashVector(h, column.Z);
+}
+
+}
+
+std::uint64_t LightmapCacheKey(const Scene& scene, const std::vector<LightmapMesh>& meshes,
+                               const LightmapSettings& settings) {
+    std::uint64_t h = 14695981039346656037ull;
+    detail::hashValue(h, LIGHTMAP_CACHE_VERSION);
+    detail::hashValue(h, settings.TexelsPerUnit);
+    detail::hashValue(h, settings.MaxSize);
+    detail::hashValue(h, settings.AtlasSize);
+    detail::hashValue(h, settings.Samples);
+    detail::hashValue(h, settings.Bounces);
+    detail::hashValue(h, settings.Albedo);
+    std::vector<std::uint64_t> meshHashes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        std::uint64_t mh = 14695981039346656037ull;
+        detail::hashVector(mh, meshes[i].Positions);
+        detail::hashVector(mh, meshes[i].Normals);
+        detail::hashVector(mh, meshes[i].Uvs);
+        detail::hashVector(mh, meshes[i].Indices);
+        detail::hashValue(mh, meshes[i].Resolution);
+        meshHashes[i] = mh;
+    }
+    const RenderableTable& t = scene.Renderables;
+    for (size_t row = 0; row < t.Size(); ++row) {
+        if (t.Flags[row] & RenderFlagDynamic)
+            continue;
+        detail::hashValue(h, t.Owner[row]);
+        detail::hashValue(h, t.World[row]);
+        detail::hashValue(h, t.Material[row]);
+        detail::hashValue(h, (std::uint8_t) (t.Flags[row] & ~RenderFlagVisible));
+        detail::hashValue(h, t.Mesh[row] < meshHashes.size() ? meshHashes[t.Mesh[row]] : 0ull);
+    }
+    const LightTable& l = scene.Lights;
+    detail::hashVector(h, l.Type);
+    detail::hashVector(h, l.Material);
+    detail::hashColumn(h, l.Position);
+    detail::hashColumn(h, l.Direction);
+    detail::hashColumn(h, l.Ambient);
+    detail::hashColumn(h, l.Diffuse);
+    detail::hashColumn(h, l.Specular);
+    detail::hashVector(h, l.Constant);
+    detail::hashVector(h, l.Linear);
+    detail::hashVector(h, l.Quadratic);
+    return h;
+}
+
+bool SaveLightmapCache(const std::string& directory, std::uint64_t key, const LightmapAtlas& atlas) {
+    // the cache directory and its parent, an existing one is fine
+    size_t slash = directory.find_last_of('/');
+    if (slash != std::string::npos)
+        mkdir(directory.substr(0, slash).c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+    std::string path = LightmapCachePath(directory, key);
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "ERROR::LIGHTMAP::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+    std::uint32_t header[3] = {LIGHTMAP_CACHE_VERSION, (std::uint32_t) atlas.Size, (std::uint32_t) atlas.Entities.size()};
+    bool ok = std::fwrite(LIGHTMAP_CACHE_MAGIC, sizeof(LIGHTMAP_CACHE_MAGIC), 1, file) == 1
+              && std::fwrite(header, sizeof(header), 1, file) == 1 && std::fwrite(&key, sizeof(key), 1, file) == 1;
+    for (size_t i = 0; ok && i < atlas.Entities.size(); ++i) {
+        ok = std::fwrite(&atlas.Entities[i], sizeof(Entity), 1, file) == 1
+             && std::fwrite(&atlas.Rects[i][0], sizeof(float), 4, file) == 4;
+    }
+    ok = ok && (atlas.Texels.empty()
+                || std::fwrite(atlas.Texels.data(), sizeof(std::uint32_t), atlas.Texels.size(), file) == atlas.Texels.size());
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+        std::cout << "ERROR::LIGHTMAP::CANNOT_WRITE " << path << std::endl;
+    return ok;
+}
+
+bool LoadLightmapCache(const std::string& directory, std::uint64_t key, LightmapAtlas& atlas) {
+    std::string path = LightmapCachePath(directory, key);
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    char magic[4];
+    std::uint32_t header[3];
+    std::uint64_t stored = 0;
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1 && std::memcmp(magic, LIGHTMAP_CACHE_MAGIC, 4) == 0
+              && std::fread(header, sizeof(header), 1, file) == 1 && header[0] == LIGHTMAP_CACHE_VERSION
+              && header[1] <= 16384 && std::fread(&stored, sizeof(stored), 1, file) == 1 && stored == key;
+    LightmapAtlas loaded;
+    if (ok) {
+        loaded.Size = (int) header[1];
+        loaded.Entities.resize(header[2]);
+        loaded.Rects.resize(header[2]);
+        for (std::uint32_t i = 0; ok && i < header[2]; ++i) {
+            ok = std::fread(&loaded.Entities[i], sizeof(Entity), 1, file) == 1
+                 && std::fread(&loaded.Rects[i][0], sizeof(float), 4, file) == 4;
+        }
+        loaded.Texels.resize((size_t) loaded.Size * loaded.Size);
+        ok = ok && (loaded.Texels.empty()
+                    || std::fread(loaded.Texels.data(), sizeof(std::uint32_t), loaded.Texels.size(), file)
+                       == loaded.Texels.size());
+    }
+    std::fclose(file);
+    if (!ok) {
+        std::cout << "ERROR::LIGHTMAP::BAD_CACHE_FILE " << path << std::endl;
+        return false;
+    }
+    atlas = std::move(loaded);
+    return true;
+}
+
+}
@@ -0,0 +1,145 @@
+// Out-of-line parts of learnopengl/model.h: texture decode and upload and the Assimp mesh conversion.
+// Compiled once into rg_engine, which the app and the bench executable link.
+#include <learnopengl/model.h>
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    TextureImage image = LoadTextureImage(path, directory);
+    return TextureFromImage(image);
+}
+
+// reads and decodes the file only, safe to call from any thread
+TextureImage LoadTextureImage(const char *path, const string &directory)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
+
+    TextureImage image;
+    image.path = path;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    return image;
+}
+
+// creates the GL texture and frees the decoded pixels
+unsigned int TextureFromImage(TextureImage &image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    rg::metrics::Render().GlObjects.Add();
+
+    if (image.data)
+    {
+        GLenum format;
+        if (image.nrComponents == 1)
+            format = GL_RED;
+        else if (image.nrComponents == 3)
+            format = GL_RGB;
+        else if (image.nrComponents == 4)
+            format = GL_RGBA;
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        rg::metrics::Render().BytesUploaded.Add((std::uint64_t) image.width * image.height * image.nrComponents);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(image.data);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        stbi_image_free(image.data);
+    }
+    image.data = nullptr;
+
+    return textureID;
+}
+
+// copies level 0 of a 2D texture into a new texture with its own mipmaps, on the GL thread
+unsigned int CopyTexture(unsigned int source)
+{
+    GLint width = 0, height = 0;
+    glBindTexture(GL_TEXTURE_2D, source);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    std::vector<unsigned char> pixels((size_t) width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (!pixels.empty())
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    rg::metrics::Render().GlObjects.Add();
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.empty() ? NULL : pixels.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    rg::metrics::Render().BytesUploaded.Add(pixels.size());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+// appends the vertices and triangle indices of an imported mesh, no GL involved
+void ReadMeshGeometry(const aiMesh *mesh, vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    // walk through each of the mesh's vertices
+    vertices.reserve(vertices.size() + mesh->mNumVertices);
+    for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex vertex;
+        glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+        // positions
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        // normals
+        if (mesh->HasNormals())
+        {
+            vector.x = mesh->mNormals[i].x;
+            vector.y = mesh->mNormals[i].y;
+            vector.z = mesh->mNormals[i].z;
+            vertex.Normal = vector;
+        }
+        // texture coordinates
+        if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        {
+            glm::vec2 vec;
+            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
+            // tangent
+            vector.x = mesh->mTangents[i].x;
+            vector.y = mesh->mTangents[i].y;
+            vector.z = mesh->mTangents[i].z;
+            vertex.Tangent = vector;
+            // bitangent
+            vector.x = mesh->mBitangents[i].x;
+            vector.y = mesh->mBitangents[i].y;
+            vector.z = mesh->mBitangents[i].z;
+            vertex.Bitangent = vector;
+        }
+        else
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        // filled in by the lightmap unwrap once the whole model is read
+        vertex.LightmapTexCoords = glm::vec2(0.0f, 0.0f);
+
+        vertices.push_back(vertex);
+    }
+    // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+    for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        aiFace face = mesh->mFaces[i];
+        // retrieve all indices of the face and store them in the indices vector
+        for(unsigned int j = 0; j < face.mNumIndices; j++)
+            indices.push_back(face.mIndices[j]);
+    }
+}
@@ -10,19 +10,92 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <rg/Benchmark.h>
+#include <rg/Bloom.h>
+#include <rg/CameraRecording.h>
+#include <rg/CpuProfiler.h>
+#include <rg/DynamicResolution.h>
+#include <rg/FramePacket.h>
+#include <rg/GlCapture.h>
+#include <rg/GpuProfiler.h>
+#include <rg/Scene.h>
+#include <rg/JobSystem.h>
+#include <rg/IrradianceProbes.h>
+#include <rg/Lightmap.h>
+#include <rg/Metrics.h>
+#include <rg/OffscreenContext.h>
+#include <rg/RenderGraph.h>
+#include <rg/SceneJobs.h>
+#include <rg/SceneQueries.h>
+#include <rg/SceneRenderer.h>
+#include <rg/StressScene.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
 #include <iostream>
+#include <new>
+#include <thread>
 
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+std::uint16_t recordedInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 unsigned int loadCubemap(vector<std::string> faces);
 unsigned int loadTexture(char const * path);
 void renderCube();
 void renderQuad();
 
+#ifdef RG_COUNT_ALLOCATIONS
+// operator new calls of the current thread; the benchmark holds the render thread's frames to none
+thread_local std::uint64_t threadAllocations = 0;
+
+// The replaceable allocation functions, counted. They are kept out of line: inlined, GCC pairs their
+// malloc and free with the new and delete expressions at the call site and warns
+// (-Wmismatched-new-delete).
+#if defined(_MSC_VER) && !defined(__clang__)
+#define RG_NOINLINE __declspec(noinline)
+#else
+#define RG_NOINLINE __attribute__((noinline))
+#endif
+
+RG_NOINLINE void *operator new(std::size_t size) {
+    ++threadAllocations;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+RG_NOINLINE void *operator new[](std::size_t size) {
+    ++threadAllocations;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+RG_NOINLINE void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+RG_NOINLINE void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+RG_NOINLINE void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+RG_NOINLINE void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -32,6 +105,7 @@ const unsigned int SCR_HEIGHT = 600;
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+const float CAMERA_RADIUS = 0.2f; // collision sphere around the camera
 
 // timing
 float deltaTime = 0.0f;
@@ -41,25 +115,42 @@ bool hdr = false;
 bool hdrKeyPressed = false;
 bool bloom = false;
 bool bloomKeyPressed = false;
+rg::BloomMethod bloomMethod = rg::BloomMethod::MipChain;
+rg::DynamicResolutionSettings dynamicResolution;
+unsigned int depthPrepass = 0; // rg::DepthPrepassClass bits, F7 cycles none / opaque / all
+rg::ShadowSettings shadowSettings; // F8 switches the cascaded shadows of the directional light
+bool useLightmaps = true; // F9 switches the baked lighting of the static renderables, when there is one
+bool useProbes = true; // F10 switches the irradiance probes' ambient for dirLight's flat one
+bool useOit = true; // F11 switches the weighted blended pass for transparent meshes, off they're drawn opaque
 float exposure = 1.0f;
 glm::vec3 lightColor = glm::vec3(150.0f,88.0f,34.0f);
 
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
-    PointLight pointLight;
+    bool CameraCollisionEnabled = true;
+    // picking: a click requests a ray at PickCursor, the result is kept for the ImGui window
+    bool PickRequested = false;
+    glm::vec2 PickCursor = glm::vec2(0.0f);
+    rg::Entity PickedEntity = rg::NullEntity;
+    std::string PickedName;
+    glm::vec3 PickedPosition = glm::vec3(0.0f);
+    float PickedDistance = 0.0f;
+    // job system utilization, sampled about twice a second for the ImGui window
+    std::vector<rg::WorkerStats> JobStats;
+    double JobStatsSeconds = 0.0;
+    size_t DrawCount = 0;
+    // GPU pass timings, read back by the render thread a few frames late
+    rg::GpuProfile GpuProfile;
+    std::vector<rg::metrics::MetricSample> Metrics;
+    // F5 records the camera to RecordingFile, F6 plays it back
+    std::string RecordingFile = "resources/camera_recording.rgcam";
+    rg::CameraRecorder Recorder;
+    rg::CameraPlayback Playback;
+    bool Playing = false;
+    double PlaybackStart = 0.0;
     ProgramState()
             : camera(glm::vec3(4.0f, 5.0f, 6.0f)) {}
     void SaveToFile(std::string filename);
@@ -76,7 +167,8 @@ void ProgramState::SaveToFile(std::string filename) {
         << camera.Position.z << '\n'
         << camera.Front.x << '\n'
         << camera.Front.y << '\n'
-        << camera.Front.z << '\n';
+        << camera.Front.z << '\n'
+        << RecordingFile << '\n';
 }
 void ProgramState::LoadFromFile(std::string filename) {
     std::ifstream in(filename);
@@ -91,156 +183,225 @@ void ProgramState::LoadFromFile(std::string filename) {
            >> camera.Front.x
            >> camera.Front.y
            >> camera.Front.z;
+        // added later, older files end before it
+        std::string recordingFile;
+        if (in >> recordingFile)
+            RecordingFile = recordingFile;
     }
 }
 ProgramState *programState;
 void DrawImGui(ProgramState *programState);
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-    // glfw window creation
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "PACK-MAN", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+// framebuffer size, kept up to date by the callback and handed to the render thread with every frame
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
+// the camera's projection at the framebuffer's aspect (the offscreen target's in benchmark mode), so a
+// resized window isn't stretched; a minimized one keeps the default aspect
+glm::mat4 cameraProjection() {
+    float aspect = (float) SCR_WIDTH / (float) SCR_HEIGHT;
+    if (framebufferWidth > 0 && framebufferHeight > 0)
+        aspect = (float) framebufferWidth / (float) framebufferHeight;
+    return glm::perspective(glm::radians(programState->camera.Zoom), aspect, 0.1f, 100.0f);
+}
+
+// What the render thread draws to: the window, or in benchmark mode an offscreen context. Offscreen
+// there is nothing to swap, Present waits for the GPU instead so frame times still include its work.
+struct RenderSurface {
+    GLFWwindow *Window = nullptr;
+    rg::OffscreenContext *Offscreen = nullptr;
+    bool Vsync = true;
+
+    bool MakeCurrent() {
+        if (Offscreen)
+            return Offscreen->MakeCurrent();
+        glfwMakeContextCurrent(Window);
+        if (!Vsync)
+            glfwSwapInterval(0);
+        return true;
+    }
+    void Release() {
+        if (Offscreen)
+            Offscreen->Release();
+        else
+            glfwMakeContextCurrent(NULL);
+    }
+    void Present() {
+        if (Offscreen)
+            glFinish();
+        else
+            glfwSwapBuffers(Window);
+    }
+    GLADloadproc Loader() const {
+        return Offscreen ? (GLADloadproc) rg::OffscreenContext::GetProcAddress : (GLADloadproc) glfwGetProcAddress;
     }
+};
 
-    programState = new ProgramState;
-    programState->LoadFromFile("resources/program_state.txt");
-    if (programState->ImGuiEnabled) {
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+// filled by the render thread before it reports the scene as loaded
+struct RenderStartup {
+    rg::StressSceneOptions Stress; // in: generated load to add after the scene description
+    std::string CaptureGl; // in: GL trace to record, empty for none
+    int CaptureFrames = 0;
+    bool Lightmaps = false; // in: load the scene's lightmaps from the asset cache
+    bool BakeLightmaps = false; // in: bake them into the cache first
+    rg::LightmapSettings Lightmap;
+    int LightmapInstances = 0;
+    bool Probes = false; // in: compute irradiance probes from the skybox and the static scene
+    rg::ProbeSettings Probe;
+    int ProbeCount = 0;
+    std::string Renderer;
+    std::vector<std::pair<std::string, double>> LoadMs; // stage, milliseconds
+    // out: most heap allocations of one measured frame on the render thread, read after it has joined;
+    // only counted with RG_COUNT_ALLOCATIONS
+    std::uint64_t RenderAllocations = 0;
+};
+
+// Render thread: owns the GL context. Sets up the GL state and loads the scene (the loader's upload
+// jobs run here), reports through loaded, then draws the frame packets the main thread submits until
+// the pipeline is closed.
+void renderThread(RenderSurface &surface, rg::JobSystem &jobs, rg::Scene &scene, rg::SceneRenderer &sceneRenderer,
+                  rg::FramePipeline<rg::FramePacket> &pipeline, rg::GpuProfiler &gpuProfiler,
+                  RenderStartup &startup, std::promise<bool> &loaded) {
+    RG_PROFILE_THREAD("render");
+    auto startupBegin = std::chrono::steady_clock::now();
+    auto stage = startupBegin;
+    auto endStage = [&startup, &stage](const char *name) {
+        auto now = std::chrono::steady_clock::now();
+        startup.LoadMs.emplace_back(name, std::chrono::duration<double, std::milli>(now - stage).count());
+        stage = now;
+    };
+    if (!surface.MakeCurrent()) {
+        std::cout << "Failed to make the GL context current" << std::endl;
+        loaded.set_value(false);
+        return;
     }
-    // Init Imgui
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO &io = ImGui::GetIO();
-    (void) io;
+    jobs.SetMainThread();
 
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    // glad: load all OpenGL function pointers
+    if (!gladLoadGLLoader(surface.Loader())) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        surface.Release();
+        loaded.set_value(false);
+        return;
+    }
+    rg::GlCapture capture;
+    if (!startup.CaptureGl.empty())
+        capture.Start(startup.CaptureGl, startup.CaptureFrames, framebufferWidth, framebufferHeight);
+    startup.Renderer = (const char *) glGetString(GL_RENDERER);
+    endStage("context");
     ImGui_ImplOpenGL3_Init("#version 330 core");
+    gpuProfiler.Init();
+    rg::FragmentCounter sceneFragments;
+    sceneFragments.Init();
+    rg::ClusteredLightBuffers clusteredLights;
+    clusteredLights.Init();
+    rg::ShadowMaps shadowMaps;
+    rg::LightmapTexture lightmaps;
+    rg::IrradianceProbeTexture probes;
+    // creates the font texture up front, the main thread builds ImGui frames without touching GL
+    ImGui_ImplOpenGL3_NewFrame();
 
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
 
  
     // // build and compile shaders
-    Shader shader("resources/shaders/object.vs", "resources/shaders/object.fs");
-    Shader shaderB("resources/shaders/object.vs", "resources/shaders/3.1.blending.fs");
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
    // Shader objShader("resources/shaders/ob.vs", "resources/shaders/ob.fs");
     Shader shaderLightBox("resources/shaders/light.vs", "resources/shaders/light.fs");
     Shader hdrShader("resources/shaders/hdr.vs", "resources/shaders/hdr.fs");
     Shader shaderBlur("resources/shaders/blur.vs", "resources/shaders/blur.fs");
-
-
-
-// model
-    Model kuca(FileSystem::getPath("resources/objects/kuca/cottage.obj"));
-    kuca.SetShaderTextureNamePrefix("material.");
-    Model packman(FileSystem::getPath("resources/objects/Pac-Man/Pac-Man.obj"));
-    packman.SetShaderTextureNamePrefix("material.");
-    Model piano(FileSystem::getPath("resources/objects/Piano/Piano.obj"));
-    piano.SetShaderTextureNamePrefix("material.");
-    Model woodel(FileSystem::getPath("resources/objects/wood/Wood.obj"));
-    woodel.SetShaderTextureNamePrefix("material.");
-    Model tree(FileSystem::getPath("resources/objects/78-tree/Tree/3d files/tree.obj"));
-    tree.SetShaderTextureNamePrefix("material.");
-    Model woodTable(FileSystem::getPath("resources/objects/Wood Table with glasplatte/Wood_Table.obj"));
-    woodTable.SetShaderTextureNamePrefix("material.");
-    Model bed(FileSystem::getPath("resources/objects/bed/bed.obj"));
-    bed.SetShaderTextureNamePrefix("material.");
-    Model plants(FileSystem::getPath("resources/objects/3dexport_hourglass_planter_obj_1676848285/Hourglass Planter.obj"));
-    plants.SetShaderTextureNamePrefix("material.");
-    Model pool(FileSystem::getPath("resources/objects/pool/avika-curved_pool_ver1/avika-curved_pool_ver1.obj"));
-    pool.SetShaderTextureNamePrefix("material.");
-
-
+    Shader bloomDownShader("resources/shaders/blur.vs", "resources/shaders/bloom_down.fs");
+    Shader bloomUpShader("resources/shaders/blur.vs", "resources/shaders/bloom_up.fs");
+    Shader oitResolveShader("resources/shaders/hdr.vs", "resources/shaders/oit_resolve.fs");
+    shadowMaps.Init();
+    endStage("shaders");
+
+
+    // scene: models, materials, instances and lights come from the scene description
+    if (!sceneRenderer.LoadSceneDescription(FileSystem::getPath("resources/scene.txt"), scene, &jobs)) {
+        gpuProfiler.Shutdown();
+        ImGui_ImplOpenGL3_Shutdown();
+        surface.Release();
+        loaded.set_value(false);
+        return;
+    }
+    endStage("scene");
+    if (startup.Stress.Active()) {
+        if (!rg::GenerateStressScene(startup.Stress, scene, sceneRenderer)) {
+            gpuProfiler.Shutdown();
+            ImGui_ImplOpenGL3_Shutdown();
+            surface.Release();
+            loaded.set_value(false);
+            return;
+        }
+        endStage("stress");
+    }
+    // baked lighting of the static renderables, keyed by the scene it was baked for
+    if (startup.Lightmaps || startup.BakeLightmaps) {
+        rg::UpdateTransforms(scene, jobs);
+        std::uint64_t key = rg::LightmapCacheKey(scene, sceneRenderer.LightmapMeshes, startup.Lightmap);
+        std::string directory = rg::LightmapCacheDirectory();
+        rg::LightmapAtlas atlas;
+        if (startup.BakeLightmaps) {
+            RG_PROFILE_SCOPE("bake lightmaps");
+            rg::LightmapBaker baker;
+            rg::LightmapBakeStats stats = baker.Bake(scene, sceneRenderer.LightmapMeshes, sceneRenderer.MeshBvhs,
+                                                     startup.Lightmap, jobs, atlas);
+            std::cout << "Lightmaps: baked " << stats.Instances << " renderables into " << atlas.Size << "x"
+                      << atlas.Size << ", " << stats.Texels << " texels, " << stats.Rays << " rays";
+            if (stats.Dropped)
+                std::cout << ", " << stats.Dropped << " didn't fit";
+            std::cout << std::endl;
+            rg::SaveLightmapCache(directory, key, atlas);
+        } else if (!rg::LoadLightmapCache(directory, key, atlas)) {
+            std::cout << "Lightmaps: none cached for this scene, run with --bake-lightmaps" << std::endl;
+        }
+        lightmaps.Upload(atlas);
+        startup.LightmapInstances = (int) atlas.Entities.size();
+        endStage("lightmaps");
+    }
 
    // glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK); //zadnje str
     
      
-     // configure  point framebuffer
-    // ------------------------------------
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-
-    unsigned int colorBuffers[2]; // FragColor i BrightColor
-    glGenTextures(2, colorBuffers);
-    for(unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        // Attach texture to framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-    }
-    // create depth buffer (renderbuffer)
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-    unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-    glDrawBuffers(2, attachments);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // ping-pong-framebuffer for blurring
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-
+    // the HDR, bright-pass and bloom targets belong to the frame graph, see declareFrameGraph below
+
+
+    // offscreen there is no default framebuffer, the tonemapped frame goes to one of ours
+    unsigned int outputFBO = 0;
+    unsigned int outputRenderbuffers[2] = {0, 0};
+    if (surface.Offscreen) {
+        glGenFramebuffers(1, &outputFBO);
+        glGenRenderbuffers(2, outputRenderbuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, outputRenderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, outputRenderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, outputRenderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, outputRenderbuffers[1]);
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        rg::metrics::Render().GlObjects.Add(3);
     }
 
     shaderBlur.use();
     shaderBlur.setInt("image", 0);
+    bloomDownShader.use();
+    bloomDownShader.setInt("image", 0);
+    bloomUpShader.use();
+    bloomUpShader.setInt("image", 0);
 
     hdrShader.use();
     hdrShader.setInt("hdrBuffer", 0);
     hdrShader.setInt("bloomBlur", 1);
+    oitResolveShader.use();
+    oitResolveShader.setInt("accumulation", 0);
+    oitResolveShader.setInt("weights", 1);
 
 
 
@@ -345,6 +506,8 @@ int main() {
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    rg::metrics::Render().GlObjects.Add(2);
+    rg::metrics::Render().BytesUploaded.Add(sizeof(skyboxVertices));
     
     //load textures for skybox
     vector<std::string> faces
@@ -361,265 +524,807 @@ int main() {
 
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
-   
+    endStage("skybox");
+
+    // the skybox decoded once more on the workers for the probes, which trace the static scene as the
+    // lightmap baker does
+    if (startup.Probes) {
+        RG_PROFILE_SCOPE("irradiance probes");
+        rg::Cubemap sky;
+        rg::LoadCubemap(faces, jobs, sky);
+        rg::StaticSceneLighting lighting;
+        lighting.Build(scene, sceneRenderer.MeshBvhs);
+        rg::IrradianceProbeGrid grid;
+        std::uint64_t rays = rg::ComputeIrradianceProbes(scene, lighting, sky, startup.Probe, jobs, grid);
+        probes.Upload(grid);
+        startup.ProbeCount = (int) grid.Probes.size();
+        std::cout << "Probes: " << grid.Size[0] << "x" << grid.Size[1] << "x" << grid.Size[2] << ", " << rays
+                  << " rays" << std::endl;
+        endStage("probes");
+    }
+    startup.LoadMs.emplace_back("total", std::chrono::duration<double, std::milli>(stage - startupBegin).count());
+
+    capture.MarkLoaded();
+    loaded.set_value(true);
+
+    // The frame as a render graph: scene -> transparent -> bloom blur -> hdr composite. Declared again when the
+    // internal size or a setting it depends on changes; the blur is culled when the composite doesn't
+    // use it, and its targets go back to the pool. The graph runs at the viewport size times the
+    // dynamic resolution scale, the composite upscales into the full-size viewport.
+    int viewportWidth = 0, viewportHeight = 0;
+    rg::RenderGraph frameGraph;
+    rg::DynamicResolution resolutionController;
+    rg::BloomChain bloomChain;
+    const rg::FramePacket *framePacket = nullptr; // the packet being drawn, for the passes
+    struct FrameGraphKey {
+        int Width, Height;
+        bool Bloom;
+        rg::BloomMethod Method;
+        bool Oit;
+        bool operator==(const FrameGraphKey &o) const {
+            return Width == o.Width && Height == o.Height && Bloom == o.Bloom && Method == o.Method && Oit == o.Oit;
+        }
+    };
+    FrameGraphKey frameGraphKey = {0, 0, false, rg::BloomMethod::MipChain, false};
+    auto declareFrameGraph = [&](const FrameGraphKey &key) {
+        frameGraph.Reset(key.Width, key.Height);
+        rg::RenderTargetDesc hdrTarget;
+        hdrTarget.Format = GL_RGBA16F;
+        rg::RenderTargetDesc depthTarget;
+        depthTarget.Format = GL_DEPTH_COMPONENT24;
+        rg::RenderTargetDesc weightTarget;
+        weightTarget.Format = GL_R16F;
+
+        rg::RenderResource hdrColor, brightColor, sceneDepth;
+        {
+            // the cascades live outside the graph, they're cached from frame to frame
+            rg::RenderGraph::PassBuilder pass = frameGraph.AddPass("shadows", [&](const rg::RenderGraph &) {
+                rg::GpuScope scope(gpuProfiler, "shadows");
+                shadowMaps.Render(framePacket->Shadows, [&](const std::vector<rg::ShadowCaster> &casters, Shader &opaque,
+                                                            Shader &alphaTested, std::uint8_t layers) {
+                    sceneRenderer.DrawShadowCasters(casters, opaque, alphaTested, layers);
+                });
+            });
+            pass.SideEffect();
+        }
+        {
+            rg::RenderGraph::PassBuilder pass = frameGraph.AddPass("scene", [&](const rg::RenderGraph &graph) {
+                const rg::FramePacket *packet = framePacket;
+                gpuProfiler.BeginScope("scene");
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                // render
+                glClearColor(packet->ClearColor.r, packet->ClearColor.g, packet->ClearColor.b, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                const glm::mat4 &projection = packet->Projection;
+                glm::mat4 view = packet->View;
+                // with the transparent pass the transparent meshes wait for it
+                MeshSelection meshes = packet->Oit ? MeshSelection::Opaque : MeshSelection::All;
+                if (packet->DepthPrepass) {
+                    rg::GpuScope prepass(gpuProfiler, "depth prepass");
+                    sceneRenderer.DrawDepthPrepass(packet->Draws, projection, view, packet->DepthPrepass, meshes);
+                }
+                clusteredLights.Upload(packet->Clusters, graph.Width(), graph.Height());
+                shadowMaps.Bind();
+                bool baked = packet->Lightmaps && !lightmaps.Empty();
+                if (baked)
+                    lightmaps.Bind();
+                bool probed = packet->Probes && !probes.Empty();
+                if (probed)
+                    probes.Bind();
+                sceneFragments.Begin();
+                sceneRenderer.Draw(packet->Draws, packet->Lights, clusteredLights, shadowMaps,
+                                   baked ? &lightmaps : nullptr, probed ? &probes : nullptr, projection, view,
+                                   packet->ViewPosition, packet->DepthPrepass, meshes);
+                sceneFragments.End();
+                gpuProfiler.EndScope();
+
+                glDisable(GL_CULL_FACE);
+
+                //renderovanje svetlece kutije
+                gpuProfiler.BeginScope("light box");
+                shaderLightBox.use();
+                shaderLightBox.setMat4("projection", projection);
+                shaderLightBox.setMat4("view", view);
+                glm::mat4 model=glm::mat4(1.0f);
+                model=glm::translate(model,  glm::vec3( 1.2f,  1.2f,  1.2f));
+                model=glm::scale(model, glm::vec3(0.06));
+                shaderLightBox.setMat4("model", model);
+                shaderLightBox.setVec3("lightColor", glm::vec3(14, 2, 25));
+                renderCube();
+                gpuProfiler.EndScope();
+
+                glDisable(GL_CULL_FACE);
+                //draw skybox
+                gpuProfiler.BeginScope("skybox");
+                glDepthFunc(GL_LEQUAL);
+                skyboxShader.use();
+                view = glm::mat4(glm::mat3(packet->View));
+                skyboxShader.setMat4("view", view);
+                skyboxShader.setMat4("projection", projection);
+                // skybox cube
+                glBindVertexArray(skyboxVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+                glBindVertexArray(0);
+                rg::metrics::Render().VaoBinds.Add();
+                rg::metrics::Render().TextureBinds.Add();
+                rg::metrics::Render().DrawCalls.Add();
+                rg::metrics::Render().Triangles.Add(12);
+                glDepthFunc(GL_LESS);
+                gpuProfiler.EndScope();
+            });
+            hdrColor = pass.Create("hdr color", hdrTarget); // FragColor i BrightColor
+            brightColor = pass.Create("bright color", hdrTarget);
+            sceneDepth = pass.Create("depth", depthTarget);
+        }
 
+        // Weighted blended transparency: the transparent meshes in draw list order, unsorted, tested
+        // against the scene depth without writing it. GL 3.3 has one blend state for every target, so
+        // both add their colour and the accumulation's alpha multiplies down to the revealage instead of
+        // a revealage target of its own. The resolve blends the average over hdr color and bright color,
+        // so bloom, which runs after it, sees the transparent surfaces and what they cover.
+        if (key.Oit) {
+            rg::RenderGraph::PassBuilder pass = frameGraph.AddPass("transparent", [&](const rg::RenderGraph &) {
+                const rg::FramePacket *packet = framePacket;
+                rg::GpuScope scope(gpuProfiler, "transparent");
+                const GLfloat clearAccumulation[] = {0.0f, 0.0f, 0.0f, 1.0f};
+                const GLfloat clearWeights[] = {0.0f, 0.0f, 0.0f, 0.0f};
+                glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+                glClearBufferfv(GL_COLOR, 1, clearWeights);
+                glDepthMask(GL_FALSE);
+                glEnable(GL_BLEND);
+                glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+                // the clusters, cascades, lightmap and probes are still bound from the scene pass
+                bool baked = packet->Lightmaps && !lightmaps.Empty();
+                bool probed = packet->Probes && !probes.Empty();
+                sceneRenderer.Draw(packet->Draws, packet->Lights, clusteredLights, shadowMaps,
+                                   baked ? &lightmaps : nullptr, probed ? &probes : nullptr, packet->Projection,
+                                   packet->View, packet->ViewPosition, 0, MeshSelection::Transparent);
+                glDisable(GL_BLEND);
+                glDepthMask(GL_TRUE);
+            });
+            rg::RenderResource accumulation = pass.Create("oit accumulation", hdrTarget);
+            rg::RenderResource weights = pass.Create("oit weights", weightTarget);
+            pass.Write(sceneDepth);
+
+            rg::RenderGraph::PassBuilder resolve = frameGraph.AddPass("transparent resolve", [&, accumulation, weights](const rg::RenderGraph &graph) {
+                rg::GpuScope scope(gpuProfiler, "transparent resolve");
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                oitResolveShader.use();
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.Texture(accumulation));
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, graph.Texture(weights));
+                glActiveTexture(GL_TEXTURE0);
+                rg::metrics::Render().TextureBinds.Add(2);
+                renderQuad();
+                glDisable(GL_BLEND);
+            });
+            resolve.Read(accumulation);
+            resolve.Read(weights);
+            resolve.Write(hdrColor);
+            resolve.Write(brightColor);
+        }
 
+        // bright fragments blurred, by the dual-filter chain or the old two-pass Gaussian ping-pong (F3 switches)
+        rg::RenderResource bloomResult = rg::RENDER_RESOURCE_NONE;
+        if (key.Method == rg::BloomMethod::PingPong) {
+            rg::RenderGraph::PassBuilder pass = frameGraph.AddPass("bloom blur");
+            pass.Read(brightColor);
+            // an even number of passes ends in pingpong[0]
+            rg::RenderResource pingpong[2];
+            pingpong[0] = pass.Create("bloom ping", hdrTarget);
+            pingpong[1] = pass.Create("bloom pong", hdrTarget);
+            pass.Unbound();
+            pass.Execute([&, brightColor, pingpong](const rg::RenderGraph &graph) {
+                gpuProfiler.BeginScope("bloom blur");
+                glActiveTexture(GL_TEXTURE0);
+                glViewport(0, 0, graph.Width(pingpong[0]), graph.Height(pingpong[0]));
+                bool horizontal = true, first_iteration = true;
+                unsigned int amountBlur = 10;
+                shaderBlur.use();
+                for (unsigned int i = 0; i < amountBlur; i++)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, graph.TargetFramebuffer(pingpong[horizontal]));
+                    shaderBlur.setInt("horizontal", horizontal);
+                    glBindTexture(GL_TEXTURE_2D, graph.Texture(first_iteration ? brightColor : pingpong[!horizontal]));  // bind texture of other framebuffer (or scene if first iteration)
+                    rg::metrics::Render().TextureBinds.Add();
+                    renderQuad();
+                    horizontal = !horizontal;
+                    if (first_iteration)
+                        first_iteration = false;
+                }
+                gpuProfiler.EndScope();
+            });
+            bloomResult = pingpong[0];
+        } else {
+            rg::RenderGraph::PassBuilder pass = frameGraph.AddPass("bloom blur", [&, brightColor](const rg::RenderGraph &graph) {
+                gpuProfiler.BeginScope("bloom blur");
+                bloomChain.Render(graph, graph.Texture(brightColor), bloomDownShader, bloomUpShader, renderQuad);
+                gpuProfiler.EndScope();
+            });
+            pass.Read(brightColor);
+            bloomResult = bloomChain.Declare(frameGraph, pass);
+            pass.Unbound();
+        }
 
-     //pozicije drveca
-    srand(9);
-    const unsigned int NR_TREES = 100;
-    std::vector<glm::vec3> treePos;
-    for(int i = 0; i < NR_TREES; i++)
-        treePos.push_back(glm::vec3(rand() % 250 - 199, -1.0f, rand() % 200 - 200));
-    
+        //render floating point color buffer to a 2D quad and tonemap HDR colors to a default framebuffer
+        rg::RenderGraph::PassBuilder composite = frameGraph.AddPass("hdr composite", [&, hdrColor, bloomResult, key](const rg::RenderGraph &graph) {
+            const rg::FramePacket *packet = framePacket;
+            gpuProfiler.BeginScope("hdr composite");
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+            glViewport(0, 0, viewportWidth, viewportHeight);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            hdrShader.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, graph.Texture(hdrColor));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, key.Bloom ? graph.Texture(bloomResult) : 0);
+            rg::metrics::Render().TextureBinds.Add(2);
+            hdrShader.setInt("bloom", packet->Bloom);
+            hdrShader.setInt("hdr", packet->Hdr);
+            hdrShader.setFloat("exposure", packet->Exposure);
+            bool upscaled = graph.Width() < viewportWidth || graph.Height() < viewportHeight;
+            hdrShader.setFloat("sharpness", upscaled ? packet->DynamicResolution.Sharpness : 0.0f);
+            renderQuad();
+            gpuProfiler.EndScope();
+        });
+        composite.Read(hdrColor);
+        if (key.Bloom)
+            composite.Read(bloomResult);
+        composite.SideEffect();
+        frameGraph.Compile();
+    };
 
-    PointLight& pointLight = programState->pointLight;
-    pointLight.position = glm::vec3(4.0f, 4.0, 0.0);
-    pointLight.ambient = glm::vec3(0.1, 0.1, 0.1);
-    pointLight.diffuse = glm::vec3(0.6, 0.6, 0.6);
-    pointLight.specular = glm::vec3(1.0, 1.0, 1.0);
+    while (const rg::FramePacket *packet = pipeline.AcquireForRead()) {
+        RG_PROFILE_SCOPE("render frame");
+#ifdef RG_COUNT_ALLOCATIONS
+        std::uint64_t allocationsBefore = threadAllocations;
+#endif
+        // GL work queued by jobs (uploads etc.)
+        jobs.RunMainThreadJobs();
+        if (packet->FramebufferWidth != viewportWidth || packet->FramebufferHeight != viewportHeight) {
+            viewportWidth = packet->FramebufferWidth;
+            viewportHeight = packet->FramebufferHeight;
+            glViewport(0, 0, viewportWidth, viewportHeight);
+        }
+        gpuProfiler.BeginFrame();
+        sceneRenderer.BeginFrame();
+
+        framePacket = packet;
+        float renderScale = resolutionController.Update(packet->DynamicResolution, gpuProfiler.TakeFrameMs());
+        rg::metrics::Render().RenderScale.Set((std::int64_t) std::lround(renderScale * 100.0f));
+        FrameGraphKey key = {std::max(1, (int) std::lround(viewportWidth * renderScale)),
+                             std::max(1, (int) std::lround(viewportHeight * renderScale)),
+                             packet->Hdr && packet->Bloom, packet->BloomMethod, packet->Oit};
+        if (!(key == frameGraphKey)) {
+            frameGraphKey = key;
+            declareFrameGraph(key);
+        }
+        frameGraph.Execute();
+        rg::metrics::Render().SceneFragments.Set((std::int64_t) sceneFragments.Last());
+
+        if (packet->Capture) {
+            // the tonemapped frame without UI, rows flipped to top first
+            std::vector<std::uint8_t> pixels((size_t) viewportWidth * viewportHeight * 3);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, viewportWidth, viewportHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+            size_t row = (size_t) viewportWidth * 3;
+            for (int y = 0; y < viewportHeight / 2; ++y)
+                std::swap_ranges(pixels.begin() + y * row, pixels.begin() + (y + 1) * row,
+                                 pixels.begin() + (viewportHeight - 1 - y) * row);
+            packet->Capture->Store(packet->Frame, viewportWidth, viewportHeight, pixels);
+        }
 
-    pointLight.constant = 0.1f;
-    pointLight.linear = 1.0f;
-    pointLight.quadratic = 1.0f;
+        if (!packet->Ui.Empty()) {
+            rg::GpuScope pass(gpuProfiler, "imgui");
+            ImDrawData ui = packet->Ui.View();
+            ImGui_ImplOpenGL3_RenderDrawData(&ui);
+        }
+        gpuProfiler.EndFrame();
 
+        {
+            RG_PROFILE_SCOPE("swap buffers");
+            surface.Present();
+        }
+        capture.EndFrame();
+        rg::metrics::GetRegistry().EndFrame();
+#ifdef RG_COUNT_ALLOCATIONS
+        // the read back of a captured frame allocates its pixels, it isn't held to the steady state
+        if (packet->Measured && !packet->Capture)
+            startup.RenderAllocations = std::max(startup.RenderAllocations, threadAllocations - allocationsBefore);
+#endif
+        pipeline.Release(packet);
+    }
+    glDeleteVertexArrays(1, &skyboxVAO);
+    glDeleteBuffers(1, &skyboxVBO);
+    rg::metrics::Render().GlObjects.Add(-2);
+    if (outputFBO) {
+        glDeleteFramebuffers(1, &outputFBO);
+        glDeleteRenderbuffers(2, outputRenderbuffers);
+        rg::metrics::Render().GlObjects.Add(-3);
+    }
+    frameGraph.Shutdown();
+    sceneRenderer.Shutdown();
+    sceneFragments.Shutdown();
+    clusteredLights.Shutdown();
+    shadowMaps.Shutdown();
+    lightmaps.Shutdown();
+    probes.Shutdown();
+    gpuProfiler.Shutdown();
+    ImGui_ImplOpenGL3_Shutdown();
+    capture.Stop();
+    surface.Release();
+}
 
+// a recorded frame's camera and render settings, for playback
+void applyCameraSample(const rg::CameraSample &sample) {
+    programState->camera.SetPose(sample.Position, sample.Yaw, sample.Pitch);
+    programState->camera.Zoom = sample.Zoom;
+    exposure = sample.Exposure;
+    hdr = (sample.Flags & rg::RecordedHdr) != 0;
+    bloom = (sample.Flags & rg::RecordedBloom) != 0;
+}
 
+// Everything in a frame packet but the UI: camera, sorted draw list, lights and post-processing settings.
+void fillFramePacket(rg::FramePacket &packet, std::uint64_t frame, const glm::mat4 &projection, const glm::mat4 &view,
+                     rg::Scene &scene, rg::DrawListBuilder &drawListBuilder, rg::ShadowCascades &shadowCascades,
+                     rg::JobSystem &jobs) {
+    packet.Frame = frame;
+    packet.FramebufferWidth = framebufferWidth;
+    packet.FramebufferHeight = framebufferHeight;
+    packet.ClearColor = programState->clearColor;
+    packet.Projection = projection;
+    packet.View = view;
+    packet.ViewPosition = programState->camera.Position;
+    drawListBuilder.Build(scene, rg::Frustum(projection * view), programState->camera.Position, jobs, packet.Draws);
+    programState->DrawCount = packet.Draws.size();
+    packet.Lights = scene.Lights;
+    {
+        RG_PROFILE_SCOPE("light clusters");
+        packet.Clusters.Build(scene.Lights, projection, view);
+    }
+    {
+        RG_PROFILE_SCOPE("shadow cascades");
+        shadowCascades.Update(shadowSettings, scene, projection, view, packet.Shadows);
+    }
+    packet.Hdr = hdr;
+    packet.Bloom = bloom;
+    packet.BloomMethod = bloomMethod;
+    packet.Exposure = exposure;
+    packet.DynamicResolution = dynamicResolution;
+    packet.DepthPrepass = (std::uint8_t) depthPrepass;
+    packet.Lightmaps = useLightmaps;
+    packet.Probes = useProbes;
+    packet.Oit = useOit;
+    packet.Capture = nullptr;
+    packet.Measured = false;
+}
+
+// --benchmark: renders options.Frames frames along a scripted camera path at a fixed timestep, with no
+// input and default settings, so every run draws the same frames. With --views it renders each fixed
+// viewpoint instead and checks it against its golden image and frame cost. Needs no window when EGL
+// can make an offscreen context (Mesa llvmpipe in CI), otherwise uses a hidden one. Writes the report
+// as JSON; returns 1 when a value is over the budget, a view failed or a measured frame allocated on the
+// render thread (RG_COUNT_ALLOCATIONS builds), -1 when the run itself failed.
+int runBenchmark(const rg::BenchmarkOptions &options) {
+    // a .rgcam recording (F5) replays a flythrough, anything else is a keyed camera path
+    rg::CameraPath path;
+    rg::CameraPlayback recording;
+    std::vector<rg::BenchmarkView> views;
+    const std::string extension = ".rgcam";
+    bool fromRecording = options.CameraPath.size() >= extension.size()
+                         && options.CameraPath.compare(options.CameraPath.size() - extension.size(),
+                                                       extension.size(), extension) == 0;
+    if (!options.Views.empty()) {
+        if (!rg::LoadBenchmarkViews(options.Views, views))
+            return -1;
+    } else if (fromRecording ? !recording.Load(options.CameraPath) : !path.LoadFromFile(options.CameraPath)) {
+        return -1;
+    }
 
+    bloomMethod = options.Bloom;
+    dynamicResolution = options.DynamicResolution;
+    depthPrepass = options.DepthPrepass;
+    shadowSettings = options.Shadows;
+    useLightmaps = options.Lightmaps || options.BakeLightmaps;
+    useProbes = options.Probes;
+    useOit = options.Oit;
+    rg::BenchmarkReport report;
+    rg::OffscreenContext offscreen;
+    RenderSurface surface;
+    if (offscreen.Create()) {
+        surface.Offscreen = &offscreen;
+        report.Context = "egl-surfaceless";
+    } else {
+        if (!glfwInit()) {
+            std::cout << "Failed to initialize GLFW" << std::endl;
+            return -1;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        surface.Window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "PACK-MAN benchmark", NULL, NULL);
+        if (surface.Window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        surface.Vsync = false;
+        report.Context = "glfw-hidden-window";
+    }
+
+    // defaults rather than resources/program_state.txt, so runs on different machines compare
+    programState = new ProgramState;
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext(); // the render thread sets up its backend either way, nothing is drawn with it
+
+    rg::JobSystem jobs;
+    rg::Scene scene;
+    rg::SceneRenderer sceneRenderer;
+    rg::FramePipeline<rg::FramePacket> pipeline;
+    rg::GpuProfiler gpuProfiler;
+    rg::metrics::Render();
+    RenderStartup startup;
+    startup.Stress = options.Stress;
+    startup.CaptureGl = options.CaptureGl;
+    startup.CaptureFrames = options.CaptureFrames;
+    startup.Lightmaps = useLightmaps;
+    startup.BakeLightmaps = options.BakeLightmaps;
+    startup.Lightmap = options.Lightmap;
+    startup.Probes = useProbes;
+    startup.Probe = options.Probe;
+    std::promise<bool> loaded;
+    std::future<bool> loadResult = loaded.get_future();
+    std::thread renderer(renderThread, std::ref(surface), std::ref(jobs), std::ref(scene), std::ref(sceneRenderer),
+                         std::ref(pipeline), std::ref(gpuProfiler), std::ref(startup), std::ref(loaded));
+    bool ok = loadResult.get();
+
+    std::vector<double> frameMs, updateMs;
+    rg::FrameCosts costs;
+    std::string costsPath = options.Golden + "/frame_cost.txt";
+    if (ok) {
+        rg::UpdateTransforms(scene, jobs);
+        rg::DrawListBuilder drawListBuilder;
+        rg::ShadowCascades shadowCascades;
+        frameMs.reserve(options.Frames);
+        updateMs.reserve(options.Frames);
+        deltaTime = options.Timestep;
+        typedef std::chrono::steady_clock Clock;
+        auto milliseconds = [](Clock::duration d) {
+            return std::chrono::duration<double, std::milli>(d).count();
+        };
+        Clock::time_point previous = Clock::now();
+        std::uint64_t nextFrame = 0;
+        // one frame with the camera as it is; measured ones add their time to frameMs and viewMs
+        auto renderFrame = [&](bool measured, rg::FrameCapture *capture, std::vector<double> *viewMs) {
+            RG_PROFILE_SCOPE("update frame");
+            Clock::time_point begin = Clock::now();
+            glm::mat4 projection = cameraProjection();
+            glm::mat4 view = programState->camera.GetViewMatrix();
+            rg::UpdateTransforms(scene, jobs);
+
+            Clock::time_point waitBegin = Clock::now();
+            rg::FramePacket *packet;
+            {
+                RG_PROFILE_SCOPE("wait for free packet");
+                packet = pipeline.AcquireForWrite();
+            }
+            if (!packet)
+                return false;
+            Clock::time_point waitEnd = Clock::now();
+            fillFramePacket(*packet, nextFrame++, projection, view, scene, drawListBuilder, shadowCascades, jobs);
+            packet->Ui.Clear();
+            packet->Capture = capture;
+            packet->Measured = measured;
+            pipeline.Submit(packet);
+
+            Clock::time_point end = Clock::now();
+            if (measured) {
+                frameMs.push_back(milliseconds(end - previous));
+                updateMs.push_back(milliseconds((end - begin) - (waitEnd - waitBegin)));
+                if (viewMs)
+                    viewMs->push_back(frameMs.back());
+            }
+            previous = end;
+            return true;
+        };
+
+        if (!views.empty()) {
+            // every view: warm-up, --perf-runs runs of measured frames, the last one read back and checked
+            costs = rg::LoadFrameCosts(costsPath);
+            rg::FrameCapture capture;
+            for (const rg::BenchmarkView &view : views) {
+                programState->camera.LookAt(view.Position, view.Target);
+                for (int i = 0; i < options.Warmup; ++i)
+                    renderFrame(false, nullptr, nullptr);
+                std::vector<std::vector<double>> runMs(options.PerfRuns);
+                for (int run = 0; run < options.PerfRuns; ++run) {
+                    for (int i = 0; i < options.Frames; ++i) {
+                        bool last = run == options.PerfRuns - 1 && i == options.Frames - 1;
+                        renderFrame(true, last ? &capture : nullptr, &runMs[run]);
+                    }
+                }
+                rg::Image image;
+                capture.Take(nextFrame - 1, image.Width, image.Height, image.Pixels);
+                report.Views.push_back(rg::CheckGoldenView(options, view, image, runMs, costs));
+            }
+        } else {
+            // the warm-up frames hold the first key, the measured ones fly the path
+            for (int frame = 0; frame < options.Warmup + options.Frames; ++frame) {
+                float time = (float) std::max(0, frame - options.Warmup) * options.Timestep;
+                if (fromRecording) {
+                    applyCameraSample(recording.Evaluate(time));
+                } else {
+                    rg::CameraKey key = path.Evaluate(time);
+                    programState->camera.LookAt(key.Position, key.Target);
+                }
+                renderFrame(frame >= options.Warmup, nullptr, nullptr);
+            }
+        }
+    }
+    pipeline.Close();
+    renderer.join();
+
+    int result = ok ? 0 : -1;
+    if (ok) {
+        report.Renderer = startup.Renderer;
+        report.Frames = (int) frameMs.size();
+        report.Warmup = options.Warmup;
+        report.Timestep = options.Timestep;
+        report.FrameMs = rg::ComputeTimeStats(frameMs);
+        report.UpdateMs = rg::ComputeTimeStats(updateMs);
+        report.Gpu = gpuProfiler.Snapshot();
+        report.LoadMs = startup.LoadMs;
+        report.Stress = options.Stress;
+        report.Bloom = options.Bloom;
+        report.DynamicResolution = options.DynamicResolution;
+        report.DepthPrepass = options.DepthPrepass;
+        report.Shadows = options.Shadows;
+        report.LightmapInstances = startup.LightmapInstances;
+        report.Probes = startup.ProbeCount;
+        report.Oit = options.Oit;
+        report.RenderAllocations = startup.RenderAllocations;
+        report.Renderables = scene.Renderables.Size();
+        report.Lights = scene.Lights.Size();
+        for (const auto &material : sceneRenderer.Materials)
+            report.Materials += material != nullptr;
+        for (const auto &model : sceneRenderer.Models) {
+            if (model) {
+                ++report.Models;
+                report.Textures += model->textures_loaded.size();
+            }
+        }
+        report.Metrics = rg::metrics::GetRegistry().Snapshot();
+        if (!report.WriteJson(options.Output))
+            result = -1;
+        std::printf("benchmark: %d frames on %s (%s), frame p50 %.3f ms, p95 %.3f ms, p99 %.3f ms -> %s\n",
+                    report.Frames, report.Renderer.c_str(), report.Context.c_str(), report.FrameMs.P50,
+                    report.FrameMs.P95, report.FrameMs.P99, options.Output.c_str());
+        if (result == 0 && views.empty() && !options.Stress.Active() && !options.Budget.empty()
+            && !rg::CheckBudget(options.Budget, report))
+            result = 1;
+        // the render thread's measured frames don't touch the heap, in golden-view runs too; a change of
+        // the dynamic resolution re-declares the frame graph and a GL capture writes its trace, so those
+        // runs aren't held to it
+#ifdef RG_COUNT_ALLOCATIONS
+        if (result == 0 && report.RenderAllocations && !options.DynamicResolution.Enabled
+            && options.CaptureGl.empty()) {
+            std::cout << "ERROR::BENCHMARK::RENDER_ALLOCATIONS " << report.RenderAllocations
+                      << " in one frame" << std::endl;
+            result = 1;
+        }
+#endif
+        if (options.UpdateGolden && !report.Views.empty() && !rg::SaveFrameCosts(costsPath, costs))
+            result = -1;
+        for (const rg::ViewResult &view : report.Views) {
+            if (result == 0 && (!view.ImagePassed || !view.CostPassed))
+                result = 1;
+        }
+    }
+
+    delete programState;
+    ImGui::DestroyContext();
+    offscreen.Destroy();
+    if (surface.Window) {
+        glfwDestroyWindow(surface.Window);
+        glfwTerminate();
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    RG_PROFILE_THREAD("main");
+    rg::BenchmarkOptions benchmark;
+    if (!rg::ParseBenchmarkOptions(argc, argv, benchmark))
+        return -1;
+    if (benchmark.Enabled)
+        return runBenchmark(benchmark);
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    // glfw window creation
+    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "PACK-MAN", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    programState = new ProgramState;
+    programState->LoadFromFile("resources/program_state.txt");
+    if (programState->ImGuiEnabled) {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+    }
+    // Init Imgui
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    (void) io;
+
+    // GL belongs to the render thread from here on. This thread keeps the window events (GLFW wants
+    // them on the main thread), input, simulation and ImGui, and hands each frame over as a packet.
+    rg::JobSystem jobs;
+    rg::Scene scene;
+    rg::SceneRenderer sceneRenderer;
+    rg::FramePipeline<rg::FramePacket> pipeline;
+    rg::GpuProfiler gpuProfiler;
+    rg::metrics::Render(); // registers the renderer metrics before anything exports them
+    std::promise<bool> loaded;
+    std::future<bool> loadResult = loaded.get_future();
+    RenderSurface surface;
+    surface.Window = window;
+    RenderStartup startup;
+    startup.CaptureGl = benchmark.CaptureGl;
+    startup.CaptureFrames = benchmark.CaptureFrames;
+    // baked lighting and probes are opt-in here too, both cost time before the first frame
+    startup.Lightmaps = benchmark.Lightmaps || benchmark.BakeLightmaps;
+    startup.BakeLightmaps = benchmark.BakeLightmaps;
+    startup.Lightmap = benchmark.Lightmap;
+    startup.Probes = benchmark.Probes;
+    startup.Probe = benchmark.Probe;
+    std::thread renderer(renderThread, std::ref(surface), std::ref(jobs), std::ref(scene), std::ref(sceneRenderer),
+                         std::ref(pipeline), std::ref(gpuProfiler), std::ref(startup), std::ref(loaded));
+    // keep the window responsive while the scene loads
+    while (loadResult.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+        glfwPollEvents();
+    if (!loadResult.get()) {
+        renderer.join();
+        delete programState;
+        ImGui::DestroyContext();
+        glfwTerminate();
+        return -1;
+    }
+    // only now, so ImGui's input callbacks can't race the render thread setting up its backend
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+
+    // spatial queries: per-model triangle BVHs below an instance BVH, used for picking and camera collision
+    rg::UpdateTransforms(scene, jobs);
+    rg::SceneBvh sceneBvh;
+    sceneBvh.Build(scene, sceneRenderer.MeshBvhs);
+    programState->camera.MovementConstraint = [&sceneBvh](const glm::vec3& from, const glm::vec3& to) {
+        return programState->CameraCollisionEnabled ? sceneBvh.ConstrainMovement(from, to, CAMERA_RADIUS) : to;
+    };
+
+    // frame counters go to RG_METRICS_FILE (default metrics.prom, a .csv name appends rows instead)
+    // once a second; an empty RG_METRICS_FILE turns the export off
+    const char *metricsEnv = std::getenv("RG_METRICS_FILE");
+    std::string metricsFile = metricsEnv ? metricsEnv : "metrics.prom";
+    double metricsWritten = glfwGetTime();
+
+    rg::DrawListBuilder drawListBuilder;
+    rg::ShadowCascades shadowCascades;
+    std::uint64_t frame = 0;
+    double jobStatsStart = glfwGetTime();
     while (!glfwWindowShouldClose(window)) {
+        RG_PROFILE_SCOPE("update frame");
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        if (currentFrame - jobStatsStart >= 0.5) {
+            programState->JobStats = jobs.Stats();
+            programState->JobStatsSeconds = currentFrame - jobStatsStart;
+            jobs.ResetStats();
+            jobStatsStart = currentFrame;
+        }
+        if (!metricsFile.empty() && currentFrame - metricsWritten >= 1.0) {
+            rg::metrics::GetRegistry().WriteSnapshot(metricsFile);
+            metricsWritten = currentFrame;
+        }
+
         // input
         processInput(window);
+        if (programState->Playing) {
+            float time = (float) (glfwGetTime() - programState->PlaybackStart);
+            applyCameraSample(programState->Playback.Evaluate(time));
+            if (time > programState->Playback.Duration()) {
+                programState->Playing = false;
+                std::cout << "Playback finished" << std::endl;
+            }
+        } else if (programState->Recorder.Recording()) {
+            const Camera &c = programState->camera;
+            programState->Recorder.Record(glfwGetTime(), c.Position, c.Yaw, c.Pitch, c.Zoom, exposure,
+                                          recordedInput(window),
+                                          (hdr ? rg::RecordedHdr : 0) | (bloom ? rg::RecordedBloom : 0));
+        }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        // render
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // view/projection transformations
-        shader.use();
-        shader.setVec3("viewPosition", programState->camera.Position);
-        shader.setFloat("material.shininess", 32.0f);
         //view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = cameraProjection();
         glm::mat4 view=glm::mat4(programState->camera.GetViewMatrix());
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        
-        glDisable(GL_CULL_FACE);
-
-         // directional light
-        shader.setVec3("dirLight.direction", -0.2f, -0.1f, 0.3f);
-        shader.setVec3("dirLight.ambient", 0.255f, 0.255f, 0.01f);
-        shader.setVec3("dirLight.diffuse", 0.024f, 0.23f, 0.14f);
-        shader.setVec3("dirLight.specular", 0.3f, 0.144f, 0.255f);
-
-         // point light-svetlo u kuci
-        shader.setVec3("pointLights[0].position",  glm::vec3( 1.2f,  1.2f,  1.2f));
-        shader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        shader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        shader.setFloat("pointLights[0].constant", 1.0f);
-        shader.setFloat("pointLights[0].linear", 0.09f);
-        shader.setFloat("pointLights[0].quadratic", 0.032f);
-
-        // point light 2
-        shader.setVec3("pointLights[1].position",  glm::vec3( 6.7f,  0.2f,  7.8f));
-        shader.setVec3("pointLights[1].ambient", 0.135f, 0.205f, 0.25f);
-        shader.setVec3("pointLights[1].diffuse", 0.001f, 0.191f, 0.255f);
-        shader.setVec3("pointLights[1].specular", 1.0f, 0.144f, 0.250f);
-        shader.setFloat("pointLights[1].constant", 1.0f);
-        shader.setFloat("pointLights[1].linear", 0.10f);
-        shader.setFloat("pointLights[1].quadratic", 0.035f);
-
-        //shaderBlending
-        shaderB.use();
-        shaderB.setVec3("viewPosition", programState->camera.Position);
-        shaderB.setFloat("material.shininess", 32.0f);
-        //view/projection transformations
-        projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        view=glm::mat4(programState->camera.GetViewMatrix());
-        shaderB.setMat4("projection", projection);
-        shaderB.setMat4("view", view);
-        
-        glDisable(GL_CULL_FACE);
-
-         // directional light
-        shaderB.setVec3("dirLight.direction", -0.2f, -0.1f, 0.3f);
-        shaderB.setVec3("dirLight.ambient", 0.155f, 0.155f, 0.008f);
-        shaderB.setVec3("dirLight.diffuse", 0.024f, 0.23f, 0.9f);
-        shaderB.setVec3("dirLight.specular", 0.3f, 0.144f, 0.255f);
-
-         // point light-svetlo u kuci
-        shaderB.setVec3("pointLights[0].position",  glm::vec3( 1.2f,  1.4f,  1.2f));
-        shaderB.setVec3("pointLights[0].ambient", 0.05f, 0.01f, 0.05f);
-        shaderB.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        shaderB.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        shaderB.setFloat("pointLights[0].constant", 1.0f);
-        shaderB.setFloat("pointLights[0].linear", 0.09f);
-        shaderB.setFloat("pointLights[0].quadratic", 0.032f);
-
-        // point light 2
-        shaderB.setVec3("pointLights[1].position",  glm::vec3( 6.7f,  0.2f,  7.8f));
-        shaderB.setVec3("pointLights[1].ambient", 0.105f, 0.105f, 0.25f);
-        shaderB.setVec3("pointLights[1].diffuse", 0.001f, 0.191f, 0.255f);
-        shaderB.setVec3("pointLights[1].specular", 1.0f, 0.144f, 0.250f);
-        shaderB.setFloat("pointLights[1].constant", 1.0f);
-        shaderB.setFloat("pointLights[1].linear", 0.10f);
-        shaderB.setFloat("pointLights[1].quadratic", 0.035f);
-  
-        // pack-mam
-        shaderB.use();
-        glm::mat4  model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(7.0f, -1.0f, 7.0f));
-        model = glm::scale(model, glm::vec3(0.009f));
-        shader.setMat4("model", model);
-        packman.Draw(shaderB);
-
-        // kuca
-        shaderB.use();
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.0f, -1.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.5f, 0.6f, 0.6));
-        shaderB.setMat4("model", model);
-        kuca.Draw(shaderB);
-        
-        glEnable(GL_CULL_FACE);
-
-         //draw piano
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.2f, -0.9f, 0.3f));
-        model = glm::scale(model, glm::vec3(0.4f));
-        shaderB.setMat4("model", model);
-        piano.Draw(shaderB);
-
-        //bed
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.3f, -1.0f, 1.9f));
-        model = glm::scale(model, glm::vec3(0.06f));
-        shaderB.setMat4("model", model);
-        bed.Draw(shaderB);
-
-        //renderovanje bazena
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(8.0f, -1.0f, 6.0f));
-        model = glm::scale(model, glm::vec3(0.3f));
-        shaderB.setMat4("model", model);
-        pool.Draw(shaderB);
-
-        //saksije ispred kuce
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.7f, -0.8f, 2.50f));
-        model = glm::scale(model, glm::vec3(0.7f));
-        shaderB.setMat4("model", model);
-        plants.Draw(shaderB);
-
-        //renderovanje drveca
-        shader.use();
-        for (int i = 0; i < NR_TREES; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, treePos[i]);
-            model = glm::scale(model, glm::vec3(0.8f));
-            shader.setMat4("model", model);
-            tree.Draw(shader);
-        }
-
-        // drvo
-        shaderB.use();
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(6.0f, -1.3f, 9.0f));
-        model = glm::scale(model, glm::vec3(0.2f));
-        shaderB.setMat4("model", model);
-        woodel.Draw(shaderB);
-
-        //draw table
-        shader.use();
-        model= glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.9f, -1.0f, -0.3f));
-        model = glm::scale(model, glm::vec3(0.9f));
-        shader.setMat4("model", model);
-        woodTable.Draw(shader);
-
-        glDisable(GL_CULL_FACE);
-
-        //renderovanje svetlece kutije
-        shaderLightBox.use();
-        shaderLightBox.setMat4("projection", projection);
-        shaderLightBox.setMat4("view", view);
-        model=glm::mat4(1.0f);
-        model=glm::translate(model,  glm::vec3( 1.2f,  1.2f,  1.2f));
-        model=glm::scale(model, glm::vec3(0.06));
-        shaderLightBox.setMat4("model", model);
-        shaderLightBox.setVec3("lightColor", glm::vec3(14, 2, 25));
-        renderCube();
-        
-        glDisable(GL_CULL_FACE);
-       //draw skybox
-    //    glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
-
-        // bright fragments with two-pass Gaussian Blur
-      
-        glActiveTexture(GL_TEXTURE0);
-        bool horizontal = true, first_iteration = true;
-        unsigned int amountBlur = 10;
-        shaderBlur.use();
-        for (unsigned int i = 0; i < amountBlur; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            shaderBlur.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+
+        // scene: transforms, culling and the sorted draw list further down
+        if (rg::UpdateTransforms(scene, jobs))
+            sceneBvh.Refit(scene);
+
+        if (programState->PickRequested) {
+            RG_PROFILE_SCOPE("picking");
+            programState->PickRequested = false;
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            float ndcX = 2.0f * programState->PickCursor.x / (float) width - 1.0f;
+            float ndcY = 1.0f - 2.0f * programState->PickCursor.y / (float) height;
+            rg::SceneHit hit;
+            programState->PickedEntity = rg::NullEntity;
+            programState->PickedName.clear();
+            if (sceneBvh.Raycast(rg::ScreenPointToRay(ndcX, ndcY, glm::inverse(projection * view)), hit)) {
+                long row = scene.RenderableRow(hit.Hit);
+                programState->PickedEntity = hit.Hit;
+                programState->PickedName = row >= 0 ? scene.MeshNames[scene.Renderables.Mesh[row]] : "";
+                programState->PickedPosition = hit.Position;
+                programState->PickedDistance = hit.T;
+            }
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        //render floating point color buffer to a 2D quad and tonemap HDR colors to a default framebuffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        hdrShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        hdrShader.setInt("bloom", bloom);
-        hdrShader.setInt("hdr", hdr);
-        hdrShader.setFloat("exposure", exposure);
-        renderQuad();
-
-        if (programState->ImGuiEnabled)
+        // hand the frame to the render thread, waits while it still has both packets
+        rg::FramePacket *packet;
+        {
+            RG_PROFILE_SCOPE("wait for free packet");
+            packet = pipeline.AcquireForWrite();
+        }
+        if (!packet)
+            break;
+        fillFramePacket(*packet, frame++, projection, view, scene, drawListBuilder, shadowCascades, jobs);
+        if (programState->ImGuiEnabled) {
+            programState->GpuProfile = gpuProfiler.Snapshot();
+            programState->Metrics = rg::metrics::GetRegistry().Snapshot();
             DrawImGui(programState);
+            packet->Ui.Capture(ImGui::GetDrawData());
+        } else {
+            packet->Ui.Clear();
+        }
+        pipeline.Submit(packet);
 
-        glfwSwapBuffers(window);
         glfwPollEvents();
     }
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVAO);
+    pipeline.Close();
+    renderer.join();
 
    // programState->SaveToFile("resources/program_state.txt");
     delete programState;
-    ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
@@ -627,8 +1332,12 @@ int main() {
     return 0;
 }
 void processInput(GLFWwindow *window) {
+    RG_PROFILE_SCOPE("input");
     if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+    // the recording drives the camera and settings during playback
+    if (programState->Playing)
+        return;
 
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         programState->camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -667,8 +1376,22 @@ void processInput(GLFWwindow *window) {
       }
 }
 
+std::uint16_t recordedInput(GLFWwindow *window) {
+    const int keys[] = {GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_U, GLFW_KEY_N, GLFW_KEY_J, GLFW_KEY_L};
+    const std::uint16_t bits[] = {rg::InputForward, rg::InputBackward, rg::InputLeft, rg::InputRight,
+                                  rg::InputHdrKey, rg::InputBloomKey, rg::InputExposureDown, rg::InputExposureUp};
+    std::uint16_t input = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (glfwGetKey(window, keys[i]) == GLFW_PRESS)
+            input |= bits[i];
+    }
+    return input;
+}
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    glViewport(0, 0, width, height);
+    // no GL here, the render thread picks the size up with the next packet
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     if (firstMouse) {
@@ -690,18 +1413,9 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 void DrawImGui(ProgramState *programState) {
-    ImGui_ImplOpenGL3_NewFrame();
+    RG_PROFILE_SCOPE("imgui");
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
-    // {
-    //     static float f = 0.0f;
-    //     ImGui::Begin("Settings");
-    //     ImGui::Text("Point light settings:");
-    //     ImGui::DragFloat("pointLight.constant", &programState->pointLight.constant, 0.005, 0.0001, 1.0);
-    //     ImGui::DragFloat("pointLight.linear", &programState->pointLight.linear, 0.005, 0.0001, 1.0);
-    //     ImGui::DragFloat("pointLight.quadratic", &programState->pointLight.quadratic, 0.005, 0.0001, 1.0);
-    //     ImGui::End();
-    // }
 
     {
         ImGui::Begin("Camera info");
@@ -710,10 +1424,124 @@ void DrawImGui(ProgramState *programState) {
         ImGui::Text("(Yaw, Pitch): (%f, %f)", c.Yaw, c.Pitch);
         ImGui::Text("Camera front: (%f, %f, %f)", c.Front.x, c.Front.y, c.Front.z);
         ImGui::Checkbox("Camera mouse update", &programState->CameraMouseMovementUpdateEnabled);
+        ImGui::Checkbox("Camera collision", &programState->CameraCollisionEnabled);
+        if (programState->Recorder.Recording())
+            ImGui::Text("Recording: %zu frames (F5 stops)", programState->Recorder.Size());
+        else if (programState->Playing)
+            ImGui::Text("Playing %s (F6 stops)", programState->RecordingFile.c_str());
+        else
+            ImGui::Text("F5 records the camera, F6 plays it back");
+        if (programState->PickedEntity != rg::NullEntity) {
+            ImGui::Text("Picked: %s (entity %u) at %.2f", programState->PickedName.c_str(),
+                        programState->PickedEntity, programState->PickedDistance);
+            const glm::vec3& p = programState->PickedPosition;
+            ImGui::Text("Hit position: (%f, %f, %f)", p.x, p.y, p.z);
+        } else {
+            ImGui::Text("Picked: nothing (click the scene)");
+        }
+        ImGui::End();
+    }
+    {
+        const rg::GpuProfile& profile = programState->GpuProfile;
+        ImGui::SetNextWindowPos(ImVec2(380.0f, 20.0f), ImGuiCond_FirstUseEver);
+        ImGui::Begin("GPU profiler");
+        ImGui::Text("GPU frame: %.3f ms (avg %.3f, min %.3f, max %.3f)", profile.Frame.LastMs,
+                    profile.Frame.AverageMs, profile.Frame.MinMs, profile.Frame.MaxMs);
+        if (profile.DroppedFrames)
+            ImGui::Text("Dropped readbacks: %llu", (unsigned long long) profile.DroppedFrames);
+        ImGui::Text("Bloom: %s (F3 switches)", rg::BloomMethodName(bloomMethod));
+        ImGui::Checkbox("Dynamic resolution (F4)", &dynamicResolution.Enabled);
+        if (dynamicResolution.Enabled) {
+            ImGui::DragFloat("Target GPU ms", &dynamicResolution.TargetMs, 0.1f, 1.0f, 100.0f);
+            ImGui::DragFloatRange2("Scale", &dynamicResolution.MinScale, &dynamicResolution.MaxScale, 0.01f, 0.5f, 1.0f);
+            ImGui::SliderFloat("Sharpness", &dynamicResolution.Sharpness, 0.0f, 1.0f);
+        }
+        ImGui::Text("Render scale: %lld%%", (long long) rg::metrics::Render().RenderScale.Value());
+        ImGui::Text("Depth pre-pass (F7):");
+        ImGui::SameLine();
+        ImGui::CheckboxFlags("opaque", &depthPrepass, rg::DepthPrepassOpaque);
+        ImGui::SameLine();
+        ImGui::CheckboxFlags("alpha tested", &depthPrepass, rg::DepthPrepassAlphaTested);
+        ImGui::Checkbox("Shadows (F8)", &shadowSettings.Enabled);
+        if (shadowSettings.Enabled) {
+            static const int resolutions[] = {512, 1024, 2048, 4096};
+            int resolution = 0;
+            while (resolution < 3 && resolutions[resolution] < shadowSettings.Resolution)
+                ++resolution;
+            ImGui::SliderInt("Cascades", &shadowSettings.Cascades, 1, rg::SHADOW_MAX_CASCADES);
+            if (ImGui::Combo("Cascade size", &resolution, "512\0" "1024\0" "2048\0" "4096\0"))
+                shadowSettings.Resolution = resolutions[resolution];
+            ImGui::DragFloat("Shadow distance", &shadowSettings.MaxDistance, 0.5f, 5.0f, 100.0f);
+            ImGui::SliderFloat("Split lambda", &shadowSettings.SplitLambda, 0.0f, 1.0f);
+            ImGui::Text("Cascades drawn: %llu",
+                        (unsigned long long) rg::metrics::Render().ShadowCascadeDraws.Value());
+        }
+        ImGui::Checkbox("Lightmaps (F9)", &useLightmaps);
+        ImGui::SameLine();
+        ImGui::Text("%lld baked", (long long) rg::metrics::Render().LightmapInstances.Value());
+        ImGui::Checkbox("Irradiance probes (F10)", &useProbes);
+        ImGui::SameLine();
+        ImGui::Text("%lld probes", (long long) rg::metrics::Render().IrradianceProbes.Value());
+        ImGui::Checkbox("Transparency (F11)", &useOit);
+        {
+            // shaded fragments per pixel of the scene target, 1 would be no overdraw at all
+            double scale = rg::metrics::Render().RenderScale.Value() / 100.0;
+            double pixels = std::max(framebufferWidth * scale * framebufferHeight * scale, 1.0);
+            long long fragments = (long long) rg::metrics::Render().SceneFragments.Value();
+            ImGui::Text("Scene fragments: %lld (%.2f per pixel)", fragments, fragments / pixels);
+        }
+        ImGui::Text("Clustered lights: %lld, %lld light-cluster pairs",
+                    (long long) rg::metrics::Render().ClusteredLights.Value(),
+                    (long long) rg::metrics::Render().ClusterLightIndices.Value());
+        ImGui::Text("Render targets: %lld textures, %.1f MB",
+                    (long long) rg::metrics::Render().RenderTargetTextures.Value(),
+                    rg::metrics::Render().RenderTargetBytes.Value() / (1024.0 * 1024.0));
+        ImGui::Text("%-18s %8s %8s %8s", "pass", "avg ms", "min", "max");
+        for (const rg::GpuPassStats& pass : profile.Passes)
+            ImGui::Text("%*s%-*s %8.3f %8.3f %8.3f", pass.Depth * 2, "", 18 - pass.Depth * 2, pass.Name,
+                        pass.AverageMs, pass.MinMs, pass.MaxMs);
+
+        // flame bar of the newest frame: one row per nesting level, x is time since the frame started
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+        float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+        float span = std::max(profile.Frame.LastMs, 1e-3f);
+        int rows = 1;
+        for (size_t i = 0; i < profile.Passes.size(); ++i) {
+            const rg::GpuPassStats& pass = profile.Passes[i];
+            ImVec2 min(origin.x + width * std::min(pass.LastStartMs / span, 1.0f), origin.y + pass.Depth * rowHeight);
+            ImVec2 max(std::max(min.x + width * pass.LastMs / span, min.x + 1.0f), min.y + rowHeight - 1.0f);
+            drawList->AddRectFilled(min, max, ImColor::HSV(i * 0.13f, 0.6f, 0.8f));
+            if (max.x - min.x > ImGui::CalcTextSize(pass.Name).x + 4.0f)
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_WHITE, pass.Name);
+            if (ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s: %.3f ms", pass.Name, pass.LastMs);
+            rows = std::max(rows, pass.Depth + 1);
+        }
+        ImGui::Dummy(ImVec2(width, rows * rowHeight));
+
+        ImGui::Separator();
+        ImGui::Text("Last frame:");
+        for (const rg::metrics::MetricSample& sample : programState->Metrics)
+            ImGui::Text("%-26s %10lld", sample.Name.c_str(), (long long) sample.LastFrame);
+        ImGui::End();
+    }
+    {
+        ImGui::Begin("Jobs");
+        ImGui::Text("Draws: %zu", programState->DrawCount);
+        const std::vector<rg::WorkerStats>& stats = programState->JobStats;
+        double window = programState->JobStatsSeconds > 0.0 ? programState->JobStatsSeconds : 1.0;
+        for (size_t i = 0; i < stats.size(); ++i) {
+            float busy = (float) (stats[i].BusyNanoseconds * 1e-9 / window);
+            ImGui::Text("%s %zu: %5.0f jobs/s, %4.0f stolen/s", i == 0 ? "main  " : "worker", i,
+                        stats[i].JobsExecuted / window, stats[i].JobsStolen / window);
+            ImGui::SameLine();
+            ImGui::ProgressBar(busy, ImVec2(120.0f, 0.0f));
+        }
         ImGui::End();
     }
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
@@ -726,6 +1554,70 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
         }
     }
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+        bloomMethod = bloomMethod == rg::BloomMethod::MipChain ? rg::BloomMethod::PingPong : rg::BloomMethod::MipChain;
+        std::cout << "Bloom: " << rg::BloomMethodName(bloomMethod) << std::endl;
+    }
+    if (key == GLFW_KEY_F7 && action == GLFW_PRESS) {
+        depthPrepass = depthPrepass == 0 ? rg::DepthPrepassOpaque
+                                         : depthPrepass == rg::DepthPrepassOpaque ? rg::DepthPrepassAll : 0;
+        std::cout << "Depth pre-pass: " << rg::DepthPrepassName((std::uint8_t) depthPrepass) << std::endl;
+    }
+    if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+        shadowSettings.Enabled = !shadowSettings.Enabled;
+        std::cout << "Shadows: " << (shadowSettings.Enabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+        useLightmaps = !useLightmaps;
+        std::cout << "Lightmaps: " << (useLightmaps ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+        useProbes = !useProbes;
+        std::cout << "Irradiance probes: " << (useProbes ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
+        useOit = !useOit;
+        std::cout << "Transparency: " << (useOit ? "weighted blended" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+        dynamicResolution.Enabled = !dynamicResolution.Enabled;
+        std::cout << "Dynamic resolution: " << (dynamicResolution.Enabled ? "on" : "off") << std::endl;
+    }
+    // CPU profiler trace of the newest events of every thread, open it in chrome://tracing or ui.perfetto.dev
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+        if (rg::profiler::WriteChromeTrace("trace.json"))
+            std::cout << "Wrote trace.json" << std::endl;
+    }
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+        if (programState->Recorder.Recording()) {
+            size_t frames = programState->Recorder.Size();
+            if (programState->Recorder.Stop(programState->RecordingFile))
+                std::cout << "Wrote " << frames << " frames to " << programState->RecordingFile << std::endl;
+        } else {
+            programState->Playing = false;
+            programState->Recorder.Start(glfwGetTime());
+            std::cout << "Recording camera" << std::endl;
+        }
+    }
+    if (key == GLFW_KEY_F6 && action == GLFW_PRESS) {
+        if (programState->Playing) {
+            programState->Playing = false;
+        } else if (!programState->Recorder.Recording() && programState->Playback.Load(programState->RecordingFile)) {
+            programState->Playing = true;
+            programState->PlaybackStart = glfwGetTime();
+        }
+    }
+}
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    // only while the cursor is free, and only for clicks ImGui does not want for itself
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS || !programState->ImGuiEnabled)
+        return;
+    if (ImGui::GetCurrentContext() && ImGui::GetIO().WantCaptureMouse)
+        return;
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    programState->PickCursor = glm::vec2((float) x, (float) y);
+    programState->PickRequested = true;
 }
 unsigned int loadCubemap(vector<std::string> faces)
 {
@@ -740,6 +1632,7 @@ unsigned int loadCubemap(vector<std::string> faces)
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            rg::metrics::Render().BytesUploaded.Add((std::uint64_t) width * height * 3);
             stbi_image_free(data);
         }
         else
@@ -753,6 +1646,7 @@ unsigned int loadCubemap(vector<std::string> faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    rg::metrics::Render().GlObjects.Add();
     return textureID;
 }
 
@@ -812,6 +1706,8 @@ void renderCube()
         // fill buffer
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        rg::metrics::Render().GlObjects.Add(2);
+        rg::metrics::Render().BytesUploaded.Add(sizeof(vertices));
         // link vertex attributes
         glBindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
@@ -827,6 +1723,9 @@ void renderCube()
     glBindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
+    rg::metrics::Render().VaoBinds.Add();
+    rg::metrics::Render().DrawCalls.Add();
+    rg::metrics::Render().Triangles.Add(12);
 }
 
 
@@ -850,6 +1749,8 @@ unsigned int loadTexture(char const * path)
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        rg::metrics::Render().GlObjects.Add();
+        rg::metrics::Render().BytesUploaded.Add((std::uint64_t) width * height * nrComponents);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
@@ -887,6 +1788,8 @@ void renderQuad()
         glBindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        rg::metrics::Render().GlObjects.Add(2);
+        rg::metrics::Render().BytesUploaded.Add(sizeof(quadVertices));
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -895,4 +1798,7 @@ void renderQuad()
     glBindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
+    rg::metrics::Render().VaoBinds.Add();
+    rg::metrics::Render().DrawCalls.Add();
+    rg::metrics::Render().Triangles.Add(2);
 }
@@ -0,0 +1,92 @@
+// Dynamic resolution controller against a simulated GPU: frame cost partly fixed and partly going with
+// the pixel count, reported GPU_PROFILER_FRAMES frames late with some noise, like the real profiler.
+#include <rg/DynamicResolution.h>
+#include "test_util.h"
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+
+namespace {
+
+struct Run {
+    float FinalScale = 1.0f;
+    float FinalMs = 0.0f; // cost of a frame at the final scale, without noise
+    int Changes = 0; // scale changes over the whole run
+    int LateChanges = 0; // over its second half
+};
+
+Run simulate(const rg::DynamicResolutionSettings& settings, float fixedMs, float pixelMs, int frames) {
+    rg::DynamicResolution controller;
+    std::deque<float> inFlight;
+    Random uniform(12345);
+    Run run;
+    float scale = controller.Scale();
+    for (int frame = 0; frame < frames; ++frame) {
+        float noise = uniform(0.95f, 1.05f);
+        inFlight.push_back((fixedMs + pixelMs * scale * scale) * noise);
+        float gpuMs = 0.0f;
+        if (inFlight.size() > 4) {
+            gpuMs = inFlight.front();
+            inFlight.pop_front();
+        }
+        float next = controller.Update(settings, gpuMs);
+        if (next != scale) {
+            ++run.Changes;
+            if (frame >= frames / 2)
+                ++run.LateChanges;
+        }
+        scale = next;
+    }
+    run.FinalScale = scale;
+    run.FinalMs = fixedMs + pixelMs * scale * scale;
+    return run;
+}
+
+}
+
+int main() {
+    rg::DynamicResolutionSettings settings;
+    settings.Enabled = true;
+    settings.TargetMs = 8.0f;
+
+    // too slow at full size, fast enough around 75%: settles under the target and stays there
+    Run heavy = simulate(settings, 1.0f, 12.0f, 600);
+    check(heavy.FinalScale < 1.0f && heavy.FinalScale >= 0.5f, "heavy load: scale didn't drop");
+    check(heavy.FinalMs <= settings.TargetMs, "heavy load: still over the target");
+    check(heavy.FinalMs >= 0.6f * settings.TargetMs, "heavy load: scale dropped much further than needed");
+    check(heavy.LateChanges == 0, "heavy load: scale still changing after settling");
+    check(heavy.Changes <= 4, "heavy load: too many steps to settle");
+
+    // can't reach the target at all: stops at the minimum
+    Run overload = simulate(settings, 6.0f, 40.0f, 600);
+    check(std::fabs(overload.FinalScale - settings.MinScale) < 1e-4f, "overload: not at the minimum scale");
+
+    // comfortably fast: never leaves full size
+    Run light = simulate(settings, 1.0f, 4.0f, 600);
+    check(light.FinalScale == 1.0f && light.Changes == 0, "light load: scale changed");
+
+    // a load that goes away again: back up to full size
+    {
+        rg::DynamicResolution controller;
+        for (int frame = 0; frame < 200; ++frame)
+            controller.Update(settings, 20.0f);
+        check(controller.Scale() < 1.0f, "spike: scale didn't drop");
+        for (int frame = 0; frame < 200; ++frame)
+            controller.Update(settings, 1.0f + 4.0f * controller.Scale() * controller.Scale());
+        check(controller.Scale() == 1.0f, "spike: scale didn't recover");
+    }
+
+    // disabled, or a range that doesn't allow anything else: fixed scale
+    rg::DynamicResolutionSettings disabled = settings;
+    disabled.Enabled = false;
+    check(simulate(disabled, 1.0f, 40.0f, 300).FinalScale == 1.0f, "disabled: scale changed");
+    rg::DynamicResolutionSettings pinned = settings;
+    pinned.MinScale = pinned.MaxScale = 0.75f;
+    Run pinnedRun = simulate(pinned, 1.0f, 40.0f, 300);
+    check(std::fabs(pinnedRun.FinalScale - 0.75f) < 1e-4f && pinnedRun.Changes == 1, "pinned range: scale moved");
+
+    if (failures == 0)
+        std::printf("dynamic resolution tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+// Steady-state frames don't touch the heap: once a loop of camera views has been seen, filling frame
+// packets on the job system (transforms, draw list, light clusters, shadow cascades, the UI copy) and
+// consuming them on a render thread that takes its scratch from a FrameAllocator reaches neither
+// operator new nor ImGui's allocator, on any thread. Also the FrameAllocator on its own, and the
+// precomputed sampler units of Mesh::Draw against a recording stand-in for GL.
+#include <learnopengl/filesystem.h>
+#include <learnopengl/mesh.h>
+#include <rg/FrameAllocator.h>
+#include <rg/FramePacket.h>
+#include <rg/SceneJobs.h>
+#include "test_util.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<long> allocations{0};
+
+void* countedAlloc(size_t size, void*) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size);
+}
+
+void countedFree(void* p, void*) {
+    std::free(p);
+}
+
+}
+
+// The replaceable allocation functions, counted, with every delete form to match. They are kept out of
+// line: inlined, GCC pairs their malloc and free with the new and delete expressions at the call site
+// and warns (-Wmismatched-new-delete).
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+Random uniform(31);
+
+// the camera and the moving crate go round a loop of VIEWS frames
+const int VIEWS = 16;
+const int WARMUP_FRAMES = 2 * VIEWS;
+const int MEASURED_FRAMES = 4 * VIEWS;
+
+void frameAllocatorTests() {
+    rg::FrameAllocator frame(256);
+    char* c = frame.Allocate<char>(3, 'x');
+    double* d = frame.Allocate<double>(5, 1.5);
+    glm::vec4* v = frame.Allocate<glm::vec4>(4, glm::vec4(-1.0f));
+    check(c[2] == 'x' && d[4] == 1.5 && v[3] == glm::vec4(-1.0f), "frame allocations not filled");
+    check((std::uintptr_t) d % alignof(double) == 0 && (std::uintptr_t) v % alignof(glm::vec4) == 0,
+          "frame allocations misaligned");
+    check((void*) d != (void*) c && (void*) v != (void*) d, "frame allocations overlap");
+    frame.Reset();
+    check(frame.Used() == 0 && frame.Allocate<char>(3) == c, "reset doesn't start over");
+
+    // a frame that outgrows the block: the next Reset makes room for all of it at once
+    frame.Reset();
+    for (int i = 0; i < 8; ++i)
+        frame.Allocate<float>(32);
+    size_t used = frame.Used();
+    check(used >= 8 * 32 * sizeof(float), "overflow not counted");
+    frame.Reset();
+    check(frame.Capacity() >= used, "reset didn't grow to the frame");
+    long before = allocations.load();
+    for (int i = 0; i < 8; ++i)
+        frame.Allocate<float>(32);
+    frame.Reset();
+    check(allocations.load() == before, "a frame that fits still allocates");
+}
+
+
+// What the GL calls of Shader, Mesh::SetSamplerUnits and Mesh::Draw leave behind. Uniform locations
+// are indices into uniformNames; the draw path only touches the fixed arrays, so it can be counted.
+std::vector<std::string> uniformNames;
+std::vector<int> uniformValues;
+GLuint boundTextures[32];
+int activeUnit = 0;
+int drawnElements = 0;
+
+GLuint APIENTRY fakeCreate(GLenum) { return 1; }
+GLuint APIENTRY fakeCreateProgram() { return 7; }
+void APIENTRY fakeShaderSource(GLuint, GLsizei, const GLchar* const*, const GLint*) {}
+void APIENTRY fakeObject(GLuint) {}
+void APIENTRY fakeAttach(GLuint, GLuint) {}
+void APIENTRY fakeStatus(GLuint, GLenum, GLint* params) { *params = GL_TRUE; }
+
+GLint APIENTRY fakeGetUniformLocation(GLuint, const GLchar* name) {
+    for (size_t i = 0; i < uniformNames.size(); ++i)
+        if (uniformNames[i] == name)
+            return (GLint) i;
+    uniformNames.push_back(name);
+    uniformValues.push_back(-1);
+    return (GLint) uniformNames.size() - 1;
+}
+
+void APIENTRY fakeUniform1i(GLint location, GLint value) {
+    uniformValues[location] = value;
+}
+
+void APIENTRY fakeActiveTexture(GLenum unit) {
+    activeUnit = (int) (unit - GL_TEXTURE0);
+}
+
+void APIENTRY fakeBindTexture(GLenum, GLuint texture) {
+    boundTextures[activeUnit] = texture;
+}
+
+void APIENTRY fakeDrawElements(GLenum, GLsizei count, GLenum, const void*) {
+    drawnElements += count;
+}
+
+int uniformValue(const std::string& name) {
+    for (size_t i = 0; i < uniformNames.size(); ++i)
+        if (uniformNames[i] == name)
+            return uniformValues[i];
+    return -1;
+}
+
+void samplerUnitTests() {
+    glad_glCreateShader = fakeCreate;
+    glad_glShaderSource = fakeShaderSource;
+    glad_glCompileShader = fakeObject;
+    glad_glGetShaderiv = fakeStatus;
+    glad_glCreateProgram = fakeCreateProgram;
+    glad_glAttachShader = fakeAttach;
+    glad_glLinkProgram = fakeObject;
+    glad_glGetProgramiv = fakeStatus;
+    glad_glDeleteShader = fakeObject;
+    glad_glUseProgram = fakeObject;
+    glad_glGetUniformLocation = fakeGetUniformLocation;
+    glad_glUniform1i = fakeUniform1i;
+    glad_glActiveTexture = fakeActiveTexture;
+    glad_glBindTexture = fakeBindTexture;
+    glad_glBindVertexArray = fakeObject;
+    glad_glDrawElements = fakeDrawElements;
+
+    // a third diffuse map is past TEXTURES_PER_TYPE, an unknown type has no sampler
+    vector<Texture> textures = {{11, "texture_diffuse", ""}, {12, "texture_specular", ""},
+                                {13, "texture_diffuse", ""}, {14, "texture_diffuse", ""},
+                                {15, "texture_emissive", ""}, {16, "texture_normal", ""},
+                                {17, "texture_height", ""}, {18, "texture_specular", ""}};
+    Mesh mesh(vector<Vertex>(4), {0, 1, 2, 2, 3, 0}, textures, false);
+    const int units[] = {0, 1, 4, -1, -1, 2, 3, 5};
+    check(mesh.textureUnits.size() == textures.size(), "a texture without a unit");
+    for (size_t i = 0; i < textures.size(); ++i)
+        check(mesh.textureUnits[i] == units[i], "texture on the wrong unit");
+
+    Shader shader(FileSystem::getPath("resources/shaders/object.vs").c_str(),
+                  FileSystem::getPath("resources/shaders/object.fs").c_str());
+    Mesh::SetSamplerUnits(shader, "material.");
+    check(uniformNames.size() == TEXTURE_TYPE_COUNT * TEXTURES_PER_TYPE, "samplers not all set");
+    // each texture's unit is the one its sampler, <type>N in loader order, was pointed at
+    int count[TEXTURE_TYPE_COUNT] = {};
+    for (size_t i = 0; i < textures.size(); ++i)
+        for (int type = 0; type < TEXTURE_TYPE_COUNT; ++type)
+            if (textures[i].type == TEXTURE_TYPES[type] && ++count[type] <= TEXTURES_PER_TYPE)
+                check(uniformValue("material." + textures[i].type + std::to_string(count[type])) ==
+                      mesh.textureUnits[i], "sampler and texture on different units");
+
+    // Draw binds every texture with a unit there, and nothing else, without allocating
+    mesh.Draw(shader);
+    for (GLuint& texture : boundTextures)
+        texture = 0;
+    drawnElements = 0;
+    long before = allocations.load();
+    mesh.Draw(shader);
+    check(allocations.load() == before, "Mesh::Draw allocates");
+    for (size_t i = 0; i < textures.size(); ++i)
+        if (units[i] >= 0)
+            check(boundTextures[units[i]] == textures[i].id, "texture not bound to its unit");
+    for (GLuint texture : boundTextures)
+        check(texture != 14 && texture != 15, "texture without a unit bound");
+    check(drawnElements == 6 && activeUnit == 0, "draw not issued or unit left active");
+}
+
+}
+
+int main() {
+    frameAllocatorTests();
+    samplerUnitTests();
+
+    ImGui::SetAllocatorFunctions(countedAlloc, countedFree);
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(1280.0f, 720.0f);
+    io.DeltaTime = 1.0f / 60.0f;
+    unsigned char* fontPixels;
+    int fontWidth, fontHeight;
+    io.Fonts->GetTexDataAsRGBA32(&fontPixels, &fontWidth, &fontHeight);
+
+    rg::Scene scene;
+    rg::Aabb unitBox(glm::vec3(-0.5f), glm::vec3(0.5f));
+    for (int i = 0; i < 20000; ++i)
+        scene.CreateRenderable((std::uint16_t) (i % 3), (std::uint16_t) (i % 4), unitBox,
+                               glm::vec3(uniform(-90.0f, 90.0f), 0.0f, uniform(-90.0f, 90.0f)), uniform(0.0f, 6.0f),
+                               glm::vec3(uniform(0.5f, 2.0f)), i % 50 == 0 ? rg::RenderFlagDynamic : 0);
+    rg::Entity crate = scene.CreateRenderable(0, 0, unitBox, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f),
+                                              rg::RenderFlagDynamic);
+    rg::LightDesc sun;
+    sun.Type = rg::LightDirectional;
+    sun.Direction = glm::vec3(-0.2f, -1.0f, 0.3f);
+    scene.CreateLight(sun);
+    for (int i = 0; i < 200; ++i) {
+        rg::LightDesc light;
+        light.Type = rg::LightPoint;
+        light.Position = glm::vec3(uniform(-60.0f, 60.0f), 1.0f, uniform(-60.0f, 60.0f));
+        light.Diffuse = glm::vec3(1.0f);
+        light.Linear = 0.09f;
+        light.Quadratic = 0.032f;
+        scene.CreateLight(light);
+    }
+
+    rg::JobSystem jobs(3);
+    rg::DrawListBuilder drawListBuilder;
+    rg::ShadowCascades shadowCascades;
+    rg::ShadowSettings shadowSettings;
+    shadowSettings.Enabled = true;
+    rg::FramePipeline<rg::FramePacket> pipeline;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+
+    // what the render thread does without GL: per-material scratch from the frame allocator, a pass
+    // over the draws and the UI lists
+    std::atomic<std::uint64_t> rendered{0}, drawn{0};
+    std::thread renderThread([&] {
+        rg::FrameAllocator scratch;
+        while (const rg::FramePacket* packet = pipeline.AcquireForRead()) {
+            scratch.Reset();
+            bool* prepared = scratch.Allocate<bool>(4, false);
+            glm::vec4* rects = scratch.Allocate<glm::vec4>(4, glm::vec4(-1.0f));
+            for (const rg::DrawItem& item : packet->Draws) {
+                prepared[item.Material] = true;
+                rects[item.Material] = glm::vec4(item.World[3]);
+            }
+            ImDrawData ui = packet->Ui.View();
+            drawn.fetch_add(packet->Draws.size() + (size_t) ui.TotalVtxCount, std::memory_order_relaxed);
+            rendered.fetch_add(1, std::memory_order_relaxed);
+            pipeline.Release(packet);
+        }
+    });
+
+    long start = 0;
+    for (int frame = 0; frame < WARMUP_FRAMES + MEASURED_FRAMES; ++frame) {
+        if (frame == WARMUP_FRAMES)
+            start = allocations.load();
+        float angle = 6.2831853f * (float) (frame % VIEWS) / VIEWS;
+        glm::vec3 position(10.0f * std::cos(angle), 2.0f, 10.0f * std::sin(angle));
+        glm::mat4 view = glm::lookAt(position, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        scene.SetPosition(crate, glm::vec3(2.0f * std::sin(angle), 0.5f, 2.0f * std::cos(angle)));
+
+        // the update thread's part of the frame, as fillFramePacket does it
+        rg::UpdateTransforms(scene, jobs);
+        rg::FramePacket* packet = pipeline.AcquireForWrite();
+        packet->Frame = (std::uint64_t) frame;
+        packet->Projection = projection;
+        packet->View = view;
+        drawListBuilder.Build(scene, rg::Frustum(projection * view), position, jobs, packet->Draws);
+        packet->Lights = scene.Lights;
+        packet->Clusters.Build(scene.Lights, projection, view);
+        shadowCascades.Update(shadowSettings, scene, projection, view, packet->Shadows);
+
+        ImGui::NewFrame();
+        ImGui::Begin("Stats");
+        ImGui::Text("frame %d, %d draws", frame, (int) packet->Draws.size());
+        ImGui::End();
+        ImGui::Render();
+        packet->Ui.Capture(ImGui::GetDrawData());
+        pipeline.Submit(packet);
+    }
+    pipeline.Close();
+    renderThread.join();
+    long steady = allocations.load() - start;
+
+    check(rendered.load() == WARMUP_FRAMES + MEASURED_FRAMES, "render thread missed frames");
+    check(drawn.load() > 0, "nothing drawn");
+    if (steady != 0)
+        std::printf("%ld allocations in %d steady-state frames\n", steady, MEASURED_FRAMES);
+    check(steady == 0, "steady-state frames allocate");
+
+    ImGui::DestroyContext();
+    if (failures == 0)
+        std::printf("frame allocation tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
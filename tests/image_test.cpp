@@ -0,0 +1,80 @@
+// Image comparison behind the golden-image test: tolerance to small shading noise, sensitivity to
+// real changes, PPM round trip and downsampling.
+#include <rg/Image.h>
+#include "test_util.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+rg::Image gradient(int width, int height) {
+    rg::Image image;
+    image.Width = width;
+    image.Height = height;
+    image.Pixels.resize((size_t) width * height * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            std::uint8_t* p = &image.Pixels[((size_t) y * width + x) * 3];
+            p[0] = (std::uint8_t) (x * 255 / width);
+            p[1] = (std::uint8_t) (y * 255 / height);
+            p[2] = 96;
+        }
+    }
+    return image;
+}
+
+}
+
+int main() {
+    rg::Image a = gradient(64, 48);
+
+    rg::ImageDifference same = rg::CompareImages(a, a, 2.3);
+    check(same.MeanDeltaE == 0.0 && same.FractionOver == 0.0, "identical images differ");
+
+    // one step of 8-bit noise everywhere is below what anyone sees
+    rg::Image noisy = a;
+    for (size_t i = 0; i < noisy.Pixels.size(); i += 7)
+        noisy.Pixels[i] = (std::uint8_t) (noisy.Pixels[i] < 255 ? noisy.Pixels[i] + 1 : 254);
+    rg::ImageDifference noise = rg::CompareImages(a, noisy, 2.3);
+    check(noise.FractionOver == 0.0 && noise.MaxDeltaE < 2.3, "one step of noise is over the threshold");
+
+    // a broken object: every pixel of a 16x12 block turned red has to be counted
+    rg::Image broken = a;
+    for (int y = 10; y < 22; ++y) {
+        for (int x = 20; x < 36; ++x) {
+            std::uint8_t* p = &broken.Pixels[((size_t) y * a.Width + x) * 3];
+            p[0] = 255;
+            p[1] = 0;
+            p[2] = 0;
+        }
+    }
+    rg::ImageDifference block = rg::CompareImages(a, broken, 10.0);
+    double expected = 16.0 * 12.0 / (64.0 * 48.0);
+    check(block.FractionOver > expected * 0.9 && block.FractionOver <= expected, "changed block not detected");
+    check(block.MaxDeltaE > 50.0, "red block difference too small");
+
+    rg::Image smaller = gradient(32, 48);
+    check(rg::CompareImages(a, smaller, 10.0).FractionOver == 1.0, "different sizes compare equal");
+
+    // 2x2 averages, rounded
+    rg::Image checker;
+    checker.Width = 4;
+    checker.Height = 2;
+    checker.Pixels = {0, 0, 0, 255, 255, 255, 10, 10, 10, 20, 20, 20,
+                      255, 255, 255, 0, 0, 0, 30, 30, 30, 40, 40, 40};
+    rg::Image half = rg::Downsample(checker, 2);
+    check(half.Width == 2 && half.Height == 1, "downsampled size");
+    check(half.Pixels.size() == 6 && half.Pixels[0] == 128 && half.Pixels[3] == 25, "downsampled values");
+
+    std::string path = "image_test.ppm";
+    rg::Image read;
+    check(rg::WritePpm(path, a) && rg::ReadPpm(path, read), "ppm write/read");
+    check(read.Width == a.Width && read.Height == a.Height && read.Pixels == a.Pixels, "ppm round trip");
+    std::remove(path.c_str());
+    check(!rg::ReadPpm("does_not_exist.ppm", read), "missing ppm reads");
+
+    if (failures == 0)
+        std::printf("image tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
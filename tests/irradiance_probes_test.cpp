@@ -0,0 +1,159 @@
+// Spherical-harmonics probes on the CPU: the cubemap lookup agrees with the face layout, a constant
+// sky projects to exactly its radiance, a sky lit from above lights upward normals more, probes under
+// an occluder get less light than open ones, the grid spans the static scene, and the result doesn't
+// depend on the worker count.
+#include <rg/IrradianceProbes.h>
+#include "test_util.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+rg::Cubemap constantSky(int size, const glm::vec3& radiance) {
+    rg::Cubemap sky;
+    sky.Size = size;
+    for (std::vector<glm::vec3>& face : sky.Faces)
+        face.assign((size_t) size * size, radiance);
+    return sky;
+}
+
+bool near(const glm::vec3& a, const glm::vec3& b, float tolerance) {
+    return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance && std::fabs(a.z - b.z) <= tolerance;
+}
+
+// 0.5 x 0.5 x 0.5 box around the origin as two triangles per face
+void cube(std::vector<glm::vec3>& positions, std::vector<std::uint32_t>& indices) {
+    for (int axis = 0; axis < 3; ++axis) {
+        for (float sign : {-1.0f, 1.0f}) {
+            glm::vec3 n(0.0f), u(0.0f), v(0.0f);
+            n[axis] = sign * 0.5f;
+            u[(axis + 1) % 3] = 0.5f;
+            v[(axis + 2) % 3] = 0.5f * sign;
+            std::uint32_t base = (std::uint32_t) positions.size();
+            for (const glm::vec3& p : {n - u - v, n + u - v, n + u + v, n - u + v})
+                positions.push_back(p);
+            for (std::uint32_t i : {0u, 1u, 2u, 0u, 2u, 3u})
+                indices.push_back(base + i);
+        }
+    }
+}
+
+}
+
+int main() {
+    rg::JobSystem jobs(3), serial(0);
+
+    // every texel's direction looks the texel up again
+    rg::Cubemap labelled = constantSky(8, glm::vec3(0.0f));
+    for (int face = 0; face < 6; ++face)
+        for (size_t i = 0; i < labelled.Faces[face].size(); ++i)
+            labelled.Faces[face][i] = glm::vec3((float) face, (float) i, 0.0f);
+    bool roundTrip = true;
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < labelled.Size; ++y) {
+            for (int x = 0; x < labelled.Size; ++x) {
+                float solidAngle;
+                glm::vec3 d = labelled.Direction(face, x, y, solidAngle);
+                roundTrip &= labelled.Sample(d) == glm::vec3((float) face, (float) (y * labelled.Size + x), 0.0f);
+            }
+        }
+    }
+    check(roundTrip, "cubemap direction and lookup disagree");
+    // +Y is up, and the texel solid angles add up to the sphere
+    check(labelled.Sample(glm::vec3(0.0f, 1.0f, 0.0f)).x == 2.0f, "+Y face isn't up");
+    float sphere = 0.0f;
+    for (int face = 0; face < 6; ++face)
+        for (int y = 0; y < labelled.Size; ++y)
+            for (int x = 0; x < labelled.Size; ++x) {
+                float solidAngle;
+                labelled.Direction(face, x, y, solidAngle);
+                sphere += solidAngle;
+            }
+    check(std::fabs(sphere - 4.0f * 3.14159265f) < 0.05f, "texel solid angles don't cover the sphere");
+
+    // a constant sky lights every normal with its radiance
+    glm::vec3 grey(0.3f, 0.5f, 0.7f);
+    rg::ShL2 constant = rg::ShConvolveLambert(rg::ProjectCubemap(constantSky(32, grey), jobs));
+    bool flat = true;
+    for (const glm::vec3& n : {glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+                               glm::normalize(glm::vec3(1.0f, -2.0f, 3.0f))})
+        flat &= near(rg::ShEvaluate(constant, n), grey, 0.01f);
+    check(flat, "constant sky doesn't give constant irradiance");
+
+    // a bright top face
+    rg::Cubemap dusk = constantSky(32, glm::vec3(0.05f));
+    dusk.Faces[2].assign(dusk.Faces[2].size(), glm::vec3(1.0f));
+    rg::ShL2 duskSh = rg::ShConvolveLambert(rg::ProjectCubemap(dusk, jobs));
+    glm::vec3 up = rg::ShEvaluate(duskSh, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec3 side = rg::ShEvaluate(duskSh, glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::vec3 down = rg::ShEvaluate(duskSh, glm::vec3(0.0f, -1.0f, 0.0f));
+    check(up.x > side.x && side.x > down.x, "sky lit from above doesn't light upward normals most");
+    check(rg::ProjectCubemap(dusk, serial).C[6] == rg::ProjectCubemap(dusk, jobs).C[6],
+          "sky projection depends on the worker count");
+
+    // a 10 x 10 slab for a floor, 0.2 thick, with a 2 x 2 x 2 crate floating above its middle, the sun straight down
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    cube(positions, indices);
+    std::vector<rg::MeshBvh> bvhs(1);
+    bvhs[0].Build(positions, indices);
+    rg::Scene scene;
+    scene.FindOrAddMaterial("object");
+    rg::Aabb box(glm::vec3(-0.5f), glm::vec3(0.5f));
+    scene.CreateRenderable(0, 0, box, glm::vec3(0.0f, -0.1f, 0.0f), 0.0f, glm::vec3(10.0f, 0.2f, 10.0f));
+    scene.CreateRenderable(0, 0, box, glm::vec3(0.0f, 3.0f, 0.0f), 0.0f, glm::vec3(2.0f));
+    scene.CreateRenderable(0, 0, box, glm::vec3(20.0f, 1.0f, 20.0f), 0.0f, glm::vec3(1.0f), rg::RenderFlagDynamic);
+    rg::LightDesc sun;
+    sun.Type = rg::LightDirectional;
+    sun.Direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    sun.Ambient = glm::vec3(0.1f);
+    sun.Diffuse = glm::vec3(0.8f);
+    scene.CreateLight(sun);
+    rg::UpdateTransforms(scene);
+
+    rg::StaticSceneLighting lighting;
+    lighting.Build(scene, bvhs);
+    rg::Cubemap sky = constantSky(16, glm::vec3(1.0f));
+    rg::ProbeSettings settings;
+    settings.Rays = 256;
+    rg::IrradianceProbeGrid grid;
+    std::uint64_t rays = rg::ComputeIrradianceProbes(scene, lighting, sky, settings, jobs, grid);
+    check(rays > 0 && !grid.Empty(), "no probes traced");
+    // static bounds only: the slab and the crate, not the dynamic box far away
+    glm::vec3 last = grid.Min + grid.Cell * glm::vec3((float) grid.Size[0], (float) grid.Size[1], (float) grid.Size[2]);
+    check(near(grid.Min, glm::vec3(-5.0f, -0.2f, -5.0f), 1e-4f) && near(last, glm::vec3(5.0f, 4.0f, 5.0f), 1e-4f),
+          "grid doesn't span the static bounds");
+    check(grid.Cell.x <= settings.Spacing + 1e-4f && grid.Cell.y <= settings.Spacing + 1e-4f,
+          "probes further apart than the spacing");
+    check(grid.Probes.size() == (size_t) grid.Size[0] * grid.Size[1] * grid.Size[2], "probe count off");
+
+    glm::vec3 upward(0.0f, 1.0f, 0.0f);
+    glm::vec3 covered = grid.Irradiance(glm::vec3(0.0f, 0.5f, 0.0f), upward);
+    glm::vec3 open = grid.Irradiance(glm::vec3(4.5f, 0.5f, 4.5f), upward);
+    check(covered.x < open.x * 0.8f, "probes under the crate aren't darker than open ones");
+    check(open.x > 0.5f && open.x <= 1.01f, "open probe doesn't see the sky");
+    // looking down at the sunlit floor: its bounce, Albedo times the sun's diffuse
+    glm::vec3 floorBounce = grid.Irradiance(glm::vec3(4.5f, 0.5f, 4.5f), glm::vec3(0.0f, -1.0f, 0.0f));
+    check(std::fabs(floorBounce.x - settings.Albedo * 0.8f) < 0.1f, "downward irradiance doesn't come from the floor");
+    // outside the grid it clamps to the border probes
+    check(grid.Irradiance(glm::vec3(50.0f, 0.5f, 4.5f), upward) == grid.Irradiance(glm::vec3(5.0f, 0.5f, 4.5f), upward),
+          "irradiance outside the grid not clamped");
+
+    rg::IrradianceProbeGrid serialGrid;
+    check(rg::ComputeIrradianceProbes(scene, lighting, sky, settings, serial, serialGrid) == rays,
+          "ray count depends on the worker count");
+    bool same = serialGrid.Probes.size() == grid.Probes.size();
+    for (size_t i = 0; same && i < grid.Probes.size(); ++i)
+        for (int k = 0; k < rg::SH_COEFFICIENTS; ++k)
+            same &= serialGrid.Probes[i].C[k] == grid.Probes[i].C[k];
+    check(same, "probes depend on the worker count");
+
+    rg::Scene empty;
+    check(rg::ComputeIrradianceProbes(empty, lighting, sky, settings, jobs, grid) == 0 && grid.Empty(),
+          "empty scene has probes");
+
+    if (failures == 0)
+        std::printf("irradiance probe tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// Light clusters against brute force: for points all over the view frustum, every point light whose range
+// reaches the point has to be in the list of the point's cluster, found the way the shaders find it. Then
+// the SIMD builds have to produce exactly what the scalar one does.
+#include <rg/ClusteredLights.h>
+#include "test_util.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+Random uniform(2024);
+
+void addLight(rg::LightTable& t, const glm::vec3& position, float linear, float quadratic, std::uint16_t material) {
+    t.Owner.push_back((rg::Entity) t.Owner.size());
+    t.Type.push_back(rg::LightPoint);
+    t.Material.push_back(material);
+    t.Position.Push(position);
+    t.Direction.Push(glm::vec3(0.0f, -1.0f, 0.0f));
+    t.Ambient.Push(glm::vec3(0.05f));
+    t.Diffuse.Push(glm::vec3(uniform(0.2f, 1.0f), uniform(0.2f, 1.0f), uniform(0.2f, 1.0f)));
+    t.Specular.Push(glm::vec3(0.5f));
+    t.Constant.push_back(1.0f);
+    t.Linear.push_back(linear);
+    t.Quadratic.push_back(quadratic);
+}
+
+// cluster of a view space point, as object.fs computes it for the fragment there
+int clusterOf(const rg::LightClusters& clusters, const glm::mat4& projection, const glm::vec3& viewPoint,
+              int width, int height) {
+    glm::vec4 clip = projection * glm::vec4(viewPoint, 1.0f);
+    glm::vec2 window = (glm::vec2(clip.x, clip.y) / clip.w * 0.5f + 0.5f) * glm::vec2(width, height);
+    int x = std::min(std::max((int) (window.x / ((float) width / rg::CLUSTER_X)), 0), rg::CLUSTER_X - 1);
+    int y = std::min(std::max((int) (window.y / ((float) height / rg::CLUSTER_Y)), 0), rg::CLUSTER_Y - 1);
+    return x + rg::CLUSTER_X * (y + rg::CLUSTER_Y * clusters.Slice(-viewPoint.z));
+}
+
+bool listed(const rg::LightClusters& clusters, int cluster, std::uint16_t light) {
+    std::uint32_t first = clusters.Cells[2 * cluster], count = clusters.Cells[2 * cluster + 1];
+    for (std::uint32_t i = first; i < first + count; ++i) {
+        if (clusters.Indices[i] == light)
+            return true;
+    }
+    return false;
+}
+
+}
+
+int main() {
+    const int width = 1280, height = 720;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float) width / height, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 2.0f, 10.0f), glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 inverseView = glm::inverse(view);
+
+    rg::LightTable table;
+    for (int i = 0; i < 400; ++i)
+        addLight(table, glm::vec3(uniform(-60.0f, 60.0f), uniform(0.0f, 4.0f), uniform(-60.0f, 60.0f)), 0.35f, 0.44f,
+                 i % 5 == 0 ? 1 : rg::AllMaterials);
+    // a few wide ones and one right on the camera
+    for (int i = 0; i < 4; ++i)
+        addLight(table, glm::vec3(uniform(-10.0f, 10.0f), 1.0f, uniform(-30.0f, 0.0f)), 0.09f, 0.032f, rg::AllMaterials);
+    addLight(table, glm::vec3(3.0f, 2.0f, 10.0f), 0.7f, 1.8f, rg::AllMaterials);
+
+    rg::LightClusters clusters;
+    clusters.Build(table, projection, view, rg::GetBatchKernels(rg::SimdLevel::Scalar));
+    check(clusters.Dropped == 0, "lights or pairs dropped");
+    check(std::fabs(clusters.Near - 0.1f) < 1e-4f && std::fabs(clusters.Far - 100.0f) < 0.1f,
+          "near and far planes not recovered from the projection");
+    check(clusters.LightCount() > 0 && clusters.LightCount() < table.Size(), "lights out of view not culled");
+
+    // brute force over random points in the frustum
+    int covered = 0;
+    for (int sample = 0; sample < 20000; ++sample) {
+        float depth = 0.1f * std::pow(1000.0f, uniform(0.0f, 1.0f));
+        glm::vec3 viewPoint(uniform(-1.0f, 1.0f) * depth / projection[0][0],
+                            uniform(-1.0f, 1.0f) * depth / projection[1][1], -depth);
+        glm::vec3 world = glm::vec3(inverseView * glm::vec4(viewPoint, 1.0f));
+        int cluster = clusterOf(clusters, projection, viewPoint, width, height);
+        for (std::uint16_t light = 0; light < clusters.LightCount(); ++light) {
+            glm::vec4 position = clusters.Lights[light * rg::CLUSTER_LIGHT_TEXELS];
+            glm::vec4 ambient = clusters.Lights[light * rg::CLUSTER_LIGHT_TEXELS + 1];
+            glm::vec4 diffuse = clusters.Lights[light * rg::CLUSTER_LIGHT_TEXELS + 2];
+            glm::vec4 specular = clusters.Lights[light * rg::CLUSTER_LIGHT_TEXELS + 3];
+            float range = rg::PointLightRange(glm::vec3(ambient), glm::vec3(diffuse), glm::vec3(specular), ambient.w,
+                                              diffuse.w, specular.w);
+            if (glm::length(world - glm::vec3(position)) > range * 0.999f)
+                continue;
+            ++covered;
+            if (!listed(clusters, cluster, light)) {
+                std::printf("FAILED: light %u reaches (%.2f %.2f %.2f) but isn't in cluster %d\n", (unsigned) light,
+                            world.x, world.y, world.z, cluster);
+                ++failures;
+                break;
+            }
+        }
+    }
+    check(covered > 1000, "too few samples lit to mean anything");
+
+    // lists are sorted by light, and a light is listed once per cluster
+    for (int cluster = 0; cluster < rg::CLUSTER_COUNT; ++cluster) {
+        std::uint32_t first = clusters.Cells[2 * cluster], count = clusters.Cells[2 * cluster + 1];
+        for (std::uint32_t i = first + 1; i < first + count; ++i) {
+            if (clusters.Indices[i] <= clusters.Indices[i - 1]) {
+                check(false, "cluster list out of order");
+                cluster = rg::CLUSTER_COUNT;
+                break;
+            }
+        }
+    }
+
+    // SIMD builds match the scalar one
+    for (rg::SimdLevel level : {rg::SimdLevel::Sse2, rg::SimdLevel::Avx2}) {
+        rg::LightClusters simd;
+        simd.Build(table, projection, view, rg::GetBatchKernels(level));
+        check(simd.Cells == clusters.Cells && simd.Indices == clusters.Indices && simd.Lights == clusters.Lights,
+              "SIMD build differs from the scalar one");
+    }
+
+    // a second build into the same object, with the camera moved, starts from scratch
+    clusters.Build(table, projection, glm::translate(view, glm::vec3(0.0f, 0.0f, 40.0f)), rg::GetBatchKernels(rg::SimdLevel::Scalar));
+    rg::LightClusters fresh;
+    fresh.Build(table, projection, glm::translate(view, glm::vec3(0.0f, 0.0f, 40.0f)), rg::GetBatchKernels(rg::SimdLevel::Scalar));
+    check(clusters.Cells == fresh.Cells && clusters.Indices == fresh.Indices, "rebuild kept stale pairs");
+
+    // a light too dark to reach anything isn't uploaded
+    rg::LightTable dark;
+    addLight(dark, glm::vec3(0.0f, 0.0f, -5.0f), 0.09f, 0.032f, rg::AllMaterials);
+    dark.Ambient.Set(0, glm::vec3(0.0f));
+    dark.Diffuse.Set(0, glm::vec3(0.0f));
+    dark.Specular.Set(0, glm::vec3(0.0f));
+    rg::LightClusters none;
+    none.Build(dark, projection, view);
+    check(none.LightCount() == 0 && none.Indices.empty(), "dark light uploaded");
+
+    if (failures == 0)
+        std::printf("light cluster tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
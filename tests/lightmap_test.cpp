@@ -0,0 +1,283 @@
+// Lightmap UVs and the CPU baker: charts land inside the UV square without overlapping, a floor under
+// an occluder bakes darker than next to it, bounced light only adds, the result doesn't depend on the
+// worker count, and the asset cache gives back what was stored under the same key only.
+#include <rg/Lightmap.h>
+#include "test_util.h"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct RawMesh {
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;
+    std::vector<std::uint32_t> Indices;
+};
+
+// one quad per call, counter-clockwise seen from where normal points
+void addQuad(RawMesh& mesh, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d,
+             const glm::vec3& normal) {
+    std::uint32_t base = (std::uint32_t) mesh.Positions.size();
+    for (const glm::vec3& p : {a, b, c, d}) {
+        mesh.Positions.push_back(p);
+        mesh.Normals.push_back(normal);
+    }
+    for (std::uint32_t i : {0u, 1u, 2u, 0u, 2u, 3u})
+        mesh.Indices.push_back(base + i);
+}
+
+// unit quad in the xz plane facing up, split into n x n quads
+RawMesh floorMesh(int n) {
+    RawMesh mesh;
+    for (int z = 0; z < n; ++z) {
+        for (int x = 0; x < n; ++x) {
+            float x0 = -0.5f + (float) x / n, x1 = -0.5f + (float) (x + 1) / n;
+            float z0 = -0.5f + (float) z / n, z1 = -0.5f + (float) (z + 1) / n;
+            addQuad(mesh, glm::vec3(x0, 0.0f, z1), glm::vec3(x1, 0.0f, z1), glm::vec3(x1, 0.0f, z0),
+                    glm::vec3(x0, 0.0f, z0), glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+    }
+    return mesh;
+}
+
+// unit cube around the origin, four vertices per face
+RawMesh cubeMesh() {
+    RawMesh mesh;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (float sign : {-1.0f, 1.0f}) {
+            glm::vec3 n(0.0f), u(0.0f), v(0.0f);
+            n[axis] = sign;
+            u[(axis + 1) % 3] = 0.5f;
+            v[(axis + 2) % 3] = 0.5f * sign;
+            glm::vec3 c = n * 0.5f;
+            addQuad(mesh, c - u - v, c + u - v, c + u + v, c - u + v, n);
+        }
+    }
+    return mesh;
+}
+
+rg::LightmapMesh unwrap(const RawMesh& raw) {
+    rg::LightmapMesh out;
+    std::vector<std::uint32_t> remap;
+    out.Resolution = rg::GenerateLightmapUvs(raw.Positions, raw.Indices, remap, out.Indices, out.Uvs);
+    for (std::uint32_t source : remap) {
+        out.Positions.push_back(raw.Positions[source]);
+        out.Normals.push_back(raw.Normals[source]);
+    }
+    return out;
+}
+
+// true when the point is well inside the triangle, away from its edges
+bool strictlyInside(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+    float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    if (std::fabs(area) < 1e-12f)
+        return false;
+    float w0 = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+    float w1 = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+    return w0 > 1e-3f && w1 > 1e-3f && 1.0f - w0 - w1 > 1e-3f;
+}
+
+void checkUnwrap(const RawMesh& raw, const char* name) {
+    rg::LightmapMesh mesh = unwrap(raw);
+    char what[128];
+    std::snprintf(what, sizeof(what), "%s: triangle count changed", name);
+    check(mesh.Indices.size() == raw.Indices.size(), what);
+    bool inside = true;
+    for (const glm::vec2& uv : mesh.Uvs)
+        inside &= uv.x >= 0.0f && uv.y >= 0.0f && uv.x <= 1.0f && uv.y <= 1.0f;
+    std::snprintf(what, sizeof(what), "%s: UVs outside the unit square", name);
+    check(inside, what);
+    bool samePositions = true;
+    for (size_t i = 0; i < raw.Indices.size(); ++i)
+        samePositions &= mesh.Positions[mesh.Indices[i]] == raw.Positions[raw.Indices[i]];
+    std::snprintf(what, sizeof(what), "%s: split vertices moved", name);
+    check(samePositions, what);
+
+    // texel centres covered by two triangles that aren't neighbours in the unwrap
+    int resolution = mesh.Resolution;
+    std::vector<std::int32_t> owner((size_t) resolution * resolution, -1);
+    bool overlap = false;
+    size_t nrTriangles = mesh.Indices.size() / 3;
+    for (size_t t = 0; t < nrTriangles; ++t) {
+        const std::uint32_t* tri = &mesh.Indices[t * 3];
+        glm::vec2 a = mesh.Uvs[tri[0]] * (float) resolution, b = mesh.Uvs[tri[1]] * (float) resolution,
+                  c = mesh.Uvs[tri[2]] * (float) resolution;
+        for (int y = 0; y < resolution; ++y) {
+            for (int x = 0; x < resolution; ++x) {
+                if (!strictlyInside(glm::vec2(x + 0.5f, y + 0.5f), a, b, c))
+                    continue;
+                std::int32_t& first = owner[(size_t) y * resolution + x];
+                if (first >= 0) {
+                    const std::uint32_t* other = &mesh.Indices[(size_t) first * 3];
+                    bool shared = false;
+                    for (int i = 0; i < 3; ++i)
+                        for (int j = 0; j < 3; ++j)
+                            shared |= tri[i] == other[j];
+                    overlap |= !shared;
+                }
+                first = (std::int32_t) t;
+            }
+        }
+    }
+    std::snprintf(what, sizeof(what), "%s: charts overlap", name);
+    check(!overlap, what);
+}
+
+// the baked irradiance at a model-space point of a renderable's floor mesh, nearest texel
+glm::vec3 sample(const rg::LightmapAtlas& atlas, rg::Entity e, const rg::LightmapMesh& mesh, const glm::vec2& xz) {
+    size_t entry = 0;
+    while (entry < atlas.Entities.size() && atlas.Entities[entry] != e)
+        ++entry;
+    if (entry == atlas.Entities.size())
+        return glm::vec3(-1.0f);
+    for (size_t i = 0; i < mesh.Indices.size(); i += 3) {
+        glm::vec3 a = mesh.Positions[mesh.Indices[i]], b = mesh.Positions[mesh.Indices[i + 1]],
+                  c = mesh.Positions[mesh.Indices[i + 2]];
+        glm::vec2 pa(a.x, a.z), pb(b.x, b.z), pc(c.x, c.z);
+        float area = (pb.x - pa.x) * (pc.y - pa.y) - (pc.x - pa.x) * (pb.y - pa.y);
+        float w0 = ((pb.x - xz.x) * (pc.y - xz.y) - (pc.x - xz.x) * (pb.y - xz.y)) / area;
+        float w1 = ((pc.x - xz.x) * (pa.y - xz.y) - (pa.x - xz.x) * (pc.y - xz.y)) / area;
+        float w2 = 1.0f - w0 - w1;
+        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+            continue;
+        glm::vec2 uv = mesh.Uvs[mesh.Indices[i]] * w0 + mesh.Uvs[mesh.Indices[i + 1]] * w1
+                       + mesh.Uvs[mesh.Indices[i + 2]] * w2;
+        glm::vec4 rect = atlas.Rects[entry];
+        glm::vec2 texel = (uv * glm::vec2(rect.x, rect.y) + glm::vec2(rect.z, rect.w)) * (float) atlas.Size;
+        int x = std::min((int) texel.x, atlas.Size - 1), y = std::min((int) texel.y, atlas.Size - 1);
+        return rg::UnpackRgb9e5(atlas.Texels[(size_t) y * atlas.Size + x]);
+    }
+    return glm::vec3(-1.0f);
+}
+
+}
+
+int main() {
+    // shared-exponent packing keeps about three significant digits
+    for (float value : {0.0f, 0.001f, 0.1f, 0.8f, 1.0f, 3.7f, 250.0f}) {
+        glm::vec3 rgb(value, value * 0.5f, value * 0.25f);
+        glm::vec3 back = rg::UnpackRgb9e5(rg::PackRgb9e5(rgb));
+        check(std::fabs(back.x - rgb.x) <= rgb.x * 4e-3f + 1e-6f && std::fabs(back.y - rgb.y) <= rgb.x * 4e-3f + 1e-6f,
+              "RGB9E5 round trip off");
+    }
+
+    checkUnwrap(cubeMesh(), "cube");
+    checkUnwrap(floorMesh(8), "floor");
+    RawMesh boxes = cubeMesh();
+    for (int i = 1; i < 40; ++i) {
+        RawMesh cube = cubeMesh();
+        std::uint32_t base = (std::uint32_t) boxes.Positions.size();
+        for (const glm::vec3& p : cube.Positions)
+            boxes.Positions.push_back(p * (0.2f + 0.05f * i) + glm::vec3((float) i * 1.5f, 0.0f, 0.0f));
+        boxes.Normals.insert(boxes.Normals.end(), cube.Normals.begin(), cube.Normals.end());
+        for (std::uint32_t index : cube.Indices)
+            boxes.Indices.push_back(base + index);
+    }
+    checkUnwrap(boxes, "many boxes");
+    check(unwrap(boxes).Resolution > rg::LIGHTMAP_CHART_RESOLUTION, "240 charts didn't get a larger resolution");
+
+    // a 10 x 10 floor with a 2 x 2 x 2 crate floating above its middle, the sun straight down
+    RawMesh floorRaw = floorMesh(4), cubeRaw = cubeMesh();
+    std::vector<rg::LightmapMesh> meshes = {unwrap(floorRaw), unwrap(cubeRaw)};
+    std::vector<rg::MeshBvh> bvhs(2);
+    bvhs[0].Build(floorRaw.Positions, floorRaw.Indices);
+    bvhs[1].Build(cubeRaw.Positions, cubeRaw.Indices);
+    rg::Scene scene;
+    scene.FindOrAddMaterial("object");
+    rg::Aabb floorBounds(glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.5f, 0.0f, 0.5f));
+    rg::Aabb cubeBounds(glm::vec3(-0.5f), glm::vec3(0.5f));
+    rg::Entity floor = scene.CreateRenderable(0, 0, floorBounds, glm::vec3(0.0f), 0.0f, glm::vec3(10.0f, 1.0f, 10.0f));
+    rg::Entity crate = scene.CreateRenderable(1, 0, cubeBounds, glm::vec3(0.0f, 3.0f, 0.0f), 0.0f, glm::vec3(2.0f));
+    rg::Entity mover = scene.CreateRenderable(1, 0, cubeBounds, glm::vec3(3.0f, 1.0f, 3.0f), 0.0f, glm::vec3(1.0f),
+                                              rg::RenderFlagDynamic);
+    rg::LightDesc sun;
+    sun.Type = rg::LightDirectional;
+    sun.Direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    sun.Ambient = glm::vec3(0.1f);
+    sun.Diffuse = glm::vec3(0.8f);
+    scene.CreateLight(sun);
+    rg::UpdateTransforms(scene);
+
+    rg::LightmapSettings settings;
+    settings.TexelsPerUnit = 4.0f;
+    settings.Samples = 16;
+    settings.Bounces = 0;
+    rg::JobSystem jobs(3);
+    rg::LightmapBaker baker;
+    rg::LightmapAtlas direct;
+    rg::LightmapBakeStats stats = baker.Bake(scene, meshes, bvhs, settings, jobs, direct);
+    check(stats.Instances == 2 && stats.Dropped == 0 && direct.Entities.size() == 2, "wrong renderables baked");
+    check(std::find(direct.Entities.begin(), direct.Entities.end(), mover) == direct.Entities.end(),
+          "dynamic renderable baked");
+    check(stats.Texels > 0 && stats.Rays > 0, "nothing traced");
+    glm::vec3 shadowed = sample(direct, floor, meshes[0], glm::vec2(0.0f, 0.0f));
+    glm::vec3 lit = sample(direct, floor, meshes[0], glm::vec2(0.4f, 0.4f));
+    check(std::fabs(shadowed.x - 0.1f) < 0.01f, "floor under the crate isn't ambient only");
+    check(std::fabs(lit.x - 0.9f) < 0.01f, "floor beside the crate isn't fully lit");
+    // rects don't overlap
+    bool apart = true;
+    for (size_t i = 0; i < direct.Rects.size(); ++i) {
+        for (size_t j = i + 1; j < direct.Rects.size(); ++j) {
+            glm::vec4 a = direct.Rects[i], b = direct.Rects[j];
+            apart &= a.z + a.x <= b.z || b.z + b.x <= a.z || a.w + a.y <= b.w || b.w + b.y <= a.w;
+        }
+    }
+    check(apart, "atlas rects overlap");
+
+    // bounced light only adds, and reaches the crate's underside
+    settings.Bounces = 2;
+    rg::LightmapAtlas bounced;
+    baker.Bake(scene, meshes, bvhs, settings, jobs, bounced);
+    check(bounced.Size == direct.Size && bounced.Rects == direct.Rects, "bounces changed the atlas layout");
+    bool neverDarker = true;
+    float largestGain = 0.0f;
+    for (size_t i = 0; i < bounced.Texels.size(); ++i) {
+        glm::vec3 before = rg::UnpackRgb9e5(direct.Texels[i]), after = rg::UnpackRgb9e5(bounced.Texels[i]);
+        neverDarker &= after.x >= before.x * 0.995f - 1e-4f;
+        largestGain = std::max(largestGain, after.x - before.x);
+    }
+    check(neverDarker, "bounced light darkened a texel");
+    check(largestGain > 0.05f, "bounced light added nothing");
+
+    // one thread or several, the same texels
+    rg::JobSystem serial(0);
+    rg::LightmapAtlas single;
+    baker.Bake(scene, meshes, bvhs, settings, serial, single);
+    check(single.Texels == bounced.Texels, "bake depends on the number of workers");
+
+    // the cache hands back exactly what was stored, and only under its key
+    std::uint64_t key = rg::LightmapCacheKey(scene, meshes, settings);
+    char directory[] = "/tmp/rg_lightmap_testXXXXXX";
+    check(mkdtemp(directory) != nullptr, "no temporary directory");
+    std::string cache = std::string(directory) + "/lightmaps";
+    check(rg::SaveLightmapCache(cache, key, bounced), "cache not written");
+    rg::LightmapAtlas loaded;
+    check(rg::LoadLightmapCache(cache, key, loaded), "cache not read back");
+    check(loaded.Size == bounced.Size && loaded.Texels == bounced.Texels && loaded.Entities == bounced.Entities
+          && loaded.Rects == bounced.Rects, "cache round trip changed the atlas");
+    check(!rg::LoadLightmapCache(cache, key + 1, loaded), "cache found under another key");
+    std::remove(rg::LightmapCachePath(cache, key).c_str());
+    rmdir(cache.c_str());
+    rmdir(directory);
+
+    // the key follows the static scene, the lights and the settings, not the dynamic renderables
+    scene.SetPosition(mover, glm::vec3(-3.0f, 1.0f, 3.0f));
+    rg::UpdateTransforms(scene);
+    check(rg::LightmapCacheKey(scene, meshes, settings) == key, "moving a dynamic renderable changed the key");
+    scene.Lights.Direction.Set(0, glm::vec3(0.2f, -1.0f, 0.0f));
+    std::uint64_t turned = rg::LightmapCacheKey(scene, meshes, settings);
+    check(turned != key, "turning the sun kept the key");
+    scene.SetPosition(crate, glm::vec3(0.0f, 3.5f, 0.0f));
+    rg::UpdateTransforms(scene);
+    check(rg::LightmapCacheKey(scene, meshes, settings) != turned, "moving a static renderable kept the key");
+    settings.Samples = 8;
+    check(rg::LightmapCacheKey(scene, meshes, settings) != turned, "changing the settings kept the key");
+
+    if (failures == 0)
+        std::printf("lightmap tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+// Render graph compile without a GL context: culling of passes nobody reads from, target spans and
+// which targets share a texture.
+#include <rg/RenderGraph.h>
+#include "test_util.h"
+
+#include <cstdio>
+
+namespace {
+
+void nothing(const rg::RenderGraph&) {}
+
+rg::RenderTargetDesc target(GLenum format, float scale = 1.0f) {
+    rg::RenderTargetDesc desc;
+    desc.Format = format;
+    desc.Scale = scale;
+    return desc;
+}
+
+}
+
+int main() {
+    rg::RenderGraph graph;
+
+    // the frame as main.cpp declares it, once with the composite using the bloom and once without
+    for (int bloom = 0; bloom < 2; ++bloom) {
+        graph.Reset(800, 600);
+        rg::RenderGraph::PassBuilder scene = graph.AddPass("scene", nothing);
+        rg::RenderResource color = scene.Create("hdr color", target(GL_RGBA16F));
+        rg::RenderResource bright = scene.Create("bright", target(GL_RGBA16F));
+        rg::RenderResource depth = scene.Create("depth", target(GL_DEPTH_COMPONENT24));
+        rg::RenderGraph::PassBuilder blur = graph.AddPass("bloom blur", nothing);
+        blur.Read(bright);
+        rg::RenderResource half = blur.Create("bloom half", target(GL_R11F_G11F_B10F, 0.5f));
+        blur.Create("bloom quarter", target(GL_R11F_G11F_B10F, 0.25f));
+        blur.Unbound();
+        rg::RenderGraph::PassBuilder composite = graph.AddPass("hdr composite", nothing);
+        composite.Read(color);
+        if (bloom)
+            composite.Read(half);
+        composite.SideEffect();
+        graph.Compile();
+
+        check(!graph.Culled("scene") && !graph.Culled("hdr composite"), "scene or composite culled");
+        check(graph.Culled("bloom blur") == !bloom, "bloom blur not culled with its result unused");
+        check(graph.PhysicalIndex(depth) >= 0, "depth written by a kept pass has no texture");
+        check((graph.PhysicalIndex(half) >= 0) == (bloom != 0), "culled bloom target kept a texture");
+        check(graph.Width(half) == 400 && graph.Height(half) == 300, "half-size target has the wrong size");
+        check(graph.Stats().Textures == (bloom ? 5 : 3), "unexpected texture count");
+    }
+
+    // a chain of full-size passes: a target can take the texture of one that died before it started
+    graph.Reset(64, 64);
+    rg::RenderGraph::PassBuilder p0 = graph.AddPass("p0", nothing);
+    rg::RenderResource a = p0.Create("a", target(GL_RGBA16F));
+    rg::RenderGraph::PassBuilder p1 = graph.AddPass("p1", nothing);
+    p1.Read(a);
+    rg::RenderResource b = p1.Create("b", target(GL_RGBA16F));
+    rg::RenderGraph::PassBuilder p2 = graph.AddPass("p2", nothing);
+    p2.Read(b);
+    rg::RenderResource c = p2.Create("c", target(GL_RGBA16F));
+    rg::RenderResource other = p2.Create("other format", target(GL_RGBA8));
+    rg::RenderGraph::PassBuilder p3 = graph.AddPass("p3", nothing);
+    p3.Read(c);
+    p3.Read(other);
+    p3.SideEffect();
+    graph.Compile();
+    check(graph.PhysicalIndex(a) == graph.PhysicalIndex(c), "a and c don't overlap but don't share");
+    check(graph.PhysicalIndex(a) != graph.PhysicalIndex(b), "a and b overlap in p1 but share");
+    check(graph.PhysicalIndex(other) != graph.PhysicalIndex(a), "targets of different formats share");
+    check(graph.Stats().Targets == 4 && graph.Stats().Textures == 3, "chain: wrong target or texture count");
+    check(graph.Stats().Bytes < graph.Stats().UnaliasedBytes, "aliasing saved nothing");
+
+    // culling goes back through passes whose only reader was culled; reading your own target
+    // doesn't count
+    graph.Reset(64, 64);
+    rg::RenderGraph::PassBuilder q0 = graph.AddPass("q0", nothing);
+    rg::RenderResource x = q0.Create("x", target(GL_RGBA16F));
+    rg::RenderGraph::PassBuilder q1 = graph.AddPass("q1", nothing);
+    q1.Read(x);
+    rg::RenderResource y = q1.Create("y", target(GL_RGBA16F));
+    rg::RenderGraph::PassBuilder q2 = graph.AddPass("q2", nothing);
+    q2.Read(y);
+    q2.Write(y);
+    graph.AddPass("q3", nothing).SideEffect();
+    graph.Compile();
+    check(graph.Culled("q0") && graph.Culled("q1") && graph.Culled("q2"), "unread chain not culled");
+    check(!graph.Culled("q3"), "side-effect pass without inputs culled");
+    check(graph.Stats().CulledPasses == 3 && graph.Stats().Textures == 0, "culled chain kept textures");
+
+    if (failures == 0)
+        std::printf("render graph tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// Shadow cascade fitting and caching on the CPU: every cascade covers its slice of the view frustum,
+// re-centred cascades move by whole texels, and casters are only handed out again when something that
+// affects them changed.
+#include <rg/CascadedShadows.h>
+#include "test_util.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+Random uniform(77);
+
+glm::mat4 lookFrom(const glm::vec3& position, float yawDegrees) {
+    float yaw = glm::radians(yawDegrees);
+    return glm::lookAt(position, position + glm::vec3(std::cos(yaw), -0.2f, std::sin(yaw)), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// points of the view frustum slice [begin, end] all land inside the cascade
+bool covers(const rg::ShadowCascade& cascade, const glm::mat4& projection, const glm::mat4& view, float begin, float end) {
+    glm::mat4 inverseView = glm::inverse(view);
+    for (int sample = 0; sample < 500; ++sample) {
+        float depth = sample < 8 ? (sample & 4 ? end : begin) : uniform(begin, end);
+        float x = sample < 8 ? (sample & 1 ? 1.0f : -1.0f) : uniform(-1.0f, 1.0f);
+        float y = sample < 8 ? (sample & 2 ? 1.0f : -1.0f) : uniform(-1.0f, 1.0f);
+        glm::vec4 viewPoint(x * depth / projection[0][0], y * depth / projection[1][1], -depth, 1.0f);
+        glm::vec4 clip = cascade.Matrix * inverseView * viewPoint;
+        if (std::fabs(clip.x) > 1.0f || std::fabs(clip.y) > 1.0f)
+            return false;
+    }
+    return true;
+}
+
+}
+
+int main() {
+    rg::Scene scene;
+    rg::Aabb unitBox(glm::vec3(-0.5f), glm::vec3(0.5f));
+    for (int i = 0; i < 300; ++i)
+        scene.CreateRenderable(0, 0, unitBox, glm::vec3(uniform(-80.0f, 80.0f), 0.0f, uniform(-80.0f, 80.0f)), 0.0f,
+                               glm::vec3(1.0f));
+    rg::Entity mover = scene.CreateRenderable(0, 0, unitBox, glm::vec3(2.0f, 0.0f, 2.0f), 0.0f, glm::vec3(1.0f),
+                                              rg::RenderFlagDynamic);
+    rg::Entity crate = scene.CreateRenderable(0, 0, unitBox, glm::vec3(3.0f, 0.0f, 0.0f), 0.0f, glm::vec3(1.0f));
+    rg::LightDesc sun;
+    sun.Type = rg::LightDirectional;
+    sun.Direction = glm::vec3(-0.2f, -1.0f, 0.3f);
+    scene.CreateLight(sun);
+    rg::UpdateTransforms(scene);
+
+    rg::ShadowSettings settings;
+    settings.Enabled = true;
+    settings.Cascades = 4;
+    settings.Resolution = 1024;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::vec3 position(0.0f, 2.0f, 0.0f);
+    glm::mat4 view = lookFrom(position, 30.0f);
+
+    rg::ShadowCascades cascades;
+    rg::ShadowFrame frame;
+    cascades.Update(settings, scene, projection, view, frame);
+    check(frame.Cascades == 4 && frame.Redraw == 0xF, "first frame doesn't draw every cascade");
+    check(!frame.StaticCasters.empty(), "no static casters");
+    check(frame.Dynamic && frame.DynamicRedraw && frame.DynamicCasters.size() == 1, "dynamic caster not drawn");
+    float begin = 0.1f;
+    for (int i = 0; i < frame.Cascades; ++i) {
+        check(frame.Cascade[i].FarDepth > begin, "splits not increasing");
+        check(covers(frame.Cascade[i], projection, view, begin, frame.Cascade[i].FarDepth), "cascade misses its slice");
+        begin = frame.Cascade[i].FarDepth;
+    }
+    check(std::fabs(begin - settings.MaxDistance) < 1e-3f, "last cascade doesn't end at the shadow distance");
+    // the crate right in front of the camera is in the first cascade
+    bool crateInFirst = false;
+    for (const rg::ShadowCaster& caster : frame.StaticCasters)
+        crateInFirst |= caster.World[3][0] == 3.0f && caster.World[3][2] == 0.0f && (caster.Cascades & 1);
+    check(crateInFirst, "caster next to the camera not in the first cascade");
+
+    // nothing changed: nothing to draw
+    cascades.Update(settings, scene, projection, view, frame);
+    check(frame.Redraw == 0 && frame.StaticCasters.empty() && !frame.DynamicRedraw && frame.DynamicCasters.empty(),
+          "unchanged frame draws casters");
+
+    // small camera moves stay inside the cache margin, and the cascades still cover their slices
+    rg::ShadowCascade before[rg::SHADOW_MAX_CASCADES];
+    std::copy(frame.Cascade, frame.Cascade + rg::SHADOW_MAX_CASCADES, before);
+    glm::mat4 nudged = lookFrom(position + glm::vec3(0.05f, 0.0f, 0.05f), 30.5f);
+    cascades.Update(settings, scene, projection, nudged, frame);
+    check(frame.Redraw == 0, "a small camera move redrew a cascade");
+    begin = 0.1f;
+    for (int i = 0; i < frame.Cascades; ++i) {
+        check(covers(frame.Cascade[i], projection, nudged, begin, frame.Cascade[i].FarDepth),
+              "cached cascade misses its slice after a small move");
+        begin = frame.Cascade[i].FarDepth;
+    }
+
+    // walking away moves the near cascades, by whole texels
+    glm::mat4 walked = lookFrom(position + glm::vec3(6.0f, 0.0f, 3.0f), 30.0f);
+    cascades.Update(settings, scene, projection, walked, frame);
+    check((frame.Redraw & 1) != 0, "the first cascade didn't follow the camera");
+    check(!frame.StaticCasters.empty(), "redrawn cascade without casters");
+    for (int i = 0; i < frame.Cascades; ++i) {
+        if (!(frame.Redraw & (1u << i)))
+            continue;
+        // same scale and depth, the light-space offset changed by a multiple of a texel
+        glm::vec2 offset = glm::vec2(frame.Cascade[i].Matrix[3][0] - before[i].Matrix[3][0],
+                                     frame.Cascade[i].Matrix[3][1] - before[i].Matrix[3][1]);
+        glm::vec2 texels = offset * (0.5f * settings.Resolution);
+        check(std::fabs(texels.x - std::round(texels.x)) < 0.02f && std::fabs(texels.y - std::round(texels.y)) < 0.02f,
+              "cascade moved by a fraction of a texel");
+        check(std::fabs(frame.Cascade[i].Matrix[0][0] - before[i].Matrix[0][0]) < 1e-6f, "cascade changed size");
+    }
+    begin = 0.1f;
+    for (int i = 0; i < frame.Cascades; ++i) {
+        check(covers(frame.Cascade[i], projection, walked, begin, frame.Cascade[i].FarDepth),
+              "cascade misses its slice after walking");
+        begin = frame.Cascade[i].FarDepth;
+    }
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Redraw == 0, "cascades redrawn again without a change");
+
+    // a dynamic caster moving redraws only the dynamic layer
+    scene.SetPosition(mover, glm::vec3(2.5f, 0.0f, 2.0f));
+    rg::UpdateTransforms(scene);
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Redraw == 0 && frame.StaticCasters.empty(), "dynamic caster invalidated the static cache");
+    check(frame.DynamicRedraw && frame.DynamicCasters.size() == 1, "moved dynamic caster not drawn");
+
+    // a static caster moving, the light turning, or a setting changing redraws everything
+    scene.SetPosition(crate, glm::vec3(3.0f, 0.5f, 0.0f));
+    rg::UpdateTransforms(scene);
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Redraw == 0xF && frame.DynamicRedraw, "moved static caster didn't redraw the cascades");
+    scene.Lights.Direction.Set(0, glm::vec3(0.3f, -1.0f, 0.2f));
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Redraw == 0xF, "light change didn't redraw the cascades");
+    settings.Resolution = 2048;
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Redraw == 0xF, "resolution change didn't redraw the cascades");
+
+    // off, then on again: drawn from scratch
+    settings.Enabled = false;
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Cascades == 0 && frame.StaticCasters.empty(), "disabled shadows still have cascades");
+    settings.Enabled = true;
+    settings.Cascades = 2;
+    cascades.Update(settings, scene, projection, walked, frame);
+    check(frame.Cascades == 2 && frame.Redraw == 0x3, "re-enabled shadows not drawn from scratch");
+
+    // the SIMD culling finds the same casters as the scalar one
+    rg::ShadowCascades scalar, simd;
+    rg::ShadowFrame scalarFrame, simdFrame;
+    scalar.Update(settings, scene, projection, view, scalarFrame, rg::GetBatchKernels(rg::SimdLevel::Scalar));
+    simd.Update(settings, scene, projection, view, simdFrame, rg::GetBatchKernels(rg::SimdLevel::Avx2));
+    bool same = scalarFrame.StaticCasters.size() == simdFrame.StaticCasters.size();
+    for (size_t i = 0; same && i < scalarFrame.StaticCasters.size(); ++i)
+        same = scalarFrame.StaticCasters[i].Cascades == simdFrame.StaticCasters[i].Cascades;
+    check(same, "SIMD caster culling differs from the scalar one");
+
+    if (failures == 0)
+        std::printf("shadow cascade tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
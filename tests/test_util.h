@@ -0,0 +1,38 @@
+#ifndef PROJECT_BASE_TEST_UTIL_H
+#define PROJECT_BASE_TEST_UTIL_H
+
+// What every test in tests/ shares. Each test is a single translation unit with its own main, which
+// ends with: return failures == 0 ? 0 : 1.
+
+#include <cstdio>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// Seeded uniform floats for the randomized tests: Random uniform(seed); uniform(low, high). An LCG
+// rather than rand(), so a seed gives the same sequence on every platform.
+class Random {
+public:
+    explicit Random(unsigned int seed) : m_Seed(seed) {}
+
+    // in [low, high)
+    float operator()(float low, float high) {
+        m_Seed = m_Seed * 1664525u + 1013904223u;
+        return low + (high - low) * ((m_Seed >> 8) / 16777216.0f);
+    }
+
+private:
+    unsigned int m_Seed;
+};
+
+}
+
+#endif //PROJECT_BASE_TEST_UTIL_H